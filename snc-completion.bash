@@ -8,6 +8,40 @@ _snc_completion() {
         -t --transmit
         -p --port
         --block-size
+        --streams
+        --compress
+        --checksum
+        --resume
+        -i --input
+        -o --output
+        --direct
+        --pipeline
+        --bench
+        --server
+        --output-template
+        --max-connections
+        --connection-buffer
+        --workers
+        --zerocopy
+        --tune
+        --socket-buffer
+        --notsent-lowat
+        --low-latency
+        --stats
+        --stats-file
+        --duplex
+        --shm
+        --forward
+        --multicast
+        --multicast-interface
+        --fec
+        --udp
+        --rate
+        --simulate-loss
+        --simulate-delay
+        --slow-receiver
+        --fanout-buffer
+        --io-uring
         --print-interfaces
         --print-peer-info
         --print-progress
@@ -15,13 +49,16 @@ _snc_completion() {
 
     # Check the the previous option ('$3') for special values or options.
     case "$3" in
-        '2>' | '>' | '<')
-            # If it was a redirector, show the default file completion.
+        '2>' | '>' | '<' | '-i' | '--input' | '-o' | '--output' | \
+            --output-template | --stats-file)
+            # If it was a redirector or a path, show the default completion.
             compopt -o bashdefault -o default
             return
             ;;
 
-        '-t' | '--transmit' | '-p' | '--port' | --block-size)
+        '-t' | '--transmit' | '-p' | '--port' | --block-size | --streams | \
+            --pipeline | --max-connections | --connection-buffer | \
+            --socket-buffer | --notsent-lowat)
             # These options expect an extra parameter, so don't show completion.
             return
             ;;
@@ -18,12 +18,22 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h> /* SIZE_MAX */
 #include <assert.h>
+#include <errno.h>
 #include <stdio.h>
+#include <stdlib.h> /* strtod(), strtoull() */
+#include <string.h> /* strcmp() */
+#include <limits.h> /* INT_MAX */
 
 #include <argp.h>
 
 #include "include/args.h"
+#include "include/streams.h" /* STREAMS_MAX */
+#include "include/ring.h"    /* RING_MAX_DEPTH */
+#include "include/mcast.h"   /* MCAST_* */
+#include "include/sim.h"     /* SIM_MAX_DELAY_MS */
+#include "include/server.h"  /* SERVER_MAX_* */
 
 /*----------------------------------------------------------------------------*/
 
@@ -46,6 +56,38 @@ enum ELongOptionIds {
     LONGOPT_PRINT_INTERFACES,
     LONGOPT_PRINT_PEER_INFO,
     LONGOPT_PRINT_PROGRESS,
+    LONGOPT_STREAMS,
+    LONGOPT_IO_URING,
+    LONGOPT_PIPELINE,
+    LONGOPT_BENCH,
+    LONGOPT_SERVER,
+    LONGOPT_OUTPUT_TEMPLATE,
+    LONGOPT_MAX_CONNECTIONS,
+    LONGOPT_CONNECTION_BUFFER,
+    LONGOPT_WORKERS,
+    LONGOPT_COMPRESS,
+    LONGOPT_CHECKSUM,
+    LONGOPT_RESUME,
+    LONGOPT_ZEROCOPY,
+    LONGOPT_DIRECT,
+    LONGOPT_TUNE,
+    LONGOPT_SOCKET_BUFFER,
+    LONGOPT_NOTSENT_LOWAT,
+    LONGOPT_LOW_LATENCY,
+    LONGOPT_STATS,
+    LONGOPT_STATS_FILE,
+    LONGOPT_DUPLEX,
+    LONGOPT_SHM,
+    LONGOPT_FORWARD,
+    LONGOPT_MULTICAST,
+    LONGOPT_MULTICAST_INTERFACE,
+    LONGOPT_FEC,
+    LONGOPT_RATE,
+    LONGOPT_UDP,
+    LONGOPT_SIMULATE_LOSS,
+    LONGOPT_SIMULATE_DELAY,
+    LONGOPT_SLOW_RECEIVER,
+    LONGOPT_FANOUT_BUFFER,
 };
 
 /*
@@ -67,7 +109,10 @@ static struct argp_option options[] = {
       't',
       "DESTINATION",
       0,
-      "Transmit data into the DESTINATION receiver.",
+      "Transmit data into the DESTINATION receiver. Several receivers can be "
+      "separated by commas, optionally with their own ports (e.g. "
+      "'host1,host2:1338'), in which case the input is only read once, and "
+      "sent to all of them.",
       1,
     },
     { NULL, 0, NULL, 0, "Optional arguments", 2 },
@@ -90,6 +135,361 @@ static struct argp_option options[] = {
       2,
     },
 #endif
+    {
+      "streams",
+      LONGOPT_STREAMS,
+      "N",
+      0,
+      "When transmitting data, split it in blocks and send them over N "
+      "parallel connections. The receiver detects this automatically.",
+      2,
+    },
+    {
+      "compress",
+      LONGOPT_COMPRESS,
+      "MODE",
+      OPTION_ARG_OPTIONAL,
+      "When transmitting data, compress each block, sending it uncompressed "
+      "if it doesn't shrink. If MODE is 'auto', compression is only used "
+      "while it makes the transfer faster, that is, while the network is "
+      "slower than the CPU. If MODE is 'always' (the default), it's always "
+      "used. The receiver detects this automatically.",
+      2,
+    },
+    {
+      "checksum",
+      LONGOPT_CHECKSUM,
+      NULL,
+      0,
+      "When transmitting data, compute a CRC-32C checksum of the input, and "
+      "send it after the data, so the receiver can verify it. When receiving "
+      "data, fail if the transmitter didn't send a checksum. In both cases, "
+      "the checksum is printed along with the progress.",
+      2,
+    },
+    {
+      "resume",
+      LONGOPT_RESUME,
+      NULL,
+      0,
+      "When transmitting data, continue a previous transfer from the end of "
+      "the output of the receiver, if it matches the input. If the connection "
+      "is interrupted, reconnect and continue, as long as the input is a "
+      "file. The receiver must be using '--output'.",
+      2,
+    },
+    {
+      "input",
+      'i',
+      "FILE",
+      0,
+      "When transmitting data, read it from FILE instead of 'stdin'. The file "
+      "is mapped into memory and sent from there, and the kernel is told to "
+      "drop it from the page cache as it's sent.",
+      2,
+    },
+    {
+      "output",
+      'o',
+      "FILE",
+      0,
+      "When receiving data, write it to FILE instead of 'stdout'. The file is "
+      "only truncated once the transmitter connects, so it can be used for "
+      "resuming a transfer. The space is preallocated if the size is known, "
+      "and the data is flushed to disk as it's written, so dirty pages don't "
+      "pile up.",
+      2,
+    },
+    {
+      "direct",
+      LONGOPT_DIRECT,
+      NULL,
+      0,
+      "When receiving data into '--output', bypass the page cache by writing "
+      "large aligned blocks with O_DIRECT, if the file system supports it.",
+      2,
+    },
+    {
+      "pipeline",
+      LONGOPT_PIPELINE,
+      "DEPTH",
+      0,
+      "When transmitting data, read the input from a separate thread, into a "
+      "ring of DEPTH blocks. Useful when the input is slow, so reading and "
+      "sending can overlap.",
+      2,
+    },
+    {
+      "zerocopy",
+      LONGOPT_ZEROCOPY,
+      NULL,
+      0,
+      "When transmitting data, send it with MSG_ZEROCOPY, so the kernel "
+      "doesn't copy it. Only worth it with big blocks on fast networks. Falls "
+      "back to the normal system calls if the kernel doesn't support it, or "
+      "if it copies the data anyway.",
+      2,
+    },
+#ifndef NO_IO_URING
+    {
+      "io-uring",
+      LONGOPT_IO_URING,
+      NULL,
+      0,
+      "Use io_uring for receiving or transmitting data, keeping several "
+      "blocks in flight. Falls back to the normal system calls if the kernel "
+      "doesn't support it. Not used with '--streams'.",
+      2,
+    },
+#endif
+    {
+      "bench",
+      LONGOPT_BENCH,
+      "AMOUNT",
+      OPTION_ARG_OPTIONAL,
+      "Measure the throughput. When transmitting, send AMOUNT of synthetic "
+      "data from memory instead of reading 'stdin'. The AMOUNT can be a size "
+      "with an optional 'K', 'M' or 'G' suffix (1G by default), or a number "
+      "of seconds with an 's' suffix. When receiving, discard the data. In "
+      "both cases, print a summary at the end.",
+      2,
+    },
+    {
+      "server",
+      LONGOPT_SERVER,
+      NULL,
+      0,
+      "When receiving data, keep accepting connections until the user quits, "
+      "handling all of them concurrently. The data of each connection is "
+      "written to 'stdout' one connection at a time, or to its own file with "
+      "'--output-template'.",
+      2,
+    },
+    {
+      "output-template",
+      LONGOPT_OUTPUT_TEMPLATE,
+      "TEMPLATE",
+      0,
+      "In server mode, append the data of each connection to the file whose "
+      "path results from expanding TEMPLATE. The sequences '%a' and '%p' are "
+      "replaced with the address and port of the peer, '%n' with the number "
+      "of the connection, '%t' with the current UNIX time, and '%%' with "
+      "'%'.",
+      2,
+    },
+    {
+      "max-connections",
+      LONGOPT_MAX_CONNECTIONS,
+      "N",
+      0,
+      "In server mode, stop accepting connections while N of them are open "
+      "(256 by default, up to 1048576).",
+      2,
+    },
+    {
+      "connection-buffer",
+      LONGOPT_CONNECTION_BUFFER,
+      "BYTES",
+      0,
+      "In server mode, limit the receive buffer of each connection to BYTES. "
+      "The kernel default is used otherwise.",
+      2,
+    },
+    {
+      "workers",
+      LONGOPT_WORKERS,
+      "N",
+      0,
+      "In server mode, accept and receive the connections from N threads (1 "
+      "by default, up to 1024), each pinned to a different CPU and listening "
+      "on its own socket, so the kernel distributes the connections between "
+      "them. The '--max-connections' limit applies to each thread.",
+      2,
+    },
+    {
+      "tune",
+      LONGOPT_TUNE,
+      "RATE",
+      OPTION_ARG_OPTIONAL,
+      "Size the socket buffers of each connection to twice its "
+      "bandwidth-delay product, measuring the RTT when connecting, for a "
+      "target RATE in bits per second, with an optional 'K', 'M' or 'G' "
+      "suffix (10G by default). Unless '--block-size' is used, the block "
+      "size is also adjusted. When transmitting, a not-sent low-water mark "
+      "of two blocks is also set.",
+      2,
+    },
+    {
+      "socket-buffer",
+      LONGOPT_SOCKET_BUFFER,
+      "BYTES",
+      0,
+      "Set the send buffer (when transmitting) or the receive buffer (when "
+      "receiving) of each connection to BYTES, overriding '--tune'.",
+      2,
+    },
+    {
+      "notsent-lowat",
+      LONGOPT_NOTSENT_LOWAT,
+      "BYTES",
+      0,
+      "When transmitting, set the TCP not-sent low-water mark of each "
+      "connection to BYTES, overriding '--tune'.",
+      2,
+    },
+    {
+      "low-latency",
+      LONGOPT_LOW_LATENCY,
+      "USEC",
+      OPTION_ARG_OPTIONAL,
+      "Deliver small amounts of data as soon as possible, disabling Nagle's "
+      "algorithm and, when receiving, busy-polling the connection. When "
+      "transmitting, data waits up to USEC microseconds for more input to "
+      "send along with it (0 by default, up to 1000000), but a complete line "
+      "is always sent immediately.",
+      2,
+    },
+    {
+      "stats",
+      LONGOPT_STATS,
+      "FORMAT",
+      OPTION_ARG_OPTIONAL,
+      "At the end of the transfer, print its statistics, including the time "
+      "spent waiting for the network and for the input or output, and the TCP "
+      "information of each connection. The FORMAT can be 'text' (default) or "
+      "'json', which also includes histograms of the sizes returned by each "
+      "system call.",
+      2,
+    },
+    {
+      "stats-file",
+      LONGOPT_STATS_FILE,
+      "FILE",
+      0,
+      "Write the statistics of '--stats' to FILE instead of 'stderr'.",
+      2,
+    },
+    {
+      "slow-receiver",
+      LONGOPT_SLOW_RECEIVER,
+      "POLICY",
+      0,
+      "When transmitting to several receivers, what to do with a receiver "
+      "that falls behind the rest: 'block' the input while it catches up, "
+      "'buffer' (default) up to the size of '--fanout-buffer' before "
+      "blocking, or 'drop' it once it falls that far behind.",
+      2,
+    },
+    {
+      "fanout-buffer",
+      LONGOPT_FANOUT_BUFFER,
+      "BYTES",
+      0,
+      "When transmitting to several receivers, size of the buffer shared by "
+      "all of them, with an optional 'K', 'M' or 'G' suffix (64M by "
+      "default).",
+      2,
+    },
+    {
+      "duplex",
+      LONGOPT_DUPLEX,
+      NULL,
+      0,
+      "Relay data in both directions over the connection: from the input to "
+      "the peer, and from the peer to the output. Once the input reaches EOF, "
+      "the sending side of the connection is shut down, and the transfer ends "
+      "when the peer does the same.",
+      2,
+    },
+    {
+      "shm",
+      LONGOPT_SHM,
+      NULL,
+      0,
+      "When transmitting to a receiver on the same host, pass the data "
+      "through shared memory instead of the connection. Other receivers, and "
+      "those that can't reach the shared memory, still get it through the "
+      "connection.",
+      2,
+    },
+    {
+      "forward",
+      LONGOPT_FORWARD,
+      "DESTINATION",
+      0,
+      "When receiving, also send the data to the next receiver of a chain, "
+      "with the format 'HOST[:PORT]' (same port by default). If the next "
+      "receiver fails, the data is still written into the output.",
+      2,
+    },
+    {
+      "multicast",
+      LONGOPT_MULTICAST,
+      "GROUP",
+      OPTION_ARG_OPTIONAL,
+      "Send the data as UDP datagrams to a multicast group, which is the "
+      "destination when transmitting, and the GROUP when receiving. Receivers "
+      "ask the transmitter for lost datagrams through TCP on the same port.",
+      2,
+    },
+    {
+      "multicast-interface",
+      LONGOPT_MULTICAST_INTERFACE,
+      "ADDRESS",
+      0,
+      "With '--multicast', use the local interface with this IPv4 ADDRESS "
+      "(e.g. 127.0.0.1) instead of the one chosen by the system.",
+      2,
+    },
+    {
+      "fec",
+      LONGOPT_FEC,
+      "N",
+      0,
+      "When transmitting with '--multicast', send a parity datagram after "
+      "every N datagrams (8 by default, 0 to disable), so the receivers can "
+      "rebuild one lost datagram of each group on their own.",
+      2,
+    },
+    {
+      "udp",
+      LONGOPT_UDP,
+      NULL,
+      0,
+      "Send the data as paced UDP datagrams instead of using TCP. The "
+      "receiver reorders them, and asks for the missing ones, so random loss "
+      "doesn't slow down the transfer.",
+      2,
+    },
+    {
+      "rate",
+      LONGOPT_RATE,
+      "RATE",
+      0,
+      "When transmitting with '--multicast' or '--udp', send the datagrams at "
+      "RATE bits per second, with an optional 'K', 'M' or 'G' suffix. By "
+      "default, multicast uses 100M, and UDP discovers the rate from the "
+      "delay of the path.",
+      2,
+    },
+    {
+      "simulate-loss",
+      LONGOPT_SIMULATE_LOSS,
+      "PERCENT",
+      0,
+      "With '--udp', or when receiving with '--multicast', drop this PERCENT "
+      "of the datagrams on arrival, for testing.",
+      2,
+    },
+    {
+      "simulate-delay",
+      LONGOPT_SIMULATE_DELAY,
+      "MS",
+      0,
+      "Like '--simulate-loss', but hold the datagrams for MS milliseconds on "
+      "arrival.",
+      2,
+    },
     {
       "print-interfaces",
       LONGOPT_PRINT_INTERFACES,
@@ -105,7 +505,8 @@ static struct argp_option options[] = {
       NULL,
       0,
       "When receiving data, print the peer information whenever a connection "
-      "is accepted.",
+      "is accepted. In both modes, print the RTT, socket buffer and block "
+      "size of the connection.",
       3,
     },
     {
@@ -113,7 +514,8 @@ static struct argp_option options[] = {
       LONGOPT_PRINT_PROGRESS,
       NULL,
       0,
-      "Print the size of the received or transmitted data to 'stderr'.",
+      "Print the size of the received or transmitted data to 'stderr', along "
+      "with the current and average rates, twice per second.",
       3,
     },
     { NULL, 0, NULL, 0, NULL, 0 }
@@ -121,6 +523,118 @@ static struct argp_option options[] = {
 
 /*----------------------------------------------------------------------------*/
 
+/*
+ * Parse a decimal integer between `min' and `max' into `value'. Unlike
+ * sscanf(3) with "%zu", negative numbers are rejected instead of wrapping
+ * around. Returns false if the argument is invalid.
+ */
+static bool parse_count(const char* str,
+                        size_t min,
+                        size_t max,
+                        size_t* value) {
+    while (*str == ' ' || *str == '\t')
+        str++;
+    if (*str < '0' || *str > '9')
+        return false;
+
+    char* end;
+    errno                        = 0;
+    const unsigned long long num = strtoull(str, &end, 10);
+    if (errno != 0 || *end != '\0' || num < min || num > max)
+        return false;
+
+    *value = num;
+    return true;
+}
+
+/*
+ * Parse a positive size in bytes, with an optional binary 'K', 'M' or 'G'
+ * suffix, into `bytes'. Returns false if the argument is invalid.
+ */
+static bool parse_size(const char* str, size_t* bytes) {
+    char* end;
+    const double value = strtod(str, &end);
+    if (end == str || !(value > 0))
+        return false;
+
+    double multiplier = 1;
+    switch (*end) {
+        case 'G':
+            multiplier *= 1024;
+            /* fall through */
+        case 'M':
+            multiplier *= 1024;
+            /* fall through */
+        case 'K':
+            multiplier *= 1024;
+            end++;
+            break;
+
+        default:
+            break;
+    }
+
+    /* Converting a value that doesn't fit into a `size_t' is undefined */
+    if (*end != '\0' || value * multiplier >= (double)SIZE_MAX)
+        return false;
+
+    *bytes = (size_t)(value * multiplier);
+    return *bytes > 0;
+}
+
+/*
+ * Parse the AMOUNT argument of '--bench'. If it ends with 's', it's stored in
+ * `seconds'. Otherwise, it's a size, and it's stored in `bytes'. Returns false
+ * if the argument is invalid.
+ */
+static bool parse_bench_amount(const char* str,
+                               size_t* bytes,
+                               double* seconds) {
+    const size_t len = strlen(str);
+    if (len > 0 && str[len - 1] == 's') {
+        char* end;
+        const double value = strtod(str, &end);
+        if (end == str || value <= 0 || end != &str[len - 1])
+            return false;
+
+        *seconds = value;
+        return true;
+    }
+
+    *seconds = 0;
+    return parse_size(str, bytes);
+}
+
+/*
+ * Parse the RATE argument of '--tune', in bits per second, with an optional
+ * decimal suffix. Returns false if the argument is invalid.
+ */
+static bool parse_rate(const char* str, double* rate) {
+    char* end;
+    double value = strtod(str, &end);
+    if (end == str || value <= 0)
+        return false;
+
+    switch (*end) {
+        case 'G':
+            value *= 1000;
+            /* fall through */
+        case 'M':
+            value *= 1000;
+            /* fall through */
+        case 'K':
+            value *= 1000;
+            end++;
+            break;
+
+        default:
+            break;
+    }
+
+    *rate = value;
+    return *end == '\0';
+}
+
 /*
  * Callback function used by the Argp library (specifically, by 'argp_parse'
  * through the 'argp' structure) for parsing each option in the command-line
@@ -159,6 +673,279 @@ static error_t parse_opt(int key, char* arg, struct argp_state* state) {
                         state->name);
                 argp_usage(state);
             }
+            args->block_size_set = true;
+            break;
+#endif
+
+        case LONGOPT_STREAMS:
+            if (sscanf(arg, "%zu", &args->streams) != 1 ||
+                args->streams <= 0 || args->streams > STREAMS_MAX) {
+                fprintf(state->err_stream,
+                        "%s: Invalid number of streams (1-%d).\n",
+                        state->name,
+                        STREAMS_MAX);
+                argp_usage(state);
+            }
+            break;
+
+        case LONGOPT_PIPELINE:
+            if (!parse_count(arg, 2, RING_MAX_DEPTH, &args->pipeline_depth)) {
+                fprintf(state->err_stream,
+                        "%s: Invalid pipeline depth (2-%d).\n",
+                        state->name,
+                        RING_MAX_DEPTH);
+                argp_usage(state);
+            }
+            break;
+
+        case LONGOPT_BENCH:
+            args->bench = true;
+            if (arg != NULL &&
+                !parse_bench_amount(arg,
+                                    &args->bench_size,
+                                    &args->bench_seconds)) {
+                fprintf(state->err_stream,
+                        "%s: Invalid benchmark amount.\n",
+                        state->name);
+                argp_usage(state);
+            }
+            break;
+
+        case LONGOPT_COMPRESS:
+            args->compress = true;
+            if (arg == NULL || strcmp(arg, "always") == 0) {
+                args->compress_auto = false;
+            } else if (strcmp(arg, "auto") == 0) {
+                args->compress_auto = true;
+            } else {
+                fprintf(state->err_stream,
+                        "%s: Invalid compression mode.\n",
+                        state->name);
+                argp_usage(state);
+            }
+            break;
+
+        case LONGOPT_CHECKSUM:
+            args->checksum = true;
+            break;
+
+        case LONGOPT_RESUME:
+            args->resume = true;
+            break;
+
+        case LONGOPT_ZEROCOPY:
+            args->zerocopy = true;
+            break;
+
+        case 'i':
+            args->input = arg;
+            break;
+
+        case LONGOPT_DIRECT:
+            args->direct = true;
+            break;
+
+        case LONGOPT_TUNE:
+            args->tune = true;
+            if (arg != NULL && !parse_rate(arg, &args->tune_rate)) {
+                fprintf(state->err_stream,
+                        "%s: Invalid target rate.\n",
+                        state->name);
+                argp_usage(state);
+            }
+            break;
+
+        case LONGOPT_SOCKET_BUFFER:
+            if (sscanf(arg, "%zu", &args->socket_buffer) != 1 ||
+                args->socket_buffer <= 0 || args->socket_buffer > INT_MAX) {
+                fprintf(state->err_stream,
+                        "%s: Invalid socket buffer size.\n",
+                        state->name);
+                argp_usage(state);
+            }
+            break;
+
+        case LONGOPT_NOTSENT_LOWAT:
+            if (sscanf(arg, "%zu", &args->notsent_lowat) != 1 ||
+                args->notsent_lowat <= 0 || args->notsent_lowat > INT_MAX) {
+                fprintf(state->err_stream,
+                        "%s: Invalid low-water mark.\n",
+                        state->name);
+                argp_usage(state);
+            }
+            break;
+
+        case LONGOPT_LOW_LATENCY:
+            args->low_latency = true;
+            if (arg != NULL && !parse_count(arg,
+                                            0,
+                                            ARGS_MAX_FLUSH_TIMEOUT,
+                                            &args->flush_timeout)) {
+                fprintf(state->err_stream,
+                        "%s: Invalid flush timeout (0-%d).\n",
+                        state->name,
+                        ARGS_MAX_FLUSH_TIMEOUT);
+                argp_usage(state);
+            }
+            break;
+
+        case LONGOPT_STATS:
+            args->stats = true;
+            if (arg == NULL || strcmp(arg, "text") == 0) {
+                args->stats_json = false;
+            } else if (strcmp(arg, "json") == 0) {
+                args->stats_json = true;
+            } else {
+                fprintf(state->err_stream,
+                        "%s: Invalid statistics format.\n",
+                        state->name);
+                argp_usage(state);
+            }
+            break;
+
+        case LONGOPT_STATS_FILE:
+            args->stats_file = arg;
+            break;
+
+        case LONGOPT_SLOW_RECEIVER:
+            if (strcmp(arg, "block") == 0) {
+                args->fanout_policy = FANOUT_POLICY_BLOCK;
+            } else if (strcmp(arg, "buffer") == 0) {
+                args->fanout_policy = FANOUT_POLICY_BUFFER;
+            } else if (strcmp(arg, "drop") == 0) {
+                args->fanout_policy = FANOUT_POLICY_DROP;
+            } else {
+                fprintf(state->err_stream,
+                        "%s: Invalid slow receiver policy.\n",
+                        state->name);
+                argp_usage(state);
+            }
+            break;
+
+        case LONGOPT_FANOUT_BUFFER:
+            if (!parse_size(arg, &args->fanout_buffer)) {
+                fprintf(state->err_stream,
+                        "%s: Invalid fan-out buffer size.\n",
+                        state->name);
+                argp_usage(state);
+            }
+            break;
+
+        case LONGOPT_DUPLEX:
+            args->duplex = true;
+            break;
+
+        case LONGOPT_SHM:
+            args->shm = true;
+            break;
+
+        case LONGOPT_FORWARD:
+            args->forward = arg;
+            break;
+
+        case LONGOPT_MULTICAST:
+            args->multicast       = true;
+            args->multicast_group = arg;
+            break;
+
+        case LONGOPT_MULTICAST_INTERFACE:
+            args->multicast_interface = arg;
+            break;
+
+        case LONGOPT_FEC:
+            if (sscanf(arg, "%zu", &args->fec) != 1 || args->fec == 1 ||
+                args->fec > MCAST_MAX_FEC) {
+                fprintf(state->err_stream,
+                        "%s: Invalid parity group size (0 or 2..%d).\n",
+                        state->name,
+                        MCAST_MAX_FEC);
+                argp_usage(state);
+            }
+            break;
+
+        case LONGOPT_UDP:
+            args->udp = true;
+            break;
+
+        case LONGOPT_RATE:
+            if (!parse_rate(arg, &args->rate)) {
+                fprintf(state->err_stream,
+                        "%s: Invalid rate.\n",
+                        state->name);
+                argp_usage(state);
+            }
+            break;
+
+        case LONGOPT_SIMULATE_LOSS:
+            if (sscanf(arg, "%lf", &args->simulate_loss) != 1 ||
+                args->simulate_loss < 0 || args->simulate_loss >= 100) {
+                fprintf(state->err_stream,
+                        "%s: Invalid loss percentage.\n",
+                        state->name);
+                argp_usage(state);
+            }
+            break;
+
+        case LONGOPT_SIMULATE_DELAY:
+            if (!parse_count(arg,
+                             0,
+                             SIM_MAX_DELAY_MS,
+                             &args->simulate_delay)) {
+                fprintf(state->err_stream,
+                        "%s: Invalid delay (0-%d).\n",
+                        state->name,
+                        SIM_MAX_DELAY_MS);
+                argp_usage(state);
+            }
+            break;
+
+        case 'o':
+            args->output = arg;
+            break;
+
+        case LONGOPT_SERVER:
+            args->server = true;
+            break;
+
+        case LONGOPT_OUTPUT_TEMPLATE:
+            args->output_template = arg;
+            break;
+
+        case LONGOPT_MAX_CONNECTIONS:
+            if (!parse_count(arg,
+                             1,
+                             SERVER_MAX_CONNECTIONS,
+                             &args->max_connections)) {
+                fprintf(state->err_stream,
+                        "%s: Invalid number of connections (1-%d).\n",
+                        state->name,
+                        SERVER_MAX_CONNECTIONS);
+                argp_usage(state);
+            }
+            break;
+
+        case LONGOPT_WORKERS:
+            if (!parse_count(arg, 1, SERVER_MAX_WORKERS, &args->workers)) {
+                fprintf(state->err_stream,
+                        "%s: Invalid number of workers (1-%d).\n",
+                        state->name,
+                        SERVER_MAX_WORKERS);
+                argp_usage(state);
+            }
+            break;
+
+        case LONGOPT_CONNECTION_BUFFER:
+            if (!parse_count(arg, 1, INT_MAX, &args->connection_buffer)) {
+                fprintf(state->err_stream,
+                        "%s: Invalid connection buffer size.\n",
+                        state->name);
+                argp_usage(state);
+            }
+            break;
+
+#ifndef NO_IO_URING
+        case LONGOPT_IO_URING:
+            args->io_uring = true;
             break;
 #endif
 
@@ -182,6 +969,242 @@ static error_t parse_opt(int key, char* arg, struct argp_state* state) {
                         state->name);
                 argp_usage(state);
             }
+
+            /* Check for incompatible options */
+            const bool framed = args->streams > 1 || args->compress ||
+                                args->checksum || args->resume;
+            if (args->bench && args->mode == ARGS_MODE_TRANSMIT &&
+                (framed || args->pipeline_depth > 0))
+                argp_error(state,
+                           "The '--bench' option can't be used with "
+                           "'--streams', '--compress', '--checksum', "
+                           "'--resume' or '--pipeline' when transmitting.");
+            if (args->pipeline_depth > 0 && framed)
+                argp_error(state,
+                           "The '--pipeline' option can't be used with "
+                           "'--streams', '--compress', '--checksum' or "
+                           "'--resume'.");
+            if (args->zerocopy &&
+                (args->mode != ARGS_MODE_TRANSMIT || framed ||
+                 args->pipeline_depth > 0 || args->bench))
+                argp_error(state,
+                           "The '--zerocopy' option can only be used when "
+                           "transmitting, without '--streams', '--compress', "
+                           "'--checksum', '--resume', '--pipeline' or "
+                           "'--bench'.");
+            if (args->resume && args->mode != ARGS_MODE_TRANSMIT)
+                argp_error(state,
+                           "The '--resume' option can only be used when "
+                           "transmitting.");
+            if (args->output != NULL &&
+                (args->mode != ARGS_MODE_RECEIVE || args->server))
+                argp_error(state,
+                           "The '--output' option can only be used when "
+                           "receiving, without '--server'.");
+            if (args->input != NULL &&
+                (args->mode != ARGS_MODE_TRANSMIT || args->bench))
+                argp_error(state,
+                           "The '--input' option can only be used when "
+                           "transmitting, without '--bench'.");
+            if (args->server && (args->tune || args->socket_buffer > 0))
+                argp_error(state,
+                           "The '--tune' and '--socket-buffer' options can't "
+                           "be used with '--server'. Use "
+                           "'--connection-buffer' instead.");
+            if (args->notsent_lowat > 0 && args->mode != ARGS_MODE_TRANSMIT)
+                argp_error(state,
+                           "The '--notsent-lowat' option can only be used "
+                           "when transmitting.");
+            if (args->low_latency &&
+                (framed || args->pipeline_depth > 0 || args->zerocopy ||
+                 args->bench || args->direct))
+                argp_error(state,
+                           "The '--low-latency' option can't be used with "
+                           "'--streams', '--compress', '--checksum', "
+                           "'--resume', '--pipeline', '--zerocopy', '--bench' "
+                           "or '--direct'.");
+            const bool fanout = args->mode == ARGS_MODE_TRANSMIT &&
+                                strchr(args->destination, ',') != NULL;
+            if (fanout && (framed || args->pipeline_depth > 0 ||
+                           args->zerocopy || args->bench || args->duplex ||
+                           args->low_latency))
+                argp_error(state,
+                           "Several destinations can't be used with "
+                           "'--streams', '--compress', '--checksum', "
+                           "'--resume', '--pipeline', '--zerocopy', '--bench', "
+                           "'--duplex' or '--low-latency'.");
+            if (!fanout && (args->fanout_policy != FANOUT_POLICY_BUFFER ||
+                            args->fanout_buffer != FANOUT_DEFAULT_BUFFER_SZ))
+                argp_error(state,
+                           "The '--slow-receiver' and '--fanout-buffer' "
+                           "options can only be used with several "
+                           "destinations.");
+            if (args->duplex &&
+                (framed || args->pipeline_depth > 0 || args->zerocopy ||
+                 args->bench || args->server || args->output != NULL))
+                argp_error(state,
+                           "The '--duplex' option can't be used with "
+                           "'--streams', '--compress', '--checksum', "
+                           "'--resume', '--pipeline', '--zerocopy', '--bench', "
+                           "'--server' or '--output'.");
+            if (args->forward != NULL &&
+                (args->mode != ARGS_MODE_RECEIVE || args->server ||
+                 args->bench || args->duplex))
+                argp_error(state,
+                           "The '--forward' option can only be used when "
+                           "receiving, without '--server', '--bench' or "
+                           "'--duplex'.");
+            if (args->multicast &&
+                (framed || args->pipeline_depth > 0 || args->zerocopy ||
+                 args->bench || args->duplex || args->low_latency ||
+                 args->server || args->forward != NULL || fanout))
+                argp_error(state,
+                           "The '--multicast' option can't be used with "
+                           "'--streams', '--compress', '--checksum', "
+                           "'--resume', '--pipeline', '--zerocopy', '--bench', "
+                           "'--duplex', '--low-latency', '--server', "
+                           "'--forward' or several destinations.");
+            if ((args->multicast || args->udp) &&
+                (args->tune || args->socket_buffer > 0 ||
+                 args->notsent_lowat > 0))
+                argp_error(state,
+                           "The '--tune', '--socket-buffer' and "
+                           "'--notsent-lowat' options can't be used with "
+                           "'--multicast' or '--udp'.");
+            if (args->multicast && args->mode == ARGS_MODE_RECEIVE &&
+                args->multicast_group == NULL)
+                argp_error(state,
+                           "When receiving, the '--multicast' option needs "
+                           "the GROUP.");
+            if (args->multicast && args->mode == ARGS_MODE_TRANSMIT &&
+                args->multicast_group != NULL)
+                argp_error(state,
+                           "When transmitting, the multicast GROUP is the "
+                           "destination.");
+            if (!args->multicast && args->multicast_interface != NULL)
+                argp_error(state,
+                           "The '--multicast-interface' option can only be "
+                           "used with '--multicast'.");
+            if (args->udp &&
+                (framed || args->pipeline_depth > 0 || args->zerocopy ||
+                 args->bench || args->duplex || args->low_latency ||
+                 args->server || args->forward != NULL || fanout ||
+                 args->multicast))
+                argp_error(state,
+                           "The '--udp' option can't be used with "
+                           "'--streams', '--compress', '--checksum', "
+                           "'--resume', '--pipeline', '--zerocopy', '--bench', "
+                           "'--duplex', '--low-latency', '--server', "
+                           "'--forward', '--multicast' or several "
+                           "destinations.");
+            if (args->shm &&
+                (args->mode != ARGS_MODE_TRANSMIT || framed ||
+                 args->pipeline_depth > 0 || args->zerocopy || args->bench ||
+                 args->duplex || args->low_latency || fanout ||
+                 args->multicast || args->udp))
+                argp_error(state,
+                           "The '--shm' option can only be used when "
+                           "transmitting, without '--streams', '--compress', "
+                           "'--checksum', '--resume', '--pipeline', "
+                           "'--zerocopy', '--bench', '--duplex', "
+                           "'--low-latency', '--multicast', '--udp' or "
+                           "several destinations.");
+            if ((!args->multicast || args->mode != ARGS_MODE_TRANSMIT) &&
+                args->fec != MCAST_DEFAULT_FEC)
+                argp_error(state,
+                           "The '--fec' option can only be used when "
+                           "transmitting with '--multicast'.");
+            if (((!args->multicast && !args->udp) ||
+                 args->mode != ARGS_MODE_TRANSMIT) &&
+                args->rate != 0)
+                argp_error(state,
+                           "The '--rate' option can only be used when "
+                           "transmitting with '--multicast' or '--udp'.");
+            if (!args->udp &&
+                (!args->multicast || args->mode != ARGS_MODE_RECEIVE) &&
+                (args->simulate_loss > 0 || args->simulate_delay > 0))
+                argp_error(state,
+                           "The '--simulate-loss' and '--simulate-delay' "
+                           "options can only be used with '--udp', or when "
+                           "receiving with '--multicast'.");
+            if (args->stats_file != NULL && !args->stats)
+                argp_error(state,
+                           "The '--stats-file' option can only be used with "
+                           "'--stats'.");
+            if (args->stats && args->server)
+                argp_error(state,
+                           "The '--stats' and '--server' options are "
+                           "incompatible.");
+            if (args->direct && args->output == NULL)
+                argp_error(state,
+                           "The '--direct' option can only be used with "
+                           "'--output'.");
+            if (args->output != NULL && args->bench)
+                argp_error(state,
+                           "The '--output' and '--bench' options are "
+                           "incompatible.");
+            if (args->compress && args->mode != ARGS_MODE_TRANSMIT)
+                argp_error(state,
+                           "The '--compress' option can only be used when "
+                           "transmitting.");
+            if (args->server && args->checksum)
+                argp_error(state,
+                           "The '--server' and '--checksum' options are "
+                           "incompatible.");
+            if (args->server && args->mode != ARGS_MODE_RECEIVE)
+                argp_error(state,
+                           "The '--server' option can only be used when "
+                           "receiving.");
+            if (args->server && args->bench)
+                argp_error(state,
+                           "The '--server' and '--bench' options are "
+                           "incompatible.");
+            if (!args->server && args->workers > 1)
+                argp_error(state,
+                           "The '--workers' option can only be used with "
+                           "'--server'.");
+            if (!args->server && args->output_template != NULL)
+                argp_error(state,
+                           "The '--output-template' option can only be used "
+                           "with '--server'.");
+#ifndef NO_IO_URING
+            if (args->zerocopy && args->io_uring)
+                argp_error(state,
+                           "The '--zerocopy' and '--io-uring' options are "
+                           "incompatible.");
+            if (args->pipeline_depth > 0 && args->io_uring)
+                argp_error(state,
+                           "The '--pipeline' and '--io-uring' options are "
+                           "incompatible.");
+            if (args->low_latency && args->io_uring)
+                argp_error(state,
+                           "The '--low-latency' and '--io-uring' options are "
+                           "incompatible.");
+            if (fanout && args->io_uring)
+                argp_error(state,
+                           "Several destinations can't be used with "
+                           "'--io-uring'.");
+            if (args->duplex && args->io_uring)
+                argp_error(state,
+                           "The '--duplex' and '--io-uring' options are "
+                           "incompatible.");
+            if (args->forward != NULL && args->io_uring)
+                argp_error(state,
+                           "The '--forward' and '--io-uring' options are "
+                           "incompatible.");
+            if (args->multicast && args->io_uring)
+                argp_error(state,
+                           "The '--multicast' and '--io-uring' options are "
+                           "incompatible.");
+            if (args->udp && args->io_uring)
+                argp_error(state,
+                           "The '--udp' and '--io-uring' options are "
+                           "incompatible.");
+            if (args->shm && args->io_uring)
+                argp_error(state,
+                           "The '--shm' and '--io-uring' options are "
+                           "incompatible.");
+#endif
             break;
 
         default:
@@ -193,14 +1216,60 @@ static error_t parse_opt(int key, char* arg, struct argp_state* state) {
 /*----------------------------------------------------------------------------*/
 
 void args_init(struct Args* args) {
-    args->mode             = ARGS_MODE_NONE;
-    args->port             = "1337";
-    args->print_interfaces = false;
-    args->print_peer_info  = false;
-    args->print_progress   = false;
+    args->mode              = ARGS_MODE_NONE;
+    args->port              = "1337";
+    args->print_interfaces  = false;
+    args->print_peer_info   = false;
+    args->print_progress    = false;
+    args->streams           = 1;
+    args->pipeline_depth    = 0;
+    args->compress          = false;
+    args->compress_auto     = false;
+    args->checksum          = false;
+    args->resume            = false;
+    args->input             = NULL;
+    args->output            = NULL;
+    args->direct            = false;
+    args->tune              = false;
+    args->tune_rate         = 10e9;
+    args->socket_buffer     = 0;
+    args->notsent_lowat     = 0;
+    args->low_latency       = false;
+    args->flush_timeout     = 0;
+    args->stats             = false;
+    args->stats_json        = false;
+    args->stats_file        = NULL;
+    args->duplex            = false;
+    args->shm               = false;
+    args->forward           = NULL;
+    args->fanout_policy     = FANOUT_POLICY_BUFFER;
+    args->fanout_buffer     = FANOUT_DEFAULT_BUFFER_SZ;
+    args->zerocopy          = false;
+    args->bench             = false;
+    args->bench_size        = 1024 * 1024 * 1024;
+    args->bench_seconds     = 0;
+    args->server            = false;
+    args->output_template   = NULL;
+    args->max_connections   = 256;
+    args->connection_buffer = 0;
+    args->workers           = 1;
+
+    args->multicast           = false;
+    args->multicast_group     = NULL;
+    args->multicast_interface = NULL;
+    args->fec                 = MCAST_DEFAULT_FEC;
+    args->udp                 = false;
+    args->rate                = 0;
+    args->simulate_loss       = 0;
+    args->simulate_delay      = 0;
+
+#ifndef NO_IO_URING
+    args->io_uring = false;
+#endif
 
 #ifndef FIXED_BLOCK_SIZE
-    args->block_size = 0x1000;
+    args->block_size     = 0x1000;
+    args->block_size_set = false;
 #endif
 }
 
@@ -0,0 +1,154 @@
+/*
+ * Copyright 2025 8dcc
+ *
+ * This file is part of snc (Simple NetCat).
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <pthread.h> /* pthread_once() */
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h> /* _mm_crc32_u64(), etc. */
+#define CRC32C_HAVE_SSE42 1
+#endif
+
+#include "include/crc32c.h"
+
+/*
+ * Reversed representation of the CRC-32C polynomial.
+ */
+#define CRC32C_POLY 0x82F63B78
+
+/*
+ * Lookup tables for the portable implementation, which processes 8 bytes at a
+ * time ("slicing-by-8"). The first table is the usual byte-wise table.
+ */
+static uint32_t table[8][256];
+
+/*
+ * Implementation selected by `crc32c_init'. Both receive and return the
+ * checksum without the final inversion.
+ */
+static uint32_t (*impl)(uint32_t crc, const uint8_t* data, size_t data_sz);
+static const char* impl_name;
+
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+
+/*----------------------------------------------------------------------------*/
+
+static uint32_t crc32c_sw(uint32_t crc, const uint8_t* data, size_t data_sz) {
+    while (data_sz > 0 && ((uintptr_t)data & 7) != 0) {
+        crc = table[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+        data_sz--;
+    }
+
+    while (data_sz >= 8) {
+        uint32_t low, high;
+        memcpy(&low, data, sizeof(low));
+        memcpy(&high, data + 4, sizeof(high));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        low  = __builtin_bswap32(low);
+        high = __builtin_bswap32(high);
+#endif
+        low ^= crc;
+
+        crc = table[7][low & 0xFF] ^ table[6][(low >> 8) & 0xFF] ^
+              table[5][(low >> 16) & 0xFF] ^ table[4][low >> 24] ^
+              table[3][high & 0xFF] ^ table[2][(high >> 8) & 0xFF] ^
+              table[1][(high >> 16) & 0xFF] ^ table[0][high >> 24];
+
+        data += 8;
+        data_sz -= 8;
+    }
+
+    while (data_sz > 0) {
+        crc = table[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+        data_sz--;
+    }
+
+    return crc;
+}
+
+#ifdef CRC32C_HAVE_SSE42
+__attribute__((target("sse4.2"))) static uint32_t
+crc32c_sse42(uint32_t crc, const uint8_t* data, size_t data_sz) {
+    while (data_sz > 0 && ((uintptr_t)data & 7) != 0) {
+        crc = _mm_crc32_u8(crc, *data++);
+        data_sz--;
+    }
+
+    uint64_t crc64 = crc;
+    while (data_sz >= 8) {
+        uint64_t value;
+        memcpy(&value, data, sizeof(value));
+        crc64 = _mm_crc32_u64(crc64, value);
+
+        data += 8;
+        data_sz -= 8;
+    }
+    crc = (uint32_t)crc64;
+
+    while (data_sz > 0) {
+        crc = _mm_crc32_u8(crc, *data++);
+        data_sz--;
+    }
+
+    return crc;
+}
+#endif /* CRC32C_HAVE_SSE42 */
+
+/*
+ * Fill the lookup tables, and select the fastest implementation supported by
+ * the CPU. Called once, through `pthread_once'.
+ */
+static void crc32c_init(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        table[0][i] = crc;
+    }
+
+    for (uint32_t i = 0; i < 256; i++)
+        for (int t = 1; t < 8; t++)
+            table[t][i] =
+              table[0][table[t - 1][i] & 0xFF] ^ (table[t - 1][i] >> 8);
+
+    impl      = crc32c_sw;
+    impl_name = "software";
+
+#ifdef CRC32C_HAVE_SSE42
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) {
+        impl      = crc32c_sse42;
+        impl_name = "SSE4.2";
+    }
+#endif /* CRC32C_HAVE_SSE42 */
+}
+
+/*----------------------------------------------------------------------------*/
+
+uint32_t crc32c_update(uint32_t crc, const void* data, size_t data_sz) {
+    pthread_once(&init_once, crc32c_init);
+    return ~impl(~crc, data, data_sz);
+}
+
+const char* crc32c_impl_name(void) {
+    pthread_once(&init_once, crc32c_init);
+    return impl_name;
+}
@@ -0,0 +1,112 @@
+/*
+ * Copyright 2025 8dcc
+ *
+ * This file is part of snc (Simple NetCat).
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <sys/types.h>
+#include <sys/socket.h> /* send() */
+#include <netinet/in.h> /* sockaddr_in */
+#include <arpa/inet.h>  /* inet_ntop() */
+
+#include "include/util.h"
+#include "include/main.h"
+#include "include/stats.h"
+#include "include/dgram.h"
+
+void dgram_put_header(uint8_t* buf,
+                      const char* magic,
+                      const struct DgramHeader* header) {
+    memcpy(&buf[0], magic, DGRAM_MAGIC_SZ);
+    store_be(&buf[4], header->session, 4);
+    store_be(&buf[8], header->seq, 4);
+    store_be(&buf[12], header->type, 1);
+    store_be(&buf[13], header->param, 1);
+    store_be(&buf[14], header->len, 2);
+}
+
+bool dgram_get_header(const uint8_t* buf,
+                      size_t buf_sz,
+                      const char* magic,
+                      struct DgramHeader* header) {
+    if (buf_sz < DGRAM_HEADER_SZ || memcmp(&buf[0], magic, DGRAM_MAGIC_SZ) != 0)
+        return false;
+
+    header->session = load_be(&buf[4], 4);
+    header->seq     = load_be(&buf[8], 4);
+    header->type    = load_be(&buf[12], 1);
+    header->param   = load_be(&buf[13], 1);
+    header->len     = load_be(&buf[14], 2);
+    return true;
+}
+
+bool dgram_send(int sockfd, const void* packet, size_t packet_sz) {
+    for (;;) {
+        const uint64_t start = stats_start_call(STATS_CALL_SEND);
+        const ssize_t sent   = send(sockfd, packet, packet_sz, 0);
+        stats_end_call(STATS_CALL_SEND, STATS_WAIT_NET, start, sent);
+        if (sent >= 0)
+            return true;
+        if (errno == EINTR)
+            continue;
+        if (errno == ENOBUFS || errno == EAGAIN || errno == ECONNREFUSED)
+            return true;
+
+        ERR("Send error: %s", strerror(errno));
+        return false;
+    }
+}
+
+void dgram_pacer_set_rate(struct DgramPacer* pacer,
+                          double rate,
+                          size_t datagram_sz) {
+    pacer->rate        = rate;
+    pacer->interval_ns = (uint64_t)(datagram_sz * 8 * NS_PER_SEC / rate);
+}
+
+void dgram_pacer_advance(struct DgramPacer* pacer, uint64_t now) {
+    /* After a long pause, don't try to catch up all at once */
+    if (now > pacer->next_ns + DGRAM_MAX_BURST * pacer->interval_ns)
+        pacer->next_ns = now;
+    pacer->next_ns += pacer->interval_ns;
+}
+
+enum EDgramLock dgram_lock(struct DgramLock* lock,
+                           uint32_t session,
+                           const struct sockaddr_in* from,
+                           const char* transport) {
+    if (lock->locked)
+        return (session == lock->session) ? DGRAM_LOCK_SAME : DGRAM_LOCK_OTHER;
+
+    lock->locked  = true;
+    lock->session = session;
+
+    if (g_opt_print_peer_info) {
+        char host[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &from->sin_addr, host, sizeof(host));
+        print_separator(stderr);
+        fprintf(stderr, "Receiving %s from: %s\n", transport, host);
+        print_separator(stderr);
+    }
+
+    return DGRAM_LOCK_NEW;
+}
@@ -0,0 +1,263 @@
+/*
+ * Copyright 2025 8dcc
+ *
+ * This file is part of snc (Simple NetCat).
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h> /* read(), write() */
+#include <fcntl.h>  /* fcntl() */
+#include <poll.h>   /* poll() */
+#include <sys/types.h>
+#include <sys/socket.h> /* send(), recv(), shutdown() */
+
+#include "include/util.h"
+#include "include/main.h"
+#include "include/stats.h"
+#include "include/duplex.h"
+
+/*
+ * One of the two directions of the relay. The data in `buf' between `start' and
+ * `end' was read from `src_fd', but not written into `dst_fd' yet. A new read
+ * is only made once all of it was written.
+ */
+struct Direction {
+    int src_fd, dst_fd;
+    bool src_is_socket, dst_is_socket;
+
+    uint8_t* buf;
+    size_t start, end;
+
+    /* The source reached EOF, and then all of its data was written */
+    bool eof, done;
+};
+
+/*----------------------------------------------------------------------------*/
+
+static inline bool is_pending(const struct Direction* dir) {
+    return dir->start < dir->end;
+}
+
+static inline bool would_block(void) {
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+}
+
+/*
+ * Read the next chunk of data from the source of `dir', if it's available.
+ * Returns false on error, after printing it.
+ */
+static bool direction_read(struct Direction* dir, size_t buf_sz) {
+    const enum EStatsCall call =
+      dir->src_is_socket ? STATS_CALL_RECV : STATS_CALL_READ;
+    const enum EStatsWait wait =
+      dir->src_is_socket ? STATS_WAIT_NET : STATS_WAIT_IO;
+
+    const uint64_t start = stats_start_call(call);
+    const ssize_t received =
+      dir->src_is_socket ? recv(dir->src_fd, dir->buf, buf_sz, 0)
+                         : read(dir->src_fd, dir->buf, buf_sz);
+    stats_end_call(call, wait, start, received);
+    if (received < 0) {
+        if (would_block())
+            return true;
+
+        ERR("%s error: %s",
+            dir->src_is_socket ? "Receive" : "Read",
+            strerror(errno));
+        return false;
+    }
+
+    dir->start = 0;
+    dir->end   = received;
+    if (received == 0)
+        dir->eof = true;
+
+    return true;
+}
+
+/*
+ * Write as much of the pending data of `dir' as possible without blocking,
+ * adding the written bytes to `total'. Returns false on error, after printing
+ * it.
+ */
+static bool direction_write(struct Direction* dir, size_t* total) {
+    const enum EStatsCall call =
+      dir->dst_is_socket ? STATS_CALL_SEND : STATS_CALL_WRITE;
+    const enum EStatsWait wait =
+      dir->dst_is_socket ? STATS_WAIT_NET : STATS_WAIT_IO;
+
+    while (is_pending(dir)) {
+        const uint8_t* data = &dir->buf[dir->start];
+        const size_t data_sz = dir->end - dir->start;
+
+        const uint64_t start = stats_start_call(call);
+        const ssize_t written =
+          dir->dst_is_socket ? send(dir->dst_fd, data, data_sz, 0)
+                             : write(dir->dst_fd, data, data_sz);
+        stats_end_call(call, wait, start, written);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            if (would_block())
+                return true;
+
+            ERR("%s error: %s",
+                dir->dst_is_socket ? "Send" : "Write",
+                strerror(errno));
+            return false;
+        }
+
+        dir->start += written;
+        *total += written;
+        update_progress(*total);
+    }
+
+    return true;
+}
+
+/*
+ * Add `O_NONBLOCK' to the flags of `fd', storing the previous ones in
+ * `old_flags'. Returns false on error, with `errno' set.
+ */
+static bool set_nonblocking(int fd, int* old_flags) {
+    *old_flags = fcntl(fd, F_GETFL);
+    if (*old_flags < 0)
+        return false;
+
+    return fcntl(fd, F_SETFL, *old_flags | O_NONBLOCK) == 0;
+}
+
+/*----------------------------------------------------------------------------*/
+
+bool duplex_relay(int sockfd,
+                  int src_fd,
+                  int dst_fd,
+                  size_t buf_sz,
+                  size_t* total) {
+    bool result = true;
+
+    /*
+     * The standard input and output might share their file description with
+     * other processes (e.g. a terminal), so their flags are restored at the
+     * end. If some of them are the same description, restoring them in the
+     * reverse order leaves the original flags.
+     */
+    const int fds[] = { sockfd, src_fd, dst_fd };
+    int old_flags[] = { -1, -1, -1 };
+
+    uint8_t* bufs = malloc(2 * buf_sz);
+    if (bufs == NULL) {
+        ERR("Failed to allocate %zu bytes: %s", 2 * buf_sz, strerror(errno));
+        return false;
+    }
+
+    for (size_t i = 0; i < LENGTH(fds); i++) {
+        if (!set_nonblocking(fds[i], &old_flags[i])) {
+            ERR("Could not make a descriptor non-blocking: %s",
+                strerror(errno));
+            result = false;
+            goto cleanup;
+        }
+    }
+
+    struct Direction dirs[2];
+    memset(dirs, 0, sizeof(dirs));
+
+    dirs[0].src_fd        = src_fd;
+    dirs[0].dst_fd        = sockfd;
+    dirs[0].dst_is_socket = true;
+    dirs[0].buf           = &bufs[0];
+
+    dirs[1].src_fd        = sockfd;
+    dirs[1].dst_fd        = dst_fd;
+    dirs[1].src_is_socket = true;
+    dirs[1].buf           = &bufs[buf_sz];
+
+    while (!(dirs[0].done && dirs[1].done) && !g_signaled_quit) {
+        /*
+         * Each direction waits either for its source to have data, or for its
+         * destination to accept the pending data. A negative descriptor is
+         * ignored by poll(2).
+         */
+        struct pollfd pfds[2 * LENGTH(dirs)];
+        for (size_t i = 0; i < LENGTH(dirs); i++) {
+            const struct Direction* dir = &dirs[i];
+            const bool can_read = !dir->eof && !is_pending(dir);
+
+            pfds[2 * i].fd         = can_read ? dir->src_fd : -1;
+            pfds[2 * i].events     = POLLIN;
+            pfds[2 * i + 1].fd     = is_pending(dir) ? dir->dst_fd : -1;
+            pfds[2 * i + 1].events = POLLOUT;
+        }
+
+        if (poll(pfds, LENGTH(pfds), -1) < 0) {
+            if (errno == EINTR)
+                continue;
+
+            ERR("Could not poll the descriptors: %s", strerror(errno));
+            result = false;
+            goto cleanup;
+        }
+
+        for (size_t i = 0; i < LENGTH(dirs); i++) {
+            struct Direction* dir = &dirs[i];
+            if (dir->done)
+                continue;
+
+            /*
+             * Errors and hang-ups are reported by the read or write itself.
+             * Data that was just read is written right away, since the
+             * destination is usually ready.
+             */
+            if (pfds[2 * i].revents != 0 && !direction_read(dir, buf_sz)) {
+                result = false;
+                goto cleanup;
+            }
+            if ((pfds[2 * i].revents != 0 || pfds[2 * i + 1].revents != 0) &&
+                !direction_write(dir, total)) {
+                result = false;
+                goto cleanup;
+            }
+
+            if (!dir->eof || is_pending(dir))
+                continue;
+
+            /*
+             * Let the peer know that we won't send anything else, but keep
+             * receiving its data.
+             */
+            if (dir->dst_is_socket && shutdown(sockfd, SHUT_WR) != 0) {
+                ERR("Could not shut down the connection: %s", strerror(errno));
+                result = false;
+                goto cleanup;
+            }
+            dir->done = true;
+        }
+    }
+
+cleanup:
+    for (size_t i = LENGTH(fds); i-- > 0;)
+        if (old_flags[i] >= 0)
+            fcntl(fds[i], F_SETFL, old_flags[i]);
+
+    free(bufs);
+    return result;
+}
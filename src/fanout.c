@@ -0,0 +1,416 @@
+/*
+ * Copyright 2025 8dcc
+ *
+ * This file is part of snc (Simple NetCat).
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <unistd.h> /* read(), close() */
+#include <sys/types.h>
+#include <sys/socket.h> /* shutdown() */
+
+#include "include/util.h"
+#include "include/main.h"
+#include "include/io.h"
+#include "include/net.h"
+#include "include/stats.h"
+#include "include/fanout.h"
+
+/*
+ * State shared by the main thread, which reads the input, and the sender
+ * threads of each receiver.
+ *
+ * The input is stored in a ring of `ring_sz' bytes. The byte at position `pos'
+ * of the input is at `ring[pos % ring_sz]', and the ring holds the bytes from
+ * the position of the slowest active receiver up to `head'. The main thread
+ * only writes after `head', as long as that doesn't overwrite any byte that an
+ * active receiver hasn't sent yet.
+ */
+struct FanoutShared {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    uint8_t* ring;
+    size_t ring_sz, buf_sz;
+
+    /* Number of bytes read from the input */
+    uint64_t head;
+
+    /* Set by the main thread once the input has been fully read, or on error */
+    bool finished, aborted;
+
+    struct FanoutReceiver* receivers;
+    size_t receiver_count;
+};
+
+struct FanoutReceiver {
+    struct FanoutShared* shared;
+    pthread_t thread;
+    bool thread_started;
+
+    const char* host;
+    const char* port;
+    int sockfd;
+
+    /* Number of bytes sent to this receiver */
+    uint64_t pos;
+
+    /* Cleared once it fails or it's dropped, so nobody waits for it */
+    bool active;
+};
+
+/*----------------------------------------------------------------------------*/
+
+/*
+ * Return the position of the slowest active receiver, or `head' if there are
+ * none. The lock must be held.
+ */
+static uint64_t slowest_pos(const struct FanoutShared* shared) {
+    uint64_t result = shared->head;
+    for (size_t i = 0; i < shared->receiver_count; i++) {
+        const struct FanoutReceiver* receiver = &shared->receivers[i];
+        if (receiver->active && receiver->pos < result)
+            result = receiver->pos;
+    }
+    return result;
+}
+
+static size_t active_count(const struct FanoutShared* shared) {
+    size_t result = 0;
+    for (size_t i = 0; i < shared->receiver_count; i++)
+        if (shared->receivers[i].active)
+            result++;
+    return result;
+}
+
+/*
+ * Drop the receivers that are a full ring behind the fastest one, so the main
+ * thread can keep reading. If the ring is full just because we read faster than
+ * all of them, nobody is dropped. The sockets of the dropped receivers are shut
+ * down, so their sender threads return from any send in progress. Returns true
+ * if any receiver was dropped. The lock must be held.
+ */
+static bool drop_slowest(struct FanoutShared* shared) {
+    uint64_t fastest = 0;
+    for (size_t i = 0; i < shared->receiver_count; i++) {
+        const struct FanoutReceiver* receiver = &shared->receivers[i];
+        if (receiver->active && receiver->pos > fastest)
+            fastest = receiver->pos;
+    }
+
+    bool dropped = false;
+    for (size_t i = 0; i < shared->receiver_count; i++) {
+        struct FanoutReceiver* receiver = &shared->receivers[i];
+        if (!receiver->active || fastest - receiver->pos < shared->ring_sz)
+            continue;
+
+        ERR("Dropping the receiver at '%s', which fell %zu bytes behind.",
+            receiver->host,
+            shared->ring_sz);
+        receiver->active = false;
+        shutdown(receiver->sockfd, SHUT_RDWR);
+        dropped = true;
+    }
+
+    if (dropped)
+        pthread_cond_broadcast(&shared->cond);
+    return dropped;
+}
+
+/*
+ * Main function of the sender threads. Sends the data in the ring to its
+ * receiver, as it becomes available, until the input is finished.
+ */
+static void* sender_main(void* arg) {
+    struct FanoutReceiver* receiver = arg;
+    struct FanoutShared* shared     = receiver->shared;
+
+    pthread_mutex_lock(&shared->lock);
+    for (;;) {
+        while (receiver->active && !shared->aborted && !shared->finished &&
+               receiver->pos == shared->head)
+            pthread_cond_wait(&shared->cond, &shared->lock);
+        if (!receiver->active || shared->aborted ||
+            receiver->pos == shared->head)
+            break;
+
+        /*
+         * Send a single block at a time, so the position is updated often, and
+         * the main thread can reuse the ring as soon as possible.
+         */
+        const size_t offset = receiver->pos % shared->ring_sz;
+        size_t len          = shared->head - receiver->pos;
+        if (len > shared->ring_sz - offset)
+            len = shared->ring_sz - offset;
+        if (len > shared->buf_sz)
+            len = shared->buf_sz;
+        pthread_mutex_unlock(&shared->lock);
+
+        const bool sent = io_send_all(receiver->sockfd,
+                                      &shared->ring[offset],
+                                      len);
+        const int send_errno = errno;
+
+        pthread_mutex_lock(&shared->lock);
+        if (!sent) {
+            if (receiver->active && !shared->aborted)
+                ERR("Send error to '%s': %s",
+                    receiver->host,
+                    strerror(send_errno));
+            receiver->active = false;
+            pthread_cond_broadcast(&shared->cond);
+            break;
+        }
+
+        receiver->pos += len;
+        update_progress(slowest_pos(shared));
+        pthread_cond_broadcast(&shared->cond);
+    }
+    pthread_mutex_unlock(&shared->lock);
+
+    return NULL;
+}
+
+/*
+ * Read the input into the ring, until EOF, an error, or until there are no
+ * active receivers left. Returns false on error, after printing it.
+ */
+static bool read_input(struct FanoutShared* shared, int src_fd) {
+    for (;;) {
+        pthread_mutex_lock(&shared->lock);
+
+        /*
+         * Wait until there is free space in the ring. Since this is the main
+         * thread, we need to check `g_signaled_quit' periodically.
+         */
+        uint64_t slowest = slowest_pos(shared);
+        while (shared->head - slowest >= shared->ring_sz && !g_signaled_quit) {
+            if (g_opt_fanout_policy != FANOUT_POLICY_DROP ||
+                !drop_slowest(shared))
+                cond_wait_briefly(&shared->cond, &shared->lock);
+            slowest = slowest_pos(shared);
+        }
+
+        if (g_signaled_quit || active_count(shared) == 0) {
+            pthread_mutex_unlock(&shared->lock);
+            return true;
+        }
+
+        const size_t offset = shared->head % shared->ring_sz;
+        size_t len          = shared->ring_sz - (shared->head - slowest);
+        if (len > shared->ring_sz - offset)
+            len = shared->ring_sz - offset;
+        if (len > shared->buf_sz)
+            len = shared->buf_sz;
+        pthread_mutex_unlock(&shared->lock);
+
+        const uint64_t start   = stats_start_call(STATS_CALL_READ);
+        const ssize_t received = read(src_fd, &shared->ring[offset], len);
+        stats_end_call(STATS_CALL_READ, STATS_WAIT_IO, start, received);
+        if (received < 0) {
+            if (errno == EINTR)
+                continue;
+
+            ERR("Read error: %s", strerror(errno));
+            return false;
+        }
+        if (received == 0)
+            return true;
+
+        pthread_mutex_lock(&shared->lock);
+        shared->head += received;
+        pthread_cond_broadcast(&shared->cond);
+        pthread_mutex_unlock(&shared->lock);
+    }
+}
+
+/*
+ * Connect to each of the hosts in the comma-separated `destinations' list,
+ * filling the `receivers' array, which has room for all of them. Each host can
+ * be followed by a colon and its own port, unless it's an IPv6 address, which
+ * always uses the default `port'. Receivers that can't be reached are left
+ * inactive. Returns the number of receivers.
+ */
+static size_t connect_receivers(char* destinations,
+                                const char* port,
+                                size_t buf_sz,
+                                struct FanoutReceiver* receivers) {
+    size_t count = 0;
+    char* saveptr;
+    for (char* host = strtok_r(destinations, ",", &saveptr); host != NULL;
+         host       = strtok_r(NULL, ",", &saveptr)) {
+        struct FanoutReceiver* receiver = &receivers[count++];
+        receiver->host                  = host;
+        receiver->port                  = net_split_port(host, port);
+
+        receiver->sockfd = net_connect(receiver->host, receiver->port);
+        if (receiver->sockfd < 0)
+            continue;
+        receiver->active = true;
+        stats_watch_connection(receiver->sockfd);
+
+        struct NetTuning tuning;
+        net_tune(receiver->sockfd, true, 1, buf_sz, &tuning);
+        if (g_opt_print_peer_info) {
+            print_separator(stderr);
+            fprintf(stderr,
+                    "Connected to '%s', port '%s'.\n",
+                    receiver->host,
+                    receiver->port);
+            net_print_tuning(stderr, true, &tuning);
+            print_separator(stderr);
+        }
+    }
+
+    return count;
+}
+
+/*----------------------------------------------------------------------------*/
+
+bool fanout_transmit(int src_fd,
+                     const char* destinations,
+                     const char* port,
+                     size_t buf_sz,
+                     size_t* total) {
+    bool result = true;
+
+    struct FanoutShared shared;
+    memset(&shared, 0, sizeof(shared));
+    pthread_mutex_init(&shared.lock, NULL);
+    pthread_cond_init(&shared.cond, NULL);
+
+    /*
+     * The ring needs room for at least one block, no matter the policy.
+     */
+    shared.buf_sz  = buf_sz;
+    shared.ring_sz = (g_opt_fanout_policy == FANOUT_POLICY_BLOCK)
+                       ? FANOUT_BLOCK_BUFFER_SZ
+                       : g_opt_fanout_buffer;
+    if (shared.ring_sz < buf_sz)
+        shared.ring_sz = buf_sz;
+
+    /* The list is split in place, so make a copy */
+    char* hosts = strdup(destinations);
+    if (hosts == NULL) {
+        ERR("Failed to allocate %zu bytes: %s",
+            strlen(destinations) + 1,
+            strerror(errno));
+        result = false;
+        goto cleanup;
+    }
+
+    size_t max_count = 1;
+    for (const char* p = destinations; *p != '\0'; p++)
+        if (*p == ',')
+            max_count++;
+
+    shared.receivers = calloc(max_count, sizeof(struct FanoutReceiver));
+    shared.ring      = malloc(shared.ring_sz);
+    if (shared.receivers == NULL || shared.ring == NULL) {
+        ERR("Failed to allocate the fan-out buffer: %s", strerror(errno));
+        result = false;
+        goto cleanup;
+    }
+
+    for (size_t i = 0; i < max_count; i++) {
+        shared.receivers[i].shared = &shared;
+        shared.receivers[i].sockfd = -1;
+    }
+
+    shared.receiver_count =
+      connect_receivers(hosts, port, buf_sz, shared.receivers);
+    if (active_count(&shared) < shared.receiver_count)
+        result = false;
+    if (active_count(&shared) == 0) {
+        ERR("Could not connect to any receiver.");
+        goto cleanup;
+    }
+
+    for (size_t i = 0; i < shared.receiver_count; i++) {
+        struct FanoutReceiver* receiver = &shared.receivers[i];
+        if (!receiver->active)
+            continue;
+
+        if (!create_worker_thread(&receiver->thread, sender_main, receiver)) {
+            ERR("Could not create sender thread: %s", strerror(errno));
+            result = false;
+            goto cleanup;
+        }
+        receiver->thread_started = true;
+    }
+
+    const bool read_ok = read_input(&shared, src_fd);
+
+    /*
+     * Let the senders finish sending the rest of the ring, unless we are
+     * stopping early, in which case they are woken up from their sends.
+     */
+    pthread_mutex_lock(&shared.lock);
+    shared.finished = true;
+    shared.aborted  = !read_ok || g_signaled_quit;
+    pthread_cond_broadcast(&shared.cond);
+    pthread_mutex_unlock(&shared.lock);
+
+    if (!read_ok)
+        result = false;
+
+cleanup:
+    if (shared.receivers != NULL) {
+        /* If we didn't reach the end of the input, stop the senders */
+        pthread_mutex_lock(&shared.lock);
+        if (!shared.finished)
+            shared.aborted = true;
+        pthread_cond_broadcast(&shared.cond);
+        pthread_mutex_unlock(&shared.lock);
+
+        for (size_t i = 0; i < shared.receiver_count; i++) {
+            struct FanoutReceiver* receiver = &shared.receivers[i];
+            if (receiver->thread_started) {
+                if (shared.aborted)
+                    shutdown(receiver->sockfd, SHUT_RDWR);
+                pthread_join(receiver->thread, NULL);
+            }
+
+            /* A receiver that stopped before the end failed */
+            if (!shared.aborted && receiver->pos < shared.head)
+                result = false;
+
+            if (receiver->sockfd > -1) {
+                stats_sample_connection(receiver->sockfd);
+                stats_unwatch_connection(receiver->sockfd);
+                close(receiver->sockfd);
+            }
+        }
+    }
+
+    *total = shared.head;
+
+    free(shared.ring);
+    free(shared.receivers);
+    free(hosts);
+    pthread_cond_destroy(&shared.cond);
+    pthread_mutex_destroy(&shared.lock);
+    return result;
+}
@@ -22,6 +22,14 @@
 #include <stdbool.h>
 #include <stddef.h>
 
+#include "fanout.h" /* EFanoutPolicy */
+
+/*
+ * Maximum flush timeout of '--low-latency', in microseconds. Waiting any longer
+ * for more input would defeat the purpose of the option.
+ */
+#define ARGS_MAX_FLUSH_TIMEOUT 1000000
+
 /*
  * Available program modes, used in 'Args.mode'.
  */
@@ -42,9 +50,73 @@ struct Args {
     /* Optional arguments */
     const char* port;
     bool print_interfaces, print_peer_info, print_progress;
+    size_t streams;
+    size_t pipeline_depth;
+    bool compress, compress_auto;
+    bool checksum;
+    bool resume;
+    bool zerocopy;
+    const char* input;
+    const char* output;
+    bool direct;
+
+    /* The target rate of `tune' is in bits per second */
+    bool tune;
+    double tune_rate;
+    size_t socket_buffer;
+    size_t notsent_lowat;
+
+    /* The `flush_timeout' of `low_latency' is in microseconds */
+    bool low_latency;
+    size_t flush_timeout;
+
+    /* When `stats' is set, `stats_file' is only used if not NULL */
+    bool stats, stats_json;
+    const char* stats_file;
+
+    bool duplex;
+    bool shm;
+
+    /* When receiving, only used if not NULL */
+    const char* forward;
+
+    /*
+     * The `multicast_group' is only used when receiving, the `rate' is in bits
+     * per second (zero for the default), and the `simulate_delay' is in
+     * milliseconds.
+     */
+    bool multicast;
+    const char* multicast_group;
+    const char* multicast_interface;
+    size_t fec;
+    bool udp;
+    double rate;
+    double simulate_loss;
+    size_t simulate_delay;
+
+    /* When transmitting to several destinations */
+    enum EFanoutPolicy fanout_policy;
+    size_t fanout_buffer;
+
+    /* When transmitting, `bench_seconds' is only used if non-zero */
+    bool bench;
+    size_t bench_size;
+    double bench_seconds;
+
+    /* When receiving, `connection_buffer' is only used if non-zero */
+    bool server;
+    const char* output_template;
+    size_t max_connections;
+    size_t connection_buffer;
+    size_t workers;
+
+#ifndef NO_IO_URING
+    bool io_uring;
+#endif
 
 #ifndef FIXED_BLOCK_SIZE
     size_t block_size;
+    bool block_size_set;
 #endif
 
     /* Only set if 'mode' is 'ARGS_MODE_TRANSMIT' */
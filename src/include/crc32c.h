@@ -0,0 +1,42 @@
+/*
+ * Copyright 2025 8dcc
+ *
+ * This file is part of snc (Simple NetCat).
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CRC32C_H_
+#define CRC32C_H_ 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Update the CRC-32C (Castagnoli) checksum `crc' with `data_sz' bytes from
+ * `data', and return the new checksum. The initial value should be zero, just
+ * like with zlib's crc32(3).
+ *
+ * The implementation is selected at runtime: if the CPU supports SSE4.2, its
+ * 'crc32' instruction is used. Otherwise, a portable table-driven version is
+ * used.
+ */
+uint32_t crc32c_update(uint32_t crc, const void* data, size_t data_sz);
+
+/*
+ * Return a short name of the implementation used by `crc32c_update', for
+ * printing.
+ */
+const char* crc32c_impl_name(void);
+
+#endif /* CRC32C_H_ */
@@ -0,0 +1,128 @@
+/*
+ * Copyright 2025 8dcc
+ *
+ * This file is part of snc (Simple NetCat).
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef DGRAM_H_
+#define DGRAM_H_ 1
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <netinet/in.h> /* sockaddr_in */
+
+/*
+ * Helpers shared by the datagram transports, '--multicast' and '--udp'.
+ *
+ * Every datagram starts with a 4-byte magic, followed by the rest of the
+ * common header, all in big-endian. The transports can append their own
+ * members after it.
+ */
+#define DGRAM_MAGIC_SZ  4
+#define DGRAM_HEADER_SZ 16
+
+/* Maximum number of datagrams sent at once after a pause */
+#define DGRAM_MAX_BURST 16
+
+/*
+ * Common header of the datagrams. The meaning of `seq' and `len' depends on
+ * the `type', and the meaning of `param' on the transport.
+ */
+struct DgramHeader {
+    uint32_t session;
+    uint32_t seq;
+    uint8_t type;
+    uint8_t param;
+    uint16_t len;
+};
+
+/*
+ * Pacing of the datagrams of a transmitter, which can't be sent faster than
+ * its `rate', in bits per second.
+ */
+struct DgramPacer {
+    double rate;
+    uint64_t interval_ns, next_ns;
+};
+
+/*
+ * Transfer accepted by a receiver. Only the datagrams of the first transfer
+ * that arrives are accepted, so a late datagram of a previous transfer, or one
+ * from a different transmitter, can't corrupt the output.
+ */
+struct DgramLock {
+    bool locked;
+    uint32_t session;
+};
+
+enum EDgramLock {
+    DGRAM_LOCK_NEW,
+    DGRAM_LOCK_SAME,
+    DGRAM_LOCK_OTHER,
+};
+
+/*----------------------------------------------------------------------------*/
+
+/*
+ * Write the `magic' and the common `header' into the first `DGRAM_HEADER_SZ'
+ * bytes of `buf'.
+ */
+void dgram_put_header(uint8_t* buf,
+                      const char* magic,
+                      const struct DgramHeader* header);
+
+/*
+ * Read the common `header' from the `buf_sz' bytes of `buf'. Returns false if
+ * it's too short, or if it doesn't start with `magic'.
+ */
+bool dgram_get_header(const uint8_t* buf,
+                      size_t buf_sz,
+                      const char* magic,
+                      struct DgramHeader* header);
+
+/*
+ * Send the `packet_sz' bytes of `packet' as a single datagram through the
+ * connected socket `sockfd'. A datagram that the kernel can't queue is simply
+ * lost, like any other, so it's not an error. Returns false on error, after
+ * printing it.
+ */
+bool dgram_send(int sockfd, const void* packet, size_t packet_sz);
+
+/*
+ * Set the `rate' of the pacer, for datagrams of `datagram_sz' bytes.
+ */
+void dgram_pacer_set_rate(struct DgramPacer* pacer,
+                          double rate,
+                          size_t datagram_sz);
+
+/*
+ * Schedule the next datagram after one that is being sent `now'.
+ */
+void dgram_pacer_advance(struct DgramPacer* pacer, uint64_t now);
+
+/*
+ * Check if a datagram of `session', sent from `from', belongs to the transfer
+ * accepted by the receiver. The first one locks the receiver to its transfer,
+ * and if '--print-peer-info' was used, the sender is printed along with the
+ * name of the `transport'.
+ */
+enum EDgramLock dgram_lock(struct DgramLock* lock,
+                           uint32_t session,
+                           const struct sockaddr_in* from,
+                           const char* transport);
+
+#endif /* DGRAM_H_ */
@@ -0,0 +1,46 @@
+/*
+ * Copyright 2025 8dcc
+ *
+ * This file is part of snc (Simple NetCat).
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef DUPLEX_H_
+#define DUPLEX_H_ 1
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Relay the data in both directions at the same time: from `src_fd' to the
+ * connected socket `sockfd', and from `sockfd' to `dst_fd'. The descriptors
+ * are made non-blocking, and a single thread waits for all of them with
+ * poll(2), so a direction that is idle or blocked never stalls the other one.
+ * Each direction uses its own buffer of `buf_sz' bytes.
+ *
+ * When `src_fd' reaches EOF and all of its data was sent, the sending side of
+ * the socket is shut down, so the peer receives EOF while it can still reply.
+ * The relay ends once both directions reached EOF, and the original flags of
+ * the descriptors are restored.
+ *
+ * The number of bytes moved in both directions is added to `total', and the
+ * progress is updated. Returns false on error, after printing it.
+ */
+bool duplex_relay(int sockfd,
+                  int src_fd,
+                  int dst_fd,
+                  size_t buf_sz,
+                  size_t* total);
+
+#endif /* DUPLEX_H_ */
@@ -0,0 +1,69 @@
+/*
+ * Copyright 2025 8dcc
+ *
+ * This file is part of snc (Simple NetCat).
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef FANOUT_H_
+#define FANOUT_H_ 1
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Default size of the buffer shared by all the receivers of a fan-out, that is,
+ * how far behind the fastest receiver the slowest one can fall with the
+ * `FANOUT_POLICY_BUFFER' and `FANOUT_POLICY_DROP' policies. With
+ * `FANOUT_POLICY_BLOCK', the buffer is only `FANOUT_BLOCK_BUFFER_SZ' bytes.
+ */
+#define FANOUT_DEFAULT_BUFFER_SZ (64 * 1024 * 1024)
+#define FANOUT_BLOCK_BUFFER_SZ   (1024 * 1024)
+
+/*
+ * What to do when a receiver falls so far behind that the shared buffer is
+ * full. See '--slow-receiver'.
+ */
+enum EFanoutPolicy {
+    FANOUT_POLICY_BLOCK,  /* Wait for it, with a small buffer */
+    FANOUT_POLICY_BUFFER, /* Wait for it, once it's the buffer behind */
+    FANOUT_POLICY_DROP,   /* Disconnect it, and continue with the rest */
+};
+
+/*----------------------------------------------------------------------------*/
+
+/*
+ * Transmit all the data from `src_fd' to each of the receivers in the
+ * comma-separated list of `destinations'. Each of them can specify its own port
+ * after a colon, e.g. "host:port"; otherwise, `port' is used.
+ *
+ * The input is only read once, in blocks of up to `buf_sz' bytes, into a
+ * buffer shared by all the receivers. Each receiver has its own sender thread,
+ * which sends the data at its own pace, so the memory usage doesn't depend on
+ * the number of receivers. Slow receivers are handled according to
+ * `g_opt_fanout_policy'.
+ *
+ * A receiver that can't be reached, that fails or that is dropped doesn't stop
+ * the transfer to the rest. The number of bytes read from the input is stored
+ * in `total', and the progress shows the bytes sent to all the receivers.
+ * Returns false if the transfer failed for any of the receivers, after printing
+ * the errors.
+ */
+bool fanout_transmit(int src_fd,
+                     const char* destinations,
+                     const char* port,
+                     size_t buf_sz,
+                     size_t* total);
+
+#endif /* FANOUT_H_ */
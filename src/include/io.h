@@ -0,0 +1,71 @@
+/*
+ * Copyright 2025 8dcc
+ *
+ * This file is part of snc (Simple NetCat).
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef IO_H_
+#define IO_H_ 1
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h> /* ssize_t */
+
+/*
+ * Kinds of file descriptors, as returned by `io_fd_type'. Used for choosing the
+ * cheapest kernel path when moving data from or to a descriptor.
+ */
+enum EIoFdType {
+    IO_FD_OTHER,
+    IO_FD_REGULAR,
+    IO_FD_PIPE,
+    IO_FD_SOCKET,
+};
+
+/*----------------------------------------------------------------------------*/
+
+/*
+ * Return the type of the specified file descriptor. Returns `IO_FD_OTHER' if
+ * the type is unknown or if it couldn't be obtained.
+ */
+enum EIoFdType io_fd_type(int fd);
+
+/*
+ * Read from `fd' into `buf' until `buf_sz' bytes have been read or until EOF is
+ * reached, retrying on short reads and on `EINTR'. Returns the number of bytes
+ * read, which is only smaller than `buf_sz' on EOF (or if the user signaled
+ * that he wants to quit), or -1 on error, with `errno' set.
+ */
+ssize_t io_read_full(int fd, void* buf, size_t buf_sz);
+
+/*
+ * Receive from the connected socket `sockfd' into `buf', just like
+ * `io_read_full' reads from a descriptor.
+ */
+ssize_t io_recv_full(int sockfd, void* buf, size_t buf_sz);
+
+/*
+ * Write all `data_sz' bytes from `data' into the file descriptor `fd', retrying
+ * on short writes and on `EINTR'. Returns false on error, with `errno' set.
+ */
+bool io_write_all(int fd, const void* data, size_t data_sz);
+
+/*
+ * Send all `data_sz' bytes from `data' through the socket `sockfd', retrying on
+ * short sends and on `EINTR'. Returns false on error, with `errno' set.
+ */
+bool io_send_all(int sockfd, const void* data, size_t data_sz);
+
+#endif /* IO_H_ */
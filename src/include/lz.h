@@ -0,0 +1,71 @@
+/*
+ * Copyright 2025 8dcc
+ *
+ * This file is part of snc (Simple NetCat).
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef LZ_H_
+#define LZ_H_ 1
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Number of bits used for indexing the hash table of the compressor. Bigger
+ * tables find more matches, but take longer to clear for each block.
+ */
+#define LZ_HASH_BITS 12
+
+/*
+ * State used by `lz_compress'. It can be reused for any number of blocks, but
+ * not by multiple threads at the same time.
+ */
+struct LzState {
+    uint32_t table[1 << LZ_HASH_BITS];
+};
+
+/*----------------------------------------------------------------------------*/
+
+/*
+ * Compress the `src_sz' bytes in `src' into the `dst' buffer, of `dst_sz'
+ * bytes, using the LZ4 block format. Each block is compressed independently.
+ *
+ * Returns the size of the compressed data, or zero if it doesn't fit in
+ * `dst_sz' bytes. Callers can pass a `dst_sz' smaller than `src_sz' for
+ * giving up as soon as the data doesn't shrink.
+ */
+size_t lz_compress(struct LzState* state,
+                   const uint8_t* src,
+                   size_t src_sz,
+                   uint8_t* dst,
+                   size_t dst_sz);
+
+/*
+ * Decompress the `src_sz' bytes in `src' (in the format produced by
+ * `lz_compress') into the `dst' buffer, of `dst_sz' bytes. The size of the
+ * decompressed data is stored in `out_sz'.
+ *
+ * Returns false if the compressed data is invalid, or if it doesn't fit in
+ * `dst_sz' bytes. The input is never trusted, so this function never reads or
+ * writes out of bounds.
+ */
+bool lz_decompress(const uint8_t* src,
+                   size_t src_sz,
+                   uint8_t* dst,
+                   size_t dst_sz,
+                   size_t* out_sz);
+
+#endif /* LZ_H_ */
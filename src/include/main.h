@@ -22,15 +22,61 @@
 #include <stdbool.h>
 #include <stddef.h>
 
+#include "fanout.h" /* EFanoutPolicy */
+
 /*
  * Globals for program arguments.
  */
 extern bool g_opt_print_interfaces;
 extern bool g_opt_print_peer_info;
 extern bool g_opt_print_progress;
+extern size_t g_opt_streams;
+extern size_t g_opt_pipeline_depth;
+extern bool g_opt_compress;
+extern bool g_opt_compress_auto;
+extern bool g_opt_checksum;
+extern bool g_opt_resume;
+extern bool g_opt_zerocopy;
+extern const char* g_opt_input;
+extern const char* g_opt_output;
+extern bool g_opt_direct;
+extern bool g_opt_tune;
+extern double g_opt_tune_rate;
+extern size_t g_opt_socket_buffer;
+extern size_t g_opt_notsent_lowat;
+extern bool g_opt_low_latency;
+extern size_t g_opt_flush_timeout;
+extern bool g_opt_stats;
+extern bool g_opt_stats_json;
+extern const char* g_opt_stats_file;
+extern bool g_opt_duplex;
+extern bool g_opt_shm;
+extern const char* g_opt_forward;
+extern bool g_opt_multicast;
+extern const char* g_opt_multicast_group;
+extern const char* g_opt_multicast_interface;
+extern size_t g_opt_fec;
+extern bool g_opt_udp;
+extern double g_opt_rate;
+extern double g_opt_simulate_loss;
+extern size_t g_opt_simulate_delay;
+extern enum EFanoutPolicy g_opt_fanout_policy;
+extern size_t g_opt_fanout_buffer;
+extern bool g_opt_bench;
+extern size_t g_opt_bench_size;
+extern double g_opt_bench_seconds;
+extern const char* g_opt_output_template;
+extern size_t g_opt_max_connections;
+extern size_t g_opt_connection_buffer;
+extern size_t g_opt_workers;
+
+#ifndef NO_IO_URING
+extern bool g_opt_io_uring;
+#endif /* NO_IO_URING */
 
 #ifndef FIXED_BLOCK_SIZE
 extern size_t g_opt_block_size;
+extern bool g_opt_tune_block_size;
 #endif /* FIXED_BLOCK_SIZE */
 
 /*
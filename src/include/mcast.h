@@ -0,0 +1,112 @@
+/*
+ * Copyright 2025 8dcc
+ *
+ * This file is part of snc (Simple NetCat).
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef MCAST_H_
+#define MCAST_H_ 1
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "dgram.h" /* DGRAM_HEADER_SZ */
+
+/*
+ * In multicast mode, the input is split into numbered datagrams of up to
+ * `MCAST_PAYLOAD_SZ' bytes, each with a `MCAST_HEADER_SZ' header, so they fit
+ * in the usual Ethernet MTU. All integers are sent in big-endian.
+ *
+ * After every group of '--fec' data datagrams, the transmitter sends a parity
+ * datagram with the XOR of all of them, so a receiver can rebuild a single
+ * lost datagram of each group on its own. Once the input ends, the transmitter
+ * keeps announcing the number of datagrams, and serves repairs of anything
+ * else through a TCP connection to the same port, until no receiver has asked
+ * for them in `MCAST_LINGER_MS' milliseconds.
+ */
+#define MCAST_MAGIC       "SNCM"
+#define MCAST_HEADER_SZ   DGRAM_HEADER_SZ
+#define MCAST_PAYLOAD_SZ  1400
+#define MCAST_DEFAULT_FEC 8
+#define MCAST_MAX_FEC     255
+
+/*
+ * Default rate of the transmitter, in bits per second. Multicast has no
+ * congestion control, so the datagrams are always paced.
+ */
+#define MCAST_DEFAULT_RATE 100e6
+
+/*
+ * Number of datagrams a receiver can hold while waiting for a missing one.
+ * Anything further ahead is dropped, and repaired later.
+ */
+#define MCAST_WINDOW 8192
+
+/*
+ * A datagram is considered lost, and its repair is requested, once this many
+ * datagrams after its parity group were received.
+ */
+#define MCAST_REPAIR_LAG 64
+
+/*
+ * Timing of the end of the transfer: the transmitter announces the end every
+ * `MCAST_END_INTERVAL_MS', and stops once no receiver asked for repairs in
+ * `MCAST_LINGER_MS'. A receiver gives up if nothing arrives in
+ * `MCAST_TIMEOUT_MS' once the transfer started.
+ */
+#define MCAST_END_INTERVAL_MS 100
+#define MCAST_LINGER_MS       1000
+#define MCAST_TIMEOUT_MS      10000
+
+/* Maximum number of receivers asking for repairs at the same time */
+#define MCAST_MAX_REPAIR_CLIENTS 256
+
+/*----------------------------------------------------------------------------*/
+
+/*
+ * Transmit all the data from `src_fd' to the multicast `group', with UDP
+ * datagrams sent to `port' at the rate of '--rate', and listening on the same
+ * TCP port for repair requests.
+ *
+ * The data is kept in memory (or mapped, if the input is a regular file) until
+ * the end of the transfer, since any part of it might need to be repaired. The
+ * number of bytes sent is stored in `total', and the progress is updated.
+ * Returns false on error, after printing it.
+ */
+bool mcast_transmit(int src_fd,
+                    const char* group,
+                    const char* port,
+                    size_t* total);
+
+/*
+ * Join the multicast `group' on `port', and write the data of the first
+ * transfer received from it into `dst_fd', in order. Lost datagrams are
+ * rebuilt from the parity datagrams if possible, and otherwise requested to
+ * the transmitter through TCP.
+ *
+ * If '--simulate-loss' or '--simulate-delay' were used, the datagrams go
+ * through the simulator on arrival. The number of bytes written is stored in
+ * `total', and the progress is updated. The number of datagrams rebuilt from
+ * the parity, and the number of them repaired through TCP, are stored in
+ * `recovered' and `repaired'. Returns false on error, after printing it.
+ */
+bool mcast_receive(const char* group,
+                   const char* port,
+                   int dst_fd,
+                   size_t* total,
+                   size_t* recovered,
+                   size_t* repaired);
+
+#endif /* MCAST_H_ */
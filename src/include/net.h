@@ -0,0 +1,145 @@
+/*
+ * Copyright 2025 8dcc
+ *
+ * This file is part of snc (Simple NetCat).
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef NET_H_
+#define NET_H_ 1
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/socket.h> /* sockaddr_storage */
+
+/*
+ * Maximum number of connections that the receiver can wait for, when it only
+ * accepts one of them. See the second parameter of listen(2).
+ */
+#define SNC_LISTEN_QUEUE_SZ 10
+
+/*
+ * Limits used by `net_tune'. The socket buffers are never grown past
+ * `NET_TUNE_MAX_BUFFER', and the block size is kept between
+ * `NET_TUNE_MIN_BLOCK' and `NET_TUNE_MAX_BLOCK'. The not-sent low-water mark
+ * is at least `NET_TUNE_MIN_LOWAT'.
+ */
+#define NET_TUNE_MAX_BUFFER (256 * 1024 * 1024)
+#define NET_TUNE_MIN_BLOCK  (4 * 1024)
+#define NET_TUNE_MAX_BLOCK  (1024 * 1024)
+#define NET_TUNE_MIN_LOWAT  (128 * 1024)
+
+/*
+ * Time, in microseconds, that a receiving socket busy-polls the device queue
+ * for new packets before sleeping, in low-latency mode.
+ */
+#define NET_BUSY_POLL_US 50
+
+/*
+ * Values chosen by `net_tune' for a connection.
+ */
+struct NetTuning {
+    /* Smoothed RTT measured by the kernel, in microseconds, or zero */
+    uint32_t rtt_us;
+
+    /* Size of the buffer in the direction of the data, as used by the kernel */
+    int buffer_sz;
+
+    /* Value of `TCP_NOTSENT_LOWAT' when transmitting, or zero if not set */
+    int notsent_lowat;
+
+    /* Block size that should be used for the connection */
+    size_t block_sz;
+
+    /* Whether the socket was set up with `net_set_low_latency' */
+    bool low_latency;
+};
+
+/*----------------------------------------------------------------------------*/
+
+/*
+ * Create a TCP socket, bind it to the local `port', and start listening for
+ * incoming connections, queueing up to `backlog' of them. If `reuse_port' is
+ * true, the socket is created with `SO_REUSEPORT', so more sockets can listen
+ * on the same port. Returns the listening socket descriptor, or -1 on error,
+ * after printing it.
+ *
+ * The format of the `port' argument should match any valid input for
+ * `getaddrinfo'. If it's not numeric, it should appear in the "/etc/services"
+ * file.
+ */
+int net_listen(const char* port, int backlog, bool reuse_port);
+
+/*
+ * Accept an incoming connection from the `sockfd_listen' socket, and store the
+ * peer information in `peer_addr' (which can't be NULL). Returns the new
+ * connection socket descriptor, or -1 on error, after printing it.
+ */
+int net_accept(int sockfd_listen, struct sockaddr_storage* peer_addr);
+
+/*
+ * Create a TCP socket and connect it to the specified `port' at `host'. Returns
+ * the connected socket descriptor, or -1 on error, after printing it.
+ *
+ * Just like in `net_listen', the format of the `host' and `port' arguments
+ * should match any valid input for `getaddrinfo'.
+ */
+int net_connect(const char* host, const char* port);
+
+/*
+ * Split the port from a `destination' with the format 'host[:port]', replacing
+ * the colon with a null terminator. If there is no port, or if the destination
+ * is an IPv6 address (which contains more than one colon), `default_port' is
+ * returned instead.
+ */
+const char* net_split_port(char* destination, const char* default_port);
+
+/*
+ * Set up the connected socket `sockfd', which is used for `transmitting' or
+ * receiving data, for delivering small writes as soon as possible. Nagle's
+ * algorithm is disabled, and when receiving, the socket busy-polls for up to
+ * `NET_BUSY_POLL_US' microseconds before sleeping. Errors are ignored, since
+ * busy polling might need `CAP_NET_ADMIN'.
+ */
+void net_set_low_latency(int sockfd, bool transmitting);
+
+/*
+ * Tune the connected socket `sockfd', which is used for `transmitting' or
+ * receiving data, as one of `stream_count' parallel connections. The results
+ * are stored in `tuning'.
+ *
+ * The sizes set with '--socket-buffer' and '--notsent-lowat' are always used.
+ * With '--tune', the buffer is grown to twice the bandwidth-delay product,
+ * based on the RTT of the handshake and the target rate. Unless it was set
+ * explicitly, the block size is also adjusted to the product, starting from
+ * `block_sz'. With '--low-latency', the socket is also set up with
+ * `net_set_low_latency'. Errors are ignored, since the defaults still work.
+ */
+void net_tune(int sockfd,
+              bool transmitting,
+              size_t stream_count,
+              size_t block_sz,
+              struct NetTuning* tuning);
+
+/*
+ * Print the values chosen by `net_tune' into `fp', in a single line.
+ */
+void net_print_tuning(FILE* fp,
+                      bool transmitting,
+                      const struct NetTuning* tuning);
+
+#endif /* NET_H_ */
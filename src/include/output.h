@@ -0,0 +1,78 @@
+/*
+ * Copyright 2025 8dcc
+ *
+ * This file is part of snc (Simple NetCat).
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef OUTPUT_H_
+#define OUTPUT_H_ 1
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Number of bytes written to the output file between each write-behind step.
+ * After each step, the kernel starts writing the last step back to disk, and
+ * we wait until the previous one is written, so dirty pages don't pile up.
+ */
+#define OUTPUT_WRITE_BEHIND_SZ (8 * 1024 * 1024)
+
+/*
+ * Size of the staging buffer used with '--direct', and alignment required for
+ * the offsets, addresses and sizes of the writes.
+ */
+#define OUTPUT_DIRECT_BUF_SZ (4 * 1024 * 1024)
+#define OUTPUT_DIRECT_ALIGN  4096
+
+/*----------------------------------------------------------------------------*/
+
+/*
+ * Start writing a transfer into `fd', at its current position. If the output
+ * was specified with '--output' and it's a regular file, the rest of the
+ * functions in this module handle its preallocation, write-behind and direct
+ * writes; otherwise, they simply write into it.
+ *
+ * If `expected_sz' is not zero, that many bytes are preallocated, without
+ * changing the size of the file. Returns false on error, after printing it.
+ */
+bool output_begin(int fd, uint64_t expected_sz);
+
+/*
+ * Return true if the data is being written with `O_DIRECT', in which case it
+ * can only be written through `output_write'.
+ */
+bool output_is_direct(void);
+
+/*
+ * Write all `data_sz' bytes from `data' into `fd'. If `fd' is the output of
+ * the transfer, the data might be staged until a full aligned block is
+ * available. Returns false on error, with `errno' set.
+ */
+bool output_write(int fd, const void* data, size_t data_sz);
+
+/*
+ * Tell the module that `data_sz' bytes were written into `fd' without using
+ * `output_write', e.g. with splice(2).
+ */
+void output_written(int fd, size_t data_sz);
+
+/*
+ * Write any staged data, and start writing the rest of the file back to disk.
+ * Returns false on error, after printing it.
+ */
+bool output_end(void);
+
+#endif /* OUTPUT_H_ */
@@ -0,0 +1,220 @@
+/*
+ * Copyright 2025 8dcc
+ *
+ * This file is part of snc (Simple NetCat).
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef PROTO_H_
+#define PROTO_H_ 1
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * By default, snc sends the raw input through the socket, so it can talk to
+ * other programs like ncat(1). Some modes, however, need to send additional
+ * information along with the data. In those cases, the transmitter sends a
+ * fixed-size connection header, followed by a list of blocks, each of them
+ * with its own fixed-size block header. All integers are sent in big-endian.
+ *
+ * The connection header starts with a magic value that is very unlikely to
+ * appear at the start of a raw stream, so the receiver can detect the format
+ * without extra arguments. The magic uses the same trick as PNG files: a
+ * non-ASCII first byte, followed by some line endings that would get mangled
+ * by text-mode transfers.
+ */
+#define PROTO_MAGIC           "\x89SNC\r\n\x1a\n"
+#define PROTO_MAGIC_SZ        8
+#define PROTO_VERSION         1
+#define PROTO_HEADER_SZ       32
+#define PROTO_BLOCK_HEADER_SZ 16
+
+/*
+ * Maximum block size accepted by the receiver, to avoid huge allocations when
+ * the header is malformed.
+ */
+#define PROTO_MAX_BLOCK_SZ (256 * 1024 * 1024)
+
+/*
+ * Value of `ProtoHeader.total_sz' when the transmitter doesn't know the size of
+ * its input.
+ */
+#define PROTO_SIZE_UNKNOWN UINT64_MAX
+
+/*
+ * Size of the trailer sent in the payload of `PROTO_BLOCK_END' blocks, if the
+ * `PROTO_FLAG_CHECKSUM' flag is set. It contains the CRC-32C of the whole
+ * transfer.
+ */
+#define PROTO_TRAILER_SZ 4
+
+/*
+ * Flags of the connection header, used in `ProtoHeader.flags'.
+ */
+enum EProtoFlags {
+    /* The `PROTO_BLOCK_END' blocks are followed by a trailer with a checksum */
+    PROTO_FLAG_CHECKSUM = 1 << 0,
+
+    /*
+     * The transmitter wants to resume a previous transfer. The receiver sends
+     * a `ProtoResume' message through the first connection, and the
+     * transmitter answers with another one, before sending any block.
+     */
+    PROTO_FLAG_RESUME = 1 << 1,
+
+    /*
+     * The transmitter offers to send the data through shared memory, since the
+     * receiver is on the same host. The header is followed by the secret of
+     * the offer, and no blocks are sent. See `shm_transmit'.
+     */
+    PROTO_FLAG_SHM = 1 << 2,
+};
+
+/*
+ * Mask with all the flags supported by this version.
+ */
+#define PROTO_FLAGS_KNOWN                                                      \
+    (PROTO_FLAG_CHECKSUM | PROTO_FLAG_RESUME | PROTO_FLAG_SHM)
+
+/*
+ * Size of a `ProtoResume' message.
+ */
+#define PROTO_RESUME_SZ 16
+
+/*
+ * Connection header, sent once at the start of each connection.
+ */
+struct ProtoHeader {
+    uint8_t version;
+    uint8_t flags;
+
+    /* Index of this connection, and total number of parallel connections */
+    uint16_t stream_idx;
+    uint16_t stream_count;
+
+    /* Random value shared by all the connections of the same transfer */
+    uint32_t session;
+
+    /* Maximum size of the payload of each block */
+    uint32_t block_sz;
+
+    /* Total size of the transfer, or `PROTO_SIZE_UNKNOWN' */
+    uint64_t total_sz;
+};
+
+/*
+ * Types of blocks, used in `ProtoBlock.type'.
+ */
+enum EProtoBlockType {
+    /* Block with `len' bytes of data, with sequence number `seq' */
+    PROTO_BLOCK_DATA = 1,
+
+    /*
+     * Last block of a connection. The `seq' is the total number of blocks. Its
+     * payload is either empty or a trailer of `PROTO_TRAILER_SZ' bytes.
+     */
+    PROTO_BLOCK_END = 2,
+};
+
+/*
+ * Encodings of the payload of a block, used in `ProtoBlock.codec'.
+ */
+enum EProtoCodec {
+    /* The payload is the data itself */
+    PROTO_CODEC_RAW = 0,
+
+    /*
+     * The payload was compressed with `lz_compress'. It's only used if the
+     * data shrinks, so `len' is still at most the block size.
+     */
+    PROTO_CODEC_LZ = 1,
+};
+
+/*
+ * Block header, sent before each block. The payload (of `len' bytes) follows
+ * the header.
+ */
+struct ProtoBlock {
+    uint8_t type;
+    uint8_t codec;
+    uint32_t len;
+    uint64_t seq;
+};
+
+/*
+ * Message used for negotiating the offset of a resumed transfer.
+ *
+ * The receiver offers the number of bytes it already has in `offset', along
+ * with the CRC-32C of the last `tail_sz' of them. The transmitter answers with
+ * the `offset' it will start from (either the offered one or zero), and with
+ * the rest of the fields set to zero.
+ */
+struct ProtoResume {
+    uint64_t offset;
+    uint32_t tail_sz;
+    uint32_t tail_checksum;
+};
+
+/*----------------------------------------------------------------------------*/
+
+/*
+ * Check if the data waiting in `sockfd' starts with `PROTO_MAGIC', without
+ * removing it from the socket. Returns false if the peer sent raw data, or if
+ * the connection was closed.
+ *
+ * Note that this function only blocks until the peer sends the first byte,
+ * unless that byte matches the magic.
+ */
+bool proto_detect(int sockfd);
+
+/*
+ * Return a random value for the `ProtoHeader.session' member.
+ */
+uint32_t proto_new_session(void);
+
+/*
+ * Send or receive a connection header through `sockfd'. The received header is
+ * validated, and an error is printed if it's invalid. Both functions return
+ * false on failure.
+ */
+bool proto_send_header(int sockfd, const struct ProtoHeader* header);
+bool proto_recv_header(int sockfd, struct ProtoHeader* header);
+
+/*
+ * Encode or decode a block header into or from `PROTO_BLOCK_HEADER_SZ' bytes.
+ * The decode function returns false if the block is invalid for a connection
+ * with the specified `block_sz'.
+ */
+void proto_encode_block(const struct ProtoBlock* block, void* dst);
+bool proto_decode_block(const void* src,
+                        uint32_t block_sz,
+                        struct ProtoBlock* block);
+
+/*
+ * Encode or decode the `checksum' of a trailer, into or from `PROTO_TRAILER_SZ'
+ * bytes.
+ */
+void proto_encode_trailer(uint32_t checksum, void* dst);
+uint32_t proto_decode_trailer(const void* src);
+
+/*
+ * Send or receive a `ProtoResume' message through `sockfd'. Return false on
+ * error, after printing it.
+ */
+bool proto_send_resume(int sockfd, const struct ProtoResume* resume);
+bool proto_recv_resume(int sockfd, struct ProtoResume* resume);
+
+#endif /* PROTO_H_ */
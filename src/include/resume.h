@@ -0,0 +1,65 @@
+/*
+ * Copyright 2025 8dcc
+ *
+ * This file is part of snc (Simple NetCat).
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef RESUME_H_
+#define RESUME_H_ 1
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h> /* off_t */
+
+/*
+ * Maximum number of bytes at the end of the existing output that are compared
+ * with the input before resuming a transfer.
+ */
+#define RESUME_TAIL_SZ (1024 * 1024)
+
+/*
+ * Number of times the transmitter tries to reconnect after a resumable
+ * transfer is interrupted, and maximum number of seconds it waits between
+ * attempts. The wait starts at one second, and doubles after each attempt.
+ */
+#define RESUME_MAX_RETRIES 8
+#define RESUME_MAX_BACKOFF 32
+
+/*----------------------------------------------------------------------------*/
+
+/*
+ * Negotiate the offset of a resumed transfer from the receiver side, through
+ * the connection `sockfd'.
+ *
+ * If `dst_fd' is a regular file, its size is offered to the transmitter, along
+ * with the checksum of its tail. Once the transmitter answers, the file is
+ * truncated to the accepted offset, which is stored in `offset', and the file
+ * position is moved there. Returns false on error, after printing it.
+ */
+bool resume_offer(int sockfd, int dst_fd, uint64_t* offset);
+
+/*
+ * Negotiate the offset of a resumed transfer from the transmitter side,
+ * through the connection `sockfd'.
+ *
+ * The tail of the output offered by the receiver is compared with the input,
+ * `src_fd', whose offset zero is at `src_base' if it's seekable. If they match,
+ * the input is moved to the offered offset; otherwise, it's moved back to the
+ * start, if possible. The accepted offset is stored in `offset'. Returns false
+ * on error, after printing it.
+ */
+bool resume_answer(int sockfd, int src_fd, off_t src_base, uint64_t* offset);
+
+#endif /* RESUME_H_ */
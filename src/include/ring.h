@@ -0,0 +1,91 @@
+/*
+ * Copyright 2025 8dcc
+ *
+ * This file is part of snc (Simple NetCat).
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef RING_H_
+#define RING_H_ 1
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <semaphore.h>
+
+/*
+ * Single-producer, single-consumer ring of preallocated blocks.
+ *
+ * Each side owns its own index, so the blocks themselves are never locked. The
+ * two semaphores count the free and filled blocks, and they are only used for
+ * sleeping when the ring is full or empty. Since they are implemented with
+ * futexes, the uncontended case doesn't enter the kernel.
+ */
+struct BlockRing {
+    uint8_t* data;
+    size_t* lens;
+    size_t block_sz, depth;
+
+    /* Only accessed by the producer and by the consumer, respectively */
+    size_t head, tail;
+
+    sem_t free_blocks, filled_blocks;
+
+    /* Set by either side to stop the other one */
+    bool aborted;
+};
+
+/*
+ * Maximum number of blocks in a ring. With the default block size, the ring
+ * already holds 16 MiB.
+ */
+#define RING_MAX_DEPTH 4096
+
+/*----------------------------------------------------------------------------*/
+
+/*
+ * Initialize a ring with `depth' blocks of `block_sz' bytes. Returns false on
+ * error, with `errno' set.
+ */
+bool block_ring_init(struct BlockRing* ring, size_t depth, size_t block_sz);
+
+/*
+ * Free all the resources used by the ring.
+ */
+void block_ring_destroy(struct BlockRing* ring);
+
+/*
+ * Wait for a free block, and return a pointer to it. The producer should fill
+ * it, and call `block_ring_push' with the number of bytes it wrote. Returns
+ * NULL if the ring was aborted, or with `errno' set to `EINTR' if the wait was
+ * interrupted by a signal.
+ */
+void* block_ring_acquire_free(struct BlockRing* ring);
+void block_ring_push(struct BlockRing* ring, size_t len);
+
+/*
+ * Wait for a filled block, and return a pointer to it, storing its size in
+ * `len'. The consumer should call `block_ring_pop' once it's done with it.
+ * Returns NULL in the same cases as `block_ring_acquire_free'.
+ */
+const void* block_ring_acquire_filled(struct BlockRing* ring, size_t* len);
+void block_ring_pop(struct BlockRing* ring);
+
+/*
+ * Stop the ring, waking up the other side if it's waiting.
+ */
+void block_ring_abort(struct BlockRing* ring);
+
+#endif /* RING_H_ */
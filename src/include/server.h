@@ -0,0 +1,49 @@
+/*
+ * Copyright 2025 8dcc
+ *
+ * This file is part of snc (Simple NetCat).
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SERVER_H_
+#define SERVER_H_ 1
+
+#include <stdio.h> /* FILE */
+
+/*
+ * Maximum number of connections that each worker keeps open with
+ * '--max-connections'. Each of them needs a descriptor, so this is the usual
+ * limit of open files for a process.
+ */
+#define SERVER_MAX_CONNECTIONS 1048576
+
+/*
+ * Maximum number of workers of '--workers'. Each of them is pinned to a CPU, so
+ * this is the number of CPUs in a `cpu_set_t' (`CPU_SETSIZE').
+ */
+#define SERVER_MAX_WORKERS 1024
+
+/*
+ * Main function for the "receive" mode, when using '--server'.
+ *
+ * Listens on the local `src_port', and keeps accepting connections until the
+ * user quits. The connections are handled concurrently by each worker thread
+ * (see '--workers'), using epoll(7). Each worker is pinned to a CPU, and has
+ * its own listening socket with `SO_REUSEPORT'. The data from each connection
+ * is written into its own file, if an output template was specified; or into
+ * `dst_fp' otherwise, one connection at a time across all workers.
+ */
+void snc_serve(const char* src_port, FILE* dst_fp);
+
+#endif /* SERVER_H_ */
@@ -0,0 +1,84 @@
+/*
+ * Copyright 2025 8dcc
+ *
+ * This file is part of snc (Simple NetCat).
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SHM_H_
+#define SHM_H_ 1
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "proto.h"
+
+/*
+ * In shared memory mode, the transmitter and the receiver share a ring in a
+ * memfd(2), so the data is copied once into it from the input, and once from
+ * it into the output, without going through the socket buffers. Each side
+ * sleeps on its own eventfd(2) when the ring is empty or full, and the other
+ * side only signals it if it's actually sleeping.
+ *
+ * The descriptors are passed through a Unix socket with an abstract address,
+ * which is only reachable from the same host and network namespace. The TCP
+ * connection is only used for the handshake, for telling the transmitter that
+ * the data was received, and for noticing if either side dies.
+ */
+#define SHM_RING_SZ   (8 * 1024 * 1024)
+#define SHM_MAX_CHUNK (1024 * 1024)
+
+/* Size of the random secret that the receiver sends through the Unix socket */
+#define SHM_SECRET_SZ 8
+
+/*
+ * Time that the transmitter waits for the receiver to accept or reject the
+ * shared memory.
+ */
+#define SHM_HANDSHAKE_TIMEOUT_MS 5000
+
+enum EShmResult {
+    SHM_OK,
+    SHM_UNAVAILABLE,
+    SHM_ERROR,
+};
+
+/*----------------------------------------------------------------------------*/
+
+/*
+ * Transmit all the data from `src_fd' through shared memory, if the receiver
+ * connected to `sockfd' is on the same host and accepts it.
+ *
+ * Returns `SHM_UNAVAILABLE' if the data should be sent through the connection
+ * instead, in which case nothing was read from the input yet. Otherwise, the
+ * number of bytes sent is stored in `total', and the progress is updated.
+ * Returns `SHM_ERROR' on error, after printing it.
+ */
+enum EShmResult shm_transmit(int sockfd, int src_fd, size_t* total);
+
+/*
+ * Receive the data offered through shared memory with `header', which was
+ * already received from `sockfd', and write it into `dst_fd'.
+ *
+ * Returns `SHM_UNAVAILABLE' if the shared memory couldn't be used, in which
+ * case the transmitter sends the raw data through the connection instead.
+ * Otherwise, the number of bytes written is stored in `total', and the
+ * progress is updated. Returns `SHM_ERROR' on error, after printing it.
+ */
+enum EShmResult shm_receive(int sockfd,
+                            const struct ProtoHeader* header,
+                            int dst_fd,
+                            size_t* total);
+
+#endif /* SHM_H_ */
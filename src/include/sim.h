@@ -0,0 +1,87 @@
+/*
+ * Copyright 2025 8dcc
+ *
+ * This file is part of snc (Simple NetCat).
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SIM_H_
+#define SIM_H_ 1
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <sys/types.h>
+#include <netinet/in.h> /* sockaddr_in */
+
+/*
+ * Maximum number of datagrams held by the delay simulator, and maximum size of
+ * each of them. Just like the queue of a real router, it can fill up, in which
+ * case the datagrams that keep arriving are eventually dropped.
+ */
+#define SIM_QUEUE_LEN       4096
+#define SIM_MAX_DATAGRAM_SZ 2048
+
+/*
+ * Maximum delay of '--simulate-delay', in milliseconds. The datagram transports
+ * give up on a peer that is silent for longer than this.
+ */
+#define SIM_MAX_DELAY_MS 5000
+
+/*
+ * In-process simulator of a lossy, high-latency path, used by the datagram
+ * transports for testing. Incoming datagrams are dropped with the probability
+ * of '--simulate-loss', and the rest are held for '--simulate-delay'
+ * milliseconds before being received.
+ */
+struct Simulator {
+    unsigned seed;
+
+    /* Ring of delayed datagrams, only allocated if there is a delay */
+    struct SimDatagram* queue;
+    size_t head, len;
+};
+
+/*----------------------------------------------------------------------------*/
+
+/*
+ * Initialize the simulator. Returns false on error, after printing it.
+ */
+bool sim_init(struct Simulator* sim);
+
+/*
+ * Free the resources of the simulator.
+ */
+void sim_free(struct Simulator* sim);
+
+/*
+ * Receive the next datagram from the UDP socket `sockfd' into `buf', through
+ * the simulator, without blocking. The address of the sender is stored in
+ * `from'. Returns the size of the datagram, 0 if there is nothing to receive
+ * yet, or -1 on error, with `errno' set.
+ */
+ssize_t sim_recvfrom(struct Simulator* sim,
+                     int sockfd,
+                     void* buf,
+                     size_t buf_sz,
+                     struct sockaddr_in* from);
+
+/*
+ * Return the number of nanoseconds until the next delayed datagram is due, or
+ * `timeout_ns' if that's sooner. Used for the timeout of poll(2).
+ */
+uint64_t sim_timeout_ns(const struct Simulator* sim, uint64_t timeout_ns);
+
+#endif /* SIM_H_ */
@@ -0,0 +1,193 @@
+/*
+ * Copyright 2025 8dcc
+ *
+ * This file is part of snc (Simple NetCat).
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef STATS_H_
+#define STATS_H_ 1
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>     /* FILE */
+#include <sys/types.h> /* ssize_t */
+
+#include "main.h"
+
+/*
+ * Number of buckets in the histograms of `Stats.sizes'. Bucket N counts the
+ * calls that returned between 2^N and 2^(N+1)-1 bytes.
+ */
+#define STATS_SIZE_BUCKETS 64
+
+/*
+ * Maximum number of connections whose TCP information is kept in the report.
+ */
+#define STATS_MAX_CONNECTIONS 64
+
+/*
+ * System calls in the data path, counted in `Stats.calls'.
+ */
+enum EStatsCall {
+    STATS_CALL_READ,
+    STATS_CALL_WRITE,
+    STATS_CALL_SEND,
+    STATS_CALL_RECV,
+    STATS_CALL_SPLICE,
+    STATS_CALL_SENDFILE,
+    STATS_CALL_IO_URING,
+
+    STATS_CALL_COUNT,
+};
+
+/*
+ * What a system call in the data path was waiting for: the network, or the
+ * input and output of the transfer.
+ */
+enum EStatsWait {
+    STATS_WAIT_NET,
+    STATS_WAIT_IO,
+
+    STATS_WAIT_COUNT,
+};
+
+/*
+ * TCP information of a connection, sampled when it's done.
+ */
+struct StatsConnection {
+    uint32_t rtt_us, rtt_var_us;
+    uint32_t retransmits;
+    uint32_t cwnd, mss;
+};
+
+/*
+ * Statistics about the current transfer. The counters can be updated from any
+ * thread.
+ *
+ * The histograms of the returned sizes and the time spent in each kind of call
+ * are only measured with '--stats', since they need the time of each call.
+ */
+struct Stats {
+    uint64_t calls[STATS_CALL_COUNT];
+    uint64_t sizes[STATS_CALL_COUNT][STATS_SIZE_BUCKETS];
+    uint64_t wait_ns[STATS_WAIT_COUNT];
+
+    struct StatsConnection connections[STATS_MAX_CONNECTIONS];
+    size_t connection_count;
+};
+
+extern struct Stats g_stats;
+
+/*----------------------------------------------------------------------------*/
+
+/*
+ * Count a call to the specified system call.
+ */
+static inline void stats_count_call(enum EStatsCall call) {
+    __atomic_fetch_add(&g_stats.calls[call], 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * Return the current monotonic time, in nanoseconds.
+ */
+uint64_t stats_clock_ns(void);
+
+/*
+ * Count a call to the specified system call, which is about to be made. Returns
+ * the time that should be passed to `stats_end_call', or zero if the calls are
+ * not being timed.
+ */
+static inline uint64_t stats_start_call(enum EStatsCall call) {
+    stats_count_call(call);
+    return g_opt_stats ? stats_clock_ns() : 0;
+}
+
+/*
+ * Account for the time spent in a call started with `stats_start_call', which
+ * was waiting for `wait', and for the size it returned in `result'.
+ */
+static inline void stats_end_call(enum EStatsCall call,
+                                  enum EStatsWait wait,
+                                  uint64_t start,
+                                  ssize_t result) {
+    if (!g_opt_stats)
+        return;
+
+    __atomic_fetch_add(&g_stats.wait_ns[wait],
+                       stats_clock_ns() - start,
+                       __ATOMIC_RELAXED);
+    if (result > 0)
+        __atomic_fetch_add(
+          &g_stats.sizes[call][63 - __builtin_clzll((uint64_t)result)],
+          1,
+          __ATOMIC_RELAXED);
+}
+
+/*
+ * Store the TCP information of the connected socket `sockfd', once the transfer
+ * through it is done.
+ */
+void stats_sample_connection(int sockfd);
+
+/*
+ * Add the connected socket `sockfd' to the connections whose TCP information is
+ * printed by `stats_print_live'. It must be removed with
+ * `stats_unwatch_connection' before it's closed.
+ */
+void stats_watch_connection(int sockfd);
+
+/*
+ * Remove a socket added with `stats_watch_connection'.
+ */
+void stats_unwatch_connection(int sockfd);
+
+/*
+ * Mark the start of the transfer. The elapsed time and CPU usage are measured
+ * from this point, and the sampled connections are forgotten.
+ */
+void stats_start(void);
+
+/*
+ * Print a summary of the transfer to the specified `FILE', assuming `total'
+ * bytes were moved since the last call to `stats_start'. It includes the
+ * throughput, the CPU time and the number of system calls.
+ */
+void stats_print_summary(FILE* fp, size_t total);
+
+/*
+ * Print a summary of the transfer like `stats_print_summary', but as a JSON
+ * object, also including the histograms of the returned sizes, the time spent
+ * waiting for the network and for the input or output, and the TCP
+ * information of each connection. The `mode' is either "transmit" or
+ * "receive".
+ */
+void stats_print_json(FILE* fp, const char* mode, size_t total);
+
+/*
+ * Print the state of the transfer in progress to the specified `FILE': the
+ * progress so far, the average rate and the rate since the previous call, and
+ * the TCP information of the watched connections. It can be called from any
+ * thread.
+ */
+void stats_print_live(FILE* fp);
+
+/*
+ * Print the summary in the format chosen with '--stats', into the file chosen
+ * with '--stats-file' (or `stderr'). Returns false on error, after printing it.
+ */
+bool stats_report(const char* mode, size_t total);
+
+#endif /* STATS_H_ */
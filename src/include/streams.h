@@ -0,0 +1,96 @@
+/*
+ * Copyright 2025 8dcc
+ *
+ * This file is part of snc (Simple NetCat).
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef STREAMS_H_
+#define STREAMS_H_ 1
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h> /* off_t */
+
+#include "proto.h"
+
+/*
+ * Maximum number of parallel connections for a single transfer.
+ */
+#define STREAMS_MAX 64
+
+/*
+ * Number of blocks that can be in memory at the same time, for each stream.
+ * The memory used by each side is bounded by this value, multiplied by the
+ * number of streams and the block size.
+ */
+#define STREAMS_BLOCKS_PER_STREAM 4
+
+/*
+ * When compressing adaptively, a connection that stopped compressing because
+ * it wasn't worth it tries again after this number of blocks, in case the data
+ * or the link changed.
+ */
+#define STREAMS_COMPRESS_PROBE_INTERVAL 16
+
+/*----------------------------------------------------------------------------*/
+
+/*
+ * Open `stream_count' connections to `dst_port' at `dst_ip', and transmit the
+ * data from `src_fd' through them, using the framed protocol from "proto.h".
+ *
+ * The input is split in blocks of `block_sz' bytes, each with a sequence
+ * number, and each connection sends the next available block. If compression
+ * is enabled, each connection compresses its blocks before sending them. The
+ * number of transmitted bytes (before compressing) is added to `total'.
+ *
+ * If `g_opt_resume' is set, the offset is negotiated with the receiver before
+ * sending any block (see "resume.h"). In that case, `resume_base' is the
+ * position of the input that corresponds to offset zero, if it's seekable.
+ *
+ * If `checksum' is not NULL, the CRC-32C of the input is computed while reading
+ * it, sent to the receiver after the last block, and stored in `checksum'.
+ * Returns false on error, after printing it.
+ */
+bool streams_transmit(int src_fd,
+                      const char* dst_ip,
+                      const char* dst_port,
+                      size_t stream_count,
+                      size_t block_sz,
+                      off_t resume_base,
+                      uint32_t* checksum,
+                      size_t* total);
+
+/*
+ * Receive a framed transfer into `dst_fd'.
+ *
+ * The first connection, `sockfd_first', should have been accepted already, and
+ * its connection header should have been read into `header'. The rest of the
+ * connections of the transfer are accepted from `sockfd_listen'. The blocks are
+ * decompressed if needed, and written in order. The number of written bytes is
+ * added to `total'.
+ *
+ * If the `PROTO_FLAG_CHECKSUM' flag is set in the `header', the CRC-32C of the
+ * written data is stored in `checksum', and compared with the one sent by the
+ * transmitter. Returns false on error or on mismatch, after printing it.
+ */
+bool streams_receive(int sockfd_listen,
+                     int sockfd_first,
+                     const struct ProtoHeader* header,
+                     int dst_fd,
+                     uint32_t* checksum,
+                     size_t* total);
+
+#endif /* STREAMS_H_ */
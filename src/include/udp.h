@@ -0,0 +1,95 @@
+/*
+ * Copyright 2025 8dcc
+ *
+ * This file is part of snc (Simple NetCat).
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef UDP_H_
+#define UDP_H_ 1
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "dgram.h" /* DGRAM_HEADER_SZ */
+
+/*
+ * In UDP mode, the input is split into numbered datagrams of up to
+ * `UDP_PAYLOAD_SZ' bytes, each with a `UDP_HEADER_SZ' header, which fit in
+ * the MTU of most paths, including tunnels. All integers are sent in
+ * big-endian.
+ *
+ * The transmitter paces the datagrams at a fixed '--rate', or at the rate it
+ * discovers from the delay of the path. The receiver reorders them into the
+ * output, and periodically acknowledges the ones it wrote, along with a list
+ * of the missing ones, which the transmitter sends again. A lost datagram
+ * doesn't slow down the transfer, unlike with TCP.
+ */
+#define UDP_MAGIC      "SNCU"
+#define UDP_HEADER_SZ  (DGRAM_HEADER_SZ + 8)
+#define UDP_PAYLOAD_SZ 1200
+
+/*
+ * Maximum number of datagrams sent but not acknowledged, which is also the
+ * number of them the receiver can hold while waiting for a missing one.
+ */
+#define UDP_WINDOW 8192
+
+/*
+ * Limits of the discovered rate, in bits per second. The transfer starts at
+ * `UDP_INITIAL_RATE', and the rate doubles until the delay starts growing.
+ */
+#define UDP_INITIAL_RATE 10e6
+#define UDP_MIN_RATE     1e6
+#define UDP_MAX_RATE     10e9
+
+/*
+ * Timing of the transfer: the receiver acknowledges the data every
+ * `UDP_ACK_INTERVAL_MS', and both sides give up if nothing arrives from the
+ * other in `UDP_TIMEOUT_MS'.
+ */
+#define UDP_ACK_INTERVAL_MS 10
+#define UDP_TIMEOUT_MS      10000
+
+/*----------------------------------------------------------------------------*/
+
+/*
+ * Transmit all the data from `src_fd' to the receiver at `host' and `port',
+ * with UDP datagrams.
+ *
+ * The datagrams are kept until they are acknowledged, so the input can be
+ * anything. The number of bytes sent is stored in `total', and the progress is
+ * updated. Returns false on error, after printing it.
+ */
+bool udp_transmit(int src_fd,
+                  const char* host,
+                  const char* port,
+                  size_t* total);
+
+/*
+ * Wait for a transfer on the UDP `port', and write its data into `dst_fd', in
+ * order.
+ *
+ * If '--simulate-loss' or '--simulate-delay' were used, the datagrams go
+ * through the simulator on arrival, on both sides. The number of bytes written
+ * is stored in `total', and the progress is updated. The number of lost
+ * datagrams that were received again is stored in `repaired'. Returns false
+ * on error, after printing it.
+ */
+bool udp_receive(const char* port,
+                 int dst_fd,
+                 size_t* total,
+                 size_t* repaired);
+
+#endif /* UDP_H_ */
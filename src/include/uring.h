@@ -0,0 +1,62 @@
+/*
+ * Copyright 2025 8dcc
+ *
+ * This file is part of snc (Simple NetCat).
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef URING_H_
+#define URING_H_ 1
+
+#ifndef NO_IO_URING
+
+#include <stddef.h>
+
+/*
+ * Number of buffers (of the block size) used by the io_uring engine. This is
+ * also the maximum number of operations in flight at the same time.
+ */
+#define URING_QUEUE_DEPTH 8
+
+/*
+ * Possible return values of `uring_copy'.
+ *
+ * The `URING_UNSUPPORTED' value is only returned if the kernel doesn't support
+ * io_uring (or the operations we need) before any data was moved, so the
+ * caller can safely fall back to a different engine.
+ */
+enum EUringResult {
+    URING_OK,
+    URING_UNSUPPORTED,
+    URING_ERROR,
+};
+
+/*----------------------------------------------------------------------------*/
+
+/*
+ * Copy all the data from `src_fd' into `dst_fd' using io_uring(7), with
+ * several reads and writes of `buf_sz' bytes in flight. Either descriptor can
+ * be a socket.
+ *
+ * The number of written bytes is added to `total', and the progress is updated.
+ * Returns `URING_ERROR' on error, after printing it.
+ */
+enum EUringResult uring_copy(int src_fd,
+                             int dst_fd,
+                             size_t buf_sz,
+                             size_t* total);
+
+#endif /* not NO_IO_URING */
+
+#endif /* URING_H_ */
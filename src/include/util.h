@@ -19,9 +19,14 @@
 #ifndef UTIL_H_
 #define UTIL_H_ 1
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>  /* fprintf(), fputc(), etc. */
 #include <stdlib.h> /* exit() */
 
+#include <pthread.h> /* pthread_t */
+
 #include <sys/types.h>
 #include <sys/socket.h> /* sockaddr */
 
@@ -29,6 +34,20 @@
 
 #define LENGTH(ARR) (sizeof(ARR) / sizeof((ARR)[0]))
 
+#define MIN(A, B) (((A) < (B)) ? (A) : (B))
+#define MAX(A, B) (((A) > (B)) ? (A) : (B))
+
+/* Nanoseconds in each unit, for the times returned by `stats_clock_ns' */
+#define NS_PER_US  1000ULL
+#define NS_PER_MS  1000000ULL
+#define NS_PER_SEC 1000000000ULL
+
+/*
+ * Interval between each line printed by the progress reporter, in
+ * milliseconds.
+ */
+#define PROGRESS_INTERVAL_MS 500
+
 #define ERR(...)                                                               \
     do {                                                                       \
         fprintf(stderr, "snc: ");                                              \
@@ -62,28 +81,76 @@ void print_interface_list(FILE* fp);
  */
 void print_sockaddr(FILE* fp, struct sockaddr_storage* info);
 
+/*
+ * Progress of the current operation, in bytes. Only updated through
+ * `update_progress'.
+ */
+extern size_t g_progress;
+
+/*----------------------------------------------------------------------------*/
+
 /*
  * Print the progress of a generic operation. The `verb' argument indicates the
  * action name (used for printing), and the `progress' argument indicates the
  * current progress of the operation in bytes.
  *
  * This function clears the current line, and overwrites the trailing characters
- * from the previous call.
+ * from the previous call. If the expected size was set with
+ * `set_expected_progress', the percentage and the remaining time are also
+ * printed. If the progress reporter was started, the average rate is printed
+ * as well.
  *
  * See the function definition for more details.
  */
 void print_progress(const char* verb, size_t progress);
 
 /*
- * Keep track of the `progress' history, and call `print_progress' when there is
- * a big enough difference with the previously printed `progress'.
- *
- * This "big enough difference" is defined inside the function itself.
+ * Set the size of the whole operation, if it's known in advance, so
+ * `print_progress' also prints the percentage and the estimated remaining time.
+ * The rate is measured from the moment this function is called.
+ */
+void set_expected_progress(size_t expected);
+
+/*
+ * Start a thread that prints the progress stored with `update_progress' every
+ * `PROGRESS_INTERVAL_MS' milliseconds, along with the current and average
+ * rates. The `verb' is used just like in `print_progress'. Returns false on
+ * error, after printing it.
+ */
+bool start_progress_reporter(const char* verb);
+
+/*
+ * Stop the thread started by `start_progress_reporter', if it's running. The
+ * final progress should be printed afterwards with `print_progress'.
  */
-void print_partial_progress(const char* verb, size_t progress);
+void stop_progress_reporter(void);
+
+/*
+ * Wait for `cond' for a short amount of time. Used by the main threads, which
+ * need to check `g_signaled_quit' periodically.
+ */
+void cond_wait_briefly(pthread_cond_t* cond, pthread_mutex_t* lock);
+
+/*
+ * Create a new thread that runs `func' with the specified `arg', storing its ID
+ * in `thread'. The new thread blocks the quit signals, so they are always
+ * received by the main thread. Returns false on error, with `errno' set.
+ */
+bool create_worker_thread(pthread_t* thread,
+                          void* (*func)(void*),
+                          void* arg);
 
 /*----------------------------------------------------------------------------*/
 
+/*
+ * Store the current progress of the operation, so the progress reporter can
+ * print it. This is called from the data path, so it's just a store, which can
+ * be done from any thread.
+ */
+static inline void update_progress(size_t progress) {
+    __atomic_store_n(&g_progress, progress, __ATOMIC_RELAXED);
+}
+
 /*
  * Print a simple text separator with a fixed width to the specified `FILE'.
  */
@@ -91,4 +158,20 @@ static inline void print_separator(FILE* fp) {
     fputs("--------------------------------------------------\n", fp);
 }
 
+/*
+ * Store or load big-endian integers of different sizes into or from a byte
+ * array.
+ */
+static inline void store_be(uint8_t* dst, uint64_t value, size_t sz) {
+    for (size_t i = 0; i < sz; i++)
+        dst[i] = (uint8_t)(value >> (8 * (sz - i - 1)));
+}
+
+static inline uint64_t load_be(const uint8_t* src, size_t sz) {
+    uint64_t result = 0;
+    for (size_t i = 0; i < sz; i++)
+        result = (result << 8) | src[i];
+    return result;
+}
+
 #endif /* UTIL_H_ */
@@ -0,0 +1,63 @@
+/*
+ * Copyright 2025 8dcc
+ *
+ * This file is part of snc (Simple NetCat).
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef ZEROCOPY_H_
+#define ZEROCOPY_H_ 1
+
+#include <stddef.h>
+
+/*
+ * Number of buffers (of the block size) used by the zero-copy engine. Since the
+ * kernel keeps referencing a buffer until the data is acknowledged by the peer,
+ * this is also the maximum number of blocks in flight.
+ */
+#define ZEROCOPY_DEPTH 16
+
+/*
+ * Possible return values of `zerocopy_transmit'.
+ *
+ * The `ZEROCOPY_UNSUPPORTED' value is only returned if the kernel doesn't
+ * support `MSG_ZEROCOPY' for the socket, before any data was moved, so the
+ * caller can safely fall back to a different engine.
+ */
+enum EZerocopyResult {
+    ZEROCOPY_OK,
+    ZEROCOPY_UNSUPPORTED,
+    ZEROCOPY_ERROR,
+};
+
+/*----------------------------------------------------------------------------*/
+
+/*
+ * Transmit all the data from `src_fd' through the connected socket `sockfd',
+ * reading up to `buf_sz' bytes at a time, and sending them with `MSG_ZEROCOPY',
+ * so the kernel doesn't copy them. A buffer is only reused once the kernel
+ * reports, through the error queue of the socket, that it's done with it.
+ *
+ * If the kernel reports that it had to copy the data anyway (e.g. on the
+ * loopback interface), the rest of the data is sent normally.
+ *
+ * The number of sent bytes is added to `total', and the progress is updated.
+ * Returns `ZEROCOPY_ERROR' on error, after printing it.
+ */
+enum EZerocopyResult zerocopy_transmit(int src_fd,
+                                       int sockfd,
+                                       size_t buf_sz,
+                                       size_t* total);
+
+#endif /* ZEROCOPY_H_ */
@@ -0,0 +1,140 @@
+/*
+ * Copyright 2025 8dcc
+ *
+ * This file is part of snc (Simple NetCat).
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <unistd.h> /* read(), write() */
+#include <sys/types.h>
+#include <sys/stat.h>   /* fstat() */
+#include <sys/socket.h> /* send(), recv() */
+
+#include "include/main.h"
+#include "include/stats.h"
+#include "include/io.h"
+
+enum EIoFdType io_fd_type(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+        return IO_FD_OTHER;
+
+    if (S_ISREG(st.st_mode))
+        return IO_FD_REGULAR;
+    if (S_ISFIFO(st.st_mode))
+        return IO_FD_PIPE;
+    if (S_ISSOCK(st.st_mode))
+        return IO_FD_SOCKET;
+
+    return IO_FD_OTHER;
+}
+
+ssize_t io_read_full(int fd, void* buf, size_t buf_sz) {
+    char* ptr         = buf;
+    size_t total_read = 0;
+
+    while (total_read < buf_sz) {
+        const uint64_t start = stats_start_call(STATS_CALL_READ);
+        const ssize_t received =
+          read(fd, &ptr[total_read], buf_sz - total_read);
+        stats_end_call(STATS_CALL_READ, STATS_WAIT_IO, start, received);
+        if (received < 0) {
+            /* If the user wants to quit, treat the interruption like EOF */
+            if (errno == EINTR && g_signaled_quit)
+                break;
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (received == 0)
+            break;
+
+        total_read += received;
+    }
+
+    return total_read;
+}
+
+ssize_t io_recv_full(int sockfd, void* buf, size_t buf_sz) {
+    char* ptr         = buf;
+    size_t total_read = 0;
+
+    while (total_read < buf_sz) {
+        const uint64_t start = stats_start_call(STATS_CALL_RECV);
+        const ssize_t received =
+          recv(sockfd, &ptr[total_read], buf_sz - total_read, 0);
+        stats_end_call(STATS_CALL_RECV, STATS_WAIT_NET, start, received);
+        if (received < 0) {
+            /* If the user wants to quit, treat the interruption like EOF */
+            if (errno == EINTR && g_signaled_quit)
+                break;
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (received == 0)
+            break;
+
+        total_read += received;
+    }
+
+    return total_read;
+}
+
+bool io_write_all(int fd, const void* data, size_t data_sz) {
+    const char* ptr = data;
+
+    while (data_sz > 0) {
+        const uint64_t start  = stats_start_call(STATS_CALL_WRITE);
+        const ssize_t written = write(fd, ptr, data_sz);
+        stats_end_call(STATS_CALL_WRITE, STATS_WAIT_IO, start, written);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+
+        ptr += written;
+        data_sz -= written;
+    }
+
+    return true;
+}
+
+bool io_send_all(int sockfd, const void* data, size_t data_sz) {
+    const char* ptr = data;
+
+    while (data_sz > 0) {
+        const uint64_t start = stats_start_call(STATS_CALL_SEND);
+        const ssize_t sent   = send(sockfd, ptr, data_sz, 0);
+        stats_end_call(STATS_CALL_SEND, STATS_WAIT_NET, start, sent);
+        if (sent < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+
+        ptr += sent;
+        data_sz -= sent;
+    }
+
+    return true;
+}
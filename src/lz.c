@@ -0,0 +1,304 @@
+/*
+ * Copyright 2025 8dcc
+ *
+ * This file is part of snc (Simple NetCat).
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "include/lz.h"
+
+/*
+ * Each compressed block is a list of sequences. Each sequence starts with a
+ * token byte, whose high nibble is the number of literals, and whose low nibble
+ * is the length of the match minus `LZ_MIN_MATCH'. If a nibble is 15, the
+ * length continues in the following bytes, until one of them is not 255. The
+ * token is followed by the literals themselves, and by the offset of the match
+ * (2 bytes, little-endian). The last sequence only contains literals.
+ *
+ * For compatibility with the LZ4 block format, the last `LZ_LAST_LITERALS'
+ * bytes are always literals, and the last match starts at least `LZ_MF_LIMIT'
+ * bytes before the end of the block.
+ */
+#define LZ_MIN_MATCH     4
+#define LZ_LAST_LITERALS 5
+#define LZ_MF_LIMIT      12
+#define LZ_MAX_OFFSET    65535
+#define LZ_RUN_MASK      15
+
+/*
+ * After (1 << LZ_SKIP_TRIGGER) positions without a match, the compressor starts
+ * skipping bytes, so incompressible data is processed quickly.
+ */
+#define LZ_SKIP_TRIGGER 6
+
+/*----------------------------------------------------------------------------*/
+
+static inline uint32_t read32(const uint8_t* ptr) {
+    uint32_t result;
+    memcpy(&result, ptr, sizeof(result));
+    return result;
+}
+
+static inline uint64_t read64(const uint8_t* ptr) {
+    uint64_t result;
+    memcpy(&result, ptr, sizeof(result));
+    return result;
+}
+
+static inline uint32_t hash_sequence(uint32_t sequence) {
+    return (sequence * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+/*
+ * Count the number of equal bytes at `a' and `b', without reading past `a_end'.
+ * The `b' pointer must be lower than `a'.
+ */
+static size_t count_match(const uint8_t* a,
+                          const uint8_t* b,
+                          const uint8_t* a_end) {
+    const uint8_t* start = a;
+
+    while (a_end - a >= 8) {
+        const uint64_t diff = read64(a) ^ read64(b);
+        if (diff != 0) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            return (a - start) + (__builtin_ctzll(diff) >> 3);
+#else
+            return (a - start) + (__builtin_clzll(diff) >> 3);
+#endif
+        }
+        a += 8;
+        b += 8;
+    }
+
+    while (a < a_end && *a == *b) {
+        a++;
+        b++;
+    }
+
+    return a - start;
+}
+
+/*
+ * Number of extra bytes needed for storing `len' in a token nibble.
+ */
+static inline size_t length_extra_bytes(size_t len) {
+    return (len >= LZ_RUN_MASK) ? (len - LZ_RUN_MASK) / 255 + 1 : 0;
+}
+
+static uint8_t* write_length_extra(uint8_t* op, size_t len) {
+    len -= LZ_RUN_MASK;
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+/*
+ * Write a sequence with `literals_len' bytes from `literals', followed by a
+ * match of `match_len' bytes at `offset'. If `match_len' is zero, only the
+ * literals are written, for the last sequence. Returns the new output pointer,
+ * or NULL if the sequence doesn't fit before `op_end'.
+ */
+static uint8_t* write_sequence(uint8_t* op,
+                               const uint8_t* op_end,
+                               const uint8_t* literals,
+                               size_t literals_len,
+                               size_t offset,
+                               size_t match_len) {
+    const size_t match_code = (match_len > 0) ? match_len - LZ_MIN_MATCH : 0;
+
+    size_t needed = 1 + length_extra_bytes(literals_len) + literals_len;
+    if (match_len > 0)
+        needed += 2 + length_extra_bytes(match_code);
+    if ((size_t)(op_end - op) < needed)
+        return NULL;
+
+    uint8_t* token = op++;
+    *token = (literals_len >= LZ_RUN_MASK) ? LZ_RUN_MASK << 4
+                                           : (uint8_t)(literals_len << 4);
+    if (literals_len >= LZ_RUN_MASK)
+        op = write_length_extra(op, literals_len);
+
+    memcpy(op, literals, literals_len);
+    op += literals_len;
+
+    if (match_len == 0)
+        return op;
+
+    *op++ = offset & 0xFF;
+    *op++ = (offset >> 8) & 0xFF;
+
+    *token |= (match_code >= LZ_RUN_MASK) ? LZ_RUN_MASK : (uint8_t)match_code;
+    if (match_code >= LZ_RUN_MASK)
+        op = write_length_extra(op, match_code);
+
+    return op;
+}
+
+/*
+ * Read the extra bytes of a length whose nibble was `LZ_RUN_MASK', adding them
+ * to `len'. Returns false if the input ends, or if the length overflows.
+ */
+static bool read_length_extra(const uint8_t** ip,
+                              const uint8_t* ip_end,
+                              size_t* len) {
+    uint8_t byte;
+    do {
+        if (*ip >= ip_end || *len > SIZE_MAX - 255)
+            return false;
+        byte = *(*ip)++;
+        *len += byte;
+    } while (byte == 255);
+
+    return true;
+}
+
+/*----------------------------------------------------------------------------*/
+
+size_t lz_compress(struct LzState* state,
+                   const uint8_t* src,
+                   size_t src_sz,
+                   uint8_t* dst,
+                   size_t dst_sz) {
+    uint8_t* op           = dst;
+    const uint8_t* op_end = dst + dst_sz;
+    size_t anchor         = 0;
+
+    if (src_sz > LZ_MF_LIMIT) {
+        memset(state->table, 0, sizeof(state->table));
+
+        const size_t limit       = src_sz - LZ_MF_LIMIT;
+        const uint8_t* match_end = &src[src_sz - LZ_LAST_LITERALS];
+
+        size_t ip         = 0;
+        unsigned attempts = 1 << LZ_SKIP_TRIGGER;
+        while (ip < limit) {
+            const uint32_t sequence = read32(&src[ip]);
+            const uint32_t hash     = hash_sequence(sequence);
+            size_t ref              = state->table[hash];
+            state->table[hash]      = (uint32_t)ip;
+
+            if (ref >= ip || ip - ref > LZ_MAX_OFFSET ||
+                read32(&src[ref]) != sequence) {
+                ip += attempts++ >> LZ_SKIP_TRIGGER;
+                continue;
+            }
+            attempts = 1 << LZ_SKIP_TRIGGER;
+
+            const size_t offset = ip - ref;
+            size_t match_len =
+              LZ_MIN_MATCH + count_match(&src[ip + LZ_MIN_MATCH],
+                                         &src[ref + LZ_MIN_MATCH],
+                                         match_end);
+
+            /* Extend the match backwards, into the pending literals */
+            while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1]) {
+                ip--;
+                ref--;
+                match_len++;
+            }
+
+            op = write_sequence(op,
+                                op_end,
+                                &src[anchor],
+                                ip - anchor,
+                                offset,
+                                match_len);
+            if (op == NULL)
+                return 0;
+
+            ip += match_len;
+            anchor = ip;
+
+            /* Also index a position inside the match, for the next search */
+            state->table[hash_sequence(read32(&src[ip - 2]))] =
+              (uint32_t)(ip - 2);
+        }
+    }
+
+    op = write_sequence(op, op_end, &src[anchor], src_sz - anchor, 0, 0);
+    return (op == NULL) ? 0 : (size_t)(op - dst);
+}
+
+bool lz_decompress(const uint8_t* src,
+                   size_t src_sz,
+                   uint8_t* dst,
+                   size_t dst_sz,
+                   size_t* out_sz) {
+    const uint8_t* ip     = src;
+    const uint8_t* ip_end = src + src_sz;
+    uint8_t* op           = dst;
+    uint8_t* op_end       = dst + dst_sz;
+
+    while (ip < ip_end) {
+        const uint8_t token = *ip++;
+
+        size_t literals_len = token >> 4;
+        if (literals_len == LZ_RUN_MASK &&
+            !read_length_extra(&ip, ip_end, &literals_len))
+            return false;
+
+        if (literals_len > (size_t)(ip_end - ip) ||
+            literals_len > (size_t)(op_end - op))
+            return false;
+
+        memcpy(op, ip, literals_len);
+        ip += literals_len;
+        op += literals_len;
+
+        /* The last sequence doesn't have a match */
+        if (ip == ip_end)
+            break;
+
+        if (ip_end - ip < 2)
+            return false;
+        const size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - dst))
+            return false;
+
+        size_t match_len = token & LZ_RUN_MASK;
+        if (match_len == LZ_RUN_MASK &&
+            !read_length_extra(&ip, ip_end, &match_len))
+            return false;
+        match_len += LZ_MIN_MATCH;
+
+        if (match_len > (size_t)(op_end - op))
+            return false;
+
+        /*
+         * The match can overlap with the bytes it's producing, so copy it in
+         * chunks that don't overlap, which double in size each time.
+         */
+        const uint8_t* ref = op - offset;
+        while (match_len > 0) {
+            const size_t chunk_sz =
+              ((size_t)(op - ref) < match_len) ? (size_t)(op - ref) : match_len;
+            memcpy(op, ref, chunk_sz);
+            op += chunk_sz;
+            match_len -= chunk_sz;
+        }
+    }
+
+    *out_sz = op - dst;
+    return true;
+}
@@ -24,14 +24,19 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <fcntl.h> /* open() */
+
 #ifndef NO_SIGNAL_HANDLING
 #include <signal.h>
+#include <pthread.h> /* pthread_sigmask() */
 #endif
 
 #include "include/util.h"
 #include "include/main.h"
 #include "include/args.h"
+#include "include/stats.h"
 #include "include/receive.h"
+#include "include/server.h"
 #include "include/transmit.h"
 
 /*----------------------------------------------------------------------------*/
@@ -39,12 +44,58 @@
 /*
  * Globals set depending on command-line arguments.
  */
-bool g_opt_print_interfaces = false;
-bool g_opt_print_peer_info  = false;
-bool g_opt_print_progress   = false;
+bool g_opt_print_interfaces       = false;
+bool g_opt_print_peer_info        = false;
+bool g_opt_print_progress         = false;
+size_t g_opt_streams              = 1;
+size_t g_opt_pipeline_depth       = 0;
+bool g_opt_compress               = false;
+bool g_opt_compress_auto          = false;
+bool g_opt_checksum               = false;
+bool g_opt_resume                 = false;
+bool g_opt_zerocopy               = false;
+const char* g_opt_input           = NULL;
+const char* g_opt_output          = NULL;
+bool g_opt_direct                 = false;
+bool g_opt_tune                   = false;
+double g_opt_tune_rate            = 0;
+size_t g_opt_socket_buffer        = 0;
+size_t g_opt_notsent_lowat        = 0;
+bool g_opt_low_latency            = false;
+size_t g_opt_flush_timeout        = 0;
+bool g_opt_stats                  = false;
+bool g_opt_stats_json             = false;
+const char* g_opt_stats_file      = NULL;
+bool g_opt_duplex                 = false;
+bool g_opt_shm                    = false;
+const char* g_opt_forward         = NULL;
+bool g_opt_bench                  = false;
+size_t g_opt_bench_size           = 0;
+double g_opt_bench_seconds        = 0;
+const char* g_opt_output_template = NULL;
+size_t g_opt_max_connections      = 0;
+size_t g_opt_connection_buffer    = 0;
+size_t g_opt_workers              = 1;
+
+enum EFanoutPolicy g_opt_fanout_policy = FANOUT_POLICY_BUFFER;
+size_t g_opt_fanout_buffer             = 0;
+
+bool g_opt_multicast                  = false;
+const char* g_opt_multicast_group     = NULL;
+const char* g_opt_multicast_interface = NULL;
+size_t g_opt_fec                      = 0;
+bool g_opt_udp                        = false;
+double g_opt_rate                     = 0;
+double g_opt_simulate_loss            = 0;
+size_t g_opt_simulate_delay           = 0;
+
+#ifndef NO_IO_URING
+bool g_opt_io_uring = false;
+#endif
 
 #ifndef FIXED_BLOCK_SIZE
-size_t g_opt_block_size = 0x1000;
+size_t g_opt_block_size    = 0x1000;
+bool g_opt_tune_block_size = false;
 #endif
 
 /*
@@ -106,8 +157,81 @@ static void setup_quit_signal_handler(int sig) {
             strsignal(sig),
             strerror(errno));
 }
+
+/*
+ * Main function of the thread that prints the state of the transfer whenever
+ * one of the `signals' is received.
+ */
+static void* stats_signal_main(void* arg) {
+    const sigset_t* signals = arg;
+
+    for (;;) {
+        int sig;
+        if (sigwait(signals, &sig) == 0)
+            stats_print_live(stderr);
+    }
+
+    return NULL;
+}
+
+/*
+ * Print the state of the transfer when `SIGUSR1' (or `SIGINFO', where it
+ * exists) is received, without interrupting it. The signals are blocked in all
+ * threads, and accepted synchronously by a dedicated one, so they never
+ * interrupt the system calls of the transfer. Must be called before creating
+ * any other thread.
+ */
+static void setup_stats_signal_thread(void) {
+    static sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR1);
+#ifdef SIGINFO
+    sigaddset(&signals, SIGINFO);
+#endif
+
+    const int status = pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    if (status != 0)
+        DIE("Failed to block the statistics signals: %s", strerror(status));
+
+    pthread_t thread;
+    if (!create_worker_thread(&thread, stats_signal_main, &signals))
+        DIE("Failed to create the statistics thread: %s", strerror(errno));
+    pthread_detach(thread);
+}
 #endif
 
+/*
+ * Open the file specified with '--input'.
+ */
+static FILE* open_input(const char* path) {
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        DIE("Could not open '%s': %s", path, strerror(errno));
+
+    FILE* fp = fdopen(fd, "r");
+    if (fp == NULL)
+        DIE("Could not open '%s': %s", path, strerror(errno));
+
+    return fp;
+}
+
+/*
+ * Open the file specified with '--output'. It's not truncated here, since the
+ * transmitter might want to resume a previous transfer into it, and it's also
+ * opened for reading, since the end of the file is compared with the input.
+ */
+static FILE* open_output(const char* path) {
+    const int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+    if (fd < 0)
+        DIE("Could not open '%s': %s", path, strerror(errno));
+
+    FILE* fp = fdopen(fd, "w");
+    if (fp == NULL)
+        DIE("Could not open '%s': %s", path, strerror(errno));
+
+    return fp;
+}
+
 /*----------------------------------------------------------------------------*/
 
 int main(int argc, char** argv) {
@@ -115,26 +239,82 @@ int main(int argc, char** argv) {
     args_init(&args);
     args_parse(argc, argv, &args);
 
-    g_opt_print_interfaces = args.print_interfaces;
-    g_opt_print_peer_info  = args.print_peer_info;
-    g_opt_print_progress   = args.print_progress;
+    g_opt_print_interfaces  = args.print_interfaces;
+    g_opt_print_peer_info   = args.print_peer_info;
+    g_opt_print_progress    = args.print_progress;
+    g_opt_streams           = args.streams;
+    g_opt_pipeline_depth    = args.pipeline_depth;
+    g_opt_compress          = args.compress;
+    g_opt_compress_auto     = args.compress_auto;
+    g_opt_checksum          = args.checksum;
+    g_opt_resume            = args.resume;
+    g_opt_zerocopy          = args.zerocopy;
+    g_opt_input             = args.input;
+    g_opt_output            = args.output;
+    g_opt_direct            = args.direct;
+    g_opt_tune              = args.tune;
+    g_opt_tune_rate         = args.tune_rate;
+    g_opt_socket_buffer     = args.socket_buffer;
+    g_opt_notsent_lowat     = args.notsent_lowat;
+    g_opt_low_latency       = args.low_latency;
+    g_opt_flush_timeout     = args.flush_timeout;
+    g_opt_stats             = args.stats;
+    g_opt_stats_json        = args.stats_json;
+    g_opt_stats_file        = args.stats_file;
+    g_opt_duplex            = args.duplex;
+    g_opt_shm               = args.shm;
+    g_opt_forward           = args.forward;
+    g_opt_fanout_policy     = args.fanout_policy;
+    g_opt_fanout_buffer     = args.fanout_buffer;
+    g_opt_bench             = args.bench;
+    g_opt_bench_size        = args.bench_size;
+    g_opt_bench_seconds     = args.bench_seconds;
+    g_opt_output_template   = args.output_template;
+    g_opt_max_connections   = args.max_connections;
+    g_opt_connection_buffer = args.connection_buffer;
+    g_opt_workers           = args.workers;
+
+    g_opt_multicast           = args.multicast;
+    g_opt_multicast_group     = args.multicast_group;
+    g_opt_multicast_interface = args.multicast_interface;
+    g_opt_fec                 = args.fec;
+    g_opt_udp                 = args.udp;
+    g_opt_rate                = args.rate;
+    g_opt_simulate_loss       = args.simulate_loss;
+    g_opt_simulate_delay      = args.simulate_delay;
+
+#ifndef NO_IO_URING
+    g_opt_io_uring = args.io_uring;
+#endif
 
 #ifndef FIXED_BLOCK_SIZE
-    g_opt_block_size = args.block_size;
+    g_opt_block_size      = args.block_size;
+    g_opt_tune_block_size = args.tune && !args.block_size_set;
 #endif
 
 #ifndef NO_SIGNAL_HANDLING
     setup_quit_signal_handler(SIGINT);
     setup_quit_signal_handler(SIGQUIT);
+    setup_stats_signal_thread();
 #endif
 
     switch (args.mode) {
         case ARGS_MODE_RECEIVE:
-            snc_receive(args.port, stdout);
+            if (args.server)
+                snc_serve(args.port, stdout);
+            else if (args.output != NULL)
+                snc_receive(args.port, open_output(args.output));
+            else
+                snc_receive(args.port, stdout);
             break;
 
         case ARGS_MODE_TRANSMIT:
-            snc_transmit(stdin, args.destination, args.port);
+            if (args.input != NULL)
+                snc_transmit(open_input(args.input),
+                             args.destination,
+                             args.port);
+            else
+                snc_transmit(stdin, args.destination, args.port);
             break;
 
         case ARGS_MODE_NONE:
@@ -0,0 +1,1093 @@
+/*
+ * Copyright 2025 8dcc
+ *
+ * This file is part of snc (Simple NetCat).
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE /* ppoll() */
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h> /* read(), close(), lseek() */
+#include <poll.h>   /* poll(), ppoll() */
+#include <netdb.h>  /* getaddrinfo() */
+#include <sys/types.h>
+#include <sys/stat.h>   /* fstat() */
+#include <sys/mman.h>   /* mmap(), madvise() */
+#include <sys/socket.h> /* socket(), recvfrom(), etc. */
+#include <netinet/in.h> /* ip_mreq, IP_MULTICAST_* */
+#include <arpa/inet.h>  /* inet_pton(), inet_ntop() */
+
+#include "include/util.h"
+#include "include/main.h"
+#include "include/io.h"
+#include "include/net.h"
+#include "include/stats.h"
+#include "include/proto.h"
+#include "include/output.h"
+#include "include/sim.h"
+#include "include/dgram.h"
+#include "include/mcast.h"
+
+/*
+ * The datagrams only reach the local network, unless the routers are
+ * configured otherwise.
+ */
+#define MCAST_TTL 1
+
+/* Initial size of the buffer for inputs that are not regular files */
+#define MCAST_SOURCE_MIN_SZ (1024 * 1024)
+
+/* Size of the receive buffer requested for the multicast socket */
+#define MCAST_SOCKET_BUFFER (8 * 1024 * 1024)
+
+/* Maximum number of datagrams received each time the socket is ready */
+#define MCAST_RECV_BATCH 64
+
+/*
+ * Each parity group has at least 2 datagrams, so this is enough for all the
+ * groups that overlap the window of the receiver.
+ */
+#define MCAST_PARITY_SLOTS (MCAST_WINDOW / 2 + 1)
+
+enum EMcastType {
+    MCAST_TYPE_DATA,
+    MCAST_TYPE_PARITY,
+    MCAST_TYPE_END,
+};
+
+/*
+ * Each datagram, and each repaired datagram sent through TCP, only has the
+ * common `DgramHeader'. The `param' member is the size of the parity groups
+ * (zero if there is no parity), and the rest depend on the type:
+ *
+ *   - DATA: `seq' is the index of the datagram, and `len' is the size of the
+ *     payload.
+ *   - PARITY: `seq' is the index of the group, and `len' is the XOR of the
+ *     sizes of its datagrams. The payload always has `MCAST_PAYLOAD_SZ' bytes,
+ *     as if shorter datagrams were padded with zeros.
+ *   - END: `seq' is the number of data datagrams, and the payload contains the
+ *     total size of the transfer, in 8 bytes.
+ */
+/*
+ * Input of the transmitter. Any datagram might need to be repaired until the
+ * end of the transfer, so the whole input is kept: regular files are simply
+ * mapped, and anything else is read into a growing buffer.
+ */
+struct McastSource {
+    int fd;
+    uint8_t* data;
+    size_t len, cap;
+    bool eof;
+
+    /* If the input was mapped, `data' points somewhere inside `map' */
+    uint8_t* map;
+    size_t map_sz;
+};
+
+struct McastTx {
+    struct McastSource src;
+    int udp_fd, listen_fd;
+    uint32_t session;
+    uint8_t fec;
+
+    /* Number of data datagrams sent so far; only those can be repaired */
+    uint32_t sent;
+
+    /*
+     * Descriptors polled while waiting for the next datagram: the listening
+     * socket, followed by `clients' connections asking for repairs.
+     */
+    struct pollfd pfds[1 + MCAST_MAX_REPAIR_CLIENTS];
+    size_t clients;
+    uint64_t last_repair_ns;
+
+    struct DgramPacer pacer;
+
+    /* XOR of the data datagrams of the current group, and their number */
+    uint8_t parity[MCAST_PAYLOAD_SZ];
+    uint16_t parity_len;
+    size_t parity_count;
+
+    uint8_t packet[MCAST_HEADER_SZ + MCAST_PAYLOAD_SZ];
+};
+
+/*
+ * Datagrams held by the receiver. The datagram `seq' can only be stored at
+ * `slots[seq % MCAST_WINDOW]', and the parity of the group `group' at
+ * `parities[group % MCAST_PARITY_SLOTS]', so each slot is tagged with the
+ * datagram or group it holds.
+ */
+struct McastSlot {
+    uint32_t seq;
+    bool have;
+    uint16_t len;
+    uint8_t data[MCAST_PAYLOAD_SZ];
+};
+
+struct McastParity {
+    uint32_t group;
+    bool have;
+    uint16_t len;
+    uint8_t data[MCAST_PAYLOAD_SZ];
+};
+
+struct McastRx {
+    int udp_fd, repair_fd, dst_fd;
+    const char* port;
+
+    struct DgramLock lock;
+    struct sockaddr_in sender;
+    uint8_t fec;
+
+    /*
+     * Next datagram to write, and one past the highest one received. The
+     * missing datagrams before `scanned' were already requested.
+     */
+    uint32_t head, highest, scanned;
+
+    /* Number of data datagrams, once the transmitter announces it */
+    bool have_end;
+    uint32_t count;
+
+    struct McastSlot* slots;
+    struct McastParity* parities;
+
+    struct Simulator sim;
+    uint64_t last_ns;
+    size_t *total, *recovered, *repaired;
+};
+
+/*----------------------------------------------------------------------------*/
+
+static bool get_header(const uint8_t* buf,
+                       size_t buf_sz,
+                       struct DgramHeader* header) {
+    return dgram_get_header(buf, buf_sz, MCAST_MAGIC, header) &&
+           header->param != 1;
+}
+
+/*
+ * Resolve the multicast `group' and the `port' into `addr'. Returns false if
+ * it's not a valid IPv4 multicast address, after printing the error.
+ */
+static bool resolve_group(const char* group,
+                          const char* port,
+                          struct sockaddr_in* addr) {
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags    = AI_NUMERICHOST;
+
+    struct addrinfo* info = NULL;
+    const int status      = getaddrinfo(group, port, &hints, &info);
+    if (status != 0) {
+        ERR("Invalid multicast group '%s': %s", group, gai_strerror(status));
+        return false;
+    }
+
+    memcpy(addr, info->ai_addr, sizeof(*addr));
+    freeaddrinfo(info);
+
+    if (!IN_MULTICAST(ntohl(addr->sin_addr.s_addr))) {
+        ERR("The address '%s' is not a multicast group.", group);
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Get the local interface specified with '--multicast-interface', or any
+ * interface by default. Returns false if it's invalid, after printing it.
+ */
+static bool get_interface(struct in_addr* addr) {
+    addr->s_addr = htonl(INADDR_ANY);
+    if (g_opt_multicast_interface != NULL &&
+        inet_pton(AF_INET, g_opt_multicast_interface, addr) != 1) {
+        ERR("Invalid multicast interface: '%s'.", g_opt_multicast_interface);
+        return false;
+    }
+
+    return true;
+}
+
+/*----------------------------------------------------------------------------*/
+
+static void source_open(struct McastSource* src, int fd) {
+    memset(src, 0, sizeof(*src));
+    src->fd = fd;
+
+    struct stat st;
+    const off_t offset = lseek(fd, 0, SEEK_CUR);
+    if (io_fd_type(fd) != IO_FD_REGULAR || fstat(fd, &st) != 0 || offset < 0 ||
+        offset >= st.st_size)
+        return;
+
+    /* If the file can't be mapped, it's simply read */
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+        return;
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    src->map    = map;
+    src->map_sz = st.st_size;
+    src->data   = &src->map[offset];
+    src->len    = st.st_size - offset;
+    src->eof    = true;
+}
+
+static void source_close(struct McastSource* src) {
+    if (src->map != NULL)
+        munmap(src->map, src->map_sz);
+    else
+        free(src->data);
+}
+
+/*
+ * Read from the input until at least `need' bytes are available, or until the
+ * end of the input. Returns false on error, after printing it.
+ */
+static bool source_fill(struct McastSource* src, size_t need) {
+    while (!src->eof && src->len < need) {
+        if (src->len == src->cap) {
+            const size_t new_cap =
+              (src->cap == 0) ? MCAST_SOURCE_MIN_SZ : src->cap * 2;
+            uint8_t* new_data = realloc(src->data, new_cap);
+            if (new_data == NULL) {
+                ERR("Failed to allocate %zu bytes: %s",
+                    new_cap,
+                    strerror(errno));
+                return false;
+            }
+
+            src->data = new_data;
+            src->cap  = new_cap;
+        }
+
+        const uint64_t start = stats_start_call(STATS_CALL_READ);
+        const ssize_t received =
+          read(src->fd, &src->data[src->len], src->cap - src->len);
+        stats_end_call(STATS_CALL_READ, STATS_WAIT_IO, start, received);
+        if (received < 0) {
+            if (errno == EINTR)
+                continue;
+
+            ERR("Read error: %s", strerror(errno));
+            return false;
+        }
+
+        if (received == 0)
+            src->eof = true;
+        src->len += received;
+    }
+
+    return true;
+}
+
+/*
+ * Get the payload of the data datagram `seq', which must have been read from
+ * the input. Returns its size.
+ */
+static size_t source_payload(const struct McastSource* src,
+                             uint32_t seq,
+                             const uint8_t** payload) {
+    const size_t offset = (size_t)seq * MCAST_PAYLOAD_SZ;
+    *payload            = &src->data[offset];
+    return (src->len - offset < MCAST_PAYLOAD_SZ) ? src->len - offset
+                                                  : MCAST_PAYLOAD_SZ;
+}
+
+/*----------------------------------------------------------------------------*/
+
+/*
+ * Send a single datagram to the group. Lost datagrams are repaired later.
+ * Returns false on error, after printing it.
+ */
+static bool send_datagram(struct McastTx* tx,
+                          const struct DgramHeader* header,
+                          const void* payload,
+                          size_t payload_sz) {
+    dgram_put_header(tx->packet, MCAST_MAGIC, header);
+    memcpy(&tx->packet[MCAST_HEADER_SZ], payload, payload_sz);
+    return dgram_send(tx->udp_fd, tx->packet, MCAST_HEADER_SZ + payload_sz);
+}
+
+/*
+ * Answer a single repair request from the connected socket `sockfd'. The
+ * request contains the first datagram and the number of them, in 4 bytes each,
+ * and each of them is sent back with its header. Returns false if the
+ * connection should be closed, either because the receiver is done or because
+ * of an error.
+ */
+static bool serve_request(struct McastTx* tx, int sockfd) {
+    uint8_t request[8];
+    if (io_recv_full(sockfd, request, sizeof(request)) != sizeof(request))
+        return false;
+
+    const uint32_t first = load_be(&request[0], 4);
+    const uint32_t count = load_be(&request[4], 4);
+    if (first >= tx->sent || count > tx->sent - first) {
+        ERR("Received an invalid repair request.");
+        return false;
+    }
+
+    for (uint32_t seq = first; seq < first + count; seq++) {
+        const uint8_t* payload;
+        const size_t len = source_payload(&tx->src, seq, &payload);
+
+        const struct DgramHeader header = {
+            .session = tx->session,
+            .seq     = seq,
+            .type    = MCAST_TYPE_DATA,
+            .param   = tx->fec,
+            .len     = len,
+        };
+
+        uint8_t buf[MCAST_HEADER_SZ];
+        dgram_put_header(buf, MCAST_MAGIC, &header);
+        if (!io_send_all(sockfd, buf, sizeof(buf)) ||
+            !io_send_all(sockfd, payload, len)) {
+            ERR("Repair error: %s", strerror(errno));
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Wait up to `timeout_ns' for new receivers asking for repairs, and for their
+ * requests, and serve them. Returns false on error, after printing it.
+ */
+static bool serve_repairs(struct McastTx* tx, uint64_t timeout_ns) {
+    const struct timespec timeout = {
+        .tv_sec  = timeout_ns / NS_PER_SEC,
+        .tv_nsec = timeout_ns % NS_PER_SEC,
+    };
+
+    const int ready = ppoll(tx->pfds, 1 + tx->clients, &timeout, NULL);
+    if (ready < 0) {
+        if (errno == EINTR)
+            return true;
+
+        ERR("Poll error: %s", strerror(errno));
+        return false;
+    }
+    if (ready == 0)
+        return true;
+
+    /*
+     * Closed connections are replaced by the last one, which was already
+     * checked, since we iterate backwards.
+     */
+    for (size_t i = tx->clients; i > 0; i--) {
+        if (tx->pfds[i].revents == 0)
+            continue;
+
+        tx->last_repair_ns = stats_clock_ns();
+        if (!serve_request(tx, tx->pfds[i].fd)) {
+            close(tx->pfds[i].fd);
+            tx->pfds[i] = tx->pfds[tx->clients--];
+        }
+    }
+
+    if ((tx->pfds[0].revents & POLLIN) != 0) {
+        struct sockaddr_storage peer_addr;
+        const int sockfd = net_accept(tx->listen_fd, &peer_addr);
+        if (sockfd < 0)
+            return true;
+
+        if (tx->clients >= MCAST_MAX_REPAIR_CLIENTS) {
+            ERR("Too many receivers asking for repairs, ignoring one.");
+            close(sockfd);
+            return true;
+        }
+
+        tx->clients++;
+        tx->pfds[tx->clients].fd     = sockfd;
+        tx->pfds[tx->clients].events = POLLIN;
+        tx->last_repair_ns           = stats_clock_ns();
+    }
+
+    return true;
+}
+
+/*
+ * Wait until the next datagram can be sent at the rate of the transmitter,
+ * serving repairs in the meantime. If we are already late, the repairs are
+ * checked anyway every `DGRAM_MAX_BURST' datagrams, so they are not delayed
+ * until the end. Returns false on error, after printing it.
+ */
+static bool pace(struct McastTx* tx) {
+    uint64_t now = stats_clock_ns();
+    if (now >= tx->pacer.next_ns && tx->sent % DGRAM_MAX_BURST == 0 &&
+        !serve_repairs(tx, 0))
+        return false;
+
+    while (now < tx->pacer.next_ns && !g_signaled_quit) {
+        if (!serve_repairs(tx, tx->pacer.next_ns - now))
+            return false;
+        now = stats_clock_ns();
+    }
+
+    dgram_pacer_advance(&tx->pacer, now);
+    return true;
+}
+
+/*
+ * Send the parity datagram of the current group, if it has any data, and start
+ * a new one. Returns false on error, after printing it.
+ */
+static bool flush_parity(struct McastTx* tx) {
+    if (tx->parity_count == 0)
+        return true;
+
+    const struct DgramHeader header = {
+        .session = tx->session,
+        .seq     = (tx->sent - 1) / tx->fec,
+        .type    = MCAST_TYPE_PARITY,
+        .param   = tx->fec,
+        .len     = tx->parity_len,
+    };
+    if (!pace(tx) || !send_datagram(tx, &header, tx->parity, MCAST_PAYLOAD_SZ))
+        return false;
+
+    memset(tx->parity, 0, sizeof(tx->parity));
+    tx->parity_len   = 0;
+    tx->parity_count = 0;
+    return true;
+}
+
+/*
+ * Set up the UDP socket of the transmitter, connected to the group. Returns
+ * the socket, or -1 on error, after printing it.
+ */
+static int open_tx_socket(const struct sockaddr_in* group) {
+    struct in_addr iface;
+    if (!get_interface(&iface))
+        return -1;
+
+    const int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sockfd < 0) {
+        ERR("Could not create socket: %s", strerror(errno));
+        return -1;
+    }
+
+    const unsigned char ttl = MCAST_TTL;
+    if (setsockopt(sockfd,
+                   IPPROTO_IP,
+                   IP_MULTICAST_TTL,
+                   &ttl,
+                   sizeof(ttl)) != 0 ||
+        setsockopt(sockfd,
+                   IPPROTO_IP,
+                   IP_MULTICAST_IF,
+                   &iface,
+                   sizeof(iface)) != 0 ||
+        connect(sockfd, (const struct sockaddr*)group, sizeof(*group)) != 0) {
+        ERR("Could not set up the multicast socket: %s", strerror(errno));
+        close(sockfd);
+        return -1;
+    }
+
+    return sockfd;
+}
+
+bool mcast_transmit(int src_fd,
+                    const char* group,
+                    const char* port,
+                    size_t* total) {
+    bool result = false;
+
+    struct McastTx* tx = calloc(1, sizeof(struct McastTx));
+    if (tx == NULL) {
+        ERR("Failed to allocate %zu bytes: %s",
+            sizeof(struct McastTx),
+            strerror(errno));
+        return false;
+    }
+
+    tx->udp_fd    = -1;
+    tx->listen_fd = -1;
+    tx->session   = proto_new_session();
+    tx->fec       = (uint8_t)g_opt_fec;
+    dgram_pacer_set_rate(&tx->pacer,
+                         (g_opt_rate > 0) ? g_opt_rate : MCAST_DEFAULT_RATE,
+                         MCAST_HEADER_SZ + MCAST_PAYLOAD_SZ);
+    source_open(&tx->src, src_fd);
+
+    struct sockaddr_in addr;
+    if (!resolve_group(group, port, &addr))
+        goto cleanup;
+
+    tx->listen_fd = net_listen(port, SNC_LISTEN_QUEUE_SZ, false);
+    if (tx->listen_fd < 0)
+        goto cleanup;
+    tx->pfds[0].fd     = tx->listen_fd;
+    tx->pfds[0].events = POLLIN;
+
+    tx->udp_fd = open_tx_socket(&addr);
+    if (tx->udp_fd < 0)
+        goto cleanup;
+
+    if (g_opt_print_peer_info) {
+        print_separator(stderr);
+        fprintf(stderr,
+                "Sending to group '%s', port '%s', at %.0f Mbit/s.\n",
+                group,
+                port,
+                tx->pacer.rate / 1e6);
+        print_separator(stderr);
+    }
+
+    tx->pacer.next_ns = stats_clock_ns();
+    while (!g_signaled_quit) {
+        const size_t offset = (size_t)tx->sent * MCAST_PAYLOAD_SZ;
+        if (!source_fill(&tx->src, offset + MCAST_PAYLOAD_SZ))
+            goto cleanup;
+        if (offset >= tx->src.len)
+            break;
+
+        if (tx->sent == UINT32_MAX) {
+            ERR("The input is too big for a multicast transfer.");
+            goto cleanup;
+        }
+
+        const uint8_t* payload;
+        const size_t len = source_payload(&tx->src, tx->sent, &payload);
+
+        const struct DgramHeader header = {
+            .session = tx->session,
+            .seq     = tx->sent,
+            .type    = MCAST_TYPE_DATA,
+            .param   = tx->fec,
+            .len     = len,
+        };
+        if (!pace(tx) || !send_datagram(tx, &header, payload, len))
+            goto cleanup;
+
+        tx->sent++;
+        *total += len;
+        update_progress(*total);
+
+        if (tx->fec == 0)
+            continue;
+
+        for (size_t i = 0; i < len; i++)
+            tx->parity[i] ^= payload[i];
+        tx->parity_len ^= (uint16_t)len;
+        tx->parity_count++;
+
+        if (tx->parity_count == tx->fec && !flush_parity(tx))
+            goto cleanup;
+    }
+
+    if (tx->fec > 0 && !flush_parity(tx))
+        goto cleanup;
+
+    /*
+     * Announce the end of the transfer, which also tells the receivers what
+     * they are missing, until none of them needs anything else.
+     */
+    uint8_t end_payload[8];
+    store_be(end_payload, *total, sizeof(end_payload));
+
+    const struct DgramHeader end_header = {
+        .session = tx->session,
+        .seq     = tx->sent,
+        .type    = MCAST_TYPE_END,
+        .param   = tx->fec,
+        .len     = sizeof(end_payload),
+    };
+
+    tx->last_repair_ns = stats_clock_ns();
+    while (!g_signaled_quit) {
+        if (!send_datagram(tx, &end_header, end_payload, sizeof(end_payload)))
+            goto cleanup;
+
+        uint64_t now = stats_clock_ns();
+        if (tx->clients == 0 &&
+            now - tx->last_repair_ns >= MCAST_LINGER_MS * NS_PER_MS)
+            break;
+
+        const uint64_t deadline = now + MCAST_END_INTERVAL_MS * NS_PER_MS;
+        for (; now < deadline && !g_signaled_quit; now = stats_clock_ns())
+            if (!serve_repairs(tx, deadline - now))
+                goto cleanup;
+    }
+
+    result = true;
+
+cleanup:
+    for (size_t i = 1; i <= tx->clients; i++)
+        close(tx->pfds[i].fd);
+    if (tx->listen_fd > -1)
+        close(tx->listen_fd);
+    if (tx->udp_fd > -1)
+        close(tx->udp_fd);
+
+    source_close(&tx->src);
+    free(tx);
+    return result;
+}
+
+/*----------------------------------------------------------------------------*/
+
+static inline uint32_t window_base(const struct McastRx* rx) {
+    return (rx->fec > 0) ? rx->head - rx->head % rx->fec : rx->head;
+}
+
+/*
+ * The receiver holds the datagrams from the start of the parity group of
+ * `head', so the group can still be rebuilt after some of them were written.
+ */
+static inline uint32_t window_end(const struct McastRx* rx) {
+    const uint32_t end = window_base(rx) + MCAST_WINDOW;
+    return (rx->have_end && rx->count < end) ? rx->count : end;
+}
+
+static inline struct McastSlot* slot_of(const struct McastRx* rx,
+                                        uint32_t seq) {
+    return &rx->slots[seq % MCAST_WINDOW];
+}
+
+static inline bool have_datagram(const struct McastRx* rx, uint32_t seq) {
+    const struct McastSlot* slot = slot_of(rx, seq);
+    return slot->have && slot->seq == seq;
+}
+
+/*
+ * If a single datagram of the parity group `group' is missing, and we have its
+ * parity, rebuild it as the XOR of the parity and the rest of the group.
+ */
+static void try_recover(struct McastRx* rx, uint32_t group) {
+    const struct McastParity* parity =
+      &rx->parities[group % MCAST_PARITY_SLOTS];
+    if (!parity->have || parity->group != group)
+        return;
+
+    /*
+     * Until the end is announced, the last group seems to have `fec'
+     * datagrams, so a phantom one might be rebuilt with no data.
+     */
+    const uint32_t first = group * rx->fec;
+    uint32_t last        = first + rx->fec;
+    if (rx->have_end && rx->count < last)
+        last = rx->count;
+
+    uint32_t missing     = 0;
+    size_t missing_count = 0;
+    for (uint32_t seq = first; seq < last; seq++) {
+        if (!have_datagram(rx, seq)) {
+            missing = seq;
+            missing_count++;
+        }
+    }
+    if (missing_count != 1 || missing < window_base(rx) ||
+        missing >= window_end(rx))
+        return;
+
+    struct McastSlot* slot = slot_of(rx, missing);
+    memcpy(slot->data, parity->data, MCAST_PAYLOAD_SZ);
+    uint16_t len = parity->len;
+    for (uint32_t seq = first; seq < last; seq++) {
+        if (seq == missing)
+            continue;
+
+        const struct McastSlot* other = slot_of(rx, seq);
+        for (size_t i = 0; i < other->len; i++)
+            slot->data[i] ^= other->data[i];
+        len ^= other->len;
+    }
+    if (len == 0 || len > MCAST_PAYLOAD_SZ)
+        return;
+
+    slot->seq  = missing;
+    slot->len  = len;
+    slot->have = true;
+    (*rx->recovered)++;
+}
+
+/*
+ * Store a data datagram, if it's inside the window and we didn't have it.
+ * Returns true if it was stored.
+ */
+static bool store_data(struct McastRx* rx,
+                       uint32_t seq,
+                       const uint8_t* payload,
+                       size_t len) {
+    if (rx->have_end && seq >= rx->count)
+        return false;
+    if (seq >= rx->highest)
+        rx->highest = seq + 1;
+
+    if (len == 0 || len > MCAST_PAYLOAD_SZ || seq < window_base(rx) ||
+        seq >= window_end(rx) || have_datagram(rx, seq))
+        return false;
+
+    struct McastSlot* slot = slot_of(rx, seq);
+    memcpy(slot->data, payload, len);
+    slot->seq  = seq;
+    slot->len  = len;
+    slot->have = true;
+
+    if (rx->fec > 0)
+        try_recover(rx, seq / rx->fec);
+
+    return true;
+}
+
+static void store_parity(struct McastRx* rx,
+                         uint32_t group,
+                         uint16_t len,
+                         const uint8_t* payload) {
+    if (rx->fec == 0)
+        return;
+
+    const uint32_t first = group * rx->fec;
+    if (first + rx->fec <= window_base(rx) ||
+        first >= window_base(rx) + MCAST_WINDOW)
+        return;
+
+    struct McastParity* parity = &rx->parities[group % MCAST_PARITY_SLOTS];
+    if (parity->have && parity->group == group)
+        return;
+
+    memcpy(parity->data, payload, MCAST_PAYLOAD_SZ);
+    parity->group = group;
+    parity->len   = len;
+    parity->have  = true;
+
+    try_recover(rx, group);
+}
+
+static void store_end(struct McastRx* rx, uint32_t count) {
+    if (rx->have_end || count < rx->head)
+        return;
+
+    rx->have_end = true;
+    rx->count    = count;
+    if (rx->highest > count)
+        rx->highest = count;
+
+    /* The last group might be shorter, which we didn't know until now */
+    if (rx->fec > 0 && count > 0)
+        try_recover(rx, (count - 1) / rx->fec);
+}
+
+/*
+ * Write all the consecutive datagrams we have after `head' into the output.
+ * Returns false on error, after printing it.
+ */
+static bool flush_datagrams(struct McastRx* rx) {
+    while (rx->head < window_end(rx) && have_datagram(rx, rx->head)) {
+        const struct McastSlot* slot = slot_of(rx, rx->head);
+        if (!output_write(rx->dst_fd, slot->data, slot->len)) {
+            ERR("Write error: %s", strerror(errno));
+            return false;
+        }
+
+        *rx->total += slot->len;
+        update_progress(*rx->total);
+        rx->head++;
+    }
+
+    return true;
+}
+
+/*
+ * Ask the transmitter for the datagrams that were lost and couldn't be
+ * rebuilt, through the TCP connection, which is opened the first time. Returns
+ * false on error, after printing it.
+ */
+static bool request_repairs(struct McastRx* rx) {
+    uint32_t limit;
+    if (rx->have_end) {
+        limit = rx->count;
+    } else {
+        const uint32_t lag = MCAST_REPAIR_LAG + 2 * rx->fec;
+        if (rx->highest <= lag)
+            return true;
+        limit = rx->highest - lag;
+    }
+    if (limit > window_end(rx))
+        limit = window_end(rx);
+    if (rx->scanned < rx->head)
+        rx->scanned = rx->head;
+
+    while (rx->scanned < limit) {
+        if (have_datagram(rx, rx->scanned)) {
+            rx->scanned++;
+            continue;
+        }
+
+        const uint32_t first = rx->scanned;
+        while (rx->scanned < limit && !have_datagram(rx, rx->scanned))
+            rx->scanned++;
+
+        if (rx->repair_fd < 0) {
+            char host[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &rx->sender.sin_addr, host, sizeof(host));
+            rx->repair_fd = net_connect(host, rx->port);
+            if (rx->repair_fd < 0)
+                return false;
+        }
+
+        uint8_t request[8];
+        store_be(&request[0], first, 4);
+        store_be(&request[4], rx->scanned - first, 4);
+        if (!io_send_all(rx->repair_fd, request, sizeof(request))) {
+            ERR("Repair error: %s", strerror(errno));
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Receive a single repaired datagram from the TCP connection. Returns false on
+ * error, after printing it.
+ */
+static bool receive_repair(struct McastRx* rx) {
+    uint8_t buf[MCAST_HEADER_SZ + MCAST_PAYLOAD_SZ];
+    struct DgramHeader header;
+
+    ssize_t received = io_recv_full(rx->repair_fd, buf, MCAST_HEADER_SZ);
+    if (received < 0) {
+        ERR("Repair error: %s", strerror(errno));
+        return false;
+    }
+    if (received != MCAST_HEADER_SZ || !get_header(buf, received, &header) ||
+        header.type != MCAST_TYPE_DATA || header.session != rx->lock.session ||
+        header.len > MCAST_PAYLOAD_SZ) {
+        ERR("Received an invalid repair.");
+        return false;
+    }
+
+    received = io_recv_full(rx->repair_fd, &buf[MCAST_HEADER_SZ], header.len);
+    if (received != header.len) {
+        ERR("Repair error: %s",
+            (received < 0) ? strerror(errno) : "Connection closed");
+        return false;
+    }
+
+    rx->last_ns = stats_clock_ns();
+    if (store_data(rx, header.seq, &buf[MCAST_HEADER_SZ], header.len))
+        (*rx->repaired)++;
+
+    return true;
+}
+
+/*
+ * Receive the datagrams queued in the multicast socket, through the simulator.
+ * The first valid one decides which transfer we receive. Returns false on
+ * error, after printing it.
+ */
+static bool receive_datagrams(struct McastRx* rx) {
+    uint8_t buf[MCAST_HEADER_SZ + MCAST_PAYLOAD_SZ];
+
+    for (int i = 0; i < MCAST_RECV_BATCH; i++) {
+        struct sockaddr_in from;
+        const ssize_t received =
+          sim_recvfrom(&rx->sim, rx->udp_fd, buf, sizeof(buf), &from);
+        if (received < 0) {
+            ERR("Receive error: %s", strerror(errno));
+            return false;
+        }
+        if (received == 0)
+            return true;
+
+        struct DgramHeader header;
+        if (!get_header(buf, received, &header))
+            continue;
+
+        switch (dgram_lock(&rx->lock, header.session, &from, "multicast")) {
+            case DGRAM_LOCK_NEW:
+                rx->sender = from;
+                rx->fec    = header.param;
+                break;
+
+            case DGRAM_LOCK_SAME:
+                break;
+
+            case DGRAM_LOCK_OTHER:
+                continue;
+        }
+
+        rx->last_ns             = stats_clock_ns();
+        const uint8_t* payload  = &buf[MCAST_HEADER_SZ];
+        const size_t payload_sz = received - MCAST_HEADER_SZ;
+        switch (header.type) {
+            case MCAST_TYPE_DATA:
+                if (header.len == payload_sz)
+                    store_data(rx, header.seq, payload, payload_sz);
+                break;
+
+            case MCAST_TYPE_PARITY:
+                if (payload_sz == MCAST_PAYLOAD_SZ)
+                    store_parity(rx, header.seq, header.len, payload);
+                break;
+
+            case MCAST_TYPE_END:
+                if (payload_sz == 8)
+                    store_end(rx, header.seq);
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Set up the UDP socket of the receiver, bound to the group and joined to it.
+ * Returns the socket, or -1 on error, after printing it.
+ */
+static int open_rx_socket(const struct sockaddr_in* group) {
+    struct ip_mreq mreq;
+    mreq.imr_multiaddr = group->sin_addr;
+    if (!get_interface(&mreq.imr_interface))
+        return -1;
+
+    const int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sockfd < 0) {
+        ERR("Could not create socket: %s", strerror(errno));
+        return -1;
+    }
+
+    /*
+     * Several receivers might be on the same host. The receive buffer might be
+     * limited by the system, so it's only a hint.
+     */
+    const int enable    = 1;
+    const int buffer_sz = MCAST_SOCKET_BUFFER;
+    setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &buffer_sz, sizeof(buffer_sz));
+    if (setsockopt(sockfd,
+                   SOL_SOCKET,
+                   SO_REUSEADDR,
+                   &enable,
+                   sizeof(enable)) != 0 ||
+        bind(sockfd, (const struct sockaddr*)group, sizeof(*group)) != 0 ||
+        setsockopt(sockfd,
+                   IPPROTO_IP,
+                   IP_ADD_MEMBERSHIP,
+                   &mreq,
+                   sizeof(mreq)) != 0) {
+        ERR("Could not join the multicast group: %s", strerror(errno));
+        close(sockfd);
+        return -1;
+    }
+
+    return sockfd;
+}
+
+bool mcast_receive(const char* group,
+                   const char* port,
+                   int dst_fd,
+                   size_t* total,
+                   size_t* recovered,
+                   size_t* repaired) {
+    bool result = false;
+
+    struct McastRx rx;
+    memset(&rx, 0, sizeof(rx));
+    rx.udp_fd    = -1;
+    rx.repair_fd = -1;
+    rx.dst_fd    = dst_fd;
+    rx.port      = port;
+    rx.total     = total;
+    rx.recovered = recovered;
+    rx.repaired  = repaired;
+
+    if (!sim_init(&rx.sim))
+        return false;
+
+    rx.slots    = calloc(MCAST_WINDOW, sizeof(struct McastSlot));
+    rx.parities = calloc(MCAST_PARITY_SLOTS, sizeof(struct McastParity));
+    if (rx.slots == NULL || rx.parities == NULL) {
+        ERR("Failed to allocate the multicast window: %s", strerror(errno));
+        goto cleanup;
+    }
+
+    struct sockaddr_in addr;
+    if (!resolve_group(group, port, &addr))
+        goto cleanup;
+
+    rx.udp_fd = open_rx_socket(&addr);
+    if (rx.udp_fd < 0)
+        goto cleanup;
+
+    while (!g_signaled_quit && !(rx.have_end && rx.head == rx.count)) {
+        struct pollfd pfds[2] = {
+            { .fd = rx.udp_fd, .events = POLLIN },
+            { .fd = rx.repair_fd, .events = POLLIN },
+        };
+
+        const uint64_t timeout_ns =
+          sim_timeout_ns(&rx.sim, MCAST_END_INTERVAL_MS * NS_PER_MS);
+        const struct timespec timeout = {
+            .tv_sec  = timeout_ns / NS_PER_SEC,
+            .tv_nsec = timeout_ns % NS_PER_SEC,
+        };
+
+        if (ppoll(pfds, LENGTH(pfds), &timeout, NULL) < 0) {
+            if (errno == EINTR)
+                continue;
+
+            ERR("Poll error: %s", strerror(errno));
+            goto cleanup;
+        }
+
+        /* Delayed datagrams might be due even if nothing arrived */
+        if (((pfds[0].revents & POLLIN) != 0 || rx.sim.len > 0) &&
+            !receive_datagrams(&rx))
+            goto cleanup;
+        if (pfds[1].revents != 0 && !receive_repair(&rx))
+            goto cleanup;
+
+        if (!flush_datagrams(&rx) || !request_repairs(&rx))
+            goto cleanup;
+
+        if (rx.lock.locked &&
+            stats_clock_ns() - rx.last_ns >= MCAST_TIMEOUT_MS * NS_PER_MS) {
+            ERR("Timed out waiting for the transmitter.");
+            goto cleanup;
+        }
+    }
+
+    result = true;
+
+cleanup:
+    if (rx.repair_fd > -1)
+        close(rx.repair_fd);
+    if (rx.udp_fd > -1)
+        close(rx.udp_fd);
+
+    free(rx.slots);
+    free(rx.parities);
+    sim_free(&rx.sim);
+    return result;
+}
@@ -0,0 +1,361 @@
+/*
+ * Copyright 2025 8dcc
+ *
+ * This file is part of snc (Simple NetCat).
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE /* TCP_INFO, TCP_NOTSENT_LOWAT, SO_SNDBUFFORCE */
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <unistd.h> /* close() */
+#include <netdb.h>  /* getaddrinfo(), etc. */
+#include <sys/types.h>
+#include <sys/socket.h>  /* socket(), etc. */
+#include <netinet/in.h>  /* IPPROTO_TCP */
+#include <netinet/tcp.h> /* TCP_INFO, TCP_NOTSENT_LOWAT, TCP_NODELAY */
+
+#include "include/util.h"
+#include "include/main.h"
+#include "include/net.h"
+
+/*----------------------------------------------------------------------------*/
+
+/*
+ * Set the send or receive buffer of `sockfd' to `size' bytes. If we have the
+ * `CAP_NET_ADMIN' capability, we can go past the system-wide maximum. Returns
+ * the size actually used by the kernel.
+ */
+static int set_buffer(int sockfd, bool transmitting, int size) {
+    const int force_opt  = transmitting ? SO_SNDBUFFORCE : SO_RCVBUFFORCE;
+    const int normal_opt = transmitting ? SO_SNDBUF : SO_RCVBUF;
+    if (setsockopt(sockfd, SOL_SOCKET, force_opt, &size, sizeof(size)) != 0)
+        setsockopt(sockfd, SOL_SOCKET, normal_opt, &size, sizeof(size));
+
+    int result           = 0;
+    socklen_t result_len = sizeof(result);
+    getsockopt(sockfd, SOL_SOCKET, normal_opt, &result, &result_len);
+    return result;
+}
+
+/*----------------------------------------------------------------------------*/
+
+int net_listen(const char* port, int backlog, bool reuse_port) {
+    int status        = 0;
+    int sockfd_listen = -1;
+
+    /*
+     * Initialize the `addrinfo' structure with the hints for `getaddrinfo'.
+     *
+     *   1. The family: IPv4 (AF_INET).
+     *   1. The socket type: TCP (SOCK_STREAM).
+     *   3. Set the `AI_PASSIVE' flag to indicate that we want to deal with
+     *      our own IP address.
+     */
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags    = AI_PASSIVE;
+
+    /*
+     * Obtain the address information from the specified hints.
+     *
+     * Note how we use `NULL', along with the `AI_PASSIVE' flag in `hints', to
+     * indicate that we want to obtain information about or own IP address.
+     */
+    struct addrinfo* self_info = NULL;
+    status = getaddrinfo(NULL, port, &hints, &self_info);
+    if (status != 0) {
+        ERR("Could not obtaining our address info: %s", gai_strerror(status));
+        return -1;
+    }
+
+    /*
+     * We obtain the socket descriptor using the values from the `addrinfo'
+     * structure that `getaddrinfo' filled.
+     */
+    sockfd_listen = socket(self_info->ai_family,
+                           self_info->ai_socktype,
+                           self_info->ai_protocol);
+    if (sockfd_listen < 0) {
+        ERR("Could not create socket: %s", strerror(errno));
+        goto fail;
+    }
+
+    /*
+     * Allow binding to the port even if there are old connections on it in the
+     * TIME_WAIT state. Otherwise, restarting the receiver right after a
+     * transfer would fail for a while.
+     */
+    const int enable = 1;
+    setsockopt(sockfd_listen,
+               SOL_SOCKET,
+               SO_REUSEADDR,
+               &enable,
+               sizeof(enable));
+
+    /*
+     * If requested, other sockets can bind to the same port as long as they
+     * also set this option, and the kernel distributes the incoming connections
+     * between them.
+     */
+    if (reuse_port && setsockopt(sockfd_listen,
+                                 SOL_SOCKET,
+                                 SO_REUSEPORT,
+                                 &enable,
+                                 sizeof(enable)) != 0) {
+        ERR("Could not enable 'SO_REUSEPORT': %s", strerror(errno));
+        goto fail;
+    }
+
+    /*
+     * We `bind' the local port to the socket descriptor. The port (along with
+     * the IP address) should be inside a `sockaddr' structure; and,
+     * conveniently, `getaddrinfo' filled that information inside the
+     * `self_info->ai_addr' member.
+     */
+    status = bind(sockfd_listen, self_info->ai_addr, self_info->ai_addrlen);
+    if (status != 0) {
+        ERR("Could not bind port to socket descriptor: %s", strerror(errno));
+        goto fail;
+    }
+
+    /*
+     * We listen for incoming connections on the port we just bound to the
+     * socket descriptor. The second argument indicates the maximum number of
+     * connections that can be queued before being accepted.
+     */
+    status = listen(sockfd_listen, backlog);
+    if (status != 0) {
+        ERR("Could not listen for connections: %s", strerror(errno));
+        goto fail;
+    }
+
+    freeaddrinfo(self_info);
+    return sockfd_listen;
+
+fail:
+    if (sockfd_listen > -1)
+        close(sockfd_listen);
+    freeaddrinfo(self_info);
+    return -1;
+}
+
+int net_accept(int sockfd_listen, struct sockaddr_storage* peer_addr) {
+    /*
+     * We accept the incoming connection, and we get a new socket descriptor. It
+     * will be used to read (and optionally write) data.
+     *
+     * The function will fill the second and third arguments with the address
+     * information of the peer. We use `sockaddr_storage' since it's guaranteed
+     * to be "at least as large as any other `sockaddr_*' address structure".
+     * See also sockaddr(3type).
+     *
+     * The call to `accept' normally blocks the program until a connection is
+     * received.
+     */
+    socklen_t peer_addr_sz = sizeof(*peer_addr);
+    const int sockfd_connection =
+      accept(sockfd_listen, (struct sockaddr*)peer_addr, &peer_addr_sz);
+    if (sockfd_connection < 0)
+        ERR("Could not accept incoming connection: %s", strerror(errno));
+
+    return sockfd_connection;
+}
+
+int net_connect(const char* host, const char* port) {
+    int status = 0;
+    int sockfd = -1;
+
+    /*
+     * Initialize the `addrinfo' structure with the hints for `getaddrinfo'.
+     *
+     *   1. The family: IPv4 (AF_INET).
+     *   2. The socket type: TCP (SOCK_STREAM).
+     */
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+
+    /*
+     * Obtain the address information from the specified hints.
+     */
+    struct addrinfo* server_info = NULL;
+    status = getaddrinfo(host, port, &hints, &server_info);
+    if (status != 0) {
+        ERR("Could not obtaining address info: %s", gai_strerror(status));
+        return -1;
+    }
+
+    /*
+     * We obtain the socket descriptor using the values from the `addrinfo'
+     * structure that `getaddrinfo' filled.
+     */
+    sockfd = socket(server_info->ai_family,
+                    server_info->ai_socktype,
+                    server_info->ai_protocol);
+    if (sockfd < 0) {
+        ERR("Could not create socket: %s", strerror(errno));
+        goto fail;
+    }
+
+    /*
+     * Connect to the actual server. Again, using the values from the `addrinfo'
+     * structure.
+     */
+    status = connect(sockfd, server_info->ai_addr, server_info->ai_addrlen);
+    if (status != 0) {
+        ERR("Connection error: %s", strerror(errno));
+        goto fail;
+    }
+
+    freeaddrinfo(server_info);
+    return sockfd;
+
+fail:
+    if (sockfd > -1)
+        close(sockfd);
+    freeaddrinfo(server_info);
+    return -1;
+}
+
+const char* net_split_port(char* destination, const char* default_port) {
+    char* colon = strchr(destination, ':');
+    if (colon == NULL || strchr(colon + 1, ':') != NULL)
+        return default_port;
+
+    *colon = '\0';
+    return colon + 1;
+}
+
+void net_set_low_latency(int sockfd, bool transmitting) {
+    const int nodelay = 1;
+    setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+    if (!transmitting) {
+        const int busy_poll = NET_BUSY_POLL_US;
+        setsockopt(sockfd,
+                   SOL_SOCKET,
+                   SO_BUSY_POLL,
+                   &busy_poll,
+                   sizeof(busy_poll));
+    }
+}
+
+void net_tune(int sockfd,
+              bool transmitting,
+              size_t stream_count,
+              size_t block_sz,
+              struct NetTuning* tuning) {
+    memset(tuning, 0, sizeof(*tuning));
+    tuning->block_sz = block_sz;
+
+    struct tcp_info info;
+    socklen_t info_len = sizeof(info);
+    if (getsockopt(sockfd, IPPROTO_TCP, TCP_INFO, &info, &info_len) == 0)
+        tuning->rtt_us = info.tcpi_rtt;
+
+    const int buffer_opt = transmitting ? SO_SNDBUF : SO_RCVBUF;
+    socklen_t buffer_len = sizeof(tuning->buffer_sz);
+    getsockopt(sockfd,
+               SOL_SOCKET,
+               buffer_opt,
+               &tuning->buffer_sz,
+               &buffer_len);
+
+    if (g_opt_socket_buffer > 0) {
+        tuning->buffer_sz =
+          set_buffer(sockfd, transmitting, (int)g_opt_socket_buffer);
+    } else if (g_opt_tune && tuning->rtt_us > 0) {
+        /*
+         * Twice the bandwidth-delay product of this connection, so the window
+         * doesn't close while recovering from a loss. If the kernel already
+         * uses a bigger buffer, keep its automatic tuning.
+         */
+        const double rate = g_opt_tune_rate / 8 / stream_count;
+        double target     = 2 * rate * tuning->rtt_us / 1e6;
+        if (target > NET_TUNE_MAX_BUFFER)
+            target = NET_TUNE_MAX_BUFFER;
+        if (target > tuning->buffer_sz)
+            tuning->buffer_sz = set_buffer(sockfd, transmitting, (int)target);
+    }
+
+#ifndef FIXED_BLOCK_SIZE
+    /*
+     * Use blocks of about 1/16 of the buffer, rounded to a power of two, so
+     * several of them fit in flight.
+     */
+    if (g_opt_tune_block_size && tuning->buffer_sz > 0) {
+        size_t new_block_sz = NET_TUNE_MIN_BLOCK;
+        while (new_block_sz < (size_t)tuning->buffer_sz / 16 &&
+               new_block_sz < NET_TUNE_MAX_BLOCK)
+            new_block_sz *= 2;
+        tuning->block_sz = new_block_sz;
+    }
+#endif /* not FIXED_BLOCK_SIZE */
+
+    /*
+     * When transmitting, don't let the unsent data pile up in the socket
+     * beyond a couple of blocks; the data that was sent but not acknowledged
+     * doesn't count.
+     */
+    int lowat = 0;
+    if (transmitting && g_opt_notsent_lowat > 0)
+        lowat = (int)g_opt_notsent_lowat;
+    else if (transmitting && g_opt_tune)
+        lowat = (2 * tuning->block_sz > NET_TUNE_MIN_LOWAT)
+                  ? (int)(2 * tuning->block_sz)
+                  : NET_TUNE_MIN_LOWAT;
+
+    if (lowat > 0 &&
+        setsockopt(sockfd,
+                   IPPROTO_TCP,
+                   TCP_NOTSENT_LOWAT,
+                   &lowat,
+                   sizeof(lowat)) == 0)
+        tuning->notsent_lowat = lowat;
+
+    if (g_opt_low_latency) {
+        net_set_low_latency(sockfd, transmitting);
+        tuning->low_latency = true;
+    }
+}
+
+void net_print_tuning(FILE* fp,
+                      bool transmitting,
+                      const struct NetTuning* tuning) {
+    fprintf(fp,
+            "Tuning: RTT %.3f ms, %s buffer %d bytes, ",
+            tuning->rtt_us / 1000.0,
+            transmitting ? "send" : "receive",
+            tuning->buffer_sz);
+
+    if (tuning->notsent_lowat > 0)
+        fprintf(fp,
+                "not-sent low-water mark %d bytes, ",
+                tuning->notsent_lowat);
+
+    if (tuning->low_latency)
+        fprintf(fp, "low latency, ");
+
+    fprintf(fp, "block size %zu bytes.\n", tuning->block_sz);
+}
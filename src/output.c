@@ -0,0 +1,292 @@
+/*
+ * Copyright 2025 8dcc
+ *
+ * This file is part of snc (Simple NetCat).
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE /* fallocate(), sync_file_range(), O_DIRECT */
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h> /* pwrite(), lseek() */
+#include <fcntl.h>  /* fallocate(), sync_file_range(), fcntl() */
+#include <sys/types.h>
+
+#include "include/util.h"
+#include "include/main.h"
+#include "include/io.h"
+#include "include/stats.h"
+#include "include/output.h"
+
+/*
+ * State of the current transfer. There is a single output file per process, so
+ * it's simply global.
+ */
+static struct {
+    int fd;
+    bool active, direct;
+
+    /* Offset of the file where the transfer started */
+    off_t base;
+
+    /* Bytes written after `base', and bytes whose write-back was started */
+    uint64_t written, behind;
+
+    /* Aligned buffer for `O_DIRECT', with `staged' bytes not written yet */
+    uint8_t* staging;
+    size_t staged;
+} output = { .fd = -1 };
+
+/*----------------------------------------------------------------------------*/
+
+/*
+ * Enable or disable `O_DIRECT' for the output. Returns false on error, with
+ * `errno' set.
+ */
+static bool set_direct(bool enable) {
+    const int flags = fcntl(output.fd, F_GETFL);
+    if (flags < 0)
+        return false;
+
+    const int new_flags = enable ? flags | O_DIRECT : flags & ~O_DIRECT;
+    return fcntl(output.fd, F_SETFL, new_flags) == 0;
+}
+
+/*
+ * Write all `data_sz' bytes from `data' into the output at `offset'. Returns
+ * false on error, with `errno' set.
+ */
+static bool pwrite_all(const uint8_t* data, size_t data_sz, off_t offset) {
+    while (data_sz > 0) {
+        const uint64_t start  = stats_start_call(STATS_CALL_WRITE);
+        const ssize_t written = pwrite(output.fd, data, data_sz, offset);
+        stats_end_call(STATS_CALL_WRITE, STATS_WAIT_IO, start, written);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+
+        data += written;
+        data_sz -= written;
+        offset += written;
+    }
+
+    return true;
+}
+
+/*
+ * Write the staged data. The aligned part is written directly, and anything
+ * after it (only at the start and at the end of the transfer) goes through the
+ * page cache. If the file system doesn't accept the direct write after all,
+ * everything is written through the page cache from now on.
+ */
+static bool write_staged(void) {
+    const off_t offset = output.base + (off_t)output.written;
+    size_t aligned_sz  = 0;
+    if (offset % OUTPUT_DIRECT_ALIGN == 0)
+        aligned_sz = output.staged - output.staged % OUTPUT_DIRECT_ALIGN;
+
+    if (aligned_sz > 0 && !pwrite_all(output.staging, aligned_sz, offset)) {
+        if (errno != EINVAL || !set_direct(false))
+            return false;
+        output.direct = false;
+        aligned_sz    = 0;
+    }
+
+    if (aligned_sz < output.staged) {
+        if (output.direct && !set_direct(false))
+            return false;
+        if (!pwrite_all(&output.staging[aligned_sz],
+                        output.staged - aligned_sz,
+                        offset + (off_t)aligned_sz))
+            return false;
+        if (output.direct && !set_direct(true))
+            return false;
+    }
+
+    output.written += output.staged;
+    output.staged = 0;
+
+    /* If we stopped writing directly, the next writes use the position */
+    if (!output.direct &&
+        lseek(output.fd, output.base + (off_t)output.written, SEEK_SET) < 0)
+        return false;
+
+    return true;
+}
+
+/*
+ * Start writing back the data written since the last step, and wait for the
+ * step before it, dropping it from the page cache. The errors are ignored,
+ * since this is only a hint; actual write errors are reported by the writes.
+ */
+static void write_behind(void) {
+    while (output.written - output.behind >= OUTPUT_WRITE_BEHIND_SZ) {
+        const off_t offset = output.base + (off_t)output.behind;
+        sync_file_range(output.fd,
+                        offset,
+                        OUTPUT_WRITE_BEHIND_SZ,
+                        SYNC_FILE_RANGE_WRITE);
+
+        if (output.behind >= OUTPUT_WRITE_BEHIND_SZ) {
+            const off_t prev_offset = offset - OUTPUT_WRITE_BEHIND_SZ;
+            sync_file_range(output.fd,
+                            prev_offset,
+                            OUTPUT_WRITE_BEHIND_SZ,
+                            SYNC_FILE_RANGE_WAIT_BEFORE |
+                              SYNC_FILE_RANGE_WRITE |
+                              SYNC_FILE_RANGE_WAIT_AFTER);
+            posix_fadvise(output.fd,
+                          prev_offset,
+                          OUTPUT_WRITE_BEHIND_SZ,
+                          POSIX_FADV_DONTNEED);
+        }
+
+        output.behind += OUTPUT_WRITE_BEHIND_SZ;
+    }
+}
+
+/*----------------------------------------------------------------------------*/
+
+bool output_begin(int fd, uint64_t expected_sz) {
+    output.fd      = fd;
+    output.active  = g_opt_output != NULL && io_fd_type(fd) == IO_FD_REGULAR;
+    output.direct  = false;
+    output.written = 0;
+    output.behind  = 0;
+    output.staged  = 0;
+
+    if (!output.active)
+        return true;
+
+    output.base = lseek(fd, 0, SEEK_CUR);
+    if (output.base < 0) {
+        ERR("Could not get the output position: %s", strerror(errno));
+        return false;
+    }
+
+    /*
+     * Reserve the space without changing the size of the file, so an
+     * interrupted transfer can still be resumed from the end of the file. Not
+     * all file systems support it, so errors are ignored.
+     */
+    if (expected_sz > 0)
+        fallocate(fd, FALLOC_FL_KEEP_SIZE, output.base, (off_t)expected_sz);
+
+    if (g_opt_direct) {
+        const int status = (output.staging != NULL)
+                             ? 0
+                             : posix_memalign((void**)&output.staging,
+                                              OUTPUT_DIRECT_ALIGN,
+                                              OUTPUT_DIRECT_BUF_SZ);
+        if (status != 0) {
+            output.staging = NULL;
+            ERR("Failed to allocate %d bytes: %s",
+                OUTPUT_DIRECT_BUF_SZ,
+                strerror(status));
+            return false;
+        }
+
+        /* If the file system doesn't support it, use the page cache */
+        output.direct = set_direct(true);
+    }
+
+    return true;
+}
+
+bool output_is_direct(void) {
+    return output.active && output.direct;
+}
+
+bool output_write(int fd, const void* data, size_t data_sz) {
+    if (!output.active || fd != output.fd)
+        return io_write_all(fd, data, data_sz);
+
+    if (!output.direct) {
+        if (!io_write_all(fd, data, data_sz))
+            return false;
+        output_written(fd, data_sz);
+        return true;
+    }
+
+    const uint8_t* ptr = data;
+    while (data_sz > 0) {
+        /*
+         * If the transfer didn't start at an aligned offset, the first write
+         * only reaches the next aligned offset.
+         */
+        const off_t offset = output.base + (off_t)output.written;
+        const size_t limit =
+          (offset % OUTPUT_DIRECT_ALIGN != 0)
+            ? OUTPUT_DIRECT_ALIGN - (size_t)(offset % OUTPUT_DIRECT_ALIGN)
+            : OUTPUT_DIRECT_BUF_SZ;
+
+        const size_t chunk_sz =
+          (limit - output.staged < data_sz) ? limit - output.staged : data_sz;
+        memcpy(&output.staging[output.staged], ptr, chunk_sz);
+        output.staged += chunk_sz;
+        ptr += chunk_sz;
+        data_sz -= chunk_sz;
+
+        if (output.staged == limit && !write_staged())
+            return false;
+    }
+
+    return true;
+}
+
+void output_written(int fd, size_t data_sz) {
+    if (!output.active || fd != output.fd || output.direct)
+        return;
+
+    output.written += data_sz;
+    write_behind();
+}
+
+bool output_end(void) {
+    if (!output.active)
+        return true;
+
+    bool result = true;
+    if (output.direct) {
+        if (output.staged > 0 && !write_staged()) {
+            ERR("Write error: %s", strerror(errno));
+            result = false;
+        }
+
+        /*
+         * Since we used pwrite(2), leave the position of the output after the
+         * written data, just like a normal sequence of writes would.
+         */
+        set_direct(false);
+        lseek(output.fd, output.base + (off_t)output.written, SEEK_SET);
+    } else {
+        sync_file_range(output.fd,
+                        output.base + (off_t)output.behind,
+                        0,
+                        SYNC_FILE_RANGE_WRITE);
+    }
+
+    free(output.staging);
+    output.staging = NULL;
+    output.active  = false;
+    return result;
+}
@@ -0,0 +1,217 @@
+/*
+ * Copyright 2025 8dcc
+ *
+ * This file is part of snc (Simple NetCat).
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE /* getrandom() */
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <unistd.h> /* getpid() */
+#include <sys/types.h>
+#include <sys/socket.h> /* recv() */
+#include <sys/random.h> /* getrandom() */
+
+#include "include/util.h"
+#include "include/io.h"
+#include "include/proto.h"
+
+/*----------------------------------------------------------------------------*/
+
+bool proto_detect(int sockfd) {
+    char buf[PROTO_MAGIC_SZ];
+    int flags = MSG_PEEK;
+
+    for (;;) {
+        const ssize_t received = recv(sockfd, buf, sizeof(buf), flags);
+        if (received < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        if (received == 0)
+            return false;
+
+        if (memcmp(buf, PROTO_MAGIC, received) != 0)
+            return false;
+        if (received == PROTO_MAGIC_SZ)
+            return true;
+
+        /*
+         * If we were already waiting for the whole magic, the peer closed the
+         * connection (or we were interrupted) before sending it.
+         */
+        if (flags & MSG_WAITALL)
+            return false;
+
+        /*
+         * What we received so far matches the magic, so it's safe to wait for
+         * the rest of it.
+         */
+        flags |= MSG_WAITALL;
+    }
+}
+
+uint32_t proto_new_session(void) {
+    uint32_t result;
+    if (getrandom(&result, sizeof(result), 0) == sizeof(result))
+        return result;
+
+    return (uint32_t)time(NULL) ^ ((uint32_t)getpid() << 16);
+}
+
+bool proto_send_header(int sockfd, const struct ProtoHeader* header) {
+    uint8_t buf[PROTO_HEADER_SZ];
+    memset(buf, 0, sizeof(buf));
+
+    memcpy(&buf[0], PROTO_MAGIC, PROTO_MAGIC_SZ);
+    store_be(&buf[8], header->version, 1);
+    store_be(&buf[9], header->flags, 1);
+    store_be(&buf[10], header->stream_idx, 2);
+    store_be(&buf[12], header->stream_count, 2);
+    /* Bytes 14..15 are reserved */
+    store_be(&buf[16], header->session, 4);
+    store_be(&buf[20], header->block_sz, 4);
+    store_be(&buf[24], header->total_sz, 8);
+
+    return io_send_all(sockfd, buf, sizeof(buf));
+}
+
+bool proto_recv_header(int sockfd, struct ProtoHeader* header) {
+    uint8_t buf[PROTO_HEADER_SZ];
+
+    const ssize_t received = io_recv_full(sockfd, buf, sizeof(buf));
+    if (received < 0) {
+        ERR("Could not receive connection header: %s", strerror(errno));
+        return false;
+    }
+    if (received != sizeof(buf) ||
+        memcmp(&buf[0], PROTO_MAGIC, PROTO_MAGIC_SZ) != 0) {
+        ERR("Received invalid connection header.");
+        return false;
+    }
+
+    header->version      = load_be(&buf[8], 1);
+    header->flags        = load_be(&buf[9], 1);
+    header->stream_idx   = load_be(&buf[10], 2);
+    header->stream_count = load_be(&buf[12], 2);
+    header->session      = load_be(&buf[16], 4);
+    header->block_sz     = load_be(&buf[20], 4);
+    header->total_sz     = load_be(&buf[24], 8);
+
+    if (header->version != PROTO_VERSION) {
+        ERR("Unsupported protocol version: %d.", header->version);
+        return false;
+    }
+
+    if ((header->flags & ~PROTO_FLAGS_KNOWN) != 0) {
+        ERR("Unsupported flags in connection header: 0x%x.", header->flags);
+        return false;
+    }
+
+    if (header->stream_count == 0 ||
+        header->stream_idx >= header->stream_count) {
+        ERR("Invalid stream index in connection header.");
+        return false;
+    }
+
+    if (header->block_sz == 0 || header->block_sz > PROTO_MAX_BLOCK_SZ) {
+        ERR("Invalid block size in connection header: %lu.",
+            (unsigned long)header->block_sz);
+        return false;
+    }
+
+    return true;
+}
+
+void proto_encode_block(const struct ProtoBlock* block, void* dst) {
+    uint8_t* buf = dst;
+    store_be(&buf[0], block->type, 1);
+    store_be(&buf[1], block->codec, 1);
+    store_be(&buf[2], 0, 2);
+    store_be(&buf[4], block->len, 4);
+    store_be(&buf[8], block->seq, 8);
+}
+
+bool proto_decode_block(const void* src,
+                        uint32_t block_sz,
+                        struct ProtoBlock* block) {
+    const uint8_t* buf = src;
+    block->type        = load_be(&buf[0], 1);
+    block->codec       = load_be(&buf[1], 1);
+    block->len         = load_be(&buf[4], 4);
+    block->seq         = load_be(&buf[8], 8);
+
+    switch (block->type) {
+        case PROTO_BLOCK_DATA:
+            return (block->codec == PROTO_CODEC_RAW ||
+                    block->codec == PROTO_CODEC_LZ) &&
+                   block->len <= block_sz;
+
+        case PROTO_BLOCK_END:
+            return block->codec == PROTO_CODEC_RAW &&
+                   (block->len == 0 || block->len == PROTO_TRAILER_SZ);
+
+        default:
+            return false;
+    }
+}
+
+void proto_encode_trailer(uint32_t checksum, void* dst) {
+    store_be(dst, checksum, PROTO_TRAILER_SZ);
+}
+
+uint32_t proto_decode_trailer(const void* src) {
+    return load_be(src, PROTO_TRAILER_SZ);
+}
+
+bool proto_send_resume(int sockfd, const struct ProtoResume* resume) {
+    uint8_t buf[PROTO_RESUME_SZ];
+    store_be(&buf[0], resume->offset, 8);
+    store_be(&buf[8], resume->tail_sz, 4);
+    store_be(&buf[12], resume->tail_checksum, 4);
+
+    if (!io_send_all(sockfd, buf, sizeof(buf))) {
+        ERR("Could not send resume message: %s", strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+bool proto_recv_resume(int sockfd, struct ProtoResume* resume) {
+    uint8_t buf[PROTO_RESUME_SZ];
+
+    const ssize_t received = io_recv_full(sockfd, buf, sizeof(buf));
+    if (received < 0) {
+        ERR("Could not receive resume message: %s", strerror(errno));
+        return false;
+    }
+    if (received != sizeof(buf)) {
+        ERR("Connection closed while negotiating the resume offset.");
+        return false;
+    }
+
+    resume->offset        = load_be(&buf[0], 8);
+    resume->tail_sz       = load_be(&buf[8], 4);
+    resume->tail_checksum = load_be(&buf[12], 4);
+    return true;
+}
@@ -16,21 +16,36 @@
  * this program. If not, see <https://www.gnu.org/licenses/>.
  */
 
-#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE /* splice(), tee(), F_SETPIPE_SZ */
 
 #include <errno.h>
 #include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <assert.h>
 #include <stdio.h>
 #include <string.h>
+#include <signal.h> /* signal() */
 
-#include <unistd.h> /* close() */
-#include <netdb.h>  /* getaddrinfo(), etc. */
+#include <unistd.h> /* close(), pipe(), read(), ftruncate() */
+#include <fcntl.h>  /* splice(), tee(), fcntl() */
 #include <sys/types.h>
-#include <sys/socket.h> /* socket(), etc. */
+#include <sys/socket.h> /* recv(), etc. */
 
 #include "include/util.h"
 #include "include/main.h"
+#include "include/io.h"
+#include "include/net.h"
+#include "include/stats.h"
+#include "include/proto.h"
+#include "include/streams.h"
+#include "include/resume.h"
+#include "include/output.h"
+#include "include/uring.h"
+#include "include/duplex.h"
+#include "include/mcast.h"
+#include "include/udp.h"
+#include "include/shm.h"
 #include "include/receive.h"
 
 #define CLEANUP_AND_DIE(...)                                                   \
@@ -43,91 +58,820 @@
 /*----------------------------------------------------------------------------*/
 
 /*
- * Maximum number of connections that the receiver can wait for. See the second
- * parameter of listen(2).
+ * Possible return values of the receive engines below. See also the
+ * `ETransmitResult' enum in "transmit.c".
  */
-#define SNC_LISTEN_QUEUE_SZ 10
+enum EReceiveResult {
+    RECEIVE_OK,
+    RECEIVE_UNSUPPORTED,
+    RECEIVE_ERROR,
+};
+
+/*
+ * Add `received' bytes to the `total' counter, and update the progress.
+ */
+static inline void account_received(size_t* total, size_t received) {
+    *total += received;
+    update_progress(*total);
+}
+
+/*
+ * Move exactly `data_sz' bytes from the pipe `pipe_fd' into `dst_fd'.
+ *
+ * The data is spliced unless the kernel refuses it, in which case it's read
+ * into `buf' and written normally. This can happen, for example, if `dst_fd'
+ * was opened with `O_APPEND'.
+ */
+static bool drain_pipe(int pipe_fd,
+                       int dst_fd,
+                       size_t data_sz,
+                       void* buf,
+                       size_t buf_sz) {
+    static bool can_splice = true;
+
+    while (data_sz > 0) {
+        ssize_t moved;
+        if (can_splice) {
+            const uint64_t start = stats_start_call(STATS_CALL_SPLICE);
+            moved                = splice(pipe_fd,
+                                          NULL,
+                                          dst_fd,
+                                          NULL,
+                                          data_sz,
+                                          SPLICE_F_MOVE | SPLICE_F_MORE);
+            stats_end_call(STATS_CALL_SPLICE, STATS_WAIT_IO, start, moved);
+            if (moved < 0 && errno == EINVAL) {
+                can_splice = false;
+                continue;
+            }
+        } else {
+            const uint64_t start = stats_start_call(STATS_CALL_READ);
+            moved =
+              read(pipe_fd, buf, (data_sz < buf_sz) ? data_sz : buf_sz);
+            stats_end_call(STATS_CALL_READ, STATS_WAIT_IO, start, moved);
+            if (moved > 0 && !io_write_all(dst_fd, buf, moved))
+                return false;
+        }
+
+        if (moved < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+
+        data_sz -= moved;
+    }
+
+    return true;
+}
+
+/*
+ * Receive data from `sockfd' into `dst_fd' with splice(2), moving at most
+ * `chunk_sz' bytes per call.
+ *
+ * Since one end of each splice must be a pipe, if `dst_fd' is not a pipe itself
+ * the data goes through an internal pipe. In both cases, the data never reaches
+ * user space.
+ */
+static enum EReceiveResult receive_splice(int sockfd,
+                                          int dst_fd,
+                                          bool dst_is_pipe,
+                                          void* buf,
+                                          size_t buf_sz,
+                                          size_t* total) {
+    enum EReceiveResult result = RECEIVE_OK;
+    bool moved_data            = false;
+
+    int pipefd[2] = { -1, -1 };
+    if (!dst_is_pipe) {
+        if (pipe(pipefd) != 0)
+            return RECEIVE_UNSUPPORTED;
+
+        /*
+         * Try to make the pipe big enough for a whole block. If we can't, the
+         * calls to splice(2) will simply move less data each time.
+         */
+        fcntl(pipefd[1], F_SETPIPE_SZ, (int)buf_sz);
+    }
+
+    const int splice_dst = dst_is_pipe ? dst_fd : pipefd[1];
+
+    while (!g_signaled_quit) {
+        const uint64_t start   = stats_start_call(STATS_CALL_SPLICE);
+        const ssize_t received = splice(sockfd,
+                                        NULL,
+                                        splice_dst,
+                                        NULL,
+                                        buf_sz,
+                                        SPLICE_F_MOVE | SPLICE_F_MORE);
+        stats_end_call(STATS_CALL_SPLICE, STATS_WAIT_NET, start, received);
+        if (received < 0) {
+            if (errno == EINTR)
+                continue;
+            if (!moved_data && (errno == EINVAL || errno == ENOSYS)) {
+                result = RECEIVE_UNSUPPORTED;
+                break;
+            }
+
+            ERR("Receive error: %s", strerror(errno));
+            result = RECEIVE_ERROR;
+            break;
+        }
+        if (received == 0)
+            break;
+
+        moved_data = true;
+
+        if (!dst_is_pipe &&
+            !drain_pipe(pipefd[0], dst_fd, received, buf, buf_sz)) {
+            ERR("Write error: %s", strerror(errno));
+            result = RECEIVE_ERROR;
+            break;
+        }
+
+        output_written(dst_fd, received);
+        account_received(total, received);
+    }
+
+    if (pipefd[0] > -1)
+        close(pipefd[0]);
+    if (pipefd[1] > -1)
+        close(pipefd[1]);
+
+    return result;
+}
+
+/*
+ * Receive data from `sockfd' into `buf', and write it into `dst_fd'. This
+ * works for any kind of descriptor, and it's used as a fallback for the splice
+ * engine.
+ */
+static enum EReceiveResult receive_copy(int sockfd,
+                                        int dst_fd,
+                                        void* buf,
+                                        size_t buf_sz,
+                                        size_t* total) {
+    while (!g_signaled_quit) {
+        const uint64_t start   = stats_start_call(STATS_CALL_RECV);
+        const ssize_t received = recv(sockfd, buf, buf_sz, 0);
+        stats_end_call(STATS_CALL_RECV, STATS_WAIT_NET, start, received);
+        if (received < 0) {
+            if (errno == EINTR)
+                continue;
+
+            ERR("Receive error: %s", strerror(errno));
+            return RECEIVE_ERROR;
+        }
+        if (received == 0)
+            break;
+
+        if (!output_write(dst_fd, buf, received)) {
+            ERR("Write error: %s", strerror(errno));
+            return RECEIVE_ERROR;
+        }
+
+        account_received(total, received);
+    }
+
+    return RECEIVE_OK;
+}
+
+/*
+ * Receive data from `sockfd' into `buf', and discard it. Used when measuring
+ * the throughput with '--bench'.
+ */
+static enum EReceiveResult receive_discard(int sockfd,
+                                           void* buf,
+                                           size_t buf_sz,
+                                           size_t* total) {
+    while (!g_signaled_quit) {
+        const uint64_t start   = stats_start_call(STATS_CALL_RECV);
+        const ssize_t received = recv(sockfd, buf, buf_sz, 0);
+        stats_end_call(STATS_CALL_RECV, STATS_WAIT_NET, start, received);
+        if (received < 0) {
+            if (errno == EINTR)
+                continue;
+
+            ERR("Receive error: %s", strerror(errno));
+            return RECEIVE_ERROR;
+        }
+        if (received == 0)
+            break;
+
+        account_received(total, received);
+    }
+
+    return RECEIVE_OK;
+}
 
 /*----------------------------------------------------------------------------*/
 
-void snc_receive(const char* src_port, FILE* dst_fp) {
+/*
+ * Next hop of a chain of receivers, specified with '--forward'. Once sending to
+ * it fails, `failed' is set, and the rest of the data is only written locally.
+ */
+struct Forward {
+    int sockfd;
+    bool failed;
+};
+
+/*
+ * Report an error of the forward connection, with `errno' set, and stop
+ * forwarding. The local output is not affected.
+ */
+static void forward_failed(struct Forward* forward) {
+    ERR("Forward error: %s. Only writing locally from now on.",
+        strerror(errno));
+    forward->failed = true;
+    shutdown(forward->sockfd, SHUT_RDWR);
+}
+
+/*
+ * Move exactly `data_sz' bytes from the pipe `pipe_fd' into the connected
+ * socket `sockfd'. Returns false on error, with `errno' set.
+ */
+static bool splice_to_socket(int pipe_fd, int sockfd, size_t data_sz) {
+    while (data_sz > 0) {
+        const uint64_t start = stats_start_call(STATS_CALL_SPLICE);
+        const ssize_t moved  = splice(pipe_fd,
+                                     NULL,
+                                     sockfd,
+                                     NULL,
+                                     data_sz,
+                                     SPLICE_F_MOVE | SPLICE_F_MORE);
+        stats_end_call(STATS_CALL_SPLICE, STATS_WAIT_NET, start, moved);
+        if (moved < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+
+        data_sz -= moved;
+    }
+
+    return true;
+}
+
+/*
+ * Receive data from `sockfd' into `dst_fd' with splice(2), just like
+ * `receive_splice', while sending a copy of it to the next hop.
+ *
+ * The data is received into an internal pipe, and duplicated into a second one
+ * with tee(2), which doesn't consume it. Then, the first pipe is drained into
+ * the output, and the second one into the forward socket, so the data never
+ * reaches user space. Since tee(2) always starts at the beginning of the pipe,
+ * each duplicated chunk must be consumed before duplicating the next one.
+ */
+static enum EReceiveResult receive_relay_splice(int sockfd,
+                                                int dst_fd,
+                                                struct Forward* forward,
+                                                void* buf,
+                                                size_t buf_sz,
+                                                size_t* total) {
+    enum EReceiveResult result = RECEIVE_OK;
+    bool moved_data            = false;
+
+    int in_pipe[2]  = { -1, -1 };
+    int fwd_pipe[2] = { -1, -1 };
+    if (pipe(in_pipe) != 0 || pipe(fwd_pipe) != 0) {
+        result = RECEIVE_UNSUPPORTED;
+        goto cleanup;
+    }
+
     /*
-     * The 'status' variable is used to store temporary integer return values.
-     *
-     * If the 'fatal_error' variable is true that the end of the function, the
-     * program will be aborted.
+     * If the pipes can't hold a whole block, or if the second one ends up
+     * smaller, the calls to tee(2) will simply duplicate less data each time.
      */
-    int status       = 0;
-    bool fatal_error = false;
+    fcntl(in_pipe[1], F_SETPIPE_SZ, (int)buf_sz);
+    fcntl(fwd_pipe[1], F_SETPIPE_SZ, (int)buf_sz);
+
+    while (!g_signaled_quit) {
+        uint64_t start         = stats_start_call(STATS_CALL_SPLICE);
+        const ssize_t received = splice(sockfd,
+                                        NULL,
+                                        in_pipe[1],
+                                        NULL,
+                                        buf_sz,
+                                        SPLICE_F_MOVE | SPLICE_F_MORE);
+        stats_end_call(STATS_CALL_SPLICE, STATS_WAIT_NET, start, received);
+        if (received < 0) {
+            if (errno == EINTR)
+                continue;
+            if (!moved_data && (errno == EINVAL || errno == ENOSYS)) {
+                result = RECEIVE_UNSUPPORTED;
+                break;
+            }
+
+            ERR("Receive error: %s", strerror(errno));
+            result = RECEIVE_ERROR;
+            break;
+        }
+        if (received == 0)
+            break;
+
+        moved_data = true;
+
+        size_t remaining = received;
+        while (remaining > 0) {
+            size_t chunk_sz = remaining;
+            if (!forward->failed) {
+                start = stats_start_call(STATS_CALL_SPLICE);
+                const ssize_t copied =
+                  tee(in_pipe[0], fwd_pipe[1], chunk_sz, 0);
+                stats_end_call(STATS_CALL_SPLICE, STATS_WAIT_IO, start, copied);
+                if (copied < 0 && errno == EINTR)
+                    continue;
+
+                if (copied > 0) {
+                    chunk_sz = copied;
+                } else {
+                    if (copied == 0)
+                        errno = EIO;
+                    forward_failed(forward);
+                }
+            }
+
+            if (!drain_pipe(in_pipe[0], dst_fd, chunk_sz, buf, buf_sz)) {
+                ERR("Write error: %s", strerror(errno));
+                result = RECEIVE_ERROR;
+                goto cleanup;
+            }
+
+            if (!forward->failed &&
+                !splice_to_socket(fwd_pipe[0], forward->sockfd, chunk_sz))
+                forward_failed(forward);
+
+            remaining -= chunk_sz;
+        }
+
+        output_written(dst_fd, received);
+        account_received(total, received);
+    }
+
+cleanup:
+    for (int i = 0; i < 2; i++) {
+        if (in_pipe[i] > -1)
+            close(in_pipe[i]);
+        if (fwd_pipe[i] > -1)
+            close(fwd_pipe[i]);
+    }
+
+    return result;
+}
+
+/*
+ * Receive data from `sockfd' into `buf', write it into `dst_fd', and send it
+ * to the next hop. This is the fallback of the relay splice engine.
+ */
+static enum EReceiveResult receive_relay_copy(int sockfd,
+                                              int dst_fd,
+                                              struct Forward* forward,
+                                              void* buf,
+                                              size_t buf_sz,
+                                              size_t* total) {
+    while (!g_signaled_quit) {
+        const uint64_t start   = stats_start_call(STATS_CALL_RECV);
+        const ssize_t received = recv(sockfd, buf, buf_sz, 0);
+        stats_end_call(STATS_CALL_RECV, STATS_WAIT_NET, start, received);
+        if (received < 0) {
+            if (errno == EINTR)
+                continue;
+
+            ERR("Receive error: %s", strerror(errno));
+            return RECEIVE_ERROR;
+        }
+        if (received == 0)
+            break;
+
+        if (!output_write(dst_fd, buf, received)) {
+            ERR("Write error: %s", strerror(errno));
+            return RECEIVE_ERROR;
+        }
+
+        if (!forward->failed &&
+            !io_send_all(forward->sockfd, buf, received))
+            forward_failed(forward);
+
+        account_received(total, received);
+    }
+
+    return RECEIVE_OK;
+}
+
+/*
+ * Receive data from `sockfd' into `dst_fd', forwarding it to the next hop. If
+ * the output is a pipe or a file, the data is spliced into both of them.
+ * Otherwise, or if the kernel doesn't support it, fall back to copying it.
+ */
+static enum EReceiveResult receive_relay(int sockfd,
+                                         int dst_fd,
+                                         struct Forward* forward,
+                                         void* buf,
+                                         size_t buf_sz,
+                                         size_t* total) {
+    enum EReceiveResult result = RECEIVE_UNSUPPORTED;
+
+    const enum EIoFdType dst_type = io_fd_type(dst_fd);
+    if (!output_is_direct() && !g_opt_low_latency &&
+        (dst_type == IO_FD_PIPE || dst_type == IO_FD_REGULAR))
+        result =
+          receive_relay_splice(sockfd, dst_fd, forward, buf, buf_sz, total);
+
+    if (result == RECEIVE_UNSUPPORTED)
+        result =
+          receive_relay_copy(sockfd, dst_fd, forward, buf, buf_sz, total);
+
+    return result;
+}
+
+/*----------------------------------------------------------------------------*/
+
+/*
+ * Receive data from the connected socket `sockfd' into `dst_fd'. If the output
+ * is a pipe or a file, the data is spliced into it. Otherwise, or if the kernel
+ * doesn't support splicing into the output, fall back to the generic
+ * recv/write loop.
+ */
+static enum EReceiveResult receive_single(int sockfd,
+                                          int dst_fd,
+                                          void* buf,
+                                          size_t buf_sz,
+                                          size_t* total) {
+    enum EReceiveResult result = RECEIVE_UNSUPPORTED;
 
     /*
-     * Variables that need to be cleaned up if their value changes.
+     * Direct writes need aligned buffers, which only the copy engine has. In
+     * low-latency mode, the socket is only busy-polled by recv(2).
      */
-    struct addrinfo* self_info = NULL;
-    int sockfd_listen          = -1;
-    int sockfd_connection      = -1;
+    if (output_is_direct() || g_opt_low_latency)
+        return receive_copy(sockfd, dst_fd, buf, buf_sz, total);
 
-#ifdef FIXED_BLOCK_SIZE
-    static char buf[FIXED_BLOCK_SIZE];
-#else  /* not FIXED_BLOCK_SIZE */
-    char* buf           = NULL;
-#endif /* not FIXED_BLOCK_SIZE */
+#ifndef NO_IO_URING
+    if (g_opt_io_uring) {
+        switch (uring_copy(sockfd, dst_fd, buf_sz, total)) {
+            case URING_OK:
+                return RECEIVE_OK;
+            case URING_ERROR:
+                return RECEIVE_ERROR;
+            case URING_UNSUPPORTED:
+                break;
+        }
+    }
+#endif /* not NO_IO_URING */
+
+    switch (io_fd_type(dst_fd)) {
+        case IO_FD_PIPE:
+            result = receive_splice(sockfd, dst_fd, true, buf, buf_sz, total);
+            break;
+
+        case IO_FD_REGULAR:
+            result = receive_splice(sockfd, dst_fd, false, buf, buf_sz, total);
+            break;
+
+        default:
+            break;
+    }
+
+    if (result == RECEIVE_UNSUPPORTED)
+        result = receive_copy(sockfd, dst_fd, buf, buf_sz, total);
+
+    return result;
+}
+
+/*----------------------------------------------------------------------------*/
+
+/*
+ * Results of `receive_connection'.
+ */
+struct ReceiveResult {
+    size_t total;
+    bool has_checksum;
+    uint32_t checksum;
 
     /*
-     * Initialize the `addrinfo' structure with the hints for `getaddrinfo'.
-     *
-     *   1. The family: IPv4 (AF_INET).
-     *   1. The socket type: TCP (SOCK_STREAM).
-     *   3. Set the `AI_PASSIVE' flag to indicate that we want to deal with
-     *      our own IP address.
+     * The transmitter asked for a resumable transfer, so if it fails, we can
+     * wait for it to reconnect.
      */
-    struct addrinfo hints;
-    memset(&hints, 0, sizeof(hints));
-    hints.ai_family   = AF_INET;
-    hints.ai_socktype = SOCK_STREAM;
-    hints.ai_flags    = AI_PASSIVE;
+    bool resumable;
+};
+
+/*
+ * If the output was opened with '--output', it's not truncated until we know
+ * that the transmitter doesn't want to resume. Returns false on error.
+ */
+static bool truncate_output(int dst_fd) {
+    if (g_opt_output == NULL || io_fd_type(dst_fd) != IO_FD_REGULAR)
+        return true;
+
+    if (ftruncate(dst_fd, 0) != 0 || lseek(dst_fd, 0, SEEK_SET) < 0) {
+        ERR("Could not truncate the output: %s", strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Receive a whole transfer from the connected socket `sockfd_connection' into
+ * `dst_fd'. Note how we use the connection socket descriptor (returned by
+ * `accept'), not the socket descriptor used for listening for new connections
+ * (returned by `socket').
+ *
+ * If the transmitter is using the framed protocol (e.g. because it's sending
+ * through parallel streams), we also need to accept the rest of its
+ * connections from the listening socket.
+ *
+ * If `forward' is not NULL, the data is also sent to the next hop of the chain,
+ * which is only supported for raw transfers.
+ */
+static bool receive_connection(int sockfd_listen,
+                               int sockfd_connection,
+                               int dst_fd,
+                               struct Forward* forward,
+                               void* buf,
+                               size_t buf_sz,
+                               struct ReceiveResult* result) {
+    memset(result, 0, sizeof(*result));
+
+    if (!proto_detect(sockfd_connection)) {
+        if (g_opt_checksum) {
+            ERR("The transmitter didn't send a checksum.");
+            return false;
+        }
+
+        if (!truncate_output(dst_fd) || !output_begin(dst_fd, 0))
+            return false;
+
+        enum EReceiveResult engine_result;
+        if (g_opt_bench)
+            engine_result = receive_discard(sockfd_connection,
+                                            buf,
+                                            buf_sz,
+                                            &result->total);
+        else if (forward != NULL)
+            engine_result = receive_relay(sockfd_connection,
+                                          dst_fd,
+                                          forward,
+                                          buf,
+                                          buf_sz,
+                                          &result->total);
+        else
+            engine_result = receive_single(sockfd_connection,
+                                           dst_fd,
+                                           buf,
+                                           buf_sz,
+                                           &result->total);
+        stats_sample_connection(sockfd_connection);
+        return output_end() && engine_result != RECEIVE_ERROR;
+    }
+
+    if (forward != NULL) {
+        ERR("The transmitter uses the framed protocol, which can't be "
+            "forwarded.");
+        return false;
+    }
+
+    struct ProtoHeader header;
+    if (!proto_recv_header(sockfd_connection, &header))
+        return false;
+
+    result->resumable    = (header.flags & PROTO_FLAG_RESUME) != 0;
+    result->has_checksum = (header.flags & PROTO_FLAG_CHECKSUM) != 0;
+    if (g_opt_checksum && !result->has_checksum) {
+        ERR("The transmitter didn't send a checksum.");
+        return false;
+    }
+
+    if ((header.flags & PROTO_FLAG_SHM) != 0) {
+        if (!truncate_output(dst_fd))
+            return false;
+
+        uint64_t expected_sz = 0;
+        if (header.total_sz != PROTO_SIZE_UNKNOWN)
+            expected_sz = header.total_sz;
+
+        set_expected_progress(expected_sz);
+        if (!output_begin(dst_fd, expected_sz))
+            return false;
+
+        /*
+         * If we can't use the shared memory, the transmitter sends the raw
+         * data through the connection instead.
+         */
+        bool success;
+        switch (
+          shm_receive(sockfd_connection, &header, dst_fd, &result->total)) {
+            case SHM_OK:
+                success = true;
+                break;
+
+            case SHM_UNAVAILABLE:
+                success = receive_single(sockfd_connection,
+                                         dst_fd,
+                                         buf,
+                                         buf_sz,
+                                         &result->total) != RECEIVE_ERROR;
+                break;
+
+            default:
+                success = false;
+                break;
+        }
+
+        stats_sample_connection(sockfd_connection);
+        return output_end() && success;
+    }
+
+    uint64_t offset = 0;
+    if (result->resumable) {
+        /*
+         * The offset is always negotiated through the first stream. Other
+         * streams might be left over from an interrupted transfer.
+         */
+        if (header.stream_idx != 0) {
+            ERR("Ignoring unrelated connection.");
+            return false;
+        }
+
+        /*
+         * Errors while negotiating are not worth waiting for another
+         * connection, since they are probably caused by the output itself.
+         */
+        if (!resume_offer(sockfd_connection, dst_fd, &offset)) {
+            result->resumable = false;
+            return false;
+        }
+
+        if (offset > 0 && g_opt_print_progress)
+            fprintf(stderr,
+                    "Resuming transfer at byte %llu.\n",
+                    (unsigned long long)offset);
+    } else if (!truncate_output(dst_fd)) {
+        return false;
+    }
 
     /*
-     * Obtain the address information from the specified hints.
-     *
-     * Note how we use `NULL', along with the `AI_PASSIVE' flag in `hints', to
-     * indicate that we want to obtain information about or own IP address.
+     * If the transmitter told us the size of the transfer, we can reserve the
+     * space in the output, and estimate the remaining time.
      */
-    status = getaddrinfo(NULL, src_port, &hints, &self_info);
-    if (status != 0)
-        CLEANUP_AND_DIE("Could not obtaining our address info: %s",
-                        gai_strerror(status));
+    uint64_t expected_sz = 0;
+    if (header.total_sz != PROTO_SIZE_UNKNOWN && header.total_sz >= offset)
+        expected_sz = header.total_sz - offset;
+
+    set_expected_progress(expected_sz);
+    if (!output_begin(dst_fd, expected_sz))
+        return false;
+
+    const bool success = streams_receive(sockfd_listen,
+                                         sockfd_connection,
+                                         &header,
+                                         dst_fd,
+                                         &result->checksum,
+                                         &result->total);
+    return output_end() && success;
+}
+
+/*
+ * Connect to the next hop specified with '--forward', with the format
+ * 'host[:port]'. By default, the next hop listens on the same `port' as us. If
+ * it can't be reached, the error is reported, and the data is only written
+ * locally.
+ */
+static void forward_connect(struct Forward* forward,
+                            const char* port,
+                            size_t buf_sz) {
+    char* host = strdup(g_opt_forward);
+    if (host == NULL) {
+        ERR("Failed to allocate the forward destination: %s", strerror(errno));
+        forward->failed = true;
+        return;
+    }
+
+    port            = net_split_port(host, port);
+    forward->sockfd = net_connect(host, port);
+    if (forward->sockfd < 0) {
+        ERR("Could not reach the next hop. Only writing locally.");
+        forward->failed = true;
+        free(host);
+        return;
+    }
 
     /*
-     * We obtain the socket descriptor using the values from the `addrinfo'
-     * structure that `getaddrinfo' filled.
+     * If the next hop disconnects, sending to it must fail with `EPIPE'
+     * instead of killing us, so the local output can still be completed.
      */
-    sockfd_listen = socket(self_info->ai_family,
-                           self_info->ai_socktype,
-                           self_info->ai_protocol);
-    if (sockfd_listen < 0)
-        CLEANUP_AND_DIE("Could not create socket: %s", strerror(errno));
+    signal(SIGPIPE, SIG_IGN);
+    stats_watch_connection(forward->sockfd);
+
+    struct NetTuning tuning;
+    net_tune(forward->sockfd, true, 1, buf_sz, &tuning);
+    if (g_opt_print_peer_info) {
+        fprintf(stderr, "Forwarding to '%s', port '%s'.\n", host, port);
+        net_print_tuning(stderr, true, &tuning);
+        print_separator(stderr);
+    }
+
+    free(host);
+}
+
+/*
+ * Receive a multicast transfer from `g_opt_multicast_group', or a UDP transfer
+ * on `src_port', into `dst_fp'. The datagrams are received by `mcast_receive'
+ * or `udp_receive' themselves, so this only handles the output and the
+ * reports.
+ */
+static void receive_datagrams(const char* src_port, FILE* dst_fp) {
+    bool fatal_error = false;
+
+    fflush(dst_fp);
+    const int dst_fd = fileno(dst_fp);
+    if (!truncate_output(dst_fd) || !output_begin(dst_fd, 0))
+        exit(1);
+
+    stats_start();
+    if (g_opt_print_progress && !start_progress_reporter("Received"))
+        exit(1);
+
+    size_t total     = 0;
+    size_t recovered = 0;
+    size_t repaired  = 0;
+    const bool received = g_opt_multicast
+                            ? mcast_receive(g_opt_multicast_group,
+                                            src_port,
+                                            dst_fd,
+                                            &total,
+                                            &recovered,
+                                            &repaired)
+                            : udp_receive(src_port, dst_fd, &total, &repaired);
+    if (!received)
+        fatal_error = true;
+    if (!output_end())
+        fatal_error = true;
+
+    stop_progress_reporter();
+    if (g_opt_print_progress) {
+        print_progress("Received", total);
+        fputc('\n', stderr);
+        if (g_opt_multicast)
+            fprintf(stderr,
+                    "Rebuilt %zu datagrams from the parity, and repaired "
+                    "%zu.\n",
+                    recovered,
+                    repaired);
+        else
+            fprintf(stderr, "Repaired %zu lost datagrams.\n", repaired);
+    }
+
+    if (g_opt_stats && !stats_report("receive", total))
+        fatal_error = true;
+
+    if (fatal_error)
+        exit(1);
+}
+
+/*----------------------------------------------------------------------------*/
+
+void snc_receive(const char* src_port, FILE* dst_fp) {
+    if (g_opt_multicast || g_opt_udp) {
+        receive_datagrams(src_port, dst_fp);
+        return;
+    }
 
     /*
-     * We `bind' the local port to the socket descriptor. The port (along with
-     * the IP address) should be inside a `sockaddr' structure; and,
-     * conveniently, `getaddrinfo' filled that information inside the
-     * `self_info->ai_addr' member.
+     * If the 'fatal_error' variable is true that the end of the function, the
+     * program will be aborted.
      */
-    status = bind(sockfd_listen, self_info->ai_addr, self_info->ai_addrlen);
-    if (status != 0)
-        CLEANUP_AND_DIE("Could not bind port to socket descriptor: %s",
-                        strerror(errno));
+    bool fatal_error = false;
 
     /*
-     * We listen for incoming connections on the port we just bound to the
-     * socket descriptor. The second argument indicates the maximum number of
-     * connections that can be queued before being accepted.
+     * Variables that need to be cleaned up if their value changes.
      */
-    status = listen(sockfd_listen, SNC_LISTEN_QUEUE_SZ);
-    if (status != 0)
-        CLEANUP_AND_DIE("Could not listen for connections: %s",
+    int sockfd_listen     = -1;
+    int sockfd_connection = -1;
+    int dev_null_fd       = -1;
+
+    /* Next hop of the chain, connected with the first transmitter */
+    struct Forward forward = { .sockfd = -1, .failed = false };
+
+#ifdef FIXED_BLOCK_SIZE
+    static char buf[FIXED_BLOCK_SIZE];
+    const size_t buf_sz = FIXED_BLOCK_SIZE;
+#else  /* not FIXED_BLOCK_SIZE */
+    size_t buf_sz = g_opt_block_size;
+    char* buf     = malloc(buf_sz);
+    if (buf == NULL)
+        CLEANUP_AND_DIE("Failed to allocate %zu bytes: %s",
+                        buf_sz,
                         strerror(errno));
+#endif /* not FIXED_BLOCK_SIZE */
+
+    assert(buf_sz > 0);
+
+    sockfd_listen = net_listen(src_port, SNC_LISTEN_QUEUE_SZ, false);
+    if (sockfd_listen < 0) {
+        fatal_error = true;
+        goto cleanup;
+    }
 
     if (g_opt_print_interfaces) {
         print_separator(stderr);
@@ -139,95 +883,165 @@ void snc_receive(const char* src_port, FILE* dst_fp) {
     }
 
     /*
-     * We accept the incoming connection, and we get a new socket descriptor. It
-     * will be used to read (and optionally write) data.
-     *
-     * The function will fill the second and third arguments with the address
-     * information of the peer. We use `sockaddr_storage' since it's guaranteed
-     * to be "at least as large as any other `sockaddr_*' address structure".
-     * See also sockaddr(3type).
-     *
-     * The call to `accept' normally blocks the program until a connection is
-     * received.
+     * Anything buffered by 'stdio' must be written before we start writing
+     * into the underlying descriptor directly.
      */
-    struct sockaddr_storage peer_addr;
-    socklen_t peer_addr_sz = sizeof(peer_addr);
-    sockfd_connection =
-      accept(sockfd_listen, (struct sockaddr*)&peer_addr, &peer_addr_sz);
-    if (sockfd_connection < 0)
-        CLEANUP_AND_DIE("Could not accept incoming connection: %s",
-                        strerror(errno));
+    fflush(dst_fp);
+    int dst_fd = fileno(dst_fp);
 
-    if (g_opt_print_peer_info) {
-        if (!g_opt_print_interfaces)
-            print_separator(stderr);
-        fprintf(stderr, "Incoming connection from: ");
-        print_sockaddr(stderr, &peer_addr);
-        fputc('\n', stderr);
-        print_separator(stderr);
+    /*
+     * When benchmarking, parallel streams are written into "/dev/null", and
+     * single connections are simply discarded.
+     */
+    if (g_opt_bench) {
+        dst_fd = dev_null_fd = open("/dev/null", O_WRONLY);
+        if (dst_fd < 0)
+            CLEANUP_AND_DIE("Could not open '/dev/null': %s", strerror(errno));
     }
 
-#ifdef FIXED_BLOCK_SIZE
-    const size_t buf_sz = FIXED_BLOCK_SIZE;
-#else  /* not FIXED_BLOCK_SIZE */
-    const size_t buf_sz = g_opt_block_size;
-    buf                 = malloc(buf_sz);
-    if (buf == NULL)
-        CLEANUP_AND_DIE("Failed to allocate %zu bytes: %s",
-                        buf_sz,
-                        strerror(errno));
-#endif /* not FIXED_BLOCK_SIZE */
-
-    assert(buf_sz > 0);
+    /* In duplex mode, the progress includes the data in both directions */
+    const char* verb = g_opt_duplex ? "Transferred" : "Received";
 
     /*
-     * Receive the data from the connection. Note how we use the connection
-     * socket descriptor (returned by `accept'), not the socket descriptor used
-     * for listening for new connections (returned by `socket').
+     * Accept connections until one of them is received successfully. We only
+     * accept another one if a resumable transfer was interrupted, since the
+     * transmitter will try to reconnect.
      */
-    size_t total_received = 0;
-    while (!g_signaled_quit) {
-        const ssize_t received = recv(sockfd_connection, buf, buf_sz, 0);
-        if (received < 0)
-            CLEANUP_AND_DIE("Receive error: %s", strerror(errno));
-        if (received == 0)
-            break;
+    struct ReceiveResult result;
+    for (;;) {
+        struct sockaddr_storage peer_addr;
+        sockfd_connection = net_accept(sockfd_listen, &peer_addr);
+        if (sockfd_connection < 0) {
+            fatal_error = true;
+            goto cleanup;
+        }
+
+        stats_watch_connection(sockfd_connection);
+
+        struct NetTuning tuning;
+        net_tune(sockfd_connection, false, 1, buf_sz, &tuning);
 
-        if (g_opt_print_progress) {
-            total_received += received;
-            print_partial_progress("Received", total_received);
+        if (g_opt_print_peer_info) {
+            if (!g_opt_print_interfaces)
+                print_separator(stderr);
+            fprintf(stderr, "Incoming connection from: ");
+            print_sockaddr(stderr, &peer_addr);
+            fputc('\n', stderr);
+            net_print_tuning(stderr, false, &tuning);
+            print_separator(stderr);
         }
 
-        fwrite(buf, received, sizeof(char), dst_fp);
+#ifndef FIXED_BLOCK_SIZE
+        if (tuning.block_sz != buf_sz) {
+            char* new_buf = realloc(buf, tuning.block_sz);
+            if (new_buf == NULL)
+                CLEANUP_AND_DIE("Failed to allocate %zu bytes: %s",
+                                tuning.block_sz,
+                                strerror(errno));
+            buf    = new_buf;
+            buf_sz = tuning.block_sz;
+        }
+#endif /* not FIXED_BLOCK_SIZE */
+
+        if (g_opt_forward != NULL && forward.sockfd < 0 && !forward.failed)
+            forward_connect(&forward, src_port, buf_sz);
+        const bool forwarding = forward.sockfd > -1 && !forward.failed;
+
+        stats_start();
+        if (g_opt_print_progress && !start_progress_reporter(verb)) {
+            fatal_error = true;
+            goto cleanup;
+        }
+
+        /*
+         * In duplex mode, the transmitter might not send anything before we
+         * do, so the connection is never inspected for the framed protocol.
+         */
+        bool success;
+        if (g_opt_duplex) {
+            memset(&result, 0, sizeof(result));
+            success = duplex_relay(sockfd_connection,
+                                   fileno(stdin),
+                                   dst_fd,
+                                   buf_sz,
+                                   &result.total);
+        } else {
+            success = receive_connection(sockfd_listen,
+                                         sockfd_connection,
+                                         dst_fd,
+                                         forwarding ? &forward : NULL,
+                                         buf,
+                                         buf_sz,
+                                         &result);
+        }
+        if (success)
+            break;
+        if (!result.resumable || g_signaled_quit) {
+            fatal_error = true;
+            goto cleanup;
+        }
+
+        ERR("Transfer interrupted, waiting for the transmitter to "
+            "reconnect.");
+        stats_unwatch_connection(sockfd_connection);
+        close(sockfd_connection);
+        sockfd_connection = -1;
     }
 
     /*
-     * After we are done, we want to print the exact progress. Notice how we
-     * call 'print_progress' instead of 'print_partial_progress'.
+     * After we are done, stop the reporter and print the exact progress.
      */
+    stop_progress_reporter();
     if (g_opt_print_progress) {
-        print_progress("Received", total_received);
+        print_progress(verb, result.total);
         fputc('\n', stderr);
+
+        if (result.has_checksum)
+            fprintf(stderr,
+                    "CRC-32C: %08lx\n",
+                    (unsigned long)result.checksum);
     }
 
+    /*
+     * The local output is complete, but the next hop didn't receive all the
+     * data, so the whole chain failed.
+     */
+    if (forward.failed)
+        fatal_error = true;
+    else if (forward.sockfd > -1)
+        stats_sample_connection(forward.sockfd);
+
+    if ((g_opt_bench || g_opt_stats) && !stats_report("receive", result.total))
+        fatal_error = true;
+
 cleanup:
+    stop_progress_reporter();
+
 #ifndef FIXED_BLOCK_SIZE
     if (buf != NULL)
         free(buf);
 #endif /* not FIXED_BLOCK_SIZE */
 
-    /* Opened by 'accept' */
-    if (sockfd_connection > -1)
+    /* Opened when benchmarking */
+    if (dev_null_fd > -1)
+        close(dev_null_fd);
+
+    /* Opened by 'net_accept' */
+    if (sockfd_connection > -1) {
+        stats_unwatch_connection(sockfd_connection);
         close(sockfd_connection);
+    }
+
+    /* Opened by 'forward_connect' */
+    if (forward.sockfd > -1) {
+        stats_unwatch_connection(forward.sockfd);
+        close(forward.sockfd);
+    }
 
-    /* Opened by 'socket' */
+    /* Opened by 'net_listen' */
     if (sockfd_listen > -1)
         close(sockfd_listen);
 
-    /* Allocated by 'getaddrinfo' */
-    if (self_info != NULL)
-        freeaddrinfo(self_info);
-
     if (fatal_error)
         exit(1);
 }
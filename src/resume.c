@@ -0,0 +1,202 @@
+/*
+ * Copyright 2025 8dcc
+ *
+ * This file is part of snc (Simple NetCat).
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <unistd.h> /* pread(), ftruncate(), lseek() */
+#include <sys/types.h>
+#include <sys/stat.h> /* fstat() */
+
+#include "include/util.h"
+#include "include/main.h"
+#include "include/io.h"
+#include "include/proto.h"
+#include "include/crc32c.h"
+#include "include/resume.h"
+
+/*
+ * Size of the buffer used for reading the tails and skipping data.
+ */
+#define RESUME_CHUNK_SZ (64 * 1024)
+
+/*----------------------------------------------------------------------------*/
+
+/*
+ * Compute the checksum of `sz' bytes of `fd' starting at `offset', without
+ * moving its file position. Returns false on error or if the file is shorter.
+ */
+static bool checksum_range(int fd, off_t offset, size_t sz, uint32_t* result) {
+    static uint8_t buf[RESUME_CHUNK_SZ];
+    uint32_t checksum = 0;
+
+    while (sz > 0) {
+        const size_t chunk_sz = (sz < sizeof(buf)) ? sz : sizeof(buf);
+        const ssize_t received = pread(fd, buf, chunk_sz, offset);
+        if (received < 0 && errno == EINTR)
+            continue;
+        if (received <= 0)
+            return false;
+
+        checksum = crc32c_update(checksum, buf, received);
+        offset += received;
+        sz -= received;
+    }
+
+    *result = checksum;
+    return true;
+}
+
+/*
+ * Compute the checksum of the next `sz' bytes read from `fd'. Returns false on
+ * error or on EOF.
+ */
+static bool checksum_read(int fd, size_t sz, uint32_t* result) {
+    static uint8_t buf[RESUME_CHUNK_SZ];
+    uint32_t checksum = 0;
+
+    while (sz > 0) {
+        const size_t chunk_sz = (sz < sizeof(buf)) ? sz : sizeof(buf);
+        const ssize_t received = io_read_full(fd, buf, chunk_sz);
+        if (received != (ssize_t)chunk_sz)
+            return false;
+
+        checksum = crc32c_update(checksum, buf, received);
+        sz -= received;
+    }
+
+    *result = checksum;
+    return true;
+}
+
+/*
+ * Move the input `src_fd' to `offset', relative to `src_base'. If the input is
+ * not seekable, the data is read and discarded, so it can only move forward.
+ */
+static bool skip_input(int src_fd, off_t src_base, uint64_t offset) {
+    if (io_fd_type(src_fd) == IO_FD_REGULAR)
+        return lseek(src_fd, src_base + (off_t)offset, SEEK_SET) >= 0;
+
+    static uint8_t buf[RESUME_CHUNK_SZ];
+    while (offset > 0) {
+        const size_t chunk_sz =
+          (offset < sizeof(buf)) ? (size_t)offset : sizeof(buf);
+        if (io_read_full(src_fd, buf, chunk_sz) != (ssize_t)chunk_sz)
+            return false;
+        offset -= chunk_sz;
+    }
+
+    return true;
+}
+
+/*----------------------------------------------------------------------------*/
+
+bool resume_offer(int sockfd, int dst_fd, uint64_t* offset) {
+    const bool is_regular = (io_fd_type(dst_fd) == IO_FD_REGULAR);
+
+    struct ProtoResume offer;
+    memset(&offer, 0, sizeof(offer));
+
+    struct stat st;
+    if (is_regular && fstat(dst_fd, &st) == 0 && st.st_size > 0) {
+        offer.offset  = st.st_size;
+        offer.tail_sz = (st.st_size < RESUME_TAIL_SZ) ? st.st_size
+                                                      : RESUME_TAIL_SZ;
+        if (!checksum_range(dst_fd,
+                            st.st_size - offer.tail_sz,
+                            offer.tail_sz,
+                            &offer.tail_checksum)) {
+            ERR("Could not read the existing output: %s", strerror(errno));
+            return false;
+        }
+    }
+
+    struct ProtoResume answer;
+    if (!proto_send_resume(sockfd, &offer) ||
+        !proto_recv_resume(sockfd, &answer))
+        return false;
+
+    if (answer.offset != 0 && answer.offset != offer.offset) {
+        ERR("Received invalid resume offset: %llu.",
+            (unsigned long long)answer.offset);
+        return false;
+    }
+
+    if (is_regular && (ftruncate(dst_fd, (off_t)answer.offset) != 0 ||
+                       lseek(dst_fd, (off_t)answer.offset, SEEK_SET) < 0)) {
+        ERR("Could not truncate the output: %s", strerror(errno));
+        return false;
+    }
+
+    if (offer.offset > 0 && answer.offset == 0)
+        ERR("The existing output doesn't match the input, starting over.");
+
+    *offset = answer.offset;
+    return true;
+}
+
+bool resume_answer(int sockfd, int src_fd, off_t src_base, uint64_t* offset) {
+    struct ProtoResume offer;
+    if (!proto_recv_resume(sockfd, &offer))
+        return false;
+
+    if (offer.tail_sz > offer.offset || offer.tail_sz > RESUME_TAIL_SZ) {
+        ERR("Received invalid resume offer.");
+        return false;
+    }
+
+    struct ProtoResume answer;
+    memset(&answer, 0, sizeof(answer));
+
+    /*
+     * Move to the start of the tail, and compare its checksum with the one of
+     * the receiver. We can't use `checksum_range', since the input might not
+     * be seekable.
+     */
+    if (offer.offset > 0) {
+        uint32_t checksum;
+        const bool matches =
+          skip_input(src_fd, src_base, offer.offset - offer.tail_sz) &&
+          checksum_read(src_fd, offer.tail_sz, &checksum) &&
+          checksum == offer.tail_checksum;
+
+        if (matches) {
+            answer.offset = offer.offset;
+        } else if (io_fd_type(src_fd) == IO_FD_REGULAR &&
+                   lseek(src_fd, src_base, SEEK_SET) >= 0) {
+            ERR("The output of the receiver doesn't match the input, "
+                "starting over.");
+        } else {
+            ERR("The output of the receiver doesn't match the input, and the "
+                "input can't be rewound.");
+            return false;
+        }
+    }
+
+    if (!proto_send_resume(sockfd, &answer))
+        return false;
+
+    *offset = answer.offset;
+    return true;
+}
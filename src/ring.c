@@ -0,0 +1,106 @@
+/*
+ * Copyright 2025 8dcc
+ *
+ * This file is part of snc (Simple NetCat).
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include <semaphore.h>
+
+#include "include/ring.h"
+
+bool block_ring_init(struct BlockRing* ring, size_t depth, size_t block_sz) {
+    ring->block_sz = block_sz;
+    ring->depth    = depth;
+    ring->head     = 0;
+    ring->tail     = 0;
+    ring->aborted  = false;
+
+    ring->data = malloc(depth * block_sz);
+    ring->lens = calloc(depth, sizeof(size_t));
+    if (ring->data == NULL || ring->lens == NULL) {
+        free(ring->data);
+        free(ring->lens);
+        return false;
+    }
+
+    sem_init(&ring->free_blocks, 0, depth);
+    sem_init(&ring->filled_blocks, 0, 0);
+    return true;
+}
+
+void block_ring_destroy(struct BlockRing* ring) {
+    sem_destroy(&ring->filled_blocks);
+    sem_destroy(&ring->free_blocks);
+    free(ring->lens);
+    free(ring->data);
+}
+
+/*
+ * Wait for the specified semaphore. Returns false if the ring was aborted, or
+ * if the wait was interrupted.
+ */
+static bool ring_wait(struct BlockRing* ring, sem_t* sem) {
+    if (sem_wait(sem) != 0)
+        return false;
+
+    if (__atomic_load_n(&ring->aborted, __ATOMIC_ACQUIRE)) {
+        /* Let other waiters notice it too */
+        sem_post(sem);
+        errno = 0;
+        return false;
+    }
+
+    return true;
+}
+
+void* block_ring_acquire_free(struct BlockRing* ring) {
+    if (!ring_wait(ring, &ring->free_blocks))
+        return NULL;
+
+    return &ring->data[(ring->head % ring->depth) * ring->block_sz];
+}
+
+void block_ring_push(struct BlockRing* ring, size_t len) {
+    ring->lens[ring->head % ring->depth] = len;
+    ring->head++;
+    sem_post(&ring->filled_blocks);
+}
+
+const void* block_ring_acquire_filled(struct BlockRing* ring, size_t* len) {
+    if (!ring_wait(ring, &ring->filled_blocks))
+        return NULL;
+
+    const size_t idx = ring->tail % ring->depth;
+    *len             = ring->lens[idx];
+    return &ring->data[idx * ring->block_sz];
+}
+
+void block_ring_pop(struct BlockRing* ring) {
+    ring->tail++;
+    sem_post(&ring->free_blocks);
+}
+
+void block_ring_abort(struct BlockRing* ring) {
+    __atomic_store_n(&ring->aborted, true, __ATOMIC_RELEASE);
+    sem_post(&ring->free_blocks);
+    sem_post(&ring->filled_blocks);
+}
@@ -0,0 +1,839 @@
+/*
+ * Copyright 2025 8dcc
+ *
+ * This file is part of snc (Simple NetCat).
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE /* accept4(), pthread_setaffinity_np(), CPU_SET() */
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h> /* PATH_MAX */
+#include <time.h>
+#include <pthread.h>
+#include <sched.h> /* sched_getaffinity(), CPU_SET() */
+
+#include <unistd.h> /* close() */
+#include <fcntl.h>  /* open(), fcntl() */
+#include <sys/types.h>
+#include <sys/socket.h> /* accept4(), recv(), etc. */
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <arpa/inet.h> /* inet_ntop() */
+
+#include "include/util.h"
+#include "include/main.h"
+#include "include/io.h"
+#include "include/net.h"
+#include "include/stats.h"
+#include "include/server.h"
+
+#define CLEANUP_AND_DIE(...)                                                   \
+    do {                                                                       \
+        ERR(__VA_ARGS__);                                                      \
+        fatal_error = true;                                                    \
+        goto cleanup;                                                          \
+    } while (0)
+
+/*
+ * Maximum number of events returned by each call to epoll_wait(2).
+ */
+#define SERVER_MAX_EVENTS 64
+
+/*----------------------------------------------------------------------------*/
+
+struct Server;
+
+/*
+ * A connection accepted by one of the workers of the server.
+ */
+struct ServerConn {
+    struct Server* server;
+    int sockfd;
+    struct sockaddr_storage peer_addr;
+    size_t received;
+
+    /* Number of the connection among all workers, starting from 1 */
+    uint64_t id;
+
+    /*
+     * Output descriptor of this connection. If `owns_dst' is false, it's the
+     * output shared by all connections, which is only written by one of them
+     * at a time.
+     */
+    int dst_fd;
+    bool owns_dst;
+
+    /* List of all connections of the worker, used for cleaning up */
+    struct ServerConn *prev, *next;
+
+    /* Queue of connections waiting for the shared output */
+    struct ServerConn* next_waiting;
+};
+
+/*
+ * State shared by all the workers of the server.
+ */
+struct ServerShared {
+    /* Template for the per-connection outputs, or NULL */
+    const char* output_template;
+
+    /*
+     * Output used if there is no template, along with the connection that's
+     * currently writing to it, and the ones waiting for it. Since they might
+     * belong to any worker, these are protected by `lock'.
+     */
+    pthread_mutex_t lock;
+    int shared_fd;
+    struct ServerConn* shared_owner;
+    struct ServerConn *waiting_head, *waiting_tail;
+
+    /* Updated atomically by the workers */
+    uint64_t conn_id;
+    size_t total;
+
+    /* Set if the shared output can no longer be written, or on errors */
+    bool failed;
+
+    /*
+     * Event file descriptor, written by a worker once it stops, so the rest of
+     * them also stop. The quit signals are only received by the main thread.
+     */
+    int wake_fd;
+
+    /* CPUs we are allowed to run on, used for pinning the workers */
+    cpu_set_t cpus;
+};
+
+/*
+ * State of each worker of the server, with its own listening socket.
+ */
+struct Server {
+    struct ServerShared* shared;
+    size_t idx;
+    pthread_t thread;
+    bool thread_started, result;
+
+    int sockfd_listen;
+    int epoll_fd;
+    bool accepting;
+
+    struct ServerConn* conns;
+    size_t conn_count;
+
+    /*
+     * Since connections are handled one event at a time, the connections of a
+     * worker can all share the same buffer.
+     */
+    char* buf;
+    size_t buf_sz;
+};
+
+/*----------------------------------------------------------------------------*/
+
+/*
+ * Append the `src' string to the `dst' buffer of `dst_sz' bytes, at the
+ * position `*pos', advancing it. Returns false if it doesn't fit.
+ */
+static bool append_str(char* dst, size_t dst_sz, size_t* pos, const char* src) {
+    const size_t len = strlen(src);
+    if (*pos + len >= dst_sz)
+        return false;
+
+    memcpy(&dst[*pos], src, len + 1);
+    *pos += len;
+    return true;
+}
+
+/*
+ * Expand the output template `fmt' for the connection number `id', from
+ * `peer_addr', and write the resulting path into `dst'.
+ *
+ * The following sequences are replaced:
+ *   - %a: The address of the peer.
+ *   - %p: The port of the peer.
+ *   - %n: The number of the connection, starting from 1.
+ *   - %t: The time of the connection, as a UNIX timestamp.
+ *   - %%: A literal '%'.
+ *
+ * Returns false if the template is invalid, or if the path doesn't fit.
+ */
+static bool expand_template(const char* fmt,
+                            const struct sockaddr_storage* peer_addr,
+                            uint64_t id,
+                            char* dst,
+                            size_t dst_sz) {
+    const void* addr;
+    in_port_t port;
+    switch (peer_addr->ss_family) {
+        case AF_INET: {
+            const struct sockaddr_in* ipv4 =
+              (const struct sockaddr_in*)peer_addr;
+            addr = &ipv4->sin_addr;
+            port = ipv4->sin_port;
+        } break;
+
+        case AF_INET6: {
+            const struct sockaddr_in6* ipv6 =
+              (const struct sockaddr_in6*)peer_addr;
+            addr = &ipv6->sin6_addr;
+            port = ipv6->sin6_port;
+        } break;
+
+        default:
+            return false;
+    }
+
+    size_t pos = 0;
+    dst[0]     = '\0';
+
+    for (; *fmt != '\0'; fmt++) {
+        char tmp[INET6_ADDRSTRLEN];
+        if (*fmt != '%') {
+            tmp[0] = *fmt;
+            tmp[1] = '\0';
+        } else {
+            switch (*++fmt) {
+                case 'a':
+                    inet_ntop(peer_addr->ss_family, addr, tmp, sizeof(tmp));
+                    break;
+
+                case 'p':
+                    snprintf(tmp, sizeof(tmp), "%d", ntohs(port));
+                    break;
+
+                case 'n':
+                    snprintf(tmp,
+                             sizeof(tmp),
+                             "%llu",
+                             (unsigned long long)id);
+                    break;
+
+                case 't':
+                    snprintf(tmp, sizeof(tmp), "%lld", (long long)time(NULL));
+                    break;
+
+                case '%':
+                    strcpy(tmp, "%");
+                    break;
+
+                default:
+                    return false;
+            }
+        }
+
+        if (!append_str(dst, dst_sz, &pos, tmp))
+            return false;
+    }
+
+    return pos > 0;
+}
+
+/*
+ * Check or set the `failed' flag of the server, from any worker.
+ */
+static inline bool is_failed(struct ServerShared* shared) {
+    return __atomic_load_n(&shared->failed, __ATOMIC_RELAXED);
+}
+
+static inline void set_failed(struct ServerShared* shared) {
+    __atomic_store_n(&shared->failed, true, __ATOMIC_RELAXED);
+}
+
+/*
+ * Start or stop waiting for new connections on the listening socket. Used to
+ * stop accepting them when the limit is reached.
+ */
+static void set_accepting(struct Server* server, bool accepting) {
+    if (server->accepting == accepting)
+        return;
+
+    struct epoll_event event;
+    event.events   = accepting ? EPOLLIN : 0;
+    event.data.ptr = NULL;
+    if (epoll_ctl(server->epoll_fd,
+                  EPOLL_CTL_MOD,
+                  server->sockfd_listen,
+                  &event) != 0) {
+        ERR("Could not modify epoll event: %s", strerror(errno));
+        return;
+    }
+
+    server->accepting = accepting;
+}
+
+/*
+ * Start waiting for incoming data on the specified connection. Since it only
+ * modifies the epoll instance of the worker, it can be called from any thread.
+ */
+static bool start_reading(struct ServerConn* conn) {
+    struct epoll_event event;
+    event.events   = EPOLLIN;
+    event.data.ptr = conn;
+    if (epoll_ctl(conn->server->epoll_fd,
+                  EPOLL_CTL_ADD,
+                  conn->sockfd,
+                  &event) != 0) {
+        ERR("Could not add epoll event: %s", strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Stop using or waiting for the shared output from the specified connection.
+ * If it was writing into it, the next connection in the queue, from any worker,
+ * can start reading.
+ */
+static void release_shared_output(struct ServerShared* shared,
+                                  struct ServerConn* conn) {
+    pthread_mutex_lock(&shared->lock);
+
+    if (shared->shared_owner != conn) {
+        struct ServerConn* prev = NULL;
+        struct ServerConn* cur  = shared->waiting_head;
+        while (cur != NULL && cur != conn) {
+            prev = cur;
+            cur  = cur->next_waiting;
+        }
+
+        if (cur != NULL) {
+            if (prev != NULL)
+                prev->next_waiting = cur->next_waiting;
+            else
+                shared->waiting_head = cur->next_waiting;
+            if (shared->waiting_tail == cur)
+                shared->waiting_tail = prev;
+        }
+    } else {
+        shared->shared_owner = NULL;
+
+        /*
+         * If we are stopping, the workers are closing all their connections,
+         * so there is no point in handing the output to the next one.
+         */
+        struct ServerConn* next = shared->waiting_head;
+        if (next != NULL && !g_signaled_quit && !is_failed(shared)) {
+            shared->waiting_head = next->next_waiting;
+            if (shared->waiting_head == NULL)
+                shared->waiting_tail = NULL;
+
+            shared->shared_owner = next;
+            if (!start_reading(next))
+                set_failed(shared);
+        }
+    }
+
+    pthread_mutex_unlock(&shared->lock);
+}
+
+/*
+ * Close the specified connection, and free it. If it was writing into the
+ * shared output, the next connection in the queue can start reading.
+ */
+static void close_connection(struct Server* server, struct ServerConn* conn) {
+    if (g_opt_print_peer_info) {
+        flockfile(stderr);
+        fprintf(stderr, "Closed connection from: ");
+        print_sockaddr(stderr, &conn->peer_addr);
+        fprintf(stderr, " (%zu bytes)\n", conn->received);
+        funlockfile(stderr);
+    }
+
+    /* Closing the socket also removes it from the epoll instance */
+    close(conn->sockfd);
+    if (conn->owns_dst)
+        close(conn->dst_fd);
+    else
+        release_shared_output(server->shared, conn);
+
+    if (conn->prev != NULL)
+        conn->prev->next = conn->next;
+    else
+        server->conns = conn->next;
+    if (conn->next != NULL)
+        conn->next->prev = conn->prev;
+
+    free(conn);
+    server->conn_count--;
+
+    /* We might have stopped accepting connections because of the limit */
+    if (!g_signaled_quit && !is_failed(server->shared))
+        set_accepting(server, true);
+}
+
+/*
+ * Open the output of a new connection, and start reading from it, unless it has
+ * to wait for the shared output. Returns false if the connection should be
+ * closed.
+ */
+static bool setup_connection(struct Server* server, struct ServerConn* conn) {
+    struct ServerShared* shared = server->shared;
+
+    if (shared->output_template != NULL) {
+        char path[PATH_MAX];
+        if (!expand_template(shared->output_template,
+                             &conn->peer_addr,
+                             conn->id,
+                             path,
+                             sizeof(path))) {
+            ERR("Could not expand the output template.");
+            return false;
+        }
+
+        conn->dst_fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+                            0666);
+        if (conn->dst_fd < 0) {
+            ERR("Could not open '%s': %s", path, strerror(errno));
+            return false;
+        }
+
+        conn->owns_dst = true;
+        return start_reading(conn);
+    }
+
+    conn->dst_fd = shared->shared_fd;
+
+    pthread_mutex_lock(&shared->lock);
+    const bool is_owner = (shared->shared_owner == NULL);
+    if (is_owner) {
+        shared->shared_owner = conn;
+    } else {
+        if (shared->waiting_tail != NULL)
+            shared->waiting_tail->next_waiting = conn;
+        else
+            shared->waiting_head = conn;
+        shared->waiting_tail = conn;
+    }
+    pthread_mutex_unlock(&shared->lock);
+
+    return !is_owner || start_reading(conn);
+}
+
+/*
+ * Accept all the pending connections from the listening socket, until the
+ * limit is reached.
+ */
+static void accept_connections(struct Server* server) {
+    while (server->conn_count < g_opt_max_connections) {
+        struct sockaddr_storage peer_addr;
+        socklen_t peer_addr_sz = sizeof(peer_addr);
+        const int sockfd       = accept4(server->sockfd_listen,
+                                   (struct sockaddr*)&peer_addr,
+                                   &peer_addr_sz,
+                                   SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (sockfd < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ||
+                errno == ECONNABORTED)
+                return;
+
+            ERR("Could not accept incoming connection: %s", strerror(errno));
+
+            /*
+             * If we ran out of descriptors, wait until a connection is closed.
+             * Otherwise, the (level-triggered) event would be returned again
+             * immediately.
+             */
+            if ((errno == EMFILE || errno == ENFILE) && server->conn_count > 0)
+                set_accepting(server, false);
+            return;
+        }
+
+        if (g_opt_connection_buffer > 0) {
+            const int rcvbuf = (int)g_opt_connection_buffer;
+            setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+        }
+
+        if (g_opt_low_latency)
+            net_set_low_latency(sockfd, false);
+
+        if (g_opt_print_peer_info) {
+            flockfile(stderr);
+            fprintf(stderr, "Incoming connection from: ");
+            print_sockaddr(stderr, &peer_addr);
+            fputc('\n', stderr);
+            funlockfile(stderr);
+        }
+
+        struct ServerConn* conn = calloc(1, sizeof(struct ServerConn));
+        if (conn == NULL) {
+            ERR("Failed to allocate connection: %s", strerror(errno));
+            close(sockfd);
+            return;
+        }
+
+        conn->server    = server;
+        conn->sockfd    = sockfd;
+        conn->peer_addr = peer_addr;
+        conn->dst_fd    = -1;
+        conn->id =
+          __atomic_add_fetch(&server->shared->conn_id, 1, __ATOMIC_RELAXED);
+
+        conn->next = server->conns;
+        if (server->conns != NULL)
+            server->conns->prev = conn;
+        server->conns = conn;
+        server->conn_count++;
+
+        if (!setup_connection(server, conn))
+            close_connection(server, conn);
+    }
+
+    set_accepting(server, false);
+}
+
+/*
+ * Receive the available data from the specified connection into its output.
+ * At most one block is received per call, so a single connection can't starve
+ * the rest. Returns false if the connection should be closed.
+ */
+static bool receive_from(struct Server* server, struct ServerConn* conn) {
+    const uint64_t start   = stats_start_call(STATS_CALL_RECV);
+    const ssize_t received = recv(conn->sockfd, server->buf, server->buf_sz, 0);
+    stats_end_call(STATS_CALL_RECV, STATS_WAIT_NET, start, received);
+    if (received < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            return true;
+
+        ERR("Receive error: %s", strerror(errno));
+        return false;
+    }
+    if (received == 0)
+        return false;
+
+    if (!io_write_all(conn->dst_fd, server->buf, received)) {
+        ERR("Write error: %s", strerror(errno));
+
+        /* If the shared output is broken, there is no point in continuing */
+        if (!conn->owns_dst)
+            set_failed(server->shared);
+        return false;
+    }
+
+    conn->received += received;
+    update_progress(__atomic_add_fetch(&server->shared->total,
+                                       (size_t)received,
+                                       __ATOMIC_RELAXED));
+
+    return true;
+}
+
+/*
+ * Handle the events from the connections and the listening socket of a
+ * worker, until the user wants to quit or another worker stops. Returns false
+ * on error, after printing it.
+ */
+static bool server_loop(struct Server* server) {
+    struct ServerShared* shared = server->shared;
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    bool result = true;
+
+    while (!g_signaled_quit && !is_failed(shared)) {
+        const int event_count =
+          epoll_wait(server->epoll_fd, events, LENGTH(events), -1);
+        if (event_count < 0) {
+            if (errno == EINTR)
+                continue;
+
+            ERR("Could not wait for events: %s", strerror(errno));
+            set_failed(shared);
+            result = false;
+            break;
+        }
+
+        for (int i = 0; i < event_count && !is_failed(shared); i++) {
+            void* ptr = events[i].data.ptr;
+            if (ptr == NULL)
+                accept_connections(server);
+            else if (ptr != shared && !receive_from(server, ptr))
+                close_connection(server, ptr);
+        }
+    }
+
+    /* The event is never consumed, so it wakes up every other worker */
+    eventfd_write(shared->wake_fd, 1);
+
+    return result && !is_failed(shared);
+}
+
+/*
+ * Pin the calling thread to a CPU, choosing the one at position `idx' (wrapping
+ * around) from the ones we are allowed to run on. Since it's only an
+ * optimization, errors are ignored.
+ */
+static void pin_worker(const struct ServerShared* shared, size_t idx) {
+    const int cpu_count = CPU_COUNT(&shared->cpus);
+    if (cpu_count <= 0)
+        return;
+
+    int target = (int)(idx % (size_t)cpu_count);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &shared->cpus) || target-- > 0)
+            continue;
+
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        return;
+    }
+}
+
+/*
+ * Main function of the worker threads. The first worker runs in the main
+ * thread instead, since it's the one receiving the quit signals.
+ */
+static void* worker_main(void* arg) {
+    struct Server* server = arg;
+
+    pin_worker(server->shared, server->idx);
+    server->result = server_loop(server);
+    return NULL;
+}
+
+/*
+ * Create the listening socket and the epoll instance of a worker. Returns false
+ * on error, after printing it.
+ */
+static bool setup_worker(struct Server* server,
+                         const char* src_port,
+                         bool reuse_port) {
+#ifdef FIXED_BLOCK_SIZE
+    server->buf_sz = FIXED_BLOCK_SIZE;
+#else  /* not FIXED_BLOCK_SIZE */
+    server->buf_sz = g_opt_block_size;
+#endif /* not FIXED_BLOCK_SIZE */
+    assert(server->buf_sz > 0);
+
+    server->buf = malloc(server->buf_sz);
+    if (server->buf == NULL) {
+        ERR("Failed to allocate %zu bytes: %s",
+            server->buf_sz,
+            strerror(errno));
+        return false;
+    }
+
+    server->sockfd_listen = net_listen(src_port, SOMAXCONN, reuse_port);
+    if (server->sockfd_listen < 0)
+        return false;
+
+    const int flags = fcntl(server->sockfd_listen, F_GETFL);
+    if (flags < 0 ||
+        fcntl(server->sockfd_listen, F_SETFL, flags | O_NONBLOCK) != 0) {
+        ERR("Could not make the socket non-blocking: %s", strerror(errno));
+        return false;
+    }
+
+    server->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (server->epoll_fd < 0) {
+        ERR("Could not create epoll instance: %s", strerror(errno));
+        return false;
+    }
+
+    /*
+     * The listening socket is identified by a NULL pointer, and the event of
+     * the other workers by the shared state.
+     */
+    struct epoll_event event;
+    event.events   = EPOLLIN;
+    event.data.ptr = NULL;
+    if (epoll_ctl(server->epoll_fd,
+                  EPOLL_CTL_ADD,
+                  server->sockfd_listen,
+                  &event) != 0) {
+        ERR("Could not add epoll event: %s", strerror(errno));
+        return false;
+    }
+    server->accepting = true;
+
+    event.data.ptr = server->shared;
+    if (epoll_ctl(server->epoll_fd,
+                  EPOLL_CTL_ADD,
+                  server->shared->wake_fd,
+                  &event) != 0) {
+        ERR("Could not add epoll event: %s", strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Close all the connections of a worker, and free its resources. The workers
+ * must have stopped.
+ */
+static void cleanup_worker(struct Server* server) {
+    while (server->conns != NULL)
+        close_connection(server, server->conns);
+
+    free(server->buf);
+
+    if (server->epoll_fd > -1)
+        close(server->epoll_fd);
+
+    /* Opened by 'net_listen' */
+    if (server->sockfd_listen > -1)
+        close(server->sockfd_listen);
+}
+
+/*----------------------------------------------------------------------------*/
+
+void snc_serve(const char* src_port, FILE* dst_fp) {
+    /*
+     * If the 'fatal_error' variable is true that the end of the function, the
+     * program will be aborted.
+     */
+    bool fatal_error = false;
+
+    const size_t worker_count = g_opt_workers;
+    assert(worker_count > 0);
+
+    struct ServerShared shared;
+    memset(&shared, 0, sizeof(shared));
+    shared.output_template = g_opt_output_template;
+    shared.wake_fd         = -1;
+    pthread_mutex_init(&shared.lock, NULL);
+
+    struct Server* workers = calloc(worker_count, sizeof(struct Server));
+    if (workers == NULL)
+        CLEANUP_AND_DIE("Failed to allocate %zu workers: %s",
+                        worker_count,
+                        strerror(errno));
+
+    for (size_t i = 0; i < worker_count; i++) {
+        workers[i].shared        = &shared;
+        workers[i].idx           = i;
+        workers[i].sockfd_listen = -1;
+        workers[i].epoll_fd      = -1;
+    }
+
+    /*
+     * Make sure the template is valid before accepting any connections, by
+     * expanding it for a dummy address.
+     */
+    if (shared.output_template != NULL) {
+        struct sockaddr_storage dummy_addr;
+        memset(&dummy_addr, 0, sizeof(dummy_addr));
+        dummy_addr.ss_family = AF_INET;
+
+        char path[PATH_MAX];
+        if (!expand_template(shared.output_template,
+                             &dummy_addr,
+                             1,
+                             path,
+                             sizeof(path)))
+            CLEANUP_AND_DIE("Invalid output template: '%s'",
+                            shared.output_template);
+    }
+
+    shared.wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (shared.wake_fd < 0)
+        CLEANUP_AND_DIE("Could not create event descriptor: %s",
+                        strerror(errno));
+
+    if (sched_getaffinity(0, sizeof(shared.cpus), &shared.cpus) != 0)
+        CPU_ZERO(&shared.cpus);
+
+    /*
+     * Each worker listens on its own socket, so the kernel distributes the
+     * incoming connections between them, instead of sharing a single accept
+     * queue between the threads.
+     */
+    for (size_t i = 0; i < worker_count; i++) {
+        if (!setup_worker(&workers[i], src_port, worker_count > 1)) {
+            fatal_error = true;
+            goto cleanup;
+        }
+    }
+
+    if (g_opt_print_interfaces) {
+        print_separator(stderr);
+        fprintf(stderr,
+                "Listening on port '%s'. Local interfaces:\n",
+                src_port);
+        print_interface_list(stderr);
+        print_separator(stderr);
+    }
+
+    /*
+     * Anything buffered by 'stdio' must be written before we start writing
+     * into the underlying descriptor directly.
+     */
+    fflush(dst_fp);
+    shared.shared_fd = fileno(dst_fp);
+
+    stats_start();
+    if (g_opt_print_progress && !start_progress_reporter("Received")) {
+        fatal_error = true;
+        goto cleanup;
+    }
+
+    for (size_t i = 1; i < worker_count; i++) {
+        if (!create_worker_thread(&workers[i].thread, worker_main, &workers[i]))
+            CLEANUP_AND_DIE("Could not create worker thread: %s",
+                            strerror(errno));
+        workers[i].thread_started = true;
+    }
+
+    /* The first worker runs in this thread, which receives the quit signals */
+    if (worker_count > 1)
+        pin_worker(&shared, 0);
+    if (!server_loop(&workers[0]))
+        fatal_error = true;
+
+cleanup:
+    /*
+     * If we failed to start all the workers, make sure the ones that started
+     * also stop.
+     */
+    if (fatal_error) {
+        set_failed(&shared);
+        if (shared.wake_fd > -1)
+            eventfd_write(shared.wake_fd, 1);
+    }
+
+    for (size_t i = 1; workers != NULL && i < worker_count; i++) {
+        if (!workers[i].thread_started)
+            continue;
+
+        pthread_join(workers[i].thread, NULL);
+        if (!workers[i].result)
+            fatal_error = true;
+    }
+
+    stop_progress_reporter();
+    if (g_opt_print_progress && !fatal_error) {
+        print_progress("Received", shared.total);
+        fputc('\n', stderr);
+    }
+
+    for (size_t i = 0; workers != NULL && i < worker_count; i++)
+        cleanup_worker(&workers[i]);
+    free(workers);
+
+    if (shared.wake_fd > -1)
+        close(shared.wake_fd);
+    pthread_mutex_destroy(&shared.lock);
+
+    if (fatal_error)
+        exit(1);
+}
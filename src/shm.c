@@ -0,0 +1,689 @@
+/*
+ * Copyright 2025 8dcc
+ *
+ * This file is part of snc (Simple NetCat).
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE /* memfd_create() */
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <unistd.h> /* read(), write(), close(), ftruncate() */
+#include <poll.h>   /* poll() */
+#include <sys/types.h>
+#include <sys/stat.h>    /* fstat() */
+#include <sys/mman.h>    /* memfd_create(), mmap() */
+#include <sys/eventfd.h> /* eventfd() */
+#include <sys/socket.h>  /* socket(), sendmsg(), recvmsg(), etc. */
+#include <sys/un.h>      /* sockaddr_un */
+#include <sys/time.h>    /* timeval */
+#include <netinet/in.h>  /* sockaddr_in */
+
+#include "include/util.h"
+#include "include/main.h"
+#include "include/io.h"
+#include "include/net.h"
+#include "include/stats.h"
+#include "include/proto.h"
+#include "include/output.h"
+#include "include/shm.h"
+
+/*
+ * Size of the control block at the start of the memfd, before the ring. The
+ * indexes written by each side are kept in different cache lines.
+ */
+#define SHM_CONTROL_SZ 4096
+
+/* Number of descriptors passed to the receiver */
+#define SHM_FD_COUNT 3
+
+/* Time that the transmitter waits for the secret of each Unix connection */
+#define SHM_SECRET_TIMEOUT_MS 1000
+
+/*
+ * Answers of the receiver to the offer, sent through the TCP connection once
+ * it tried to use the shared memory.
+ */
+#define SHM_ANSWER_REJECT 0
+#define SHM_ANSWER_ACCEPT 1
+
+/*
+ * Control block shared by both sides. The `head' is the number of bytes
+ * written into the ring by the transmitter, and `tail' the number of them
+ * consumed by the receiver, so the data is at `head % ring_sz'. The waiting
+ * flags are set by each side before sleeping.
+ */
+struct ShmControl {
+    uint64_t head;
+    uint8_t head_pad[56];
+
+    uint64_t tail;
+    uint8_t tail_pad[56];
+
+    uint64_t ring_sz;
+    uint32_t eof;
+    uint32_t tx_waiting, rx_waiting;
+};
+
+struct Shm {
+    int sockfd;
+
+    /*
+     * The receiver sleeps on `data_efd' and the transmitter on `space_efd',
+     * and each is signaled by the other side.
+     */
+    int mem_fd, data_efd, space_efd;
+
+    struct ShmControl* control;
+    uint8_t* ring;
+    size_t ring_sz;
+
+    void* map;
+    size_t map_sz;
+};
+
+/*----------------------------------------------------------------------------*/
+
+static void shm_close(struct Shm* shm) {
+    if (shm->map != NULL)
+        munmap(shm->map, shm->map_sz);
+    if (shm->mem_fd > -1)
+        close(shm->mem_fd);
+    if (shm->data_efd > -1)
+        close(shm->data_efd);
+    if (shm->space_efd > -1)
+        close(shm->space_efd);
+}
+
+/*
+ * Map the memfd of `shm', whose size is `map_sz'. Returns false on error, with
+ * `errno' set.
+ */
+static bool shm_map(struct Shm* shm, size_t map_sz) {
+    void* map =
+      mmap(NULL, map_sz, PROT_READ | PROT_WRITE, MAP_SHARED, shm->mem_fd, 0);
+    if (map == MAP_FAILED)
+        return false;
+
+    shm->map     = map;
+    shm->map_sz  = map_sz;
+    shm->control = map;
+    shm->ring    = (uint8_t*)map + SHM_CONTROL_SZ;
+    shm->ring_sz = map_sz - SHM_CONTROL_SZ;
+    return true;
+}
+
+/*
+ * Get the abstract address of the Unix socket used by the transfer with the
+ * specified `session'. Returns the size of the address.
+ */
+static socklen_t unix_address(uint32_t session, struct sockaddr_un* addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+
+    /* The first byte of the path stays zero, so it's an abstract address */
+    const int len = snprintf(&addr->sun_path[1],
+                             sizeof(addr->sun_path) - 1,
+                             "snc-shm-%08lx",
+                             (unsigned long)session);
+    return offsetof(struct sockaddr_un, sun_path) + 1 + len;
+}
+
+/*
+ * Is the peer of the TCP connection `sockfd' on this host? That's the case if
+ * it's a loopback address, or if it's the same as our own address.
+ */
+static bool peer_is_local(int sockfd) {
+    struct sockaddr_storage local, peer;
+    socklen_t local_len = sizeof(local);
+    socklen_t peer_len  = sizeof(peer);
+    if (getsockname(sockfd, (struct sockaddr*)&local, &local_len) != 0 ||
+        getpeername(sockfd, (struct sockaddr*)&peer, &peer_len) != 0 ||
+        peer.ss_family != AF_INET || local.ss_family != AF_INET)
+        return false;
+
+    const struct sockaddr_in* local_in = (const struct sockaddr_in*)&local;
+    const struct sockaddr_in* peer_in  = (const struct sockaddr_in*)&peer;
+    return (ntohl(peer_in->sin_addr.s_addr) >> 24) == IN_LOOPBACKNET ||
+           peer_in->sin_addr.s_addr == local_in->sin_addr.s_addr;
+}
+
+/*----------------------------------------------------------------------------*/
+
+/*
+ * Signal the other side through `efd', if it's sleeping. Must be called after
+ * updating the shared indexes.
+ */
+static void notify(int efd, uint32_t* waiting) {
+    if (__atomic_load_n(waiting, __ATOMIC_SEQ_CST) == 0)
+        return;
+
+    const uint64_t value = 1;
+    while (write(efd, &value, sizeof(value)) < 0 && errno == EINTR)
+        continue;
+}
+
+/*
+ * Is the ring full, for the transmitter, or empty, for the receiver?
+ */
+static bool is_blocked(const struct Shm* shm, bool transmitting) {
+    struct ShmControl* control = shm->control;
+
+    const uint64_t head = __atomic_load_n(&control->head, __ATOMIC_SEQ_CST);
+    const uint64_t tail = __atomic_load_n(&control->tail, __ATOMIC_SEQ_CST);
+    if (transmitting)
+        return head - tail >= shm->ring_sz;
+
+    const uint32_t eof  = __atomic_load_n(&control->eof, __ATOMIC_SEQ_CST);
+    return head == tail && eof == 0;
+}
+
+/*
+ * Sleep until the other side signals `efd', if the ring is still full or
+ * empty after setting our `waiting' flag. Since the other side checks the flag
+ * after updating the indexes, the signal can't be missed. Returns false if the
+ * other side closed the connection, after printing the error.
+ */
+static bool wait_peer(struct Shm* shm,
+                      int efd,
+                      uint32_t* waiting,
+                      bool transmitting) {
+    bool result = true;
+
+    __atomic_store_n(waiting, 1, __ATOMIC_SEQ_CST);
+    if (is_blocked(shm, transmitting)) {
+        struct pollfd pfds[2] = {
+            { .fd = efd, .events = POLLIN },
+            { .fd = shm->sockfd, .events = POLLIN },
+        };
+
+        uint64_t value;
+        const int ready = poll(pfds, LENGTH(pfds), -1);
+        if (ready < 0 && errno != EINTR) {
+            ERR("Poll error: %s", strerror(errno));
+            result = false;
+        } else if (ready > 0 && pfds[1].revents != 0) {
+            /* Nothing else is sent through the connection until the end */
+            ERR("The %s closed the connection.",
+                transmitting ? "receiver" : "transmitter");
+            result = false;
+        } else if (ready > 0 &&
+                   read(efd, &value, sizeof(value)) < 0 && errno != EINTR) {
+            ERR("Read error: %s", strerror(errno));
+            result = false;
+        }
+    }
+
+    __atomic_store_n(waiting, 0, __ATOMIC_SEQ_CST);
+    return result;
+}
+
+/*----------------------------------------------------------------------------*/
+
+/*
+ * Create the memfd and the eventfds of `shm', and map the ring. Returns false
+ * on error, after printing it.
+ */
+static bool create_ring(struct Shm* shm) {
+    const size_t map_sz = SHM_CONTROL_SZ + SHM_RING_SZ;
+
+    shm->mem_fd    = memfd_create("snc-shm", MFD_CLOEXEC);
+    shm->data_efd  = eventfd(0, EFD_CLOEXEC);
+    shm->space_efd = eventfd(0, EFD_CLOEXEC);
+    if (shm->mem_fd < 0 || shm->data_efd < 0 || shm->space_efd < 0 ||
+        ftruncate(shm->mem_fd, map_sz) != 0 || !shm_map(shm, map_sz)) {
+        ERR("Could not create the shared memory: %s", strerror(errno));
+        return false;
+    }
+
+    shm->control->ring_sz = shm->ring_sz;
+    return true;
+}
+
+/*
+ * Check the secret sent by a process connected to our Unix socket, and if it's
+ * the receiver, pass it the descriptors. Returns true if they were passed.
+ */
+static bool pass_descriptors(const struct Shm* shm,
+                             int listen_fd,
+                             const uint8_t* secret) {
+    const int sockfd = accept(listen_fd, NULL, NULL);
+    if (sockfd < 0)
+        return false;
+
+    /* Anyone on the host can connect, so don't wait for them forever */
+    const struct timeval timeout = {
+        .tv_sec  = SHM_SECRET_TIMEOUT_MS / 1000,
+        .tv_usec = SHM_SECRET_TIMEOUT_MS % 1000 * 1000,
+    };
+    setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    uint8_t received[SHM_SECRET_SZ];
+    if (io_recv_full(sockfd, received, sizeof(received)) != SHM_SECRET_SZ ||
+        memcmp(received, secret, SHM_SECRET_SZ) != 0) {
+        close(sockfd);
+        return false;
+    }
+
+    const int fds[SHM_FD_COUNT] = {
+        shm->mem_fd,
+        shm->data_efd,
+        shm->space_efd,
+    };
+    union {
+        char buf[CMSG_SPACE(sizeof(fds))];
+        struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+
+    uint8_t byte      = 0;
+    struct iovec iov  = { .iov_base = &byte, .iov_len = sizeof(byte) };
+    struct msghdr msg = {
+        .msg_iov        = &iov,
+        .msg_iovlen     = 1,
+        .msg_control    = control.buf,
+        .msg_controllen = sizeof(control.buf),
+    };
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level     = SOL_SOCKET;
+    cmsg->cmsg_type      = SCM_RIGHTS;
+    cmsg->cmsg_len       = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    const bool sent = sendmsg(sockfd, &msg, MSG_NOSIGNAL) == sizeof(byte);
+    close(sockfd);
+    return sent;
+}
+
+/*
+ * Offer the shared memory to the receiver, and wait for its answer. Returns
+ * `SHM_UNAVAILABLE' if it rejected the offer.
+ */
+static enum EShmResult offer_ring(struct Shm* shm, uint64_t total_sz) {
+    enum EShmResult result = SHM_ERROR;
+
+    const struct ProtoHeader header = {
+        .version      = PROTO_VERSION,
+        .flags        = PROTO_FLAG_SHM,
+        .stream_count = 1,
+        .session      = proto_new_session(),
+        .block_sz     = SHM_MAX_CHUNK,
+        .total_sz     = total_sz,
+    };
+
+    uint8_t secret[SHM_SECRET_SZ];
+    store_be(&secret[0], proto_new_session(), 4);
+    store_be(&secret[4], proto_new_session(), 4);
+
+    struct sockaddr_un addr;
+    const socklen_t addr_len = unix_address(header.session, &addr);
+
+    const int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0 ||
+        bind(listen_fd, (const struct sockaddr*)&addr, addr_len) != 0 ||
+        listen(listen_fd, SNC_LISTEN_QUEUE_SZ) != 0) {
+        ERR("Could not listen for the receiver: %s", strerror(errno));
+        goto done;
+    }
+
+    if (!proto_send_header(shm->sockfd, &header) ||
+        !io_send_all(shm->sockfd, secret, sizeof(secret))) {
+        ERR("Send error: %s", strerror(errno));
+        goto done;
+    }
+
+    /*
+     * The receiver either rejects the offer right away, or connects to the
+     * Unix socket first, and then tells us if it could map the ring.
+     */
+    const uint64_t deadline =
+      stats_clock_ns() + SHM_HANDSHAKE_TIMEOUT_MS * 1000000ULL;
+    for (;;) {
+        const uint64_t now = stats_clock_ns();
+        if (now >= deadline) {
+            ERR("Timed out waiting for the receiver.");
+            goto done;
+        }
+
+        struct pollfd pfds[2] = {
+            { .fd = listen_fd, .events = POLLIN },
+            { .fd = shm->sockfd, .events = POLLIN },
+        };
+        if (poll(pfds, LENGTH(pfds), (deadline - now) / 1000000 + 1) < 0) {
+            if (errno == EINTR && !g_signaled_quit)
+                continue;
+
+            ERR("Poll error: %s", strerror(errno));
+            goto done;
+        }
+
+        if (pfds[1].revents != 0)
+            break;
+        if (pfds[0].revents != 0)
+            pass_descriptors(shm, listen_fd, secret);
+    }
+
+    uint8_t answer;
+    if (io_recv_full(shm->sockfd, &answer, sizeof(answer)) != 1) {
+        ERR("The receiver doesn't support shared memory.");
+        goto done;
+    }
+
+    result = (answer == SHM_ANSWER_ACCEPT) ? SHM_OK : SHM_UNAVAILABLE;
+
+done:
+    if (listen_fd > -1)
+        close(listen_fd);
+    return result;
+}
+
+/*
+ * Copy the input into the ring until the end of the input. Returns false on
+ * error, after printing it.
+ */
+static bool fill_ring(struct Shm* shm, int src_fd, size_t* total) {
+    struct ShmControl* control = shm->control;
+    uint64_t head              = 0;
+
+    while (!g_signaled_quit) {
+        const uint64_t tail = __atomic_load_n(&control->tail, __ATOMIC_ACQUIRE);
+        if (head - tail >= shm->ring_sz) {
+            if (!wait_peer(shm, shm->space_efd, &control->tx_waiting, true))
+                return false;
+            continue;
+        }
+
+        const size_t offset = head % shm->ring_sz;
+        const size_t len    = MIN(MIN(shm->ring_sz - (head - tail),
+                                      shm->ring_sz - offset),
+                                  SHM_MAX_CHUNK);
+
+        const uint64_t start = stats_start_call(STATS_CALL_READ);
+        const ssize_t received = read(src_fd, &shm->ring[offset], len);
+        stats_end_call(STATS_CALL_READ, STATS_WAIT_IO, start, received);
+        if (received < 0) {
+            if (errno == EINTR)
+                continue;
+
+            ERR("Read error: %s", strerror(errno));
+            return false;
+        }
+        if (received == 0)
+            break;
+
+        head += received;
+        __atomic_store_n(&control->head, head, __ATOMIC_SEQ_CST);
+        notify(shm->data_efd, &control->rx_waiting);
+
+        *total += received;
+        update_progress(*total);
+    }
+
+    __atomic_store_n(&control->eof, 1, __ATOMIC_SEQ_CST);
+    notify(shm->data_efd, &control->rx_waiting);
+    return !g_signaled_quit;
+}
+
+enum EShmResult shm_transmit(int sockfd, int src_fd, size_t* total) {
+    if (!peer_is_local(sockfd)) {
+        if (g_opt_print_peer_info) {
+            fprintf(stderr,
+                    "The receiver is on another host, not using shared "
+                    "memory.\n");
+            print_separator(stderr);
+        }
+        return SHM_UNAVAILABLE;
+    }
+
+    struct Shm shm = {
+        .sockfd    = sockfd,
+        .mem_fd    = -1,
+        .data_efd  = -1,
+        .space_efd = -1,
+    };
+
+    /* Without the ring, the data can still be sent through the connection */
+    if (!create_ring(&shm)) {
+        shm_close(&shm);
+        return SHM_UNAVAILABLE;
+    }
+
+    /*
+     * If the input is a regular file, we can tell the receiver how much data
+     * to expect.
+     */
+    uint64_t total_sz = PROTO_SIZE_UNKNOWN;
+    struct stat st;
+    if (io_fd_type(src_fd) == IO_FD_REGULAR && fstat(src_fd, &st) == 0) {
+        const off_t offset = lseek(src_fd, 0, SEEK_CUR);
+        if (offset >= 0 && offset <= st.st_size)
+            total_sz = st.st_size - offset;
+    }
+
+    enum EShmResult result = offer_ring(&shm, total_sz);
+    if (result != SHM_OK) {
+        if (result == SHM_UNAVAILABLE && g_opt_print_peer_info) {
+            fprintf(stderr,
+                    "The receiver can't use shared memory, sending through "
+                    "the connection.\n");
+            print_separator(stderr);
+        }
+        goto done;
+    }
+
+    if (g_opt_print_peer_info) {
+        fprintf(stderr,
+                "Sending through %zu MiB of shared memory.\n",
+                shm.ring_sz / (1024 * 1024));
+        print_separator(stderr);
+    }
+
+    /*
+     * Once the receiver wrote everything into its output, it tells us how
+     * much it received, so we don't exit before it's done.
+     */
+    result = SHM_ERROR;
+    if (!fill_ring(&shm, src_fd, total))
+        goto done;
+
+    uint8_t received[8];
+    if (io_recv_full(sockfd, received, sizeof(received)) != sizeof(received) ||
+        load_be(received, sizeof(received)) != *total) {
+        ERR("The receiver didn't get all the data.");
+        goto done;
+    }
+
+    result = SHM_OK;
+
+done:
+    shm_close(&shm);
+    return result;
+}
+
+/*----------------------------------------------------------------------------*/
+
+/*
+ * Connect to the Unix socket of the transmitter, and receive the descriptors
+ * of the ring, which is then mapped. Returns false if the shared memory can't
+ * be used, printing the reason if `g_opt_print_peer_info' is set.
+ */
+static bool open_ring(struct Shm* shm,
+                      uint32_t session,
+                      const uint8_t* secret) {
+    struct sockaddr_un addr;
+    const socklen_t addr_len = unix_address(session, &addr);
+
+    const int sockfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sockfd < 0 ||
+        connect(sockfd, (const struct sockaddr*)&addr, addr_len) != 0 ||
+        !io_send_all(sockfd, secret, SHM_SECRET_SZ)) {
+        if (g_opt_print_peer_info)
+            fprintf(stderr,
+                    "Could not reach the transmitter locally: %s\n",
+                    strerror(errno));
+        if (sockfd > -1)
+            close(sockfd);
+        return false;
+    }
+
+    union {
+        char buf[CMSG_SPACE(SHM_FD_COUNT * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+
+    uint8_t byte      = 0;
+    struct iovec iov  = { .iov_base = &byte, .iov_len = sizeof(byte) };
+    struct msghdr msg = {
+        .msg_iov        = &iov,
+        .msg_iovlen     = 1,
+        .msg_control    = control.buf,
+        .msg_controllen = sizeof(control.buf),
+    };
+
+    const ssize_t received = recvmsg(sockfd, &msg, MSG_CMSG_CLOEXEC);
+    close(sockfd);
+
+    const struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (received != sizeof(byte) || cmsg == NULL ||
+        cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS ||
+        cmsg->cmsg_len != CMSG_LEN(SHM_FD_COUNT * sizeof(int))) {
+        if (g_opt_print_peer_info)
+            fprintf(stderr, "The transmitter didn't share its memory.\n");
+        return false;
+    }
+
+    int fds[SHM_FD_COUNT];
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+    shm->mem_fd    = fds[0];
+    shm->data_efd  = fds[1];
+    shm->space_efd = fds[2];
+
+    struct stat st;
+    if (fstat(shm->mem_fd, &st) != 0 || st.st_size <= SHM_CONTROL_SZ ||
+        !shm_map(shm, st.st_size) ||
+        shm->control->ring_sz != shm->ring_sz) {
+        if (g_opt_print_peer_info)
+            fprintf(stderr, "Could not map the shared memory.\n");
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Write the data of the ring into `dst_fd' until the transmitter reaches the
+ * end of its input. Returns false on error, after printing it.
+ */
+static bool drain_ring(struct Shm* shm, int dst_fd, size_t* total) {
+    struct ShmControl* control = shm->control;
+    uint64_t tail              = 0;
+
+    while (!g_signaled_quit) {
+        uint64_t head = __atomic_load_n(&control->head, __ATOMIC_ACQUIRE);
+        if (head == tail) {
+            /* The final `head' was stored before the end was signaled */
+            if (__atomic_load_n(&control->eof, __ATOMIC_SEQ_CST) != 0 &&
+                __atomic_load_n(&control->head, __ATOMIC_SEQ_CST) == tail)
+                return true;
+            if (!wait_peer(shm, shm->data_efd, &control->rx_waiting, false))
+                return false;
+            continue;
+        }
+        if (head - tail > shm->ring_sz) {
+            ERR("Received an invalid position from the transmitter.");
+            return false;
+        }
+
+        const size_t offset = tail % shm->ring_sz;
+        const size_t len    = MIN(MIN(head - tail, shm->ring_sz - offset),
+                                  SHM_MAX_CHUNK);
+        if (!output_write(dst_fd, &shm->ring[offset], len)) {
+            ERR("Write error: %s", strerror(errno));
+            return false;
+        }
+
+        tail += len;
+        __atomic_store_n(&control->tail, tail, __ATOMIC_SEQ_CST);
+        notify(shm->space_efd, &control->tx_waiting);
+
+        *total += len;
+        update_progress(*total);
+    }
+
+    return false;
+}
+
+enum EShmResult shm_receive(int sockfd,
+                            const struct ProtoHeader* header,
+                            int dst_fd,
+                            size_t* total) {
+    uint8_t secret[SHM_SECRET_SZ];
+    if (io_recv_full(sockfd, secret, sizeof(secret)) != sizeof(secret)) {
+        ERR("Received an invalid shared memory offer.");
+        return SHM_ERROR;
+    }
+
+    struct Shm shm = {
+        .sockfd    = sockfd,
+        .mem_fd    = -1,
+        .data_efd  = -1,
+        .space_efd = -1,
+    };
+
+    /* If we can't use the ring, the transmitter uses the connection instead */
+    const bool usable = open_ring(&shm, header->session, secret);
+    const uint8_t answer = usable ? SHM_ANSWER_ACCEPT : SHM_ANSWER_REJECT;
+    if (!io_send_all(sockfd, &answer, sizeof(answer))) {
+        ERR("Send error: %s", strerror(errno));
+        shm_close(&shm);
+        return SHM_ERROR;
+    }
+    if (!usable) {
+        if (g_opt_print_peer_info)
+            print_separator(stderr);
+        shm_close(&shm);
+        return SHM_UNAVAILABLE;
+    }
+
+    if (g_opt_print_peer_info) {
+        fprintf(stderr,
+                "Receiving through %zu MiB of shared memory.\n",
+                shm.ring_sz / (1024 * 1024));
+        print_separator(stderr);
+    }
+
+    enum EShmResult result = SHM_ERROR;
+    if (!drain_ring(&shm, dst_fd, total))
+        goto done;
+
+    uint8_t received[8];
+    store_be(received, *total, sizeof(received));
+    if (!io_send_all(sockfd, received, sizeof(received))) {
+        ERR("Send error: %s", strerror(errno));
+        goto done;
+    }
+
+    result = SHM_OK;
+
+done:
+    shm_close(&shm);
+    return result;
+}
@@ -0,0 +1,165 @@
+/*
+ * Copyright 2025 8dcc
+ *
+ * This file is part of snc (Simple NetCat).
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE /* rand_r() */
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/types.h>
+#include <sys/socket.h> /* recvfrom() */
+
+#include "include/util.h"
+#include "include/main.h"
+#include "include/stats.h"
+#include "include/proto.h"
+#include "include/sim.h"
+
+struct SimDatagram {
+    uint64_t due_ns;
+    struct sockaddr_in from;
+    size_t len;
+    uint8_t data[SIM_MAX_DATAGRAM_SZ];
+};
+
+/*----------------------------------------------------------------------------*/
+
+/*
+ * Receive a datagram from the socket itself, dropping it with the probability
+ * of '--simulate-loss'. Returns just like `sim_recvfrom'.
+ */
+static ssize_t recv_lossy(struct Simulator* sim,
+                          int sockfd,
+                          void* buf,
+                          size_t buf_sz,
+                          struct sockaddr_in* from) {
+    for (;;) {
+        socklen_t from_len = sizeof(*from);
+
+        const uint64_t start   = stats_start_call(STATS_CALL_RECV);
+        const ssize_t received = recvfrom(sockfd,
+                                          buf,
+                                          buf_sz,
+                                          MSG_DONTWAIT,
+                                          (struct sockaddr*)from,
+                                          &from_len);
+        stats_end_call(STATS_CALL_RECV, STATS_WAIT_NET, start, received);
+        if (received < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return 0;
+
+            /* Errors queued by ICMP messages are like a lost datagram */
+            if (errno == ECONNREFUSED)
+                continue;
+            return -1;
+        }
+
+        if (g_opt_simulate_loss > 0 &&
+            rand_r(&sim->seed) < RAND_MAX / 100.0 * g_opt_simulate_loss)
+            continue;
+
+        return received;
+    }
+}
+
+/*----------------------------------------------------------------------------*/
+
+bool sim_init(struct Simulator* sim) {
+    memset(sim, 0, sizeof(*sim));
+    sim->seed = proto_new_session();
+
+    if (g_opt_simulate_delay == 0)
+        return true;
+
+    sim->queue = calloc(SIM_QUEUE_LEN, sizeof(struct SimDatagram));
+    if (sim->queue == NULL) {
+        ERR("Failed to allocate the simulator queue: %s", strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+void sim_free(struct Simulator* sim) {
+    free(sim->queue);
+    sim->queue = NULL;
+}
+
+ssize_t sim_recvfrom(struct Simulator* sim,
+                     int sockfd,
+                     void* buf,
+                     size_t buf_sz,
+                     struct sockaddr_in* from) {
+    if (sim->queue == NULL)
+        return recv_lossy(sim, sockfd, buf, buf_sz, from);
+
+    /*
+     * Move everything that arrived into the queue, with the time it's due.
+     * Once the queue is full, the rest of the datagrams wait in the socket,
+     * which drops them once its own buffer is full.
+     */
+    const uint64_t now = stats_clock_ns();
+    while (sim->len < SIM_QUEUE_LEN) {
+        struct SimDatagram* datagram =
+          &sim->queue[(sim->head + sim->len) % SIM_QUEUE_LEN];
+        const ssize_t received = recv_lossy(sim,
+                                            sockfd,
+                                            datagram->data,
+                                            sizeof(datagram->data),
+                                            &datagram->from);
+        if (received <= 0) {
+            if (received < 0)
+                return -1;
+            break;
+        }
+
+        datagram->due_ns = now + g_opt_simulate_delay * NS_PER_MS;
+        datagram->len    = received;
+        sim->len++;
+    }
+
+    if (sim->len == 0 || sim->queue[sim->head].due_ns > now)
+        return 0;
+
+    const struct SimDatagram* datagram = &sim->queue[sim->head];
+    const size_t len = (datagram->len < buf_sz) ? datagram->len : buf_sz;
+    memcpy(buf, datagram->data, len);
+    *from = datagram->from;
+
+    sim->head = (sim->head + 1) % SIM_QUEUE_LEN;
+    sim->len--;
+    return len;
+}
+
+uint64_t sim_timeout_ns(const struct Simulator* sim, uint64_t timeout_ns) {
+    if (sim->queue == NULL || sim->len == 0)
+        return timeout_ns;
+
+    const uint64_t now    = stats_clock_ns();
+    const uint64_t due_ns = sim->queue[sim->head].due_ns;
+    if (due_ns <= now)
+        return 0;
+
+    return (due_ns - now < timeout_ns) ? due_ns - now : timeout_ns;
+}
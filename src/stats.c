@@ -0,0 +1,393 @@
+/*
+ * Copyright 2025 8dcc
+ *
+ * This file is part of snc (Simple NetCat).
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE /* struct tcp_info */
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/resource.h> /* getrusage() */
+#include <sys/socket.h>   /* getsockopt() */
+#include <netinet/in.h>   /* IPPROTO_TCP */
+#include <netinet/tcp.h>  /* TCP_INFO */
+
+#include "include/util.h"
+#include "include/main.h"
+#include "include/stats.h"
+
+struct Stats g_stats;
+
+/*
+ * Names of each `EStatsCall', used when printing.
+ */
+static const char* call_names[STATS_CALL_COUNT] = {
+    [STATS_CALL_READ]     = "read",
+    [STATS_CALL_WRITE]    = "write",
+    [STATS_CALL_SEND]     = "send",
+    [STATS_CALL_RECV]     = "recv",
+    [STATS_CALL_SPLICE]   = "splice",
+    [STATS_CALL_SENDFILE] = "sendfile",
+    [STATS_CALL_IO_URING] = "io_uring_enter",
+};
+
+/*
+ * Time and resource usage when `stats_start' was called.
+ */
+static struct timespec start_time;
+static struct rusage start_usage;
+
+/*
+ * State used by `stats_print_live', which can be called from any thread. The
+ * lock also protects `start_time', and it's held while using the watched
+ * sockets, so they can't be closed meanwhile.
+ */
+static struct {
+    pthread_mutex_t lock;
+    bool started;
+
+    int sockfds[STATS_MAX_CONNECTIONS];
+    size_t sockfd_count;
+
+    /* Progress and time of the previous call */
+    size_t last_progress;
+    struct timespec last_time;
+} live = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/*
+ * Values measured when printing the summary, common to all formats.
+ */
+struct Summary {
+    double elapsed;
+    double user_time, sys_time;
+    uint64_t total_calls;
+};
+
+/*----------------------------------------------------------------------------*/
+
+static double timespec_seconds(const struct timespec* ts) {
+    return ts->tv_sec + ts->tv_nsec / 1e9;
+}
+
+static double timeval_seconds(const struct timeval* tv) {
+    return tv->tv_sec + tv->tv_usec / 1e6;
+}
+
+static uint64_t load_counter(const uint64_t* counter) {
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+static void get_summary(struct Summary* summary) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    summary->elapsed = timespec_seconds(&now) - timespec_seconds(&start_time);
+    summary->user_time =
+      timeval_seconds(&usage.ru_utime) - timeval_seconds(&start_usage.ru_utime);
+    summary->sys_time =
+      timeval_seconds(&usage.ru_stime) - timeval_seconds(&start_usage.ru_stime);
+
+    summary->total_calls = 0;
+    for (int i = 0; i < STATS_CALL_COUNT; i++)
+        summary->total_calls += load_counter(&g_stats.calls[i]);
+}
+
+/*
+ * Read the TCP information of `sockfd' into `conn'. Returns false on error.
+ */
+static bool get_connection(int sockfd, struct StatsConnection* conn) {
+    struct tcp_info info;
+    socklen_t info_len = sizeof(info);
+    if (getsockopt(sockfd, IPPROTO_TCP, TCP_INFO, &info, &info_len) != 0)
+        return false;
+
+    conn->rtt_us      = info.tcpi_rtt;
+    conn->rtt_var_us  = info.tcpi_rttvar;
+    conn->retransmits = info.tcpi_total_retrans;
+    conn->cwnd        = info.tcpi_snd_cwnd;
+    conn->mss         = info.tcpi_snd_mss;
+    return true;
+}
+
+static void print_connection(FILE* fp, const struct StatsConnection* conn) {
+    fprintf(fp,
+            "TCP:          RTT %.3f ms, %lu retransmits, window %lu segments\n",
+            conn->rtt_us / 1000.0,
+            (unsigned long)conn->retransmits,
+            (unsigned long)conn->cwnd);
+}
+
+/*----------------------------------------------------------------------------*/
+
+uint64_t stats_clock_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+void stats_sample_connection(int sockfd) {
+    struct StatsConnection conn;
+    if (!get_connection(sockfd, &conn))
+        return;
+
+    /* Streams are sampled from their own threads */
+    const size_t idx =
+      __atomic_fetch_add(&g_stats.connection_count, 1, __ATOMIC_RELAXED);
+    if (idx < STATS_MAX_CONNECTIONS)
+        g_stats.connections[idx] = conn;
+}
+
+void stats_watch_connection(int sockfd) {
+    pthread_mutex_lock(&live.lock);
+    if (live.sockfd_count < STATS_MAX_CONNECTIONS)
+        live.sockfds[live.sockfd_count++] = sockfd;
+    pthread_mutex_unlock(&live.lock);
+}
+
+void stats_unwatch_connection(int sockfd) {
+    pthread_mutex_lock(&live.lock);
+    for (size_t i = 0; i < live.sockfd_count; i++) {
+        if (live.sockfds[i] == sockfd) {
+            live.sockfds[i] = live.sockfds[--live.sockfd_count];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&live.lock);
+}
+
+void stats_start(void) {
+    pthread_mutex_lock(&live.lock);
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    live.started       = true;
+    live.last_progress = 0;
+    live.last_time     = start_time;
+    pthread_mutex_unlock(&live.lock);
+
+    getrusage(RUSAGE_SELF, &start_usage);
+    g_stats.connection_count = 0;
+}
+
+void stats_print_summary(FILE* fp, size_t total) {
+    struct Summary summary;
+    get_summary(&summary);
+
+    const double elapsed    = summary.elapsed;
+    const double gib        = total / (1024.0 * 1024.0 * 1024.0);
+    const double throughput = (elapsed > 0) ? gib / elapsed : 0;
+
+    print_separator(fp);
+    fprintf(fp, "Transferred:  %zu bytes in %.3f s\n", total, elapsed);
+    fprintf(fp,
+            "Throughput:   %.3f GiB/s (%.3f Gbit/s)\n",
+            throughput,
+            (elapsed > 0) ? total * 8 / elapsed / 1e9 : 0);
+    fprintf(fp,
+            "CPU time:     %.3f s user, %.3f s system",
+            summary.user_time,
+            summary.sys_time);
+    if (gib > 0)
+        fprintf(fp,
+                " (%.3f s per GiB)",
+                (summary.user_time + summary.sys_time) / gib);
+    fputc('\n', fp);
+
+    if (g_opt_stats)
+        fprintf(fp,
+                "Waiting:      %.3f s for the network, %.3f s for I/O\n",
+                load_counter(&g_stats.wait_ns[STATS_WAIT_NET]) / 1e9,
+                load_counter(&g_stats.wait_ns[STATS_WAIT_IO]) / 1e9);
+
+    fprintf(fp,
+            "System calls: %llu",
+            (unsigned long long)summary.total_calls);
+
+    const char* separator = " (";
+    for (int i = 0; i < STATS_CALL_COUNT; i++) {
+        const uint64_t calls = load_counter(&g_stats.calls[i]);
+        if (calls == 0)
+            continue;
+
+        fprintf(fp,
+                "%s%s: %llu",
+                separator,
+                call_names[i],
+                (unsigned long long)calls);
+        separator = ", ";
+    }
+    if (summary.total_calls > 0)
+        fputc(')', fp);
+    fputc('\n', fp);
+
+    const size_t connection_count = g_stats.connection_count;
+    for (size_t i = 0; i < connection_count && i < STATS_MAX_CONNECTIONS; i++)
+        print_connection(fp, &g_stats.connections[i]);
+
+    print_separator(fp);
+}
+
+void stats_print_json(FILE* fp, const char* mode, size_t total) {
+    struct Summary summary;
+    get_summary(&summary);
+
+    const double elapsed = summary.elapsed;
+
+    fprintf(fp, "{\"mode\": \"%s\", ", mode);
+    fprintf(fp, "\"bytes\": %zu, \"seconds\": %.6f, ", total, elapsed);
+    fprintf(fp,
+            "\"bits_per_second\": %.0f, ",
+            (elapsed > 0) ? total * 8 / elapsed : 0);
+    fprintf(fp,
+            "\"cpu\": {\"user_seconds\": %.6f, \"system_seconds\": %.6f}, ",
+            summary.user_time,
+            summary.sys_time);
+    fprintf(fp,
+            "\"wait\": {\"network_seconds\": %.6f, \"io_seconds\": %.6f}, ",
+            load_counter(&g_stats.wait_ns[STATS_WAIT_NET]) / 1e9,
+            load_counter(&g_stats.wait_ns[STATS_WAIT_IO]) / 1e9);
+
+    fprintf(fp, "\"calls\": {");
+    for (int i = 0; i < STATS_CALL_COUNT; i++)
+        fprintf(fp,
+                "%s\"%s\": %llu",
+                (i > 0) ? ", " : "",
+                call_names[i],
+                (unsigned long long)load_counter(&g_stats.calls[i]));
+    fprintf(fp, "}, ");
+
+    /*
+     * The histograms only include the calls that returned data, and each
+     * bucket is named after the smallest size it counts.
+     */
+    fprintf(fp, "\"sizes\": {");
+    const char* call_separator = "";
+    for (int i = 0; i < STATS_CALL_COUNT; i++) {
+        const char* bucket_separator = "";
+        for (int j = 0; j < STATS_SIZE_BUCKETS; j++) {
+            const uint64_t count = load_counter(&g_stats.sizes[i][j]);
+            if (count == 0)
+                continue;
+
+            if (*bucket_separator == '\0') {
+                fprintf(fp, "%s\"%s\": {", call_separator, call_names[i]);
+                call_separator = ", ";
+            }
+            fprintf(fp,
+                    "%s\"%llu\": %llu",
+                    bucket_separator,
+                    1ULL << j,
+                    (unsigned long long)count);
+            bucket_separator = ", ";
+        }
+        if (*bucket_separator != '\0')
+            fputc('}', fp);
+    }
+    fprintf(fp, "}, ");
+
+    fprintf(fp, "\"connections\": [");
+    const size_t connection_count = g_stats.connection_count;
+    for (size_t i = 0; i < connection_count && i < STATS_MAX_CONNECTIONS; i++) {
+        const struct StatsConnection* conn = &g_stats.connections[i];
+        fprintf(fp,
+                "%s{\"rtt_us\": %lu, \"rtt_var_us\": %lu, "
+                "\"retransmits\": %lu, \"cwnd\": %lu, \"mss\": %lu}",
+                (i > 0) ? ", " : "",
+                (unsigned long)conn->rtt_us,
+                (unsigned long)conn->rtt_var_us,
+                (unsigned long)conn->retransmits,
+                (unsigned long)conn->cwnd,
+                (unsigned long)conn->mss);
+    }
+    fprintf(fp, "]}\n");
+}
+
+void stats_print_live(FILE* fp) {
+    pthread_mutex_lock(&live.lock);
+
+    /* Don't continue the line of the progress */
+    if (g_opt_print_progress)
+        fputc('\n', fp);
+
+    print_separator(fp);
+    if (!live.started) {
+        fprintf(fp, "Waiting for the transfer to start.\n");
+    } else {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        const size_t progress = __atomic_load_n(&g_progress, __ATOMIC_RELAXED);
+
+        const double elapsed =
+          timespec_seconds(&now) - timespec_seconds(&start_time);
+        const double interval =
+          timespec_seconds(&now) - timespec_seconds(&live.last_time);
+        const size_t recent = (progress >= live.last_progress)
+                                ? progress - live.last_progress
+                                : 0;
+
+        fprintf(fp, "Transferred:  %zu bytes in %.3f s\n", progress, elapsed);
+        fprintf(fp,
+                "Throughput:   %.3f Gbit/s average, %.3f Gbit/s since the "
+                "last report\n",
+                (elapsed > 0) ? progress * 8 / elapsed / 1e9 : 0,
+                (interval > 0) ? recent * 8 / interval / 1e9 : 0);
+
+        for (size_t i = 0; i < live.sockfd_count; i++) {
+            struct StatsConnection conn;
+            if (get_connection(live.sockfds[i], &conn))
+                print_connection(fp, &conn);
+        }
+
+        live.last_progress = progress;
+        live.last_time     = now;
+    }
+    print_separator(fp);
+
+    pthread_mutex_unlock(&live.lock);
+}
+
+bool stats_report(const char* mode, size_t total) {
+    FILE* fp = stderr;
+    if (g_opt_stats_file != NULL) {
+        fp = fopen(g_opt_stats_file, "w");
+        if (fp == NULL) {
+            ERR("Could not open '%s': %s", g_opt_stats_file, strerror(errno));
+            return false;
+        }
+    }
+
+    if (g_opt_stats_json)
+        stats_print_json(fp, mode, total);
+    else
+        stats_print_summary(fp, total);
+
+    if (fp != stderr && fclose(fp) != 0) {
+        ERR("Could not write '%s': %s", g_opt_stats_file, strerror(errno));
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,949 @@
+/*
+ * Copyright 2025 8dcc
+ *
+ * This file is part of snc (Simple NetCat).
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h> /* clock_gettime() */
+
+#include <pthread.h>
+#include <unistd.h> /* close() */
+#include <sys/types.h>
+#include <sys/stat.h>   /* fstat() */
+#include <sys/socket.h> /* shutdown() */
+
+#include "include/util.h"
+#include "include/main.h"
+#include "include/io.h"
+#include "include/crc32c.h"
+#include "include/lz.h"
+#include "include/net.h"
+#include "include/proto.h"
+#include "include/stats.h"
+#include "include/resume.h"
+#include "include/output.h"
+#include "include/streams.h"
+
+/*
+ * State shared by the main transmitter thread and the sender threads.
+ *
+ * The main thread reads each block from the input into a free slot, and pushes
+ * its index into `queue'. Each sender thread pops the next index from the
+ * queue, sends the block through its own connection, and returns the slot to
+ * the `free_slots' stack.
+ */
+struct TxShared {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    /* Each slot has room for the block header, followed by the payload */
+    uint8_t* slot_data;
+    size_t slot_sz, slot_count;
+
+    size_t* free_slots;
+    size_t free_count;
+
+    size_t* queue;
+    size_t queue_head, queue_len;
+
+    /* Set by the main thread once the input has been fully read */
+    bool finished;
+    uint64_t block_count;
+
+    /* Checksum of the input, sent in the trailer if `send_checksum' is set */
+    bool send_checksum;
+    uint32_t checksum;
+
+    bool failed;
+};
+
+struct TxWorker {
+    struct TxShared* shared;
+    pthread_t thread;
+    int sockfd;
+
+    /*
+     * Compression state, only used with '--compress'. The buffer has room for
+     * the block header, followed by the compressed payload.
+     */
+    struct LzState lz_state;
+    uint8_t* lz_buf;
+
+    /*
+     * Estimated cost, in nanoseconds, of sending a byte, and of saving a byte
+     * by compressing. Used for deciding whether compression is worth it in the
+     * adaptive mode. Negative if unknown.
+     */
+    double send_cost, lz_cost;
+    unsigned blocks_skipped;
+};
+
+/*
+ * State shared by the main receiver thread and the reader threads.
+ *
+ * Each reader thread receives blocks from its connection and stores them in
+ * the slot for their sequence number, in a window of `slot_count' blocks
+ * starting at `next_seq'. The main thread writes the slots in order. A reader
+ * waits before storing a block that doesn't fit in the window, which bounds the
+ * memory usage of the receiver.
+ */
+struct RxShared {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    uint8_t* slot_data;
+    size_t slot_sz, slot_count;
+    size_t* slot_len;
+    bool* slot_ready;
+
+    uint64_t next_seq;
+
+    /* Number of connections that sent their `PROTO_BLOCK_END' block */
+    size_t streams_ended;
+    uint64_t block_count;
+
+    /* If `has_checksum' is set, the trailer sent with the `PROTO_BLOCK_END' */
+    bool has_checksum;
+    uint32_t checksum;
+
+    bool failed;
+};
+
+struct RxWorker {
+    struct RxShared* shared;
+    pthread_t thread;
+    int sockfd;
+
+    /* Compressed payload, allocated when the first compressed block arrives */
+    uint8_t* lz_buf;
+};
+
+/*----------------------------------------------------------------------------*/
+
+/*
+ * Shut down all the connections in `sockfds', so threads blocked in them return
+ * immediately. Used when aborting a transfer.
+ */
+static void shutdown_all(const int* sockfds, size_t count) {
+    for (size_t i = 0; i < count; i++)
+        if (sockfds[i] > -1)
+            shutdown(sockfds[i], SHUT_RDWR);
+}
+
+/*
+ * Return the current monotonic time, in nanoseconds.
+ */
+static double now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+/*
+ * Add a new sample to the exponentially weighted moving average `avg', which is
+ * negative if it has no samples yet.
+ */
+static void update_average(double* avg, double sample) {
+    *avg = (*avg < 0) ? sample : *avg * 0.75 + sample * 0.25;
+}
+
+/*----------------------------------------------------------------------------*/
+
+/*
+ * Should the worker compress its next block? In the adaptive mode, compression
+ * is only used while the time it takes is lower than the time it saves when
+ * sending. Since sending only takes long when the link is the bottleneck, this
+ * disables compression when the CPU is the bottleneck instead.
+ */
+static bool tx_should_compress(struct TxWorker* worker) {
+    if (!g_opt_compress_auto)
+        return true;
+
+    if (worker->send_cost < 0 || worker->lz_cost < 0 ||
+        worker->lz_cost < worker->send_cost)
+        return true;
+
+    if (++worker->blocks_skipped >= STREAMS_COMPRESS_PROBE_INTERVAL) {
+        worker->blocks_skipped = 0;
+        return true;
+    }
+
+    return false;
+}
+
+/*
+ * Compress the block in `data' (the header, followed by the payload) into the
+ * buffer of the worker. Returns the block that should be sent, which is
+ * `data' itself if the payload didn't shrink. Updates `block' accordingly.
+ */
+static const uint8_t* tx_compress_block(struct TxWorker* worker,
+                                        const uint8_t* data,
+                                        struct ProtoBlock* block) {
+    const double start = now_ns();
+    const size_t compressed_len =
+      lz_compress(&worker->lz_state,
+                  &data[PROTO_BLOCK_HEADER_SZ],
+                  block->len,
+                  &worker->lz_buf[PROTO_BLOCK_HEADER_SZ],
+                  block->len - 1);
+    const double elapsed = now_ns() - start;
+
+    /* If nothing was saved, count it as if a single byte was */
+    const size_t saved =
+      (compressed_len > 0) ? block->len - compressed_len : 0;
+    update_average(&worker->lz_cost, elapsed / (saved > 0 ? saved : 1));
+
+    if (compressed_len == 0)
+        return data;
+
+    block->codec = PROTO_CODEC_LZ;
+    block->len   = compressed_len;
+    proto_encode_block(block, worker->lz_buf);
+    return worker->lz_buf;
+}
+
+static void* tx_worker_main(void* arg) {
+    struct TxWorker* worker = arg;
+    struct TxShared* shared = worker->shared;
+
+    for (;;) {
+        pthread_mutex_lock(&shared->lock);
+        while (shared->queue_len == 0 && !shared->finished && !shared->failed)
+            pthread_cond_wait(&shared->cond, &shared->lock);
+
+        if (shared->failed) {
+            pthread_mutex_unlock(&shared->lock);
+            break;
+        }
+
+        if (shared->queue_len == 0) {
+            /* The queue is empty, and the main thread finished */
+            const uint64_t block_count = shared->block_count;
+            const uint32_t checksum    = shared->checksum;
+            pthread_mutex_unlock(&shared->lock);
+
+            const struct ProtoBlock end_block = {
+                .type = PROTO_BLOCK_END,
+                .len  = shared->send_checksum ? PROTO_TRAILER_SZ : 0,
+                .seq  = block_count,
+            };
+            uint8_t buf[PROTO_BLOCK_HEADER_SZ + PROTO_TRAILER_SZ];
+            proto_encode_block(&end_block, buf);
+            proto_encode_trailer(checksum, &buf[PROTO_BLOCK_HEADER_SZ]);
+            if (!io_send_all(worker->sockfd,
+                             buf,
+                             PROTO_BLOCK_HEADER_SZ + end_block.len)) {
+                ERR("Send error: %s", strerror(errno));
+                pthread_mutex_lock(&shared->lock);
+                shared->failed = true;
+                pthread_cond_broadcast(&shared->cond);
+                pthread_mutex_unlock(&shared->lock);
+            }
+            break;
+        }
+
+        const size_t slot = shared->queue[shared->queue_head];
+        shared->queue_head = (shared->queue_head + 1) % shared->slot_count;
+        shared->queue_len--;
+        pthread_mutex_unlock(&shared->lock);
+
+        /*
+         * The main thread already encoded the block header before the payload,
+         * so the whole block can be sent at once.
+         */
+        const uint8_t* data = &shared->slot_data[slot * shared->slot_sz];
+        struct ProtoBlock block;
+        proto_decode_block(data, shared->slot_sz, &block);
+
+        const uint8_t* to_send = data;
+        if (g_opt_compress && tx_should_compress(worker))
+            to_send = tx_compress_block(worker, data, &block);
+
+        const size_t send_sz = PROTO_BLOCK_HEADER_SZ + block.len;
+        const double start   = now_ns();
+        const bool sent_ok   = io_send_all(worker->sockfd, to_send, send_sz);
+        if (!sent_ok)
+            ERR("Send error: %s", strerror(errno));
+        update_average(&worker->send_cost, (now_ns() - start) / send_sz);
+
+        pthread_mutex_lock(&shared->lock);
+        shared->free_slots[shared->free_count++] = slot;
+        if (!sent_ok)
+            shared->failed = true;
+        pthread_cond_broadcast(&shared->cond);
+        pthread_mutex_unlock(&shared->lock);
+
+        if (!sent_ok)
+            break;
+    }
+
+    return NULL;
+}
+
+/*
+ * Read the input into the free slots, and queue them for the sender threads.
+ * Also computes the checksum of the input, if needed. Returns false on error,
+ * after printing it.
+ */
+static bool tx_read_input(struct TxShared* shared,
+                          int src_fd,
+                          size_t block_sz,
+                          size_t* total) {
+    uint64_t seq      = 0;
+    uint32_t checksum = 0;
+    bool result       = true;
+
+    while (!g_signaled_quit) {
+        pthread_mutex_lock(&shared->lock);
+        while (shared->free_count == 0 && !shared->failed && !g_signaled_quit)
+            cond_wait_briefly(&shared->cond, &shared->lock);
+        if (shared->failed || g_signaled_quit) {
+            pthread_mutex_unlock(&shared->lock);
+            break;
+        }
+        const size_t slot = shared->free_slots[--shared->free_count];
+        pthread_mutex_unlock(&shared->lock);
+
+        uint8_t* data          = &shared->slot_data[slot * shared->slot_sz];
+        const ssize_t received = io_read_full(src_fd,
+                                              &data[PROTO_BLOCK_HEADER_SZ],
+                                              block_sz);
+        if (received < 0)
+            ERR("Read error: %s", strerror(errno));
+
+        if (received <= 0) {
+            pthread_mutex_lock(&shared->lock);
+            shared->free_slots[shared->free_count++] = slot;
+            pthread_mutex_unlock(&shared->lock);
+
+            result = (received == 0);
+            break;
+        }
+
+        const struct ProtoBlock block = {
+            .type = PROTO_BLOCK_DATA,
+            .len  = received,
+            .seq  = seq++,
+        };
+        proto_encode_block(&block, data);
+
+        if (shared->send_checksum)
+            checksum = crc32c_update(checksum,
+                                     &data[PROTO_BLOCK_HEADER_SZ],
+                                     received);
+
+        pthread_mutex_lock(&shared->lock);
+        const size_t queue_tail =
+          (shared->queue_head + shared->queue_len) % shared->slot_count;
+        shared->queue[queue_tail] = slot;
+        shared->queue_len++;
+        pthread_cond_broadcast(&shared->cond);
+        pthread_mutex_unlock(&shared->lock);
+
+        *total += received;
+        update_progress(*total);
+
+        /* The `io_read_full' function only returns less data on EOF */
+        if ((size_t)received < block_sz)
+            break;
+    }
+
+    pthread_mutex_lock(&shared->lock);
+    shared->finished    = true;
+    shared->block_count = seq;
+    shared->checksum    = checksum;
+    if (!result)
+        shared->failed = true;
+    pthread_cond_broadcast(&shared->cond);
+    pthread_mutex_unlock(&shared->lock);
+
+    return result;
+}
+
+bool streams_transmit(int src_fd,
+                      const char* dst_ip,
+                      const char* dst_port,
+                      size_t stream_count,
+                      size_t block_sz,
+                      off_t resume_base,
+                      uint32_t* checksum,
+                      size_t* total) {
+    bool result = false;
+
+    struct TxShared shared;
+    memset(&shared, 0, sizeof(shared));
+    pthread_mutex_init(&shared.lock, NULL);
+    pthread_cond_init(&shared.cond, NULL);
+    shared.send_checksum = (checksum != NULL);
+
+    struct TxWorker* workers = calloc(stream_count, sizeof(struct TxWorker));
+    int* sockfds             = malloc(stream_count * sizeof(int));
+    if (workers == NULL || sockfds == NULL) {
+        ERR("Failed to allocate stream list: %s", strerror(errno));
+        goto cleanup;
+    }
+    for (size_t i = 0; i < stream_count; i++)
+        sockfds[i] = -1;
+
+    shared.slot_sz    = PROTO_BLOCK_HEADER_SZ + block_sz;
+    shared.slot_count = stream_count * STREAMS_BLOCKS_PER_STREAM;
+    shared.slot_data  = malloc(shared.slot_count * shared.slot_sz);
+    shared.free_slots = malloc(shared.slot_count * sizeof(size_t));
+    shared.queue      = malloc(shared.slot_count * sizeof(size_t));
+    if (shared.slot_data == NULL || shared.free_slots == NULL ||
+        shared.queue == NULL) {
+        ERR("Failed to allocate %zu blocks of %zu bytes: %s",
+            shared.slot_count,
+            shared.slot_sz,
+            strerror(errno));
+        goto cleanup;
+    }
+    for (size_t i = 0; i < shared.slot_count; i++)
+        shared.free_slots[shared.free_count++] = i;
+
+    /*
+     * If the input is a regular file, we can tell the receiver how much data
+     * to expect.
+     */
+    uint64_t total_sz = PROTO_SIZE_UNKNOWN;
+    struct stat st;
+    if (io_fd_type(src_fd) == IO_FD_REGULAR && fstat(src_fd, &st) == 0) {
+        const off_t offset = lseek(src_fd, 0, SEEK_CUR);
+        if (offset >= 0 && offset <= st.st_size)
+            total_sz = st.st_size - offset;
+    }
+
+    /*
+     * Open all the connections, and send the connection header through each
+     * of them.
+     */
+    const struct ProtoHeader header = {
+        .version      = PROTO_VERSION,
+        .flags        = ((checksum != NULL) ? PROTO_FLAG_CHECKSUM : 0) |
+                        (g_opt_resume ? PROTO_FLAG_RESUME : 0),
+        .stream_count = stream_count,
+        .session      = proto_new_session(),
+        .block_sz     = block_sz,
+        .total_sz     = total_sz,
+    };
+    for (size_t i = 0; i < stream_count; i++) {
+        sockfds[i] = net_connect(dst_ip, dst_port);
+        if (sockfds[i] < 0)
+            goto cleanup;
+        stats_watch_connection(sockfds[i]);
+
+        /* The block size was already chosen, so only the socket is tuned */
+        struct NetTuning tuning;
+        net_tune(sockfds[i], true, stream_count, block_sz, &tuning);
+        tuning.block_sz = block_sz;
+        if (i == 0 && g_opt_print_peer_info) {
+            print_separator(stderr);
+            net_print_tuning(stderr, true, &tuning);
+            print_separator(stderr);
+        }
+
+        struct ProtoHeader stream_header = header;
+        stream_header.stream_idx         = i;
+        if (!proto_send_header(sockfds[i], &stream_header)) {
+            ERR("Send error: %s", strerror(errno));
+            goto cleanup;
+        }
+
+        /*
+         * When resuming, the offset is negotiated through the first
+         * connection, before the rest are opened.
+         */
+        if (i == 0 && g_opt_resume) {
+            uint64_t offset;
+            if (!resume_answer(sockfds[0], src_fd, resume_base, &offset))
+                goto cleanup;
+
+            if (offset > 0 && g_opt_print_progress)
+                fprintf(stderr,
+                        "Resuming transfer at byte %llu.\n",
+                        (unsigned long long)offset);
+
+            if (total_sz != PROTO_SIZE_UNKNOWN && total_sz >= offset)
+                set_expected_progress(total_sz - offset);
+        }
+    }
+
+    if (g_opt_compress) {
+        for (size_t i = 0; i < stream_count; i++) {
+            workers[i].lz_buf = malloc(shared.slot_sz);
+            if (workers[i].lz_buf == NULL) {
+                ERR("Failed to allocate %zu bytes: %s",
+                    shared.slot_sz,
+                    strerror(errno));
+                goto cleanup;
+            }
+        }
+    }
+
+    size_t spawned = 0;
+    for (; spawned < stream_count; spawned++) {
+        workers[spawned].shared    = &shared;
+        workers[spawned].sockfd    = sockfds[spawned];
+        workers[spawned].send_cost = -1;
+        workers[spawned].lz_cost   = -1;
+        if (!create_worker_thread(&workers[spawned].thread,
+                                  tx_worker_main,
+                                  &workers[spawned])) {
+            ERR("Failed to create sender thread: %s", strerror(errno));
+            pthread_mutex_lock(&shared.lock);
+            shared.failed = true;
+            pthread_mutex_unlock(&shared.lock);
+            break;
+        }
+    }
+
+    result = (spawned == stream_count) &&
+             tx_read_input(&shared, src_fd, block_sz, total);
+    if (!result)
+        shutdown_all(sockfds, stream_count);
+
+    for (size_t i = 0; i < spawned; i++)
+        pthread_join(workers[i].thread, NULL);
+
+    if (shared.failed)
+        result = false;
+    if (result && checksum != NULL)
+        *checksum = shared.checksum;
+
+    if (result)
+        for (size_t i = 0; i < stream_count; i++)
+            stats_sample_connection(sockfds[i]);
+
+cleanup:
+    if (sockfds != NULL) {
+        for (size_t i = 0; i < stream_count; i++)
+            if (sockfds[i] > -1) {
+                stats_unwatch_connection(sockfds[i]);
+                close(sockfds[i]);
+            }
+        free(sockfds);
+    }
+
+    if (workers != NULL)
+        for (size_t i = 0; i < stream_count; i++)
+            free(workers[i].lz_buf);
+
+    free(workers);
+    free(shared.queue);
+    free(shared.free_slots);
+    free(shared.slot_data);
+
+    pthread_cond_destroy(&shared.cond);
+    pthread_mutex_destroy(&shared.lock);
+
+    return result;
+}
+
+/*----------------------------------------------------------------------------*/
+
+/*
+ * Mark the receive operation as failed, and wake up every thread.
+ */
+static void rx_fail(struct RxShared* shared) {
+    pthread_mutex_lock(&shared->lock);
+    shared->failed = true;
+    pthread_cond_broadcast(&shared->cond);
+    pthread_mutex_unlock(&shared->lock);
+}
+
+static void* rx_worker_main(void* arg) {
+    struct RxWorker* worker = arg;
+    struct RxShared* shared = worker->shared;
+
+    for (;;) {
+        uint8_t buf[PROTO_BLOCK_HEADER_SZ];
+        ssize_t received = io_recv_full(worker->sockfd, buf, sizeof(buf));
+        if (received != sizeof(buf)) {
+            pthread_mutex_lock(&shared->lock);
+            const bool failed = shared->failed;
+            pthread_mutex_unlock(&shared->lock);
+
+            /* Don't report errors caused by another thread shutting us down */
+            if (!failed) {
+                if (received < 0)
+                    ERR("Receive error: %s", strerror(errno));
+                else
+                    ERR("Connection closed before the end of the transfer.");
+                rx_fail(shared);
+            }
+            break;
+        }
+
+        struct ProtoBlock block;
+        if (!proto_decode_block(buf, shared->slot_sz, &block)) {
+            ERR("Received invalid block header.");
+            rx_fail(shared);
+            break;
+        }
+
+        /* The trailer is only sent if the connection header said so */
+        uint32_t checksum = 0;
+        if (block.type == PROTO_BLOCK_END) {
+            const size_t trailer_sz =
+              shared->has_checksum ? PROTO_TRAILER_SZ : 0;
+            if (block.len != trailer_sz) {
+                ERR("Received invalid trailer.");
+                rx_fail(shared);
+                break;
+            }
+
+            uint8_t trailer[PROTO_TRAILER_SZ];
+            received = io_recv_full(worker->sockfd, trailer, trailer_sz);
+            if (received != (ssize_t)trailer_sz) {
+                ERR("Connection closed before the end of the transfer.");
+                rx_fail(shared);
+                break;
+            }
+            if (trailer_sz > 0)
+                checksum = proto_decode_trailer(trailer);
+        }
+
+        pthread_mutex_lock(&shared->lock);
+        if (block.type == PROTO_BLOCK_END) {
+            if (shared->streams_ended > 0 &&
+                (shared->block_count != block.seq ||
+                 shared->checksum != checksum)) {
+                ERR("Received inconsistent trailers.");
+                shared->failed = true;
+            }
+            shared->block_count = block.seq;
+            shared->checksum    = checksum;
+            shared->streams_ended++;
+            pthread_cond_broadcast(&shared->cond);
+            pthread_mutex_unlock(&shared->lock);
+
+            /*
+             * Wait for the transmitter to close the connection, so it's the
+             * one that keeps it in the TIME_WAIT state, instead of the port we
+             * are listening on.
+             */
+            recv(worker->sockfd, buf, 1, 0);
+            break;
+        }
+
+        /*
+         * Wait until the block fits in the reordering window. Once it does,
+         * its slot is guaranteed to be free, since the block that used it
+         * before has already been written.
+         */
+        while (!shared->failed &&
+               block.seq >= shared->next_seq + shared->slot_count)
+            pthread_cond_wait(&shared->cond, &shared->lock);
+
+        const bool is_duplicate =
+          block.seq < shared->next_seq ||
+          shared->slot_ready[block.seq % shared->slot_count];
+        const bool failed = shared->failed;
+        pthread_mutex_unlock(&shared->lock);
+
+        if (failed)
+            break;
+        if (is_duplicate) {
+            ERR("Received duplicated block: %llu.",
+                (unsigned long long)block.seq);
+            rx_fail(shared);
+            break;
+        }
+
+        /*
+         * Raw payloads are received directly into their slot. Compressed ones
+         * are received into the buffer of the worker, and decompressed into
+         * the slot.
+         */
+        const size_t slot = block.seq % shared->slot_count;
+        uint8_t* slot_ptr = &shared->slot_data[slot * shared->slot_sz];
+        uint8_t* payload  = slot_ptr;
+        if (block.codec == PROTO_CODEC_LZ) {
+            if (worker->lz_buf == NULL)
+                worker->lz_buf = malloc(shared->slot_sz);
+            if (worker->lz_buf == NULL) {
+                ERR("Failed to allocate %zu bytes: %s",
+                    shared->slot_sz,
+                    strerror(errno));
+                rx_fail(shared);
+                break;
+            }
+            payload = worker->lz_buf;
+        }
+
+        received = io_recv_full(worker->sockfd, payload, block.len);
+        if (received != (ssize_t)block.len) {
+            if (received < 0)
+                ERR("Receive error: %s", strerror(errno));
+            else
+                ERR("Connection closed in the middle of a block.");
+            rx_fail(shared);
+            break;
+        }
+
+        size_t len = block.len;
+        if (block.codec == PROTO_CODEC_LZ &&
+            !lz_decompress(payload,
+                           block.len,
+                           slot_ptr,
+                           shared->slot_sz,
+                           &len)) {
+            ERR("Received invalid compressed block.");
+            rx_fail(shared);
+            break;
+        }
+
+        pthread_mutex_lock(&shared->lock);
+        shared->slot_len[slot]   = len;
+        shared->slot_ready[slot] = true;
+        pthread_cond_broadcast(&shared->cond);
+        pthread_mutex_unlock(&shared->lock);
+    }
+
+    return NULL;
+}
+
+/*
+ * Write the received blocks into `dst_fd', in order. If the transmitter sent a
+ * checksum, compute the checksum of the written data, store it in `checksum',
+ * and make sure they match. Returns false on error, after printing it.
+ */
+static bool rx_write_output(struct RxShared* shared,
+                            size_t stream_count,
+                            int dst_fd,
+                            uint32_t* checksum,
+                            size_t* total) {
+    *checksum = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&shared->lock);
+
+        size_t slot = shared->next_seq % shared->slot_count;
+        while (!shared->failed && !g_signaled_quit &&
+               !shared->slot_ready[slot] &&
+               shared->streams_ended < stream_count)
+            cond_wait_briefly(&shared->cond, &shared->lock);
+
+        if (shared->failed || g_signaled_quit) {
+            const bool failed = shared->failed;
+            pthread_mutex_unlock(&shared->lock);
+            return !failed;
+        }
+
+        if (!shared->slot_ready[slot]) {
+            /* All the connections ended */
+            const bool complete = (shared->next_seq == shared->block_count);
+            const uint32_t expected_checksum = shared->checksum;
+            pthread_mutex_unlock(&shared->lock);
+
+            if (!complete) {
+                ERR("Transfer ended with missing blocks.");
+                return false;
+            }
+
+            if (shared->has_checksum && *checksum != expected_checksum) {
+                ERR("Checksum mismatch: expected %08lx, got %08lx.",
+                    (unsigned long)expected_checksum,
+                    (unsigned long)*checksum);
+                return false;
+            }
+
+            return true;
+        }
+
+        const size_t len = shared->slot_len[slot];
+        pthread_mutex_unlock(&shared->lock);
+
+        if (shared->has_checksum)
+            *checksum = crc32c_update(*checksum,
+                                      &shared->slot_data[slot *
+                                                         shared->slot_sz],
+                                      len);
+
+        if (!output_write(dst_fd,
+                          &shared->slot_data[slot * shared->slot_sz],
+                          len)) {
+            ERR("Write error: %s", strerror(errno));
+            return false;
+        }
+
+        *total += len;
+        update_progress(*total);
+
+        pthread_mutex_lock(&shared->lock);
+        shared->slot_ready[slot] = false;
+        shared->next_seq++;
+        pthread_cond_broadcast(&shared->cond);
+        pthread_mutex_unlock(&shared->lock);
+    }
+}
+
+/*
+ * Accept the remaining connections of the transfer described by `header' from
+ * `sockfd_listen', storing them in the `sockfds' array, indexed by their stream
+ * index. Unrelated connections are closed. Returns false on error.
+ */
+static bool rx_accept_streams(int sockfd_listen,
+                              const struct ProtoHeader* header,
+                              int* sockfds) {
+    size_t accepted = 1;
+    while (accepted < header->stream_count) {
+        if (g_signaled_quit)
+            return false;
+
+        struct sockaddr_storage peer_addr;
+        const int sockfd = net_accept(sockfd_listen, &peer_addr);
+        if (sockfd < 0)
+            return false;
+
+        struct ProtoHeader stream_header;
+        if (!proto_detect(sockfd) ||
+            !proto_recv_header(sockfd, &stream_header) ||
+            stream_header.session != header->session ||
+            stream_header.stream_count != header->stream_count ||
+            stream_header.block_sz != header->block_sz ||
+            sockfds[stream_header.stream_idx] > -1) {
+            ERR("Ignoring unrelated connection.");
+            close(sockfd);
+            continue;
+        }
+
+        struct NetTuning tuning;
+        net_tune(sockfd,
+                 false,
+                 header->stream_count,
+                 header->block_sz,
+                 &tuning);
+
+        sockfds[stream_header.stream_idx] = sockfd;
+        stats_watch_connection(sockfd);
+        accepted++;
+    }
+
+    return true;
+}
+
+bool streams_receive(int sockfd_listen,
+                     int sockfd_first,
+                     const struct ProtoHeader* header,
+                     int dst_fd,
+                     uint32_t* checksum,
+                     size_t* total) {
+    const size_t stream_count = header->stream_count;
+    bool result               = false;
+
+    struct RxShared shared;
+    memset(&shared, 0, sizeof(shared));
+    pthread_mutex_init(&shared.lock, NULL);
+    pthread_cond_init(&shared.cond, NULL);
+    shared.has_checksum = (header->flags & PROTO_FLAG_CHECKSUM) != 0;
+
+    struct RxWorker* workers = calloc(stream_count, sizeof(struct RxWorker));
+    int* sockfds             = malloc(stream_count * sizeof(int));
+    if (workers == NULL || sockfds == NULL) {
+        ERR("Failed to allocate stream list: %s", strerror(errno));
+        goto cleanup;
+    }
+    for (size_t i = 0; i < stream_count; i++)
+        sockfds[i] = -1;
+    sockfds[header->stream_idx] = sockfd_first;
+
+    shared.slot_sz    = header->block_sz;
+    shared.slot_count = stream_count * STREAMS_BLOCKS_PER_STREAM;
+    shared.slot_data  = malloc(shared.slot_count * shared.slot_sz);
+    shared.slot_len   = calloc(shared.slot_count, sizeof(size_t));
+    shared.slot_ready = calloc(shared.slot_count, sizeof(bool));
+    if (shared.slot_data == NULL || shared.slot_len == NULL ||
+        shared.slot_ready == NULL) {
+        ERR("Failed to allocate %zu blocks of %zu bytes: %s",
+            shared.slot_count,
+            shared.slot_sz,
+            strerror(errno));
+        goto cleanup;
+    }
+
+    if (!rx_accept_streams(sockfd_listen, header, sockfds))
+        goto cleanup;
+
+    if (g_opt_print_peer_info && stream_count > 1) {
+        fprintf(stderr, "Accepted %zu parallel streams.\n", stream_count);
+        print_separator(stderr);
+    }
+
+    size_t spawned = 0;
+    for (; spawned < stream_count; spawned++) {
+        workers[spawned].shared = &shared;
+        workers[spawned].sockfd = sockfds[spawned];
+        if (!create_worker_thread(&workers[spawned].thread,
+                                  rx_worker_main,
+                                  &workers[spawned])) {
+            ERR("Failed to create receiver thread: %s", strerror(errno));
+            rx_fail(&shared);
+            break;
+        }
+    }
+
+    result = (spawned == stream_count) &&
+             rx_write_output(&shared, stream_count, dst_fd, checksum, total);
+
+    /*
+     * If we are stopping early, make sure the reader threads don't stay
+     * blocked in their connections.
+     */
+    if (!result || g_signaled_quit) {
+        rx_fail(&shared);
+        shutdown_all(sockfds, stream_count);
+    }
+
+    for (size_t i = 0; i < spawned; i++)
+        pthread_join(workers[i].thread, NULL);
+
+    if (result)
+        for (size_t i = 0; i < stream_count; i++)
+            stats_sample_connection(sockfds[i]);
+
+cleanup:
+    /* The first connection is closed by the caller */
+    if (sockfds != NULL) {
+        for (size_t i = 0; i < stream_count; i++)
+            if (sockfds[i] > -1 && sockfds[i] != sockfd_first) {
+                stats_unwatch_connection(sockfds[i]);
+                close(sockfds[i]);
+            }
+        free(sockfds);
+    }
+
+    if (workers != NULL)
+        for (size_t i = 0; i < stream_count; i++)
+            free(workers[i].lz_buf);
+
+    free(workers);
+    free(shared.slot_ready);
+    free(shared.slot_len);
+    free(shared.slot_data);
+
+    pthread_cond_destroy(&shared.cond);
+    pthread_mutex_destroy(&shared.lock);
+
+    return result;
+}
@@ -16,22 +16,42 @@
  * this program. If not, see <https://www.gnu.org/licenses/>.
  */
 
-#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE /* splice(), ppoll() */
 
 #include <errno.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <assert.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>   /* clock_gettime() */
+#include <signal.h> /* signal() */
 
-#include <unistd.h> /* close() */
-#include <netdb.h>  /* getaddrinfo(), etc. */
+#include <pthread.h>
+#include <unistd.h> /* close(), read(), lseek(), sleep() */
+#include <fcntl.h>  /* splice() */
+#include <poll.h>   /* ppoll() */
 #include <sys/types.h>
-#include <sys/socket.h> /* socket(), etc. */
+#include <sys/stat.h>     /* fstat() */
+#include <sys/mman.h>     /* mmap(), madvise() */
+#include <sys/sendfile.h> /* sendfile() */
 
 #include "include/util.h"
 #include "include/main.h"
+#include "include/io.h"
+#include "include/net.h"
+#include "include/ring.h"
+#include "include/stats.h"
+#include "include/streams.h"
+#include "include/resume.h"
+#include "include/uring.h"
+#include "include/zerocopy.h"
+#include "include/duplex.h"
+#include "include/fanout.h"
+#include "include/mcast.h"
+#include "include/udp.h"
+#include "include/shm.h"
 #include "include/transmit.h"
 
 #define CLEANUP_AND_DIE(...)                                                   \
@@ -41,88 +61,630 @@
         goto cleanup;                                                          \
     } while (0)
 
+/*
+ * Size of each window of the input mapped by `transmit_mmap'.
+ */
+#define TRANSMIT_MMAP_WINDOW_SZ (64 * 1024 * 1024)
+
 /*----------------------------------------------------------------------------*/
 
-static bool send_data(int sockfd, void* data, size_t data_sz) {
-    size_t total_sent = 0;
+/*
+ * Possible return values of the transmit engines below.
+ *
+ * The `TRANSMIT_UNSUPPORTED' value is only returned if the kernel refused the
+ * operation before any data was moved, so the caller can safely fall back to
+ * a different engine.
+ */
+enum ETransmitResult {
+    TRANSMIT_OK,
+    TRANSMIT_UNSUPPORTED,
+    TRANSMIT_ERROR,
+};
 
-    while (data_sz > 0) {
-        const ssize_t sent =
-          send(sockfd, &((char*)data)[total_sent], data_sz, 0);
-        if (sent < 0)
-            return false;
+/*
+ * Add `sent' bytes to the `total' counter, and update the progress.
+ */
+static inline void account_sent(size_t* total, size_t sent) {
+    *total += sent;
+    update_progress(*total);
+}
+
+/*
+ * Transmit the regular file `src_fd' with sendfile(2), sending at most
+ * `chunk_sz' bytes per call. The data never reaches user space.
+ */
+static enum ETransmitResult transmit_sendfile(int src_fd,
+                                              int sockfd,
+                                              size_t chunk_sz,
+                                              size_t* total) {
+    bool moved_data = false;
+
+    while (!g_signaled_quit) {
+        const uint64_t start = stats_start_call(STATS_CALL_SENDFILE);
+        const ssize_t sent   = sendfile(sockfd, src_fd, NULL, chunk_sz);
+        stats_end_call(STATS_CALL_SENDFILE, STATS_WAIT_NET, start, sent);
+        if (sent < 0) {
+            if (errno == EINTR)
+                continue;
+            if (!moved_data && (errno == EINVAL || errno == ENOSYS))
+                return TRANSMIT_UNSUPPORTED;
 
-        total_sent += sent;
-        data_sz -= sent;
+            ERR("Send error: %s", strerror(errno));
+            return TRANSMIT_ERROR;
+        }
+        if (sent == 0)
+            break;
+
+        moved_data = true;
+        account_sent(total, sent);
     }
 
-    return true;
+    return TRANSMIT_OK;
 }
 
-void snc_transmit(FILE* src_fp, const char* dst_ip, const char* dst_port) {
+/*
+ * Transmit the pipe `src_fd' with splice(2), moving at most `chunk_sz' bytes
+ * per call. The pages are moved from the pipe into the socket, without copying
+ * them into user space.
+ */
+static enum ETransmitResult transmit_splice(int src_fd,
+                                            int sockfd,
+                                            size_t chunk_sz,
+                                            size_t* total) {
+    bool moved_data = false;
+
+    while (!g_signaled_quit) {
+        const uint64_t start = stats_start_call(STATS_CALL_SPLICE);
+        const ssize_t sent   = splice(src_fd,
+                                      NULL,
+                                      sockfd,
+                                      NULL,
+                                      chunk_sz,
+                                      SPLICE_F_MOVE | SPLICE_F_MORE);
+        stats_end_call(STATS_CALL_SPLICE, STATS_WAIT_NET, start, sent);
+        if (sent < 0) {
+            if (errno == EINTR)
+                continue;
+            if (!moved_data && (errno == EINVAL || errno == ENOSYS))
+                return TRANSMIT_UNSUPPORTED;
+
+            ERR("Send error: %s", strerror(errno));
+            return TRANSMIT_ERROR;
+        }
+        if (sent == 0)
+            break;
+
+        moved_data = true;
+        account_sent(total, sent);
+    }
+
+    return TRANSMIT_OK;
+}
+
+/*
+ * Transmit the regular file `src_fd' by mapping it into memory, one window of
+ * `TRANSMIT_MMAP_WINDOW_SZ' bytes at a time, and sending at most `chunk_sz'
+ * bytes from the mapping per call.
+ *
+ * Once a window is sent, the kernel is told that we don't need its pages
+ * anymore, so sending a huge file doesn't evict the rest of the page cache.
+ */
+static enum ETransmitResult transmit_mmap(int src_fd,
+                                          int sockfd,
+                                          size_t chunk_sz,
+                                          size_t* total) {
+    struct stat st;
+    const off_t start = lseek(src_fd, 0, SEEK_CUR);
+    if (start < 0 || fstat(src_fd, &st) != 0)
+        return TRANSMIT_UNSUPPORTED;
+
+    const off_t page_sz = sysconf(_SC_PAGESIZE);
+    posix_fadvise(src_fd, start, 0, POSIX_FADV_SEQUENTIAL);
+
+    off_t offset = start;
+    while (offset < st.st_size && !g_signaled_quit) {
+        /* Mappings must start at a page boundary */
+        const off_t window_start = offset - offset % page_sz;
+        const size_t window_sz =
+          (st.st_size - window_start < TRANSMIT_MMAP_WINDOW_SZ)
+            ? (size_t)(st.st_size - window_start)
+            : TRANSMIT_MMAP_WINDOW_SZ;
+
+        uint8_t* window =
+          mmap(NULL, window_sz, PROT_READ, MAP_SHARED, src_fd, window_start);
+        if (window == MAP_FAILED) {
+            if (offset == start)
+                return TRANSMIT_UNSUPPORTED;
+
+            ERR("Could not map the input: %s", strerror(errno));
+            return TRANSMIT_ERROR;
+        }
+        madvise(window, window_sz, MADV_SEQUENTIAL);
+
+        const off_t window_end = window_start + (off_t)window_sz;
+        while (offset < window_end && !g_signaled_quit) {
+            const size_t remaining = window_end - offset;
+            const size_t len = (remaining < chunk_sz) ? remaining : chunk_sz;
+            if (!io_send_all(sockfd, &window[offset - window_start], len)) {
+                ERR("Send error: %s", strerror(errno));
+                munmap(window, window_sz);
+                return TRANSMIT_ERROR;
+            }
+
+            offset += len;
+            account_sent(total, len);
+        }
+
+        munmap(window, window_sz);
+        posix_fadvise(src_fd, window_start, window_sz, POSIX_FADV_DONTNEED);
+    }
+
     /*
-     * The 'status' variable is used to store temporary integer return values.
-     *
-     * If the 'fatal_error' variable is true that the end of the function, the
-     * program will be aborted.
+     * Leave the input offset after the sent data, just like a normal sequence
+     * of reads would.
      */
-    int status       = 0;
-    bool fatal_error = false;
+    lseek(src_fd, offset, SEEK_SET);
+    return TRANSMIT_OK;
+}
+
+/*
+ * Transmit `src_fd' by reading up to `buf_sz' bytes into `buf', and sending
+ * them through `sockfd'. This works for any kind of descriptor, and it's used
+ * as a fallback for the other engines.
+ *
+ * Note that read(2) returns as soon as some data is available, so interactive
+ * input is sent without waiting for a full block.
+ */
+static enum ETransmitResult transmit_copy(int src_fd,
+                                          int sockfd,
+                                          void* buf,
+                                          size_t buf_sz,
+                                          size_t* total) {
+    while (!g_signaled_quit) {
+        const uint64_t start   = stats_start_call(STATS_CALL_READ);
+        const ssize_t received = read(src_fd, buf, buf_sz);
+        stats_end_call(STATS_CALL_READ, STATS_WAIT_IO, start, received);
+        if (received < 0) {
+            if (errno == EINTR)
+                continue;
+
+            ERR("Read error: %s", strerror(errno));
+            return TRANSMIT_ERROR;
+        }
+        if (received == 0)
+            break;
+
+        if (!io_send_all(sockfd, buf, received)) {
+            ERR("Send error: %s", strerror(errno));
+            return TRANSMIT_ERROR;
+        }
+
+        account_sent(total, received);
+    }
+
+    return TRANSMIT_OK;
+}
+
+/*
+ * Transmit `src_fd' through the connected socket `sockfd' in low-latency mode.
+ * The input is accumulated in `buf' until it contains a newline, it's full, or
+ * its oldest byte waited '--low-latency' microseconds, whichever happens first.
+ * With a zero timeout, the data of each read is sent immediately.
+ */
+static enum ETransmitResult transmit_latency(int src_fd,
+                                             int sockfd,
+                                             void* buf,
+                                             size_t buf_sz,
+                                             size_t* total) {
+    uint8_t* data  = buf;
+    size_t pending = 0;
+    struct timespec deadline, now;
+
+    while (!g_signaled_quit) {
+        bool flush = false;
+
+        /*
+         * If some data is waiting, only wait for more input until the deadline
+         * of the oldest byte.
+         */
+        if (pending > 0) {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            struct timespec timeout = {
+                .tv_sec  = deadline.tv_sec - now.tv_sec,
+                .tv_nsec = deadline.tv_nsec - now.tv_nsec,
+            };
+            if (timeout.tv_nsec < 0) {
+                timeout.tv_sec--;
+                timeout.tv_nsec += 1000 * 1000 * 1000;
+            }
+
+            if (timeout.tv_sec < 0) {
+                flush = true;
+            } else {
+                struct pollfd pfd = { .fd = src_fd, .events = POLLIN };
+                const int ready   = ppoll(&pfd, 1, &timeout, NULL);
+                if (ready < 0) {
+                    if (errno == EINTR)
+                        continue;
+
+                    ERR("Poll error: %s", strerror(errno));
+                    return TRANSMIT_ERROR;
+                }
+                flush = (ready == 0);
+            }
+        }
+
+        if (!flush) {
+            const uint64_t start = stats_start_call(STATS_CALL_READ);
+            const ssize_t received =
+              read(src_fd, &data[pending], buf_sz - pending);
+            stats_end_call(STATS_CALL_READ, STATS_WAIT_IO, start, received);
+            if (received < 0) {
+                if (errno == EINTR)
+                    continue;
+
+                ERR("Read error: %s", strerror(errno));
+                return TRANSMIT_ERROR;
+            }
+            if (received == 0)
+                break;
+
+            if (pending == 0 && g_opt_flush_timeout > 0) {
+                clock_gettime(CLOCK_MONOTONIC, &deadline);
+                deadline.tv_sec += g_opt_flush_timeout / 1000000;
+                deadline.tv_nsec += (g_opt_flush_timeout % 1000000) * 1000;
+                if (deadline.tv_nsec >= 1000 * 1000 * 1000) {
+                    deadline.tv_sec++;
+                    deadline.tv_nsec -= 1000 * 1000 * 1000;
+                }
+            }
+
+            flush = g_opt_flush_timeout == 0 ||
+                    memchr(&data[pending], '\n', received) != NULL ||
+                    pending + received == buf_sz;
+            pending += received;
+        }
+
+        if (flush) {
+            if (!io_send_all(sockfd, data, pending)) {
+                ERR("Send error: %s", strerror(errno));
+                return TRANSMIT_ERROR;
+            }
+
+            account_sent(total, pending);
+            pending = 0;
+        }
+    }
+
+    /* Send whatever was left when the input ended */
+    if (pending > 0) {
+        if (!io_send_all(sockfd, data, pending)) {
+            ERR("Send error: %s", strerror(errno));
+            return TRANSMIT_ERROR;
+        }
+
+        account_sent(total, pending);
+    }
+
+    return TRANSMIT_OK;
+}
+
+/*
+ * Arguments for the reader thread of `transmit_pipeline'.
+ */
+struct PipelineReader {
+    struct BlockRing* ring;
+    int src_fd;
+
+    /* Set by the reader thread if there was an error reading the input */
+    int read_errno;
+};
+
+/*
+ * Main function of the reader thread of `transmit_pipeline'. Fills the free
+ * blocks of the ring with data from the input. The end of the input (or an
+ * error) is indicated with an empty block.
+ */
+static void* pipeline_reader_main(void* arg) {
+    struct PipelineReader* reader = arg;
+    struct BlockRing* ring        = reader->ring;
+
+    for (;;) {
+        void* block = block_ring_acquire_free(ring);
+        if (block == NULL) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        ssize_t received;
+        do {
+            const uint64_t start = stats_start_call(STATS_CALL_READ);
+            received             = read(reader->src_fd, block, ring->block_sz);
+            stats_end_call(STATS_CALL_READ, STATS_WAIT_IO, start, received);
+        } while (received < 0 && errno == EINTR);
+
+        if (received < 0) {
+            reader->read_errno = errno;
+            received           = 0;
+        }
+
+        block_ring_push(ring, received);
+        if (received == 0)
+            break;
+    }
+
+    return NULL;
+}
+
+/*
+ * Transmit `src_fd' with two threads: a reader thread that fills a ring of
+ * `depth' blocks of `buf_sz' bytes, and the calling thread, which sends them
+ * through `sockfd'. This way, a slow read doesn't stall the socket, and a full
+ * socket buffer doesn't stall the reads.
+ */
+static enum ETransmitResult transmit_pipeline(int src_fd,
+                                              int sockfd,
+                                              size_t buf_sz,
+                                              size_t depth,
+                                              size_t* total) {
+    struct BlockRing ring;
+    if (!block_ring_init(&ring, depth, buf_sz)) {
+        ERR("Failed to allocate %zu blocks of %zu bytes: %s",
+            depth,
+            buf_sz,
+            strerror(errno));
+        return TRANSMIT_ERROR;
+    }
+
+    struct PipelineReader reader = {
+        .ring       = &ring,
+        .src_fd     = src_fd,
+        .read_errno = 0,
+    };
+
+    pthread_t thread;
+    if (!create_worker_thread(&thread, pipeline_reader_main, &reader)) {
+        ERR("Failed to create reader thread: %s", strerror(errno));
+        block_ring_destroy(&ring);
+        return TRANSMIT_ERROR;
+    }
+
+    enum ETransmitResult result = TRANSMIT_OK;
+    while (!g_signaled_quit) {
+        size_t len;
+        const void* block = block_ring_acquire_filled(&ring, &len);
+        if (block == NULL) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (len == 0)
+            break;
+
+        if (!io_send_all(sockfd, block, len)) {
+            ERR("Send error: %s", strerror(errno));
+            result = TRANSMIT_ERROR;
+            break;
+        }
+
+        block_ring_pop(&ring);
+        account_sent(total, len);
+    }
 
     /*
-     * Variables that need to be cleaned up if their value changes.
+     * If we are stopping early, the reader might be blocked reading the input,
+     * so we need to cancel it.
      */
-    struct addrinfo* server_info = NULL;
-    int sockfd                   = -1;
+    if (result != TRANSMIT_OK || g_signaled_quit) {
+        block_ring_abort(&ring);
+        pthread_cancel(thread);
+    }
+    pthread_join(thread, NULL);
 
-#ifdef FIXED_BLOCK_SIZE
-    static char buf[FIXED_BLOCK_SIZE];
-#else  /* not FIXED_BLOCK_SIZE */
-    char* buf           = NULL;
-#endif /* not FIXED_BLOCK_SIZE */
+    if (result == TRANSMIT_OK && reader.read_errno != 0) {
+        ERR("Read error: %s", strerror(reader.read_errno));
+        result = TRANSMIT_ERROR;
+    }
+
+    block_ring_destroy(&ring);
+    return result;
+}
 
+/*
+ * Send synthetic data from `buf' through `sockfd', until the amount specified
+ * with '--bench' is reached. The data is generated once, so the benchmark only
+ * measures the network path.
+ */
+static enum ETransmitResult transmit_bench(int sockfd,
+                                           void* buf,
+                                           size_t buf_sz,
+                                           size_t* total) {
     /*
-     * Initialize the `addrinfo' structure with the hints for `getaddrinfo'.
-     *
-     *   1. The family: IPv4 (AF_INET).
-     *   2. The socket type: TCP (SOCK_STREAM).
+     * Fill the buffer with a pattern that is not trivially compressible by
+     * the network hardware or by any middlebox.
      */
-    struct addrinfo hints;
-    memset(&hints, 0, sizeof(hints));
-    hints.ai_family   = AF_INET;
-    hints.ai_socktype = SOCK_STREAM;
+    uint32_t state = 0x12345678;
+    for (size_t i = 0; i < buf_sz; i++) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        ((uint8_t*)buf)[i] = (uint8_t)state;
+    }
+
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    while (!g_signaled_quit) {
+        size_t chunk_sz = buf_sz;
+
+        if (g_opt_bench_seconds > 0) {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            const double elapsed = (now.tv_sec - start.tv_sec) +
+                                   (now.tv_nsec - start.tv_nsec) / 1e9;
+            if (elapsed >= g_opt_bench_seconds)
+                break;
+        } else {
+            if (*total >= g_opt_bench_size)
+                break;
+            if (g_opt_bench_size - *total < chunk_sz)
+                chunk_sz = g_opt_bench_size - *total;
+        }
+
+        if (!io_send_all(sockfd, buf, chunk_sz)) {
+            ERR("Send error: %s", strerror(errno));
+            return TRANSMIT_ERROR;
+        }
+
+        account_sent(total, chunk_sz);
+    }
+
+    return TRANSMIT_OK;
+}
+
+/*----------------------------------------------------------------------------*/
+
+/*
+ * Transmit `src_fd' through the connected socket `sockfd', choosing the
+ * cheapest way of moving the data depending on the type of the input
+ * descriptor. If the kernel doesn't support the zero-copy engine for this pair
+ * of descriptors, fall back to the generic read/send loop.
+ */
+static enum ETransmitResult transmit_single(int src_fd,
+                                            int sockfd,
+                                            void* buf,
+                                            size_t buf_sz,
+                                            size_t* total) {
+    enum ETransmitResult result = TRANSMIT_UNSUPPORTED;
+
+    if (g_opt_low_latency)
+        return transmit_latency(src_fd, sockfd, buf, buf_sz, total);
+
+    if (g_opt_pipeline_depth > 0)
+        return transmit_pipeline(src_fd,
+                                 sockfd,
+                                 buf_sz,
+                                 g_opt_pipeline_depth,
+                                 total);
+
+#ifndef NO_IO_URING
+    if (g_opt_io_uring) {
+        switch (uring_copy(src_fd, sockfd, buf_sz, total)) {
+            case URING_OK:
+                return TRANSMIT_OK;
+            case URING_ERROR:
+                return TRANSMIT_ERROR;
+            case URING_UNSUPPORTED:
+                break;
+        }
+    }
+#endif /* not NO_IO_URING */
+
+    if (g_opt_zerocopy) {
+        switch (zerocopy_transmit(src_fd, sockfd, buf_sz, total)) {
+            case ZEROCOPY_OK:
+                return TRANSMIT_OK;
+            case ZEROCOPY_ERROR:
+                return TRANSMIT_ERROR;
+            case ZEROCOPY_UNSUPPORTED:
+                break;
+        }
+    }
+
+    switch (io_fd_type(src_fd)) {
+        case IO_FD_REGULAR:
+            result = (g_opt_input != NULL)
+                       ? transmit_mmap(src_fd, sockfd, buf_sz, total)
+                       : transmit_sendfile(src_fd, sockfd, buf_sz, total);
+            break;
+
+        case IO_FD_PIPE:
+            result = transmit_splice(src_fd, sockfd, buf_sz, total);
+            break;
+
+        default:
+            break;
+    }
+
+    if (result == TRANSMIT_UNSUPPORTED)
+        result = transmit_copy(src_fd, sockfd, buf, buf_sz, total);
+
+    return result;
+}
+
+/*
+ * Transmit the data in `src_fd' with the framed protocol.
+ *
+ * If the transfer is resumable and the input is a regular file, interrupted
+ * transfers are retried up to `RESUME_MAX_RETRIES' times, waiting longer after
+ * each failure. The receiver decides the offset of each attempt, so the input
+ * is simply rewound to where it started.
+ */
+static bool transmit_framed(int src_fd,
+                            const char* dst_ip,
+                            const char* dst_port,
+                            size_t buf_sz,
+                            uint32_t* checksum,
+                            size_t* total) {
+    off_t resume_base = lseek(src_fd, 0, SEEK_CUR);
+    if (resume_base < 0)
+        resume_base = 0;
+
+    const bool can_retry =
+      g_opt_resume && io_fd_type(src_fd) == IO_FD_REGULAR;
 
     /*
-     * Obtain the address information from the specified hints.
+     * A broken connection must not kill the process if we are going to
+     * reconnect; the failed call will return `EPIPE' instead.
      */
-    status = getaddrinfo(dst_ip, dst_port, &hints, &server_info);
-    if (status != 0)
-        CLEANUP_AND_DIE("Could not obtaining address info: %s",
-                        gai_strerror(status));
+    if (can_retry)
+        signal(SIGPIPE, SIG_IGN);
+
+    unsigned backoff = 1;
+    for (int attempt = 0;; attempt++) {
+        if (streams_transmit(src_fd,
+                             dst_ip,
+                             dst_port,
+                             g_opt_streams,
+                             buf_sz,
+                             resume_base,
+                             checksum,
+                             total))
+            return true;
+
+        if (!can_retry || g_signaled_quit || attempt >= RESUME_MAX_RETRIES)
+            return false;
+
+        ERR("Transfer interrupted, reconnecting in %u seconds.", backoff);
+        sleep(backoff);
+        if (g_signaled_quit || lseek(src_fd, resume_base, SEEK_SET) < 0)
+            return false;
 
+        if (backoff < RESUME_MAX_BACKOFF)
+            backoff *= 2;
+    }
+}
+
+/*----------------------------------------------------------------------------*/
+
+void snc_transmit(FILE* src_fp, const char* dst_ip, const char* dst_port) {
     /*
-     * We obtain the socket descriptor using the values from the `addrinfo'
-     * structure that `getaddrinfo' filled.
+     * If the 'fatal_error' variable is true that the end of the function, the
+     * program will be aborted.
      */
-    sockfd = socket(server_info->ai_family,
-                    server_info->ai_socktype,
-                    server_info->ai_protocol);
-    if (sockfd < 0)
-        CLEANUP_AND_DIE("Could not create socket: %s", strerror(errno));
+    bool fatal_error = false;
 
     /*
-     * Connect to the actual server. Again, using the values from the `addrinfo'
-     * structure.
+     * Variables that need to be cleaned up if their value changes.
      */
-    status = connect(sockfd, server_info->ai_addr, server_info->ai_addrlen);
-    if (status != 0)
-        CLEANUP_AND_DIE("Connection error: %s", strerror(errno));
+    int sockfd = -1;
 
 #ifdef FIXED_BLOCK_SIZE
+    static char buf[FIXED_BLOCK_SIZE];
     const size_t buf_sz = FIXED_BLOCK_SIZE;
 #else  /* not FIXED_BLOCK_SIZE */
-    const size_t buf_sz = g_opt_block_size;
-    buf                 = malloc(buf_sz);
+    size_t buf_sz = g_opt_block_size;
+    char* buf     = malloc(buf_sz);
     if (buf == NULL)
         CLEANUP_AND_DIE("Failed to allocate %zu bytes: %s",
                         buf_sz,
@@ -131,62 +693,195 @@ void snc_transmit(FILE* src_fp, const char* dst_ip, const char* dst_port) {
 
     assert(buf_sz > 0);
 
+    const int src_fd         = fileno(src_fp);
+    size_t total_transmitted = 0;
+    uint32_t checksum        = 0;
+
+    /* In duplex mode, the progress includes the data in both directions */
+    const char* verb = g_opt_duplex ? "Transferred" : "Transmitted";
+
     /*
-     * Read characters from `stdin', and write them to `sockfd'.
+     * If the input is a regular file, we know how much data we are going to
+     * send, so the progress can include an estimate.
      */
-    int c;
-    size_t buf_pos           = 0;
-    size_t total_transmitted = 0;
-    while ((c = fgetc(src_fp)) != EOF && !g_signaled_quit) {
-        buf[buf_pos++] = c;
+    struct stat st;
+    const off_t src_offset = lseek(src_fd, 0, SEEK_CUR);
+    if (!g_opt_bench && !g_opt_duplex && io_fd_type(src_fd) == IO_FD_REGULAR &&
+        fstat(src_fd, &st) == 0 && src_offset >= 0 &&
+        src_offset < st.st_size)
+        set_expected_progress(st.st_size - src_offset);
+
+    if (g_opt_multicast || g_opt_udp) {
+        /*
+         * The datagrams are sent by `mcast_transmit' or `udp_transmit'
+         * themselves, and the first also serves the repairs. A receiver
+         * closing its repair connection must not kill the process.
+         */
+        signal(SIGPIPE, SIG_IGN);
+        stats_start();
+        if (g_opt_print_progress && !start_progress_reporter(verb)) {
+            fatal_error = true;
+            goto cleanup;
+        }
+
+        const bool transmitted =
+          g_opt_multicast
+            ? mcast_transmit(src_fd, dst_ip, dst_port, &total_transmitted)
+            : udp_transmit(src_fd, dst_ip, dst_port, &total_transmitted);
+        if (!transmitted) {
+            fatal_error = true;
+            goto cleanup;
+        }
+    } else if (strchr(dst_ip, ',') != NULL) {
+        /*
+         * When transmitting to several receivers, the connections are opened
+         * by `fanout_transmit' itself. If some of the receivers fail, the rest
+         * still receive the data, so we print the results anyway. A broken
+         * connection must not kill the process either.
+         */
+        signal(SIGPIPE, SIG_IGN);
+        stats_start();
+        if (g_opt_print_progress && !start_progress_reporter(verb)) {
+            fatal_error = true;
+            goto cleanup;
+        }
 
+        if (!fanout_transmit(src_fd,
+                             dst_ip,
+                             dst_port,
+                             buf_sz,
+                             &total_transmitted))
+            fatal_error = true;
+    } else if (g_opt_streams > 1 || g_opt_compress || g_opt_checksum ||
+               g_opt_resume) {
         /*
-         * If the buffer is full, send the data in the buffer, and reset the
-         * buffer position.
+         * When using parallel streams, compression, checksums or resumable
+         * transfers, the framed protocol is needed, and the connections are
+         * opened by `streams_transmit' itself.
          */
-        if (buf_pos >= buf_sz) {
-            if (!send_data(sockfd, buf, buf_pos))
-                CLEANUP_AND_DIE("Send error: %s", strerror(errno));
+        stats_start();
+        if (g_opt_print_progress && !start_progress_reporter(verb)) {
+            fatal_error = true;
+            goto cleanup;
+        }
+
+        if (!transmit_framed(src_fd,
+                             dst_ip,
+                             dst_port,
+                             buf_sz,
+                             g_opt_checksum ? &checksum : NULL,
+                             &total_transmitted)) {
+            fatal_error = true;
+            goto cleanup;
+        }
+    } else {
+        sockfd = net_connect(dst_ip, dst_port);
+        if (sockfd < 0) {
+            fatal_error = true;
+            goto cleanup;
+        }
+        stats_watch_connection(sockfd);
+
+        struct NetTuning tuning;
+        net_tune(sockfd, true, 1, buf_sz, &tuning);
+        if (g_opt_print_peer_info) {
+            print_separator(stderr);
+            net_print_tuning(stderr, true, &tuning);
+            print_separator(stderr);
+        }
+
+#ifndef FIXED_BLOCK_SIZE
+        if (tuning.block_sz != buf_sz) {
+            char* new_buf = realloc(buf, tuning.block_sz);
+            if (new_buf == NULL)
+                CLEANUP_AND_DIE("Failed to allocate %zu bytes: %s",
+                                tuning.block_sz,
+                                strerror(errno));
+            buf    = new_buf;
+            buf_sz = tuning.block_sz;
+        }
+#endif /* not FIXED_BLOCK_SIZE */
 
-            if (g_opt_print_progress) {
-                total_transmitted += buf_pos;
-                print_partial_progress("Transmitted", total_transmitted);
+        stats_start();
+        if (g_opt_print_progress && !start_progress_reporter(verb)) {
+            fatal_error = true;
+            goto cleanup;
+        }
+
+        if (g_opt_duplex) {
+            /*
+             * The data received from the peer is written into the standard
+             * output, after anything buffered by 'stdio'.
+             */
+            fflush(stdout);
+            if (!duplex_relay(sockfd,
+                              src_fd,
+                              fileno(stdout),
+                              buf_sz,
+                              &total_transmitted)) {
+                fatal_error = true;
+                goto cleanup;
+            }
+        } else {
+            /*
+             * If the shared memory can't be used, nothing was transmitted yet,
+             * and the data is sent through the connection instead.
+             */
+            const enum EShmResult shm_result =
+              g_opt_shm ? shm_transmit(sockfd, src_fd, &total_transmitted)
+                        : SHM_UNAVAILABLE;
+            if (shm_result == SHM_ERROR) {
+                fatal_error = true;
+                goto cleanup;
             }
 
-            buf_pos = 0;
+            const enum ETransmitResult result =
+              (shm_result == SHM_OK) ? TRANSMIT_OK
+              : g_opt_bench
+                ? transmit_bench(sockfd, buf, buf_sz, &total_transmitted)
+                : transmit_single(src_fd,
+                                  sockfd,
+                                  buf,
+                                  buf_sz,
+                                  &total_transmitted);
+            if (result == TRANSMIT_ERROR) {
+                fatal_error = true;
+                goto cleanup;
+            }
         }
-    }
 
-    /*
-     * Once we reach this poitn, `fgetc' returned EOF. Send the remaining data
-     * in the buffer (if any).
-     */
-    if (!send_data(sockfd, buf, buf_pos))
-        CLEANUP_AND_DIE("Send error: %s", strerror(errno));
+        stats_sample_connection(sockfd);
+    }
 
     /*
-     * After we are done, we want to print the exact progress. Notice how we
-     * call 'print_progress' instead of 'print_partial_progress'.
+     * After we are done, stop the reporter and print the exact progress.
      */
+    stop_progress_reporter();
     if (g_opt_print_progress) {
-        total_transmitted += buf_pos;
-        print_progress("Transmitted", total_transmitted);
+        print_progress(verb, total_transmitted);
         fputc('\n', stderr);
+
+        if (g_opt_checksum)
+            fprintf(stderr, "CRC-32C: %08lx\n", (unsigned long)checksum);
     }
 
+    if ((g_opt_bench || g_opt_stats) &&
+        !stats_report("transmit", total_transmitted))
+        fatal_error = true;
+
 cleanup:
+    stop_progress_reporter();
+
 #ifndef FIXED_BLOCK_SIZE
     if (buf != NULL)
         free(buf);
 #endif /* not FIXED_BLOCK_SIZE */
 
-    /* Opened by 'socket' */
-    if (sockfd > -1)
+    /* Opened by 'net_connect' */
+    if (sockfd > -1) {
+        stats_unwatch_connection(sockfd);
         close(sockfd);
-
-    /* Allocated by 'getaddrinfo' */
-    if (server_info != NULL)
-        freeaddrinfo(server_info);
+    }
 
     if (fatal_error)
         exit(1);
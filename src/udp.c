@@ -0,0 +1,979 @@
+/*
+ * Copyright 2025 8dcc
+ *
+ * This file is part of snc (Simple NetCat).
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE /* ppoll() */
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h> /* read(), close() */
+#include <poll.h>   /* ppoll() */
+#include <netdb.h>  /* getaddrinfo() */
+#include <sys/types.h>
+#include <sys/socket.h> /* socket(), send(), etc. */
+#include <netinet/in.h> /* sockaddr_in */
+
+#include "include/util.h"
+#include "include/main.h"
+#include "include/io.h"
+#include "include/stats.h"
+#include "include/proto.h"
+#include "include/output.h"
+#include "include/sim.h"
+#include "include/dgram.h"
+#include "include/udp.h"
+
+/* Size of the buffers requested for the socket, on both sides */
+#define UDP_SOCKET_BUFFER (8 * 1024 * 1024)
+
+/* Maximum number of datagrams received each time the socket is ready */
+#define UDP_RECV_BATCH 64
+
+/* Each range of missing datagrams takes 8 bytes of an acknowledgement */
+#define UDP_MAX_NACKS (UDP_PAYLOAD_SZ / 8)
+
+/*
+ * Lower bounds of the times that depend on the RTT: the retransmission
+ * timeout, the interval between announcements of the end, the time before a
+ * missing datagram is requested again, and the time the receiver waits after
+ * the transfer, in case its last acknowledgement is lost.
+ */
+#define UDP_MIN_RTO_MS           200
+#define UDP_MIN_END_INTERVAL_MS  20
+#define UDP_MIN_NACK_INTERVAL_MS 20
+#define UDP_MIN_LINGER_MS        300
+
+/*
+ * The rate is lowered once the RTT grows this much over the minimum, since
+ * that means the datagrams are being queued somewhere in the path, or once
+ * the receiver asks for more than this fraction of the datagrams again, in
+ * case the queue is too short to notice. Random loss below that doesn't lower
+ * the rate.
+ */
+#define UDP_RTT_TOLERANCE  1.25
+#define UDP_RTT_SLACK_NS   1000000ULL
+#define UDP_LOSS_TOLERANCE 0.1
+#define UDP_RATE_DECREASE 0.85
+#define UDP_RATE_INCREASE 1.1
+
+enum EUdpType {
+    UDP_TYPE_DATA,
+    UDP_TYPE_END,
+    UDP_TYPE_ACK,
+};
+
+/* Set in the acknowledgements once the receiver knows where the data ends */
+#define UDP_FLAG_END 0x01
+
+/*
+ * Header of each datagram: the common `DgramHeader', whose `param' holds the
+ * `UDP_FLAG_*' flags, followed by the `stamp' and the `rtt', in microseconds.
+ * The rest depend on the type:
+ *
+ *   - DATA: `seq' is the index of the datagram, `len' is the size of the
+ *     payload, `stamp' is the time it was sent, and `rtt' is the smoothed RTT
+ *     measured by the transmitter.
+ *   - END: Same as DATA, but `seq' is the number of data datagrams, and the
+ *     payload contains the total size of the transfer, in 8 bytes.
+ *   - ACK: `seq' is the number of datagrams written by the receiver, `stamp'
+ *     is the one of the last datagram it received, and `rtt' is the time
+ *     since it was received. The payload contains the ranges of datagrams
+ *     that are missing, each with the first one and their number, in 4 bytes.
+ */
+struct UdpHeader {
+    struct DgramHeader dgram;
+    uint32_t stamp;
+    uint32_t rtt;
+};
+
+struct UdpTxSlot {
+    uint16_t len;
+    bool queued;
+    uint64_t sent_ns;
+    uint8_t data[UDP_PAYLOAD_SZ];
+};
+
+struct UdpTx {
+    int src_fd, udp_fd;
+    uint32_t session;
+    uint64_t start_ns;
+    struct Simulator sim;
+
+    /*
+     * Regular files can always be read without blocking, and anything else
+     * only after polling it.
+     */
+    bool src_regular, src_ready, eof;
+
+    /*
+     * Number of datagrams acknowledged and sent. The datagram `seq' is kept at
+     * `slots[seq % UDP_WINDOW]' from the time it's read until it's
+     * acknowledged, and the one being read has `pending' bytes so far.
+     */
+    uint32_t acked, next;
+    size_t pending;
+    struct UdpTxSlot* slots;
+    bool done;
+
+    /*
+     * Datagrams to send again, oldest first. Some of them might have been
+     * acknowledged since, so it holds up to two windows.
+     */
+    uint32_t* resend;
+    size_t resend_head, resend_len;
+
+    struct DgramPacer pacer;
+
+    /*
+     * RTT measurements, time of the next change in the rate, and number of
+     * datagrams sent and lost since the last one.
+     */
+    uint64_t srtt_ns, min_rtt_ns, next_rate_ns;
+    size_t period_sent, period_lost;
+    bool slow_start;
+
+    uint64_t last_ack_ns, last_progress_ns, next_end_ns;
+    size_t* total;
+
+    uint8_t packet[UDP_HEADER_SZ + UDP_PAYLOAD_SZ];
+};
+
+/*
+ * Datagrams held by the receiver. The datagram `seq' can only be stored at
+ * `slots[seq % UDP_WINDOW]', so each slot is tagged with the datagram it
+ * holds, or the one it's waiting for, along with the last time it was
+ * requested.
+ */
+struct UdpRxSlot {
+    uint32_t seq;
+    bool have;
+    uint16_t len;
+    uint64_t nack_ns;
+    uint8_t data[UDP_PAYLOAD_SZ];
+};
+
+struct UdpRx {
+    int udp_fd, dst_fd;
+
+    struct DgramLock lock;
+
+    /* Next datagram to write, and one past the highest one received */
+    uint32_t head, highest;
+
+    /* Number of data datagrams and bytes, once the transmitter announces it */
+    bool have_end;
+    uint32_t count;
+    uint64_t expected;
+
+    struct UdpRxSlot* slots;
+    struct Simulator sim;
+
+    /*
+     * Stamp of the last datagram and the time it arrived, echoed in the
+     * acknowledgements, and the RTT measured by the transmitter.
+     */
+    uint32_t stamp;
+    uint64_t stamp_ns, rtt_ns;
+
+    bool ack_now;
+    uint64_t next_ack_ns, last_ns;
+    size_t *total, *repaired;
+
+    uint8_t packet[UDP_HEADER_SZ + UDP_PAYLOAD_SZ];
+};
+
+/*----------------------------------------------------------------------------*/
+
+static void put_header(uint8_t* buf, const struct UdpHeader* header) {
+    dgram_put_header(buf, UDP_MAGIC, &header->dgram);
+    store_be(&buf[DGRAM_HEADER_SZ], header->stamp, 4);
+    store_be(&buf[DGRAM_HEADER_SZ + 4], header->rtt, 4);
+}
+
+static bool get_header(const uint8_t* buf,
+                       size_t buf_sz,
+                       struct UdpHeader* header) {
+    if (buf_sz < UDP_HEADER_SZ ||
+        !dgram_get_header(buf, buf_sz, UDP_MAGIC, &header->dgram))
+        return false;
+
+    header->stamp = load_be(&buf[DGRAM_HEADER_SZ], 4);
+    header->rtt   = load_be(&buf[DGRAM_HEADER_SZ + 4], 4);
+    return header->dgram.len == buf_sz - UDP_HEADER_SZ;
+}
+
+/*
+ * Send a single datagram through the connected socket `sockfd', using
+ * `packet' as the buffer. Returns false on error, after printing it.
+ */
+static bool send_datagram(int sockfd,
+                          uint8_t* packet,
+                          const struct UdpHeader* header,
+                          const void* payload) {
+    put_header(packet, header);
+    memcpy(&packet[UDP_HEADER_SZ], payload, header->dgram.len);
+    return dgram_send(sockfd, packet, UDP_HEADER_SZ + header->dgram.len);
+}
+
+/*
+ * Create a UDP socket for `host' and `port', connected to it if
+ * `transmitting', and bound to it otherwise. Returns the socket, or -1 on
+ * error, after printing it.
+ */
+static int open_socket(const char* host, const char* port, bool transmitting) {
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags    = transmitting ? 0 : AI_PASSIVE;
+
+    struct addrinfo* info = NULL;
+    const int status      = getaddrinfo(host, port, &hints, &info);
+    if (status != 0) {
+        ERR("Could not obtaining address info: %s", gai_strerror(status));
+        return -1;
+    }
+
+    const int sockfd =
+      socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+    if (sockfd < 0) {
+        ERR("Could not create socket: %s", strerror(errno));
+        freeaddrinfo(info);
+        return -1;
+    }
+
+    /* The buffers might be limited by the system, so they are only a hint */
+    const int buffer_sz = UDP_SOCKET_BUFFER;
+    setsockopt(sockfd, SOL_SOCKET, SO_SNDBUF, &buffer_sz, sizeof(buffer_sz));
+    setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &buffer_sz, sizeof(buffer_sz));
+
+    const int result = transmitting
+                         ? connect(sockfd, info->ai_addr, info->ai_addrlen)
+                         : bind(sockfd, info->ai_addr, info->ai_addrlen);
+    freeaddrinfo(info);
+    if (result != 0) {
+        ERR("Could not set up the UDP socket: %s", strerror(errno));
+        close(sockfd);
+        return -1;
+    }
+
+    return sockfd;
+}
+
+/*----------------------------------------------------------------------------*/
+
+static inline uint32_t tx_stamp(const struct UdpTx* tx, uint64_t now) {
+    return (uint32_t)((now - tx->start_ns) / NS_PER_US);
+}
+
+static inline bool all_sent(const struct UdpTx* tx) {
+    return tx->eof && tx->pending == 0;
+}
+
+/* Is the next datagram read, and is there room for it in the window? */
+static inline bool new_ready(const struct UdpTx* tx) {
+    return tx->next - tx->acked < UDP_WINDOW &&
+           (tx->pending == UDP_PAYLOAD_SZ || (tx->eof && tx->pending > 0));
+}
+
+static inline bool wants_input(const struct UdpTx* tx) {
+    return !tx->eof && tx->pending < UDP_PAYLOAD_SZ &&
+           tx->next - tx->acked < UDP_WINDOW;
+}
+
+static void set_rate(struct UdpTx* tx, double rate) {
+    dgram_pacer_set_rate(&tx->pacer,
+                         MIN(MAX(rate, UDP_MIN_RATE), UDP_MAX_RATE),
+                         UDP_HEADER_SZ + UDP_PAYLOAD_SZ);
+}
+
+/*
+ * Add a datagram to the queue of the ones to send again, unless it's there
+ * already. Returns true if it was added.
+ */
+static bool queue_resend(struct UdpTx* tx, uint32_t seq) {
+    struct UdpTxSlot* slot = &tx->slots[seq % UDP_WINDOW];
+    if (slot->queued || tx->resend_len >= 2 * UDP_WINDOW)
+        return false;
+
+    tx->resend[(tx->resend_head + tx->resend_len) % (2 * UDP_WINDOW)] = seq;
+    tx->resend_len++;
+    slot->queued = true;
+    return true;
+}
+
+/*
+ * Read from the input into the datagram after the last one sent, until it's
+ * full, or until reading again might block. Returns false on error, after
+ * printing it.
+ */
+static bool fill_input(struct UdpTx* tx) {
+    while (wants_input(tx) && tx->src_ready) {
+        struct UdpTxSlot* slot = &tx->slots[tx->next % UDP_WINDOW];
+
+        const uint64_t start = stats_start_call(STATS_CALL_READ);
+        const ssize_t received = read(tx->src_fd,
+                                      &slot->data[tx->pending],
+                                      UDP_PAYLOAD_SZ - tx->pending);
+        stats_end_call(STATS_CALL_READ, STATS_WAIT_IO, start, received);
+        if (received < 0) {
+            if (errno == EINTR)
+                continue;
+
+            ERR("Read error: %s", strerror(errno));
+            return false;
+        }
+
+        if (received == 0)
+            tx->eof = true;
+        tx->pending += received;
+        if (!tx->src_regular)
+            tx->src_ready = false;
+    }
+
+    return true;
+}
+
+/*
+ * Send the oldest datagram that was requested again, or otherwise the next
+ * one, if any. Returns false on error, after printing it.
+ */
+static bool send_next(struct UdpTx* tx, uint64_t now) {
+    uint32_t seq = tx->next;
+    while (tx->resend_len > 0) {
+        const uint32_t queued = tx->resend[tx->resend_head];
+        tx->resend_head = (tx->resend_head + 1) % (2 * UDP_WINDOW);
+        tx->resend_len--;
+
+        /* The slot of an acknowledged datagram might have been reused */
+        if (queued < tx->acked)
+            continue;
+
+        tx->slots[queued % UDP_WINDOW].queued = false;
+        seq = queued;
+        break;
+    }
+
+    struct UdpTxSlot* slot = &tx->slots[seq % UDP_WINDOW];
+    if (seq == tx->next) {
+        if (!new_ready(tx))
+            return true;
+        if (tx->next == UINT32_MAX) {
+            ERR("The input is too big for a UDP transfer.");
+            return false;
+        }
+
+        /* Nothing was in flight, so the timeout starts now */
+        if (tx->acked == tx->next)
+            tx->last_progress_ns = now;
+
+        slot->len   = tx->pending;
+        tx->pending = 0;
+        tx->next++;
+        tx->period_sent++;
+        *tx->total += slot->len;
+        update_progress(*tx->total);
+    }
+
+    const struct UdpHeader header = {
+        .dgram = {
+            .session = tx->session,
+            .seq     = seq,
+            .type    = UDP_TYPE_DATA,
+            .len     = slot->len,
+        },
+        .stamp = tx_stamp(tx, now),
+        .rtt   = tx->srtt_ns / NS_PER_US,
+    };
+    slot->sent_ns = now;
+    return send_datagram(tx->udp_fd, tx->packet, &header, slot->data);
+}
+
+/*
+ * Announce the end of the transfer, again and again until the receiver
+ * acknowledges everything. Returns false on error, after printing it.
+ */
+static bool send_end(struct UdpTx* tx, uint64_t now) {
+    uint8_t payload[8];
+    store_be(payload, *tx->total, sizeof(payload));
+
+    const struct UdpHeader header = {
+        .dgram = {
+            .session = tx->session,
+            .seq     = tx->next,
+            .type    = UDP_TYPE_END,
+            .len     = sizeof(payload),
+        },
+        .stamp = tx_stamp(tx, now),
+        .rtt   = tx->srtt_ns / NS_PER_US,
+    };
+
+    tx->next_end_ns =
+      now + MAX(2 * tx->srtt_ns, UDP_MIN_END_INTERVAL_MS * NS_PER_MS);
+    return send_datagram(tx->udp_fd, tx->packet, &header, payload);
+}
+
+/*
+ * Update the RTT with a new sample, and the rate if it wasn't fixed with
+ * '--rate'. The rate doubles at first, and once the path is congested, it's
+ * lowered whenever that happens, and raised slowly otherwise, at most once per
+ * RTT.
+ */
+static void update_rtt(struct UdpTx* tx, uint64_t sample_ns, uint64_t now) {
+    tx->srtt_ns = (tx->srtt_ns == 0) ? sample_ns
+                                     : (7 * tx->srtt_ns + sample_ns) / 8;
+    if (tx->min_rtt_ns == 0 || sample_ns < tx->min_rtt_ns)
+        tx->min_rtt_ns = sample_ns;
+
+    if (g_opt_rate > 0 || now < tx->next_rate_ns)
+        return;
+    tx->next_rate_ns = now + tx->srtt_ns;
+
+    const bool congested =
+      sample_ns > tx->min_rtt_ns * UDP_RTT_TOLERANCE + UDP_RTT_SLACK_NS ||
+      tx->period_lost > tx->period_sent * UDP_LOSS_TOLERANCE;
+    tx->period_sent = 0;
+    tx->period_lost = 0;
+
+    if (congested) {
+        tx->slow_start = false;
+        set_rate(tx, tx->pacer.rate * UDP_RATE_DECREASE);
+    } else {
+        set_rate(tx, tx->pacer.rate * (tx->slow_start ? 2 : UDP_RATE_INCREASE));
+    }
+}
+
+static void handle_ack(struct UdpTx* tx,
+                       const struct UdpHeader* header,
+                       const uint8_t* payload,
+                       uint64_t now) {
+    const uint32_t head = header->dgram.seq;
+    if (head < tx->acked || head > tx->next)
+        return;
+
+    tx->last_ack_ns = now;
+    if (head > tx->acked) {
+        tx->acked            = head;
+        tx->last_progress_ns = now;
+    }
+    if ((header->dgram.param & UDP_FLAG_END) != 0 && all_sent(tx) &&
+        head == tx->next)
+        tx->done = true;
+
+    const uint64_t elapsed_us = (uint32_t)(tx_stamp(tx, now) - header->stamp);
+    if (elapsed_us > header->rtt)
+        update_rtt(tx, (elapsed_us - header->rtt) * NS_PER_US, now);
+
+    /*
+     * Don't send a datagram again if it was just sent, since the receiver
+     * might have asked for it before it arrived.
+     */
+    for (size_t i = 0; i + 8 <= header->dgram.len; i += 8) {
+        const uint32_t first = load_be(&payload[i], 4);
+        const uint32_t count = load_be(&payload[i + 4], 4);
+        if (first < tx->acked || first >= tx->next ||
+            count > tx->next - first)
+            continue;
+
+        for (uint32_t seq = first; seq < first + count; seq++)
+            if (now - tx->slots[seq % UDP_WINDOW].sent_ns >= tx->srtt_ns &&
+                queue_resend(tx, seq))
+                tx->period_lost++;
+    }
+}
+
+/*
+ * Receive the acknowledgements queued in the socket, through the simulator.
+ * Returns false on error, after printing it.
+ */
+static bool receive_acks(struct UdpTx* tx) {
+    uint8_t buf[UDP_HEADER_SZ + UDP_PAYLOAD_SZ];
+
+    for (int i = 0; i < UDP_RECV_BATCH; i++) {
+        struct sockaddr_in from;
+        const ssize_t received =
+          sim_recvfrom(&tx->sim, tx->udp_fd, buf, sizeof(buf), &from);
+        if (received < 0) {
+            ERR("Receive error: %s", strerror(errno));
+            return false;
+        }
+        if (received == 0)
+            return true;
+
+        struct UdpHeader header;
+        if (get_header(buf, received, &header) &&
+            header.dgram.type == UDP_TYPE_ACK &&
+            header.dgram.session == tx->session)
+            handle_ack(tx, &header, &buf[UDP_HEADER_SZ], stats_clock_ns());
+    }
+
+    return true;
+}
+
+bool udp_transmit(int src_fd,
+                  const char* host,
+                  const char* port,
+                  size_t* total) {
+    bool result = false;
+
+    struct UdpTx* tx = calloc(1, sizeof(struct UdpTx));
+    if (tx == NULL) {
+        ERR("Failed to allocate %zu bytes: %s",
+            sizeof(struct UdpTx),
+            strerror(errno));
+        return false;
+    }
+
+    tx->src_fd      = src_fd;
+    tx->udp_fd      = -1;
+    tx->session     = proto_new_session();
+    tx->src_regular = io_fd_type(src_fd) == IO_FD_REGULAR;
+    tx->src_ready   = tx->src_regular;
+    tx->slow_start  = true;
+    tx->total       = total;
+    set_rate(tx, (g_opt_rate > 0) ? g_opt_rate : UDP_INITIAL_RATE);
+
+    if (!sim_init(&tx->sim)) {
+        free(tx);
+        return false;
+    }
+
+    tx->slots  = calloc(UDP_WINDOW, sizeof(struct UdpTxSlot));
+    tx->resend = calloc(2 * UDP_WINDOW, sizeof(uint32_t));
+    if (tx->slots == NULL || tx->resend == NULL) {
+        ERR("Failed to allocate the UDP window: %s", strerror(errno));
+        goto cleanup;
+    }
+
+    tx->udp_fd = open_socket(host, port, true);
+    if (tx->udp_fd < 0)
+        goto cleanup;
+
+    if (g_opt_print_peer_info) {
+        print_separator(stderr);
+        if (g_opt_rate > 0)
+            fprintf(stderr,
+                    "Sending UDP to '%s', port '%s', at %.0f Mbit/s.\n",
+                    host,
+                    port,
+                    g_opt_rate / 1e6);
+        else
+            fprintf(stderr, "Sending UDP to '%s', port '%s'.\n", host, port);
+        print_separator(stderr);
+    }
+
+    tx->start_ns         = stats_clock_ns();
+    tx->pacer.next_ns    = tx->start_ns;
+    tx->last_ack_ns      = tx->start_ns;
+    tx->last_progress_ns = tx->start_ns;
+
+    while (!g_signaled_quit && !tx->done) {
+        uint64_t now = stats_clock_ns();
+        if (now - tx->last_ack_ns >= UDP_TIMEOUT_MS * NS_PER_MS) {
+            ERR("Timed out waiting for the receiver.");
+            goto cleanup;
+        }
+
+        /*
+         * If nothing was acknowledged for a while, all the datagrams after
+         * the oldest one might have been lost, so nothing tells the receiver
+         * that it's missing.
+         */
+        const uint64_t rto_ns =
+          MAX(4 * tx->srtt_ns, UDP_MIN_RTO_MS * NS_PER_MS);
+        if (tx->acked < tx->next && now - tx->last_progress_ns >= rto_ns) {
+            queue_resend(tx, tx->acked);
+            tx->last_progress_ns = now;
+        }
+
+        if (all_sent(tx) && now >= tx->next_end_ns && !send_end(tx, now))
+            goto cleanup;
+
+        if ((tx->resend_len > 0 || new_ready(tx)) &&
+            now >= tx->pacer.next_ns) {
+            if (!send_next(tx, now))
+                goto cleanup;
+            dgram_pacer_advance(&tx->pacer, now);
+        }
+
+        /*
+         * Wait for the acknowledgements and the input until the next
+         * datagram is due.
+         */
+        if (!fill_input(tx))
+            goto cleanup;
+
+        now                 = stats_clock_ns();
+        uint64_t timeout_ns = UDP_ACK_INTERVAL_MS * NS_PER_MS;
+        if (tx->resend_len > 0 || new_ready(tx))
+            timeout_ns =
+              (tx->pacer.next_ns > now) ? tx->pacer.next_ns - now : 0;
+        if (all_sent(tx))
+            timeout_ns = MIN(timeout_ns,
+                             (tx->next_end_ns > now) ? tx->next_end_ns - now
+                                                     : 0);
+        timeout_ns = sim_timeout_ns(&tx->sim, timeout_ns);
+
+        const struct timespec timeout = {
+            .tv_sec  = timeout_ns / NS_PER_SEC,
+            .tv_nsec = timeout_ns % NS_PER_SEC,
+        };
+
+        const bool poll_src = wants_input(tx) && !tx->src_ready;
+        struct pollfd pfds[2] = {
+            { .fd = tx->udp_fd, .events = POLLIN },
+            { .fd = poll_src ? src_fd : -1, .events = POLLIN },
+        };
+
+        if (ppoll(pfds, LENGTH(pfds), &timeout, NULL) < 0) {
+            if (errno == EINTR)
+                continue;
+
+            ERR("Poll error: %s", strerror(errno));
+            goto cleanup;
+        }
+
+        if (pfds[1].revents != 0) {
+            tx->src_ready = true;
+            if (!fill_input(tx))
+                goto cleanup;
+        }
+        if (((pfds[0].revents & POLLIN) != 0 || tx->sim.len > 0) &&
+            !receive_acks(tx))
+            goto cleanup;
+    }
+
+    if (g_opt_print_peer_info) {
+        print_separator(stderr);
+        fprintf(stderr,
+                "Final rate: %.0f Mbit/s, RTT: %.3f ms.\n",
+                tx->pacer.rate / 1e6,
+                (double)tx->srtt_ns / NS_PER_MS);
+        print_separator(stderr);
+    }
+
+    result = true;
+
+cleanup:
+    if (tx->udp_fd > -1)
+        close(tx->udp_fd);
+
+    sim_free(&tx->sim);
+    free(tx->slots);
+    free(tx->resend);
+    free(tx);
+    return result;
+}
+
+/*----------------------------------------------------------------------------*/
+
+static inline bool have_datagram(const struct UdpRx* rx, uint32_t seq) {
+    const struct UdpRxSlot* slot = &rx->slots[seq % UDP_WINDOW];
+    return slot->have && slot->seq == seq;
+}
+
+static void store_data(struct UdpRx* rx,
+                       uint32_t seq,
+                       const uint8_t* payload,
+                       size_t len) {
+    if (len == 0 || len > UDP_PAYLOAD_SZ || seq < rx->head ||
+        seq - rx->head >= UDP_WINDOW || (rx->have_end && seq >= rx->count) ||
+        have_datagram(rx, seq))
+        return;
+    if (seq >= rx->highest)
+        rx->highest = seq + 1;
+
+    /* If we asked for it, it was lost */
+    struct UdpRxSlot* slot = &rx->slots[seq % UDP_WINDOW];
+    if (slot->seq == seq && slot->nack_ns != 0)
+        (*rx->repaired)++;
+
+    memcpy(slot->data, payload, len);
+    slot->seq     = seq;
+    slot->len     = len;
+    slot->have    = true;
+    slot->nack_ns = 0;
+}
+
+static void store_end(struct UdpRx* rx, uint32_t count, uint64_t expected) {
+    rx->ack_now = true;
+    if (rx->have_end || count < rx->highest)
+        return;
+
+    rx->have_end = true;
+    rx->count    = count;
+    rx->expected = expected;
+}
+
+/*
+ * Write all the consecutive datagrams we have after `head' into the output.
+ * Returns false on error, after printing it.
+ */
+static bool flush_datagrams(struct UdpRx* rx) {
+    while (have_datagram(rx, rx->head)) {
+        struct UdpRxSlot* slot = &rx->slots[rx->head % UDP_WINDOW];
+        if (!output_write(rx->dst_fd, slot->data, slot->len)) {
+            ERR("Write error: %s", strerror(errno));
+            return false;
+        }
+
+        slot->have = false;
+        *rx->total += slot->len;
+        update_progress(*rx->total);
+        rx->head++;
+    }
+
+    return true;
+}
+
+/*
+ * Acknowledge the datagrams written so far, and ask for the missing ones that
+ * were not requested recently. Returns false on error, after printing it.
+ */
+static bool send_ack(struct UdpRx* rx, uint64_t now) {
+    uint8_t payload[UDP_MAX_NACKS * 8];
+    size_t nacks       = 0;
+    uint32_t range_end = 0;
+
+    const uint64_t interval_ns =
+      MAX(rx->rtt_ns * 3 / 2, UDP_MIN_NACK_INTERVAL_MS * NS_PER_MS);
+    const uint32_t limit = rx->have_end ? rx->count : rx->highest;
+
+    for (uint32_t seq = rx->head; seq < limit; seq++) {
+        struct UdpRxSlot* slot = &rx->slots[seq % UDP_WINDOW];
+        if (slot->have)
+            continue;
+        if (slot->seq != seq) {
+            slot->seq     = seq;
+            slot->nack_ns = 0;
+        }
+        if (slot->nack_ns != 0 && now - slot->nack_ns < interval_ns)
+            continue;
+
+        if (nacks > 0 && range_end == seq) {
+            const uint32_t count = load_be(&payload[(nacks - 1) * 8 + 4], 4);
+            store_be(&payload[(nacks - 1) * 8 + 4], count + 1, 4);
+        } else if (nacks < UDP_MAX_NACKS) {
+            store_be(&payload[nacks * 8], seq, 4);
+            store_be(&payload[nacks * 8 + 4], 1, 4);
+            nacks++;
+        } else {
+            break;
+        }
+
+        slot->nack_ns = now;
+        range_end     = seq + 1;
+    }
+
+    const struct UdpHeader header = {
+        .dgram = {
+            .session = rx->lock.session,
+            .seq     = rx->head,
+            .type    = UDP_TYPE_ACK,
+            .param   = rx->have_end ? UDP_FLAG_END : 0,
+            .len     = nacks * 8,
+        },
+        .stamp = rx->stamp,
+        .rtt   = (now - rx->stamp_ns) / NS_PER_US,
+    };
+
+    rx->ack_now     = false;
+    rx->next_ack_ns = now + UDP_ACK_INTERVAL_MS * NS_PER_MS;
+    return send_datagram(rx->udp_fd, rx->packet, &header, payload);
+}
+
+/*
+ * Receive the datagrams queued in the socket, through the simulator. The first
+ * valid one decides which transfer we receive, and the socket is connected to
+ * its transmitter. Returns false on error, after printing it.
+ */
+static bool receive_datagrams(struct UdpRx* rx) {
+    uint8_t buf[UDP_HEADER_SZ + UDP_PAYLOAD_SZ];
+
+    for (int i = 0; i < UDP_RECV_BATCH; i++) {
+        struct sockaddr_in from;
+        const ssize_t received =
+          sim_recvfrom(&rx->sim, rx->udp_fd, buf, sizeof(buf), &from);
+        if (received < 0) {
+            ERR("Receive error: %s", strerror(errno));
+            return false;
+        }
+        if (received == 0)
+            return true;
+
+        struct UdpHeader header;
+        if (!get_header(buf, received, &header) ||
+            (header.dgram.type != UDP_TYPE_DATA &&
+             header.dgram.type != UDP_TYPE_END))
+            continue;
+
+        switch (dgram_lock(&rx->lock, header.dgram.session, &from, "UDP")) {
+            case DGRAM_LOCK_NEW:
+                if (connect(rx->udp_fd,
+                            (const struct sockaddr*)&from,
+                            sizeof(from)) != 0) {
+                    ERR("Could not connect to the transmitter: %s",
+                        strerror(errno));
+                    return false;
+                }
+                break;
+
+            case DGRAM_LOCK_SAME:
+                break;
+
+            case DGRAM_LOCK_OTHER:
+                continue;
+        }
+
+        rx->last_ns  = stats_clock_ns();
+        rx->stamp    = header.stamp;
+        rx->stamp_ns = rx->last_ns;
+        rx->rtt_ns   = header.rtt * NS_PER_US;
+
+        const uint8_t* payload = &buf[UDP_HEADER_SZ];
+        if (header.dgram.type == UDP_TYPE_DATA)
+            store_data(rx, header.dgram.seq, payload, header.dgram.len);
+        else if (header.dgram.len == 8)
+            store_end(rx, header.dgram.seq, load_be(payload, 8));
+    }
+
+    return true;
+}
+
+/*
+ * Wait up to `timeout_ns' for datagrams, and receive them. Returns false on
+ * error, after printing it.
+ */
+static bool wait_datagrams(struct UdpRx* rx, uint64_t timeout_ns) {
+    timeout_ns = sim_timeout_ns(&rx->sim, timeout_ns);
+    const struct timespec timeout = {
+        .tv_sec  = timeout_ns / NS_PER_SEC,
+        .tv_nsec = timeout_ns % NS_PER_SEC,
+    };
+
+    struct pollfd pfd = { .fd = rx->udp_fd, .events = POLLIN };
+    if (ppoll(&pfd, 1, &timeout, NULL) < 0) {
+        if (errno == EINTR)
+            return true;
+
+        ERR("Poll error: %s", strerror(errno));
+        return false;
+    }
+
+    /* Delayed datagrams might be due even if nothing arrived */
+    if ((pfd.revents & POLLIN) == 0 && rx->sim.len == 0)
+        return true;
+    return receive_datagrams(rx);
+}
+
+bool udp_receive(const char* port,
+                 int dst_fd,
+                 size_t* total,
+                 size_t* repaired) {
+    bool result = false;
+
+    struct UdpRx* rx = calloc(1, sizeof(struct UdpRx));
+    if (rx == NULL) {
+        ERR("Failed to allocate %zu bytes: %s",
+            sizeof(struct UdpRx),
+            strerror(errno));
+        return false;
+    }
+
+    rx->udp_fd   = -1;
+    rx->dst_fd   = dst_fd;
+    rx->total    = total;
+    rx->repaired = repaired;
+
+    if (!sim_init(&rx->sim)) {
+        free(rx);
+        return false;
+    }
+
+    rx->slots = calloc(UDP_WINDOW, sizeof(struct UdpRxSlot));
+    if (rx->slots == NULL) {
+        ERR("Failed to allocate the UDP window: %s", strerror(errno));
+        goto cleanup;
+    }
+
+    rx->udp_fd = open_socket(NULL, port, false);
+    if (rx->udp_fd < 0)
+        goto cleanup;
+
+    while (!g_signaled_quit && !(rx->have_end && rx->head == rx->count)) {
+        uint64_t now        = stats_clock_ns();
+        uint64_t timeout_ns = UDP_ACK_INTERVAL_MS * NS_PER_MS;
+        if (rx->lock.locked)
+            timeout_ns = (rx->next_ack_ns > now) ? rx->next_ack_ns - now : 0;
+
+        if (!wait_datagrams(rx, timeout_ns) || !flush_datagrams(rx))
+            goto cleanup;
+        if (!rx->lock.locked)
+            continue;
+
+        now = stats_clock_ns();
+        if ((rx->ack_now || now >= rx->next_ack_ns) && !send_ack(rx, now))
+            goto cleanup;
+
+        if (now - rx->last_ns >= UDP_TIMEOUT_MS * NS_PER_MS) {
+            ERR("Timed out waiting for the transmitter.");
+            goto cleanup;
+        }
+    }
+
+    if (rx->have_end && *total != rx->expected) {
+        ERR("Received %zu bytes, but the transmitter sent %llu.",
+            *total,
+            (unsigned long long)rx->expected);
+        goto cleanup;
+    }
+
+    /*
+     * Our last acknowledgement might be lost, so keep answering the
+     * transmitter until it stops announcing the end.
+     */
+    const uint64_t linger_ns =
+      MAX(4 * rx->rtt_ns, UDP_MIN_LINGER_MS * NS_PER_MS);
+    rx->ack_now = true;
+    while (!g_signaled_quit && rx->have_end) {
+        const uint64_t now = stats_clock_ns();
+        if (rx->ack_now && !send_ack(rx, now))
+            goto cleanup;
+        if (now - rx->last_ns >= linger_ns)
+            break;
+
+        if (!wait_datagrams(rx, rx->last_ns + linger_ns - now))
+            goto cleanup;
+    }
+
+    result = true;
+
+cleanup:
+    if (rx->udp_fd > -1)
+        close(rx->udp_fd);
+
+    sim_free(&rx->sim);
+    free(rx->slots);
+    free(rx);
+    return result;
+}
@@ -0,0 +1,646 @@
+/*
+ * Copyright 2025 8dcc
+ *
+ * This file is part of snc (Simple NetCat).
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef NO_IO_URING
+
+#define _GNU_SOURCE /* syscall() */
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h> /* syscall(), lseek() */
+#include <fcntl.h>  /* fcntl() */
+#include <sys/types.h>
+#include <sys/mman.h>    /* mmap() */
+#include <sys/uio.h>     /* iovec */
+#include <sys/syscall.h> /* __NR_io_uring_* */
+#include <linux/io_uring.h>
+
+#include "include/util.h"
+#include "include/main.h"
+#include "include/io.h"
+#include "include/stats.h"
+#include "include/uring.h"
+
+/*
+ * Since we don't depend on liburing, this structure holds the pointers into
+ * the submission and completion rings shared with the kernel. See the
+ * io_uring_setup(2) man page.
+ */
+struct Ring {
+    int fd;
+
+    void* sq_ptr;
+    size_t sq_map_sz;
+    void* cq_ptr;
+    size_t cq_map_sz;
+    struct io_uring_sqe* sqes;
+    size_t sqes_map_sz;
+
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned sq_entries;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe* cqes;
+
+    /* Number of queued entries that were not submitted yet */
+    unsigned to_submit;
+};
+
+/*
+ * State of each buffer used by `uring_copy'. Buffers go from free, to being
+ * read, to filled, to being written, and back to free.
+ */
+enum EBufState {
+    BUF_FREE,
+    BUF_READING,
+    BUF_FILLED,
+    BUF_WRITING,
+};
+
+struct Buf {
+    enum EBufState state;
+
+    /* Order in which the buffer was read, and position in the stream */
+    uint64_t seq;
+    uint64_t stream_off;
+
+    /* Bytes stored in the buffer, and bytes already read or written */
+    size_t len, done;
+};
+
+/*
+ * State of a `uring_copy' call.
+ */
+struct Copy {
+    struct Ring ring;
+
+    int src_fd, dst_fd;
+    bool src_is_socket, dst_is_socket;
+
+    /*
+     * If a descriptor is seekable, we can have several operations in flight,
+     * each with its own explicit offset. Otherwise, operations must be issued
+     * one at a time, to keep the data in order.
+     */
+    bool src_seekable, dst_seekable;
+    off_t src_base, dst_base;
+
+    /* True if the buffers were registered with the kernel */
+    bool fixed_bufs;
+
+    uint8_t* data;
+    size_t buf_sz;
+    struct Buf bufs[URING_QUEUE_DEPTH];
+
+    uint64_t next_read_seq, next_write_seq;
+    uint64_t read_off;
+    unsigned reads_in_flight, writes_in_flight;
+
+    bool eof, quitting, moved_data;
+};
+
+/*----------------------------------------------------------------------------*/
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params* p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd,
+                              unsigned to_submit,
+                              unsigned min_complete,
+                              unsigned flags) {
+    return (int)
+      syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd,
+                                 unsigned opcode,
+                                 void* arg,
+                                 unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/*
+ * Check if the kernel supports all the operations we need.
+ */
+static bool ring_supports_ops(struct Ring* ring) {
+    static const uint8_t needed_ops[] = {
+        IORING_OP_READ,        IORING_OP_WRITE, IORING_OP_READ_FIXED,
+        IORING_OP_WRITE_FIXED, IORING_OP_SEND,  IORING_OP_RECV,
+    };
+
+    const size_t probe_sz = sizeof(struct io_uring_probe) +
+                            256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe* probe = calloc(1, probe_sz);
+    if (probe == NULL)
+        return false;
+
+    bool result = false;
+    if (sys_io_uring_register(ring->fd, IORING_REGISTER_PROBE, probe, 256) <
+        0)
+        goto done;
+
+    for (size_t i = 0; i < LENGTH(needed_ops); i++)
+        if (needed_ops[i] > probe->last_op ||
+            (probe->ops[needed_ops[i]].flags & IO_URING_OP_SUPPORTED) == 0)
+            goto done;
+
+    result = true;
+
+done:
+    free(probe);
+    return result;
+}
+
+static void ring_destroy(struct Ring* ring) {
+    if (ring->sqes != NULL && ring->sqes != MAP_FAILED)
+        munmap(ring->sqes, ring->sqes_map_sz);
+    if (ring->cq_ptr != NULL && ring->cq_ptr != MAP_FAILED &&
+        ring->cq_ptr != ring->sq_ptr)
+        munmap(ring->cq_ptr, ring->cq_map_sz);
+    if (ring->sq_ptr != NULL && ring->sq_ptr != MAP_FAILED)
+        munmap(ring->sq_ptr, ring->sq_map_sz);
+    if (ring->fd > -1)
+        close(ring->fd);
+}
+
+/*
+ * Create a new ring with room for `entries' submissions, and map its queues.
+ * Returns false if io_uring is not available.
+ */
+static bool ring_init(struct Ring* ring, unsigned entries) {
+    memset(ring, 0, sizeof(*ring));
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring->fd = sys_io_uring_setup(entries, &params);
+    if (ring->fd < 0)
+        return false;
+
+    ring->sq_map_sz =
+      params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_map_sz = params.cq_off.cqes +
+                      params.cq_entries * sizeof(struct io_uring_cqe);
+
+    /*
+     * Newer kernels map both rings with a single call.
+     */
+    const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+        if (ring->cq_map_sz > ring->sq_map_sz)
+            ring->sq_map_sz = ring->cq_map_sz;
+        ring->cq_map_sz = ring->sq_map_sz;
+    }
+
+    ring->sq_ptr = mmap(NULL,
+                        ring->sq_map_sz,
+                        PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE,
+                        ring->fd,
+                        IORING_OFF_SQ_RING);
+    if (ring->sq_ptr == MAP_FAILED)
+        goto fail;
+
+    ring->cq_ptr = single_mmap ? ring->sq_ptr
+                               : mmap(NULL,
+                                      ring->cq_map_sz,
+                                      PROT_READ | PROT_WRITE,
+                                      MAP_SHARED | MAP_POPULATE,
+                                      ring->fd,
+                                      IORING_OFF_CQ_RING);
+    if (ring->cq_ptr == MAP_FAILED)
+        goto fail;
+
+    ring->sqes_map_sz = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes        = mmap(NULL,
+                             ring->sqes_map_sz,
+                             PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE,
+                             ring->fd,
+                             IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED)
+        goto fail;
+
+    uint8_t* sq      = ring->sq_ptr;
+    ring->sq_head    = (unsigned*)(sq + params.sq_off.head);
+    ring->sq_tail    = (unsigned*)(sq + params.sq_off.tail);
+    ring->sq_mask    = (unsigned*)(sq + params.sq_off.ring_mask);
+    ring->sq_array   = (unsigned*)(sq + params.sq_off.array);
+    ring->sq_entries = params.sq_entries;
+
+    uint8_t* cq   = ring->cq_ptr;
+    ring->cq_head = (unsigned*)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+    ring->cqes    = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    if (!ring_supports_ops(ring))
+        goto fail;
+
+    return true;
+
+fail:
+    ring_destroy(ring);
+    return false;
+}
+
+/*
+ * Get a new, zeroed submission queue entry. It will be submitted in the next
+ * call to `ring_enter'.
+ */
+static struct io_uring_sqe* ring_get_sqe(struct Ring* ring) {
+    const unsigned tail = *ring->sq_tail;
+    const unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if (tail - head >= ring->sq_entries)
+        return NULL;
+
+    const unsigned idx       = tail & *ring->sq_mask;
+    struct io_uring_sqe* sqe = &ring->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[idx] = idx;
+
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->to_submit++;
+    return sqe;
+}
+
+/*
+ * Submit the pending entries, and wait for at least `wait_nr' completions.
+ * Returns zero on success, or a negative `errno' value on failure.
+ */
+static int ring_enter(struct Ring* ring, unsigned wait_nr) {
+    stats_count_call(STATS_CALL_IO_URING);
+    const int submitted =
+      sys_io_uring_enter(ring->fd,
+                         ring->to_submit,
+                         wait_nr,
+                         (wait_nr > 0) ? IORING_ENTER_GETEVENTS : 0);
+    if (submitted < 0)
+        return -errno;
+
+    ring->to_submit -= submitted;
+    return 0;
+}
+
+/*
+ * Pop the next completion queue entry into `cqe'. Returns false if there are
+ * no completions left.
+ */
+static bool ring_pop_cqe(struct Ring* ring, struct io_uring_cqe* cqe) {
+    const unsigned head = *ring->cq_head;
+    const unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    if (head == tail)
+        return false;
+
+    *cqe = ring->cqes[head & *ring->cq_mask];
+    __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+/*----------------------------------------------------------------------------*/
+
+/*
+ * Return true if `fd' can be accessed with explicit offsets.
+ */
+static bool is_seekable(int fd, off_t* base) {
+    if (io_fd_type(fd) != IO_FD_REGULAR)
+        return false;
+
+    /* Writes to files opened with `O_APPEND' ignore the offset */
+    const int flags = fcntl(fd, F_GETFL);
+    if (flags < 0 || (flags & O_APPEND) != 0)
+        return false;
+
+    *base = lseek(fd, 0, SEEK_CUR);
+    return *base >= 0;
+}
+
+/*
+ * Queue a read (or receive) operation for the remaining part of `buf'.
+ */
+static void submit_read(struct Copy* copy, size_t idx) {
+    struct Buf* buf          = &copy->bufs[idx];
+    struct io_uring_sqe* sqe = ring_get_sqe(&copy->ring);
+
+    sqe->fd        = copy->src_fd;
+    sqe->addr      = (uintptr_t)&copy->data[idx * copy->buf_sz + buf->done];
+    sqe->len       = copy->buf_sz - buf->done;
+    sqe->user_data = idx * 2;
+
+    if (copy->src_is_socket) {
+        sqe->opcode = IORING_OP_RECV;
+    } else {
+        sqe->opcode = copy->fixed_bufs ? IORING_OP_READ_FIXED : IORING_OP_READ;
+        sqe->off    = copy->src_seekable
+                        ? (uint64_t)copy->src_base + buf->stream_off + buf->done
+                        : (uint64_t)-1;
+    }
+
+    buf->state = BUF_READING;
+    copy->reads_in_flight++;
+}
+
+/*
+ * Queue a write (or send) operation for the remaining part of `buf'.
+ */
+static void submit_write(struct Copy* copy, size_t idx) {
+    struct Buf* buf          = &copy->bufs[idx];
+    struct io_uring_sqe* sqe = ring_get_sqe(&copy->ring);
+
+    sqe->fd        = copy->dst_fd;
+    sqe->addr      = (uintptr_t)&copy->data[idx * copy->buf_sz + buf->done];
+    sqe->len       = buf->len - buf->done;
+    sqe->user_data = idx * 2 + 1;
+
+    if (copy->dst_is_socket) {
+        sqe->opcode = IORING_OP_SEND;
+    } else {
+        sqe->opcode =
+          copy->fixed_bufs ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+        sqe->off = copy->dst_seekable
+                     ? (uint64_t)copy->dst_base + buf->stream_off + buf->done
+                     : (uint64_t)-1;
+    }
+
+    buf->state = BUF_WRITING;
+    copy->writes_in_flight++;
+}
+
+/*
+ * Queue as many reads as possible. Returns the number of queued reads.
+ */
+static unsigned queue_reads(struct Copy* copy) {
+    unsigned queued = 0;
+
+    for (size_t i = 0; i < URING_QUEUE_DEPTH; i++) {
+        if (copy->eof || copy->quitting)
+            break;
+        if (!copy->src_seekable && copy->reads_in_flight > 0)
+            break;
+
+        struct Buf* buf = &copy->bufs[i];
+        if (buf->state != BUF_FREE)
+            continue;
+
+        buf->seq  = copy->next_read_seq++;
+        buf->len  = 0;
+        buf->done = 0;
+
+        /*
+         * For seekable inputs, the position of each buffer is known before
+         * reading it. Otherwise, it's set once the read completes.
+         */
+        if (copy->src_seekable)
+            buf->stream_off = buf->seq * copy->buf_sz;
+
+        submit_read(copy, i);
+        queued++;
+    }
+
+    return queued;
+}
+
+/*
+ * Queue as many writes as possible. Empty buffers are released without writing
+ * them. Returns the number of queued writes.
+ */
+static unsigned queue_writes(struct Copy* copy) {
+    unsigned queued = 0;
+
+    bool progressed = true;
+    while (progressed) {
+        progressed = false;
+
+        for (size_t i = 0; i < URING_QUEUE_DEPTH; i++) {
+            struct Buf* buf = &copy->bufs[i];
+            if (buf->state != BUF_FILLED)
+                continue;
+
+            /* Non-seekable outputs need their data in order */
+            if (!copy->dst_seekable &&
+                (copy->writes_in_flight > 0 ||
+                 buf->seq != copy->next_write_seq))
+                continue;
+
+            if (buf->len == 0) {
+                buf->state = BUF_FREE;
+                copy->next_write_seq++;
+                progressed = true;
+                continue;
+            }
+
+            buf->done = 0;
+            submit_write(copy, i);
+            copy->next_write_seq++;
+            queued++;
+        }
+    }
+
+    return queued;
+}
+
+/*
+ * Handle the completion of a read or write operation. Returns false on error,
+ * after printing it, or if the operation is not supported.
+ */
+static bool handle_completion(struct Copy* copy,
+                              const struct io_uring_cqe* cqe,
+                              bool* unsupported,
+                              size_t* total) {
+    const size_t idx    = cqe->user_data / 2;
+    const bool is_write = (cqe->user_data % 2) != 0;
+    struct Buf* buf     = &copy->bufs[idx];
+
+    if (is_write)
+        copy->writes_in_flight--;
+    else
+        copy->reads_in_flight--;
+
+    if (cqe->res < 0) {
+        const int err = -cqe->res;
+        if ((err == EINTR || err == EAGAIN) && !copy->quitting) {
+            if (is_write)
+                submit_write(copy, idx);
+            else
+                submit_read(copy, idx);
+            return true;
+        }
+
+        if (!copy->moved_data && (err == EINVAL || err == EOPNOTSUPP)) {
+            *unsupported = true;
+            return false;
+        }
+
+        if (is_write)
+            ERR("%s error: %s",
+                copy->dst_is_socket ? "Send" : "Write",
+                strerror(err));
+        else
+            ERR("%s error: %s",
+                copy->src_is_socket ? "Receive" : "Read",
+                strerror(err));
+        return false;
+    }
+
+    const size_t res = cqe->res;
+
+    if (is_write) {
+        buf->done += res;
+        *total += res;
+        update_progress(*total);
+
+        if (buf->done < buf->len)
+            submit_write(copy, idx);
+        else
+            buf->state = BUF_FREE;
+        return true;
+    }
+
+    copy->moved_data = true;
+
+    if (res == 0) {
+        copy->eof = true;
+    } else {
+        buf->done += res;
+
+        /*
+         * Seekable inputs only return less data than requested on EOF, but
+         * the next read will confirm it.
+         */
+        if (copy->src_seekable && buf->done < copy->buf_sz) {
+            submit_read(copy, idx);
+            return true;
+        }
+    }
+
+    buf->len = buf->done;
+    if (!copy->src_seekable) {
+        buf->stream_off = copy->read_off;
+        copy->read_off += buf->len;
+    }
+    buf->state = BUF_FILLED;
+
+    return true;
+}
+
+enum EUringResult uring_copy(int src_fd,
+                             int dst_fd,
+                             size_t buf_sz,
+                             size_t* total) {
+    enum EUringResult result = URING_OK;
+
+    struct Copy copy;
+    memset(&copy, 0, sizeof(copy));
+    copy.src_fd        = src_fd;
+    copy.dst_fd        = dst_fd;
+    copy.buf_sz        = buf_sz;
+    copy.src_is_socket = (io_fd_type(src_fd) == IO_FD_SOCKET);
+    copy.dst_is_socket = (io_fd_type(dst_fd) == IO_FD_SOCKET);
+    copy.src_seekable  = is_seekable(src_fd, &copy.src_base);
+    copy.dst_seekable  = is_seekable(dst_fd, &copy.dst_base);
+
+    if (!ring_init(&copy.ring, URING_QUEUE_DEPTH * 2))
+        return URING_UNSUPPORTED;
+
+    copy.data = malloc(URING_QUEUE_DEPTH * buf_sz);
+    if (copy.data == NULL) {
+        ERR("Failed to allocate %zu bytes: %s",
+            URING_QUEUE_DEPTH * buf_sz,
+            strerror(errno));
+        result = URING_ERROR;
+        goto cleanup;
+    }
+
+    /*
+     * Try to register the buffers, so the kernel doesn't need to map them on
+     * each operation. This can fail because of `RLIMIT_MEMLOCK', in which case
+     * we simply use the normal operations.
+     */
+    struct iovec iov = {
+        .iov_base = copy.data,
+        .iov_len  = URING_QUEUE_DEPTH * buf_sz,
+    };
+    copy.fixed_bufs =
+      sys_io_uring_register(copy.ring.fd, IORING_REGISTER_BUFFERS, &iov, 1) ==
+      0;
+
+    uint64_t written_before = *total;
+    for (;;) {
+        queue_reads(&copy);
+        queue_writes(&copy);
+
+        const bool idle =
+          copy.reads_in_flight == 0 && copy.writes_in_flight == 0;
+        if (idle && (copy.eof || copy.quitting))
+            break;
+
+        /*
+         * When quitting, don't wait for reads that might never complete. Just
+         * make sure the data we already have is written.
+         */
+        if (copy.quitting && copy.writes_in_flight == 0 &&
+            copy.ring.to_submit == 0)
+            break;
+
+        const int status = ring_enter(&copy.ring, 1);
+        if (status == -EINTR) {
+            if (g_signaled_quit)
+                copy.quitting = true;
+            continue;
+        }
+        if (status < 0) {
+            ERR("Failed to submit io_uring operations: %s", strerror(-status));
+            result = URING_ERROR;
+            goto cleanup;
+        }
+
+        struct io_uring_cqe cqe;
+        while (ring_pop_cqe(&copy.ring, &cqe)) {
+            bool unsupported = false;
+            if (!handle_completion(&copy, &cqe, &unsupported, total)) {
+                result = unsupported ? URING_UNSUPPORTED : URING_ERROR;
+                goto cleanup;
+            }
+        }
+
+        if (g_signaled_quit)
+            copy.quitting = true;
+    }
+
+    /*
+     * Leave the output offset after the written data, just like a normal
+     * sequence of writes would.
+     */
+    if (copy.dst_seekable)
+        lseek(dst_fd,
+              copy.dst_base + (off_t)(*total - written_before),
+              SEEK_SET);
+
+cleanup:
+    /* Closing the ring also cancels any pending operation */
+    ring_destroy(&copy.ring);
+    free(copy.data);
+
+    return result;
+}
+
+#endif /* not NO_IO_URING */
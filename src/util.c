@@ -23,8 +23,15 @@
  */
 #define _GNU_SOURCE
 
+#include <errno.h>
 #include <stddef.h>
+#include <stdbool.h>
 #include <stdio.h> /* fprintf(), fputc(), etc. */
+#include <string.h>
+#include <signal.h>
+#include <time.h> /* clock_gettime() */
+
+#include <pthread.h>
 
 #include <ifaddrs.h> /* getifaddrs(), etc. */
 #include <net/if.h>  /* IFF_LOOPBACK */
@@ -104,12 +111,56 @@ void print_sockaddr(FILE* fp, struct sockaddr_storage* info) {
 
     char dst[INET6_ADDRSTRLEN];
     inet_ntop(info->ss_family, addr, dst, sizeof(dst));
-    fprintf(fp, "%s, %d", dst, port);
+    fprintf(fp, "%s, %d", dst, ntohs(port));
 }
 
-void print_progress(const char* verb, size_t progress) {
+size_t g_progress = 0;
+
+/*
+ * Size of the whole operation, if known, and the time when it was set. Used by
+ * `print_progress' for printing the percentage and the remaining time.
+ */
+static size_t expected_progress = 0;
+static struct timespec expected_progress_start;
+
+/*
+ * State of the progress reporter thread. The `stop' flag is protected by
+ * `lock', and signaled through `cond'.
+ */
+static struct {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool running, stop;
+
+    const char* verb;
+    struct timespec start;
+} reporter = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+
+/*
+ * Return the seconds elapsed from `start' until `end'.
+ */
+static double elapsed_seconds(const struct timespec* start,
+                              const struct timespec* end) {
+    return (end->tv_sec - start->tv_sec) +
+           (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+void set_expected_progress(size_t expected) {
+    expected_progress = expected;
+    clock_gettime(CLOCK_MONOTONIC, &expected_progress_start);
+}
+
+/*
+ * Print the specified number of `bytes' in the most appropriate unit, followed
+ * by `suffix'. Returns the number of printed characters.
+ */
+static int print_size(double bytes, const char* suffix) {
     /*
-     * List of units for printing the `progress'. Each unit should be 1024 bytes
+     * List of units for printing the size. Each unit should be 1024 bytes
      * appart from each other. You can safely add or remove units to this array
      * if you want more or less precision.
      */
@@ -118,32 +169,91 @@ void print_progress(const char* verb, size_t progress) {
         "KiB",
         "MiB",
         "GiB",
+        "TiB",
     };
 
-    /*
-     * Convert progress (originally in bytes) to the appropriate unit.
-     */
-    size_t unit_name_idx   = 0;
-    double pretty_progress = progress;
-    while (pretty_progress >= 1024 && unit_name_idx + 1 < LENGTH(unit_names)) {
-        pretty_progress /= 1024.0;
+    size_t unit_name_idx = 0;
+    while (bytes >= 1024 && unit_name_idx + 1 < LENGTH(unit_names)) {
+        bytes /= 1024.0;
         unit_name_idx++;
     }
 
-    const int printed_len = (unit_name_idx == 0)
-                              ? fprintf(stderr,
-                                        "\r%s %zu %s.",
-                                        verb,
-                                        progress,
-                                        unit_names[unit_name_idx])
-                              : fprintf(stderr,
-                                        "\r%s %.2f %s.",
-                                        verb,
-                                        pretty_progress,
-                                        unit_names[unit_name_idx]);
+    return (unit_name_idx == 0)
+             ? fprintf(stderr, "%.0f %s%s", bytes, unit_names[0], suffix)
+             : fprintf(stderr,
+                       "%.2f %s%s",
+                       bytes,
+                       unit_names[unit_name_idx],
+                       suffix);
+}
+
+/*
+ * Print the percentage of the `expected_progress' that was completed, and the
+ * estimated remaining time, based on the average rate so far. Returns the
+ * number of printed characters.
+ */
+static int print_progress_estimate(size_t progress) {
+    const double fraction =
+      (progress < expected_progress) ? (double)progress / expected_progress : 1;
+    if (fraction >= 1)
+        return fprintf(stderr, " (100.0%%)");
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    const double elapsed = elapsed_seconds(&expected_progress_start, &now);
+    if (progress == 0 || elapsed <= 0)
+        return fprintf(stderr, " (%.1f%%)", fraction * 100);
+
+    const unsigned long remaining =
+      (unsigned long)(elapsed * (1 - fraction) / fraction + 0.5);
+    return fprintf(stderr,
+                   " (%.1f%%, ETA %lu:%02lu:%02lu)",
+                   fraction * 100,
+                   remaining / 3600,
+                   remaining / 60 % 60,
+                   remaining % 60);
+}
+
+/*
+ * Print the progress line, as described in `print_progress'. If `rate' is not
+ * negative, it's printed as the current rate, in bytes per second.
+ */
+static void print_progress_line(const char* verb,
+                                size_t progress,
+                                double rate) {
+    int printed_len = fprintf(stderr, "\r%s ", verb);
     if (printed_len < 0)
         return;
 
+    const int size_len = print_size(progress, "");
+    if (size_len < 0)
+        return;
+    printed_len += size_len;
+
+    if (expected_progress > 0) {
+        const int estimate_len = print_progress_estimate(progress);
+        if (estimate_len < 0)
+            return;
+        printed_len += estimate_len;
+    }
+
+    /* The average rate is measured since the reporter was started */
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    const double elapsed = elapsed_seconds(&reporter.start, &now);
+    if (reporter.verb != NULL && elapsed > 0) {
+        printed_len += fprintf(stderr, " at ");
+        if (rate >= 0) {
+            printed_len += print_size(rate, "/s");
+            printed_len += fprintf(stderr, ", ");
+        }
+        printed_len += print_size(progress / elapsed, "/s");
+        printed_len += fprintf(stderr, " average");
+    }
+
+    fputc('.', stderr);
+    printed_len++;
+
     /*
      * If the last printed text was longer, remove trailing characters.
      */
@@ -158,21 +268,121 @@ void print_progress(const char* verb, size_t progress) {
     last_printed_len = printed_len;
 }
 
-void print_partial_progress(const char* verb, size_t progress) {
-    /*
-     * The `progress' will be printed if it advanced at least `PROGRESS_STEP'
-     * times since the last printed value.
-     */
-    static const double PROGRESS_STEP = 1.25;
-    static size_t last_progress       = 0;
+void print_progress(const char* verb, size_t progress) {
+    print_progress_line(verb, progress, -1);
+}
+
+/*
+ * Main function of the progress reporter thread. Samples `g_progress' every
+ * `PROGRESS_INTERVAL_MS' milliseconds, and prints it along with the rate since
+ * the previous sample.
+ */
+static void* reporter_main(void* arg) {
+    (void)arg;
+
+    size_t last_progress = 0;
+    struct timespec last_time = reporter.start;
+
+    pthread_mutex_lock(&reporter.lock);
+    while (!reporter.stop) {
+        /* Condition variables use the real-time clock by default */
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += PROGRESS_INTERVAL_MS / 1000;
+        deadline.tv_nsec += (PROGRESS_INTERVAL_MS % 1000) * 1000 * 1000;
+        if (deadline.tv_nsec >= 1000 * 1000 * 1000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000 * 1000 * 1000;
+        }
+
+        pthread_cond_timedwait(&reporter.cond, &reporter.lock, &deadline);
+        if (reporter.stop)
+            break;
+
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        const size_t progress = __atomic_load_n(&g_progress, __ATOMIC_RELAXED);
+        const double elapsed  = elapsed_seconds(&last_time, &now);
+
+        /* The progress might go back if a transfer is restarted */
+        const double rate = (elapsed > 0 && progress >= last_progress)
+                              ? (progress - last_progress) / elapsed
+                              : 0;
+        print_progress_line(reporter.verb, progress, rate);
+
+        last_progress = progress;
+        last_time     = now;
+    }
+    pthread_mutex_unlock(&reporter.lock);
+
+    return NULL;
+}
+
+bool start_progress_reporter(const char* verb) {
+    if (reporter.running)
+        return true;
+
+    update_progress(0);
+    reporter.verb = verb;
+    reporter.stop = false;
+    clock_gettime(CLOCK_MONOTONIC, &reporter.start);
 
+    if (!create_worker_thread(&reporter.thread, reporter_main, NULL)) {
+        ERR("Failed to create progress thread: %s", strerror(errno));
+        reporter.verb = NULL;
+        return false;
+    }
+
+    reporter.running = true;
+    return true;
+}
+
+void stop_progress_reporter(void) {
+    if (!reporter.running)
+        return;
+
+    pthread_mutex_lock(&reporter.lock);
+    reporter.stop = true;
+    pthread_cond_signal(&reporter.cond);
+    pthread_mutex_unlock(&reporter.lock);
+
+    pthread_join(reporter.thread, NULL);
+    reporter.running = false;
+}
+
+void cond_wait_briefly(pthread_cond_t* cond, pthread_mutex_t* lock) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += 100 * 1000 * 1000;
+    if (deadline.tv_nsec >= 1000 * 1000 * 1000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000 * 1000 * 1000;
+    }
+
+    pthread_cond_timedwait(cond, lock, &deadline);
+}
+
+bool create_worker_thread(pthread_t* thread,
+                          void* (*func)(void*),
+                          void* arg) {
     /*
-     * If the current progress changed enough, print it. Then, save the current
-     * progress in a `last_progress' static variable for future calls.
+     * The new thread inherits the signal mask of the calling thread, so we
+     * block the quit signals temporarily while creating it.
      */
-    if (progress < last_progress * PROGRESS_STEP)
-        return;
+    sigset_t quit_signals, old_mask;
+    sigemptyset(&quit_signals);
+    sigaddset(&quit_signals, SIGINT);
+    sigaddset(&quit_signals, SIGQUIT);
+    pthread_sigmask(SIG_BLOCK, &quit_signals, &old_mask);
+
+    const int status = pthread_create(thread, NULL, func, arg);
+
+    pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+
+    if (status != 0) {
+        errno = status;
+        return false;
+    }
 
-    print_progress(verb, progress);
-    last_progress = progress;
+    return true;
 }
@@ -0,0 +1,315 @@
+/*
+ * Copyright 2025 8dcc
+ *
+ * This file is part of snc (Simple NetCat).
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE /* MSG_ZEROCOPY, SO_ZEROCOPY */
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h> /* read(), sysconf() */
+#include <poll.h>   /* poll() */
+#include <sys/types.h>
+#include <sys/socket.h> /* send(), recvmsg() */
+#include <netinet/in.h> /* IP_RECVERR, IPV6_RECVERR */
+#include <linux/errqueue.h>
+
+#include "include/util.h"
+#include "include/main.h"
+#include "include/stats.h"
+#include "include/zerocopy.h"
+
+/*
+ * Each successful send with `MSG_ZEROCOPY' is identified by a 32-bit counter,
+ * which the kernel increments on its own. Once it's done with the data of a
+ * range of sends, it queues a notification with the first and last ids into
+ * the error queue of the socket. On TCP, notifications arrive in order.
+ */
+struct Buf {
+    uint8_t* data;
+
+    /* The kernel might still reference the data of sends up to `last_id' */
+    bool in_flight;
+    uint32_t last_id;
+};
+
+struct Zerocopy {
+    int sockfd;
+    struct Buf bufs[ZEROCOPY_DEPTH];
+    uint8_t* data;
+
+    /* Id of the next send, and number of sends completed by the kernel */
+    uint32_t next_id;
+    uint32_t completed;
+
+    /* Cleared once the kernel reports that it copied the data anyway */
+    bool enabled;
+};
+
+/*----------------------------------------------------------------------------*/
+
+/*
+ * Compare two ids, taking into account that the counter wraps around.
+ */
+static inline bool id_before(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) < 0;
+}
+
+static inline bool buf_is_free(const struct Zerocopy* zc,
+                               const struct Buf* buf) {
+    return !buf->in_flight || id_before(buf->last_id, zc->completed);
+}
+
+/*
+ * Read a single notification from the error queue of the socket. Returns 1 if
+ * a notification was read, 0 if the queue is empty, and -1 on error.
+ */
+static int read_notification(struct Zerocopy* zc) {
+    char control[CMSG_SPACE(sizeof(struct sock_extended_err)) + 64];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control    = control;
+    msg.msg_controllen = sizeof(control);
+
+    stats_count_call(STATS_CALL_RECV);
+    if (recvmsg(zc->sockfd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return 0;
+        return (errno == EINTR) ? 0 : -1;
+    }
+
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+         cmsg                 = CMSG_NXTHDR(&msg, cmsg)) {
+        const bool is_recverr =
+          (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_RECVERR) ||
+          (cmsg->cmsg_level == IPPROTO_IPV6 && cmsg->cmsg_type == IPV6_RECVERR);
+        if (!is_recverr)
+            continue;
+
+        struct sock_extended_err err;
+        memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+        if (err.ee_origin != SO_EE_ORIGIN_ZEROCOPY || err.ee_errno != 0)
+            continue;
+
+        /* The range of completed ids is in `ee_info' and `ee_data' */
+        if (id_before(zc->completed, err.ee_data + 1))
+            zc->completed = err.ee_data + 1;
+
+        if ((err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) != 0 && zc->enabled) {
+            zc->enabled = false;
+            if (g_opt_print_peer_info) {
+                /* Don't continue the line of the progress */
+                if (g_opt_print_progress)
+                    fputc('\n', stderr);
+                fprintf(stderr,
+                        "The kernel copied the data, disabling zero-copy.\n");
+            }
+        }
+    }
+
+    return 1;
+}
+
+/*
+ * Read all the pending notifications. If `wait' is true, block until at least
+ * one of them arrives. Returns false on error, with `errno' set.
+ */
+static bool reap_notifications(struct Zerocopy* zc, bool wait) {
+    for (;;) {
+        int status;
+        bool reaped = false;
+        while ((status = read_notification(zc)) > 0)
+            reaped = true;
+        if (status < 0)
+            return false;
+
+        if (reaped || !wait || g_signaled_quit)
+            return true;
+
+        /*
+         * Notifications are reported as `POLLERR', so we don't need to ask for
+         * any event. A real error of the socket is also reported that way, in
+         * which case it's not a notification.
+         */
+        struct pollfd pfd = { .fd = zc->sockfd, .events = 0 };
+        if (poll(&pfd, 1, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+
+        int sock_error      = 0;
+        socklen_t error_len = sizeof(sock_error);
+        if (getsockopt(zc->sockfd,
+                       SOL_SOCKET,
+                       SO_ERROR,
+                       &sock_error,
+                       &error_len) == 0 &&
+            sock_error != 0) {
+            errno = sock_error;
+            return false;
+        }
+        if ((pfd.revents & POLLHUP) != 0) {
+            errno = EPIPE;
+            return false;
+        }
+    }
+}
+
+/*
+ * Send all `len' bytes of `buf', with `MSG_ZEROCOPY' while it's enabled.
+ * Returns false on error, with `errno' set.
+ */
+static bool send_buf(struct Zerocopy* zc, struct Buf* buf, size_t len) {
+    const uint8_t* ptr = buf->data;
+
+    while (len > 0) {
+        const int flags = zc->enabled ? MSG_ZEROCOPY : 0;
+
+        const uint64_t start = stats_start_call(STATS_CALL_SEND);
+        const ssize_t sent   = send(zc->sockfd, ptr, len, flags);
+        stats_end_call(STATS_CALL_SEND, STATS_WAIT_NET, start, sent);
+        if (sent < 0) {
+            if (errno == EINTR)
+                continue;
+
+            /*
+             * The kernel ran out of memory for tracking the pages, so wait
+             * until some of them are released. If nothing is in flight, the
+             * limit is simply too low for us.
+             */
+            if (errno == ENOBUFS && zc->enabled) {
+                if (zc->completed == zc->next_id)
+                    zc->enabled = false;
+                else if (!reap_notifications(zc, true))
+                    return false;
+                continue;
+            }
+
+            return false;
+        }
+
+        if (flags != 0) {
+            buf->in_flight = true;
+            buf->last_id   = zc->next_id++;
+        }
+
+        ptr += sent;
+        len -= sent;
+    }
+
+    return true;
+}
+
+/*----------------------------------------------------------------------------*/
+
+enum EZerocopyResult zerocopy_transmit(int src_fd,
+                                       int sockfd,
+                                       size_t buf_sz,
+                                       size_t* total) {
+    const int enable = 1;
+    if (setsockopt(sockfd, SOL_SOCKET, SO_ZEROCOPY, &enable, sizeof(enable)) !=
+        0)
+        return ZEROCOPY_UNSUPPORTED;
+
+    struct Zerocopy zc;
+    memset(&zc, 0, sizeof(zc));
+    zc.sockfd  = sockfd;
+    zc.enabled = true;
+
+    /*
+     * The kernel pins whole pages, so align the buffers to them. This way, the
+     * pages of a buffer are never shared with the previous one.
+     */
+    const size_t page_sz = (size_t)sysconf(_SC_PAGESIZE);
+    const size_t slot_sz = (buf_sz + page_sz - 1) / page_sz * page_sz;
+    if (posix_memalign((void**)&zc.data, page_sz, ZEROCOPY_DEPTH * slot_sz) !=
+        0) {
+        ERR("Failed to allocate %zu bytes: %s",
+            ZEROCOPY_DEPTH * slot_sz,
+            strerror(errno));
+        return ZEROCOPY_ERROR;
+    }
+
+    for (size_t i = 0; i < ZEROCOPY_DEPTH; i++)
+        zc.bufs[i].data = &zc.data[i * slot_sz];
+
+    enum EZerocopyResult result = ZEROCOPY_OK;
+    size_t idx                  = 0;
+    while (!g_signaled_quit) {
+        struct Buf* buf = &zc.bufs[idx];
+
+        /*
+         * Reap the notifications we already have, and only wait if the next
+         * buffer is still referenced by the kernel.
+         */
+        if (!reap_notifications(&zc, !buf_is_free(&zc, buf))) {
+            ERR("Send error: %s", strerror(errno));
+            result = ZEROCOPY_ERROR;
+            goto cleanup;
+        }
+        if (!buf_is_free(&zc, buf))
+            continue;
+
+        const uint64_t start   = stats_start_call(STATS_CALL_READ);
+        const ssize_t received = read(src_fd, buf->data, buf_sz);
+        stats_end_call(STATS_CALL_READ, STATS_WAIT_IO, start, received);
+        if (received < 0) {
+            if (errno == EINTR)
+                continue;
+
+            ERR("Read error: %s", strerror(errno));
+            result = ZEROCOPY_ERROR;
+            goto cleanup;
+        }
+        if (received == 0)
+            break;
+
+        buf->in_flight = false;
+        if (!send_buf(&zc, buf, received)) {
+            ERR("Send error: %s", strerror(errno));
+            result = ZEROCOPY_ERROR;
+            goto cleanup;
+        }
+
+        *total += received;
+        update_progress(*total);
+
+        idx = (idx + 1) % ZEROCOPY_DEPTH;
+    }
+
+    /*
+     * The kernel might still need the data for retransmitting it, so we can't
+     * free the buffers until all of them are released.
+     */
+    while (id_before(zc.completed, zc.next_id) && !g_signaled_quit) {
+        if (!reap_notifications(&zc, true)) {
+            ERR("Send error: %s", strerror(errno));
+            result = ZEROCOPY_ERROR;
+            goto cleanup;
+        }
+    }
+
+cleanup:
+    free(zc.data);
+    return result;
+}
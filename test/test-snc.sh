@@ -4,15 +4,501 @@ set -e
 SCRIPT_DIR=$(dirname -- "$(readlink -f -- "${BASH_SOURCE[0]}")")
 SNC="${SCRIPT_DIR}/../snc"
 
+TMP_DIR=$(mktemp -d)
+trap 'rm -rf -- "$TMP_DIR"' EXIT
+
+# void check_output(bytes, description);
+check_output() {
+    if ! cmp -s "$TMP_DIR/input" "$TMP_DIR/output"; then
+        echo "Output mismatch when transmitting $1 bytes ($2)." 1>&2
+        exit 1
+    fi
+
+    echo "Successfully transmitted and received $1 bytes ($2)."
+}
+
 # void test_random(bytes);
 test_random() {
-    $SNC --receive > /dev/null &
+    tr -dc A-Za-z0-9 </dev/urandom | head -c "$1" > "$TMP_DIR/input"
+
+    $SNC --receive > "$TMP_DIR/output" &
+    sleep 0.25
+
+    cat "$TMP_DIR/input" | $SNC --transmit 'localhost'
+    wait
+
+    check_output "$1" "pipe"
+}
+
+# void test_random_file(bytes);
+test_random_file() {
+    head -c "$1" </dev/urandom > "$TMP_DIR/input"
+
+    $SNC --receive > "$TMP_DIR/output" &
+    sleep 0.25
+
+    $SNC --transmit 'localhost' < "$TMP_DIR/input"
+    wait
+
+    check_output "$1" "file"
+}
+
+# void test_random_input(bytes);
+test_random_input() {
+    head -c "$1" </dev/urandom > "$TMP_DIR/input"
+
+    $SNC --receive > "$TMP_DIR/output" &
+    sleep 0.25
+
+    $SNC --transmit 'localhost' --input "$TMP_DIR/input"
+    wait
+
+    check_output "$1" "mapped input"
+}
+
+# void test_random_pipe_output(bytes);
+test_random_pipe_output() {
+    head -c "$1" </dev/urandom > "$TMP_DIR/input"
+
+    $SNC --receive | cat > "$TMP_DIR/output" &
+    sleep 0.25
+
+    $SNC --transmit 'localhost' < "$TMP_DIR/input"
+    wait
+
+    check_output "$1" "pipe output"
+}
+
+# void test_random_streams(bytes, streams);
+test_random_streams() {
+    head -c "$1" </dev/urandom > "$TMP_DIR/input"
+
+    $SNC --receive > "$TMP_DIR/output" &
+    sleep 0.25
+
+    cat "$TMP_DIR/input" |
+        $SNC --transmit 'localhost' --streams "$2" --block-size 1000
+    wait
+
+    check_output "$1" "$2 streams"
+}
+
+# void test_compress(bytes, mode);
+test_compress() {
+    # Mix compressible and incompressible blocks.
+    { seq 1 1000000 | head -c "$1"; head -c "$1" </dev/urandom; } \
+        > "$TMP_DIR/input"
+
+    $SNC --receive > "$TMP_DIR/output" &
+    sleep 0.25
+
+    $SNC --transmit 'localhost' --compress="$2" < "$TMP_DIR/input"
+    wait
+
+    check_output "$(($1 * 2))" "$2 compression"
+}
+
+# void test_checksum(bytes, streams);
+test_checksum() {
+    head -c "$1" </dev/urandom > "$TMP_DIR/input"
+
+    $SNC --receive --checksum --print-progress \
+        > "$TMP_DIR/output" 2> "$TMP_DIR/receiver.log" &
+    sleep 0.25
+
+    $SNC --transmit 'localhost' --checksum --streams "$2" --print-progress \
+        < "$TMP_DIR/input" 2> "$TMP_DIR/transmitter.log"
+    wait
+
+    if ! grep -q '^CRC-32C:' "$TMP_DIR/receiver.log" ||
+        [ "$(grep '^CRC-32C:' "$TMP_DIR/receiver.log")" != \
+            "$(grep '^CRC-32C:' "$TMP_DIR/transmitter.log")" ]; then
+        echo "Checksum mismatch when transmitting $1 bytes." 1>&2
+        exit 1
+    fi
+
+    check_output "$1" "checksum over $2 streams"
+}
+
+# void test_resume(bytes, prefix_bytes, prefix_source);
+test_resume() {
+    head -c "$1" </dev/urandom > "$TMP_DIR/input"
+    head -c "$2" < "$3" > "$TMP_DIR/output"
+
+    $SNC --receive --output "$TMP_DIR/output" 2> /dev/null &
+    sleep 0.25
+
+    $SNC --transmit 'localhost' --resume < "$TMP_DIR/input" 2> /dev/null
+    wait
+
+    check_output "$1" "resume after $2 bytes"
+}
+
+# void test_output(bytes, streams, receiver_flags...);
+test_output() {
+    head -c "$1" </dev/urandom > "$TMP_DIR/input"
+    rm -f "$TMP_DIR/output"
+
+    $SNC --receive --output "$TMP_DIR/output" "${@:3}" &
+    sleep 0.25
+
+    $SNC --transmit 'localhost' --streams "$2" < "$TMP_DIR/input"
+    wait
+
+    check_output "$1" "output file over $2 streams${3:+, ${*:3}}"
+}
+
+# void test_tune(bytes, rate);
+test_tune() {
+    head -c "$1" </dev/urandom > "$TMP_DIR/input"
+
+    $SNC --receive --tune="$2" --print-peer-info \
+        > "$TMP_DIR/output" 2> "$TMP_DIR/receiver.log" &
     sleep 0.25
 
-    tr -dc A-Za-z0-9 </dev/urandom | head -c "$1" | $SNC --transmit 'localhost'
+    $SNC --transmit 'localhost' --tune="$2" --print-peer-info \
+        < "$TMP_DIR/input" 2> "$TMP_DIR/transmitter.log"
+    wait
+
+    if ! grep -q '^Tuning: RTT' "$TMP_DIR/receiver.log" ||
+        ! grep -q '^Tuning: RTT' "$TMP_DIR/transmitter.log"; then
+        echo "Tuning not reported when transmitting $1 bytes." 1>&2
+        exit 1
+    fi
+
+    check_output "$1" "tuned for $2"
+}
+
+# void test_low_latency(bytes, usec);
+test_low_latency() {
+    head -c "$1" </dev/urandom > "$TMP_DIR/input"
+
+    $SNC --receive --low-latency > "$TMP_DIR/output" &
     sleep 0.25
 
-    echo "Successfully transmitted and received $1 bytes."
+    cat "$TMP_DIR/input" | $SNC --transmit 'localhost' --low-latency="$2"
+    wait
+
+    check_output "$1" "in low-latency mode, flushing after $2 us"
+}
+
+# void test_stats(bytes);
+test_stats() {
+    head -c "$1" </dev/urandom > "$TMP_DIR/input"
+
+    $SNC --receive --stats=json --stats-file="$TMP_DIR/receiver.json" \
+        > "$TMP_DIR/output" &
+    sleep 0.25
+
+    $SNC --transmit 'localhost' --stats=json \
+        --stats-file="$TMP_DIR/transmitter.json" < "$TMP_DIR/input"
+    wait
+
+    if ! grep -q "^{\"mode\": \"receive\", \"bytes\": $1, " \
+        "$TMP_DIR/receiver.json" ||
+        ! grep -q "^{\"mode\": \"transmit\", \"bytes\": $1, " \
+            "$TMP_DIR/transmitter.json"; then
+        echo "Statistics not reported when transmitting $1 bytes." 1>&2
+        exit 1
+    fi
+
+    check_output "$1" "with statistics"
+}
+
+# void test_live_stats(bytes);
+test_live_stats() {
+    head -c "$1" </dev/urandom > "$TMP_DIR/input"
+
+    $SNC --receive > "$TMP_DIR/output" &
+    sleep 0.25
+
+    # The input is delayed, so the signal arrives in the middle of the transfer
+    $SNC --transmit 'localhost' 2> "$TMP_DIR/transmitter.log" \
+        < <(sleep 0.5 && cat "$TMP_DIR/input") &
+    local transmitter_pid=$!
+    sleep 0.25
+
+    kill -USR1 "$transmitter_pid"
+    wait
+
+    if ! grep -q '^Transferred: ' "$TMP_DIR/transmitter.log"; then
+        echo "Live statistics not printed when transmitting $1 bytes." 1>&2
+        exit 1
+    fi
+
+    check_output "$1" "with live statistics"
+}
+
+# void test_duplex(bytes);
+test_duplex() {
+    head -c "$1" </dev/urandom > "$TMP_DIR/input"
+    head -c "$1" </dev/urandom > "$TMP_DIR/reply"
+
+    # The reply is delayed, so the transmitter finishes sending first
+    $SNC --receive --duplex > "$TMP_DIR/output" \
+        < <(sleep 0.5 && cat "$TMP_DIR/reply") &
+    sleep 0.25
+
+    $SNC --transmit 'localhost' --duplex < "$TMP_DIR/input" \
+        > "$TMP_DIR/reply-output"
+    wait
+
+    if ! cmp -s "$TMP_DIR/reply" "$TMP_DIR/reply-output"; then
+        echo "Reply mismatch when transmitting $1 bytes (duplex)." 1>&2
+        exit 1
+    fi
+
+    check_output "$1" "duplex"
+}
+
+# void test_fanout(bytes, receivers, transmitter_flags...);
+test_fanout() {
+    head -c "$1" </dev/urandom > "$TMP_DIR/input"
+
+    local i destinations=''
+    for ((i = 1; i <= $2; i++)); do
+        $SNC --receive --port $((1337 + i)) > "$TMP_DIR/output-$i" &
+        destinations+="${destinations:+,}localhost:$((1337 + i))"
+    done
+    sleep 0.25
+
+    $SNC --transmit "$destinations" "${@:3}" < "$TMP_DIR/input"
+    wait
+
+    for ((i = 1; i <= $2; i++)); do
+        if ! cmp -s "$TMP_DIR/input" "$TMP_DIR/output-$i"; then
+            echo "Output mismatch when transmitting $1 bytes to $2" \
+                "receivers." 1>&2
+            exit 1
+        fi
+    done
+
+    echo "Successfully transmitted $1 bytes to $2 receivers${3:+ (${*:3})}."
+}
+
+# void test_fanout_drop(bytes);
+test_fanout_drop() {
+    head -c "$1" </dev/urandom > "$TMP_DIR/input"
+
+    # The second receiver stalls, since nothing reads its output. The input is
+    # fed slowly, so that the healthy receiver keeps up with it, and the stalled
+    # one is the only one that can fall the buffer behind.
+    $SNC --receive --port 1338 > "$TMP_DIR/output" &
+    $SNC --receive --port 1339 | sleep 60 &
+    local stalled=$!
+    sleep 0.25
+
+    local i
+    if for ((i = 0; i < $1 / 65536; i++)); do
+        dd if="$TMP_DIR/input" bs=64K skip="$i" count=1 status=none
+        sleep 0.002
+    done | $SNC --transmit localhost:1338,localhost:1339 --slow-receiver=drop \
+        --fanout-buffer=1M 2> "$TMP_DIR/stderr"; then
+        echo "Transmitter succeeded after dropping a receiver." 1>&2
+        exit 1
+    fi
+    kill "$stalled"
+    wait
+
+    if ! grep -q "Dropping the receiver" "$TMP_DIR/stderr"; then
+        echo "Stalled receiver not dropped when transmitting $1 bytes." 1>&2
+        exit 1
+    fi
+    if ! cmp -s "$TMP_DIR/input" "$TMP_DIR/output"; then
+        echo "Output mismatch when transmitting $1 bytes, dropping a" \
+            "receiver." 1>&2
+        exit 1
+    fi
+
+    echo "Successfully transmitted $1 bytes, dropping a stalled receiver."
+}
+
+# void test_relay(bytes, hops, receiver_flags...);
+test_relay() {
+    head -c "$1" </dev/urandom > "$TMP_DIR/input"
+
+    # Start from the end of the chain, so each hop can reach the next one
+    local i
+    $SNC --receive --port $((1337 + $2)) > "$TMP_DIR/output-$2" &
+    for ((i = $2 - 1; i >= 1; i--)); do
+        $SNC --receive --port $((1337 + i)) \
+            --forward "localhost:$((1338 + i))" "${@:3}" \
+            > "$TMP_DIR/output-$i" &
+        sleep 0.1
+    done
+    sleep 0.25
+
+    $SNC --transmit 'localhost' --port 1338 < "$TMP_DIR/input"
+    wait
+
+    for ((i = 1; i <= $2; i++)); do
+        if ! cmp -s "$TMP_DIR/input" "$TMP_DIR/output-$i"; then
+            echo "Output mismatch when relaying $1 bytes through $2" \
+                "receivers." 1>&2
+            exit 1
+        fi
+    done
+
+    echo "Successfully relayed $1 bytes through $2 receivers${3:+ (${*:3})}."
+}
+
+# void test_multicast(bytes, loss_percent, transmitter_flags...);
+test_multicast() {
+    head -c "$1" </dev/urandom > "$TMP_DIR/input"
+
+    local i
+    for ((i = 1; i <= 2; i++)); do
+        $SNC --receive --multicast=239.255.0.1 \
+            --multicast-interface=127.0.0.1 --simulate-loss="$2" \
+            > "$TMP_DIR/output-$i" &
+    done
+    sleep 0.25
+
+    $SNC --transmit 239.255.0.1 --multicast --multicast-interface=127.0.0.1 \
+        "${@:3}" < "$TMP_DIR/input"
+    wait
+
+    for ((i = 1; i <= 2; i++)); do
+        if ! cmp -s "$TMP_DIR/input" "$TMP_DIR/output-$i"; then
+            echo "Output mismatch when multicasting $1 bytes with $2%" \
+                "loss." 1>&2
+            exit 1
+        fi
+    done
+
+    echo "Successfully multicast $1 bytes with $2% loss${3:+ (${*:3})}."
+}
+
+# void test_udp(bytes, loss_percent, flags...);
+test_udp() {
+    head -c "$1" </dev/urandom > "$TMP_DIR/input"
+
+    $SNC --receive --udp --simulate-loss="$2" "${@:3}" > "$TMP_DIR/output" &
+    sleep 0.25
+
+    $SNC --transmit 'localhost' --udp --simulate-loss="$2" "${@:3}" \
+        < "$TMP_DIR/input"
+    wait
+
+    if ! cmp -s "$TMP_DIR/input" "$TMP_DIR/output"; then
+        echo "Output mismatch when sending $1 bytes over UDP with $2%" \
+            "loss." 1>&2
+        exit 1
+    fi
+
+    echo "Successfully sent $1 bytes over UDP with $2% loss${3:+ (${*:3})}."
+}
+
+# void test_shm(bytes);
+test_shm() {
+    head -c "$1" </dev/urandom > "$TMP_DIR/input"
+
+    $SNC --receive --print-peer-info > "$TMP_DIR/output" \
+        2> "$TMP_DIR/receiver.log" &
+    sleep 0.25
+
+    # The data could silently go through the connection instead
+    cat "$TMP_DIR/input" |
+        $SNC --transmit 'localhost' --shm --print-peer-info \
+            2> "$TMP_DIR/transmitter.log"
+    wait
+
+    if ! grep -q "^Sending through " "$TMP_DIR/transmitter.log" ||
+        ! grep -q "^Receiving through " "$TMP_DIR/receiver.log"; then
+        echo "Shared memory not used when transmitting $1 bytes." 1>&2
+        exit 1
+    fi
+
+    check_output "$1" "shared memory"
+}
+
+# void test_random_io_uring(bytes);
+test_random_io_uring() {
+    head -c "$1" </dev/urandom > "$TMP_DIR/input"
+
+    $SNC --receive --io-uring > "$TMP_DIR/output" &
+    sleep 0.25
+
+    $SNC --transmit 'localhost' --io-uring < "$TMP_DIR/input"
+    wait
+
+    check_output "$1" "io_uring"
+}
+
+# void test_random_zerocopy(bytes);
+test_random_zerocopy() {
+    head -c "$1" </dev/urandom > "$TMP_DIR/input"
+
+    $SNC --receive > "$TMP_DIR/output" &
+    sleep 0.25
+
+    cat "$TMP_DIR/input" | $SNC --transmit 'localhost' --zerocopy
+    wait
+
+    check_output "$1" "zerocopy"
+}
+
+# void test_random_pipeline(bytes, depth);
+test_random_pipeline() {
+    head -c "$1" </dev/urandom > "$TMP_DIR/input"
+
+    $SNC --receive > "$TMP_DIR/output" &
+    sleep 0.25
+
+    cat "$TMP_DIR/input" | $SNC --transmit 'localhost' --pipeline "$2"
+    wait
+
+    check_output "$1" "pipeline of $2 blocks"
+}
+
+# void test_bench(amount);
+test_bench() {
+    $SNC --receive --bench 2> "$TMP_DIR/output" &
+    sleep 0.25
+
+    $SNC --transmit 'localhost' --bench="$1" 2> /dev/null
+    wait
+
+    if ! grep -q '^Throughput:' "$TMP_DIR/output"; then
+        echo "Benchmark of $1 did not print a summary." 1>&2
+        exit 1
+    fi
+
+    echo "Successfully benchmarked $1."
+}
+
+# void test_server(bytes, clients, server_flags...);
+test_server() {
+    # The outputs are appended to, so remove the ones from previous tests.
+    rm -f "$TMP_DIR"/input-* "$TMP_DIR"/output-*
+
+    $SNC --receive --server --output-template "$TMP_DIR/output-%n" "${@:3}" &
+    local server_pid=$!
+    sleep 0.25
+
+    local i
+    for ((i = 1; i <= $2; i++)); do
+        head -c "$1" </dev/urandom > "$TMP_DIR/input-$i"
+        $SNC --transmit 'localhost' < "$TMP_DIR/input-$i" &
+    done
+
+    # Wait for the transmitters, and then for the server to stop.
+    while (($(jobs -rp | wc -l) > 1)); do
+        sleep 0.1
+    done
+    sleep 0.25
+    kill -INT "$server_pid"
+    wait
+
+    # The connections can be accepted in any order, so compare the checksums.
+    if ! diff -q <(cd "$TMP_DIR" && md5sum input-* | cut -d' ' -f1 | sort) \
+        <(cd "$TMP_DIR" && md5sum output-* | cut -d' ' -f1 | sort) \
+        >/dev/null; then
+        echo "Output mismatch when serving $2 clients of $1 bytes." 1>&2
+        exit 1
+    fi
+
+    echo "Successfully served $2 clients of $1 bytes${3:+ (${*:3})}."
 }
 
 test_random 1
@@ -21,3 +507,86 @@ test_random 100
 test_random 4096
 test_random 5376
 test_random 8192
+
+test_random_file 1
+test_random_file 8192
+test_random_file 1048576
+
+test_random_input 0
+test_random_input 1
+test_random_input 1048576
+
+test_random_pipe_output 1
+test_random_pipe_output 1048576
+
+test_random_streams 0 4
+test_random_streams 1 4
+test_random_streams 1048576 4
+
+test_compress 1 always
+test_compress 1048576 always
+test_compress 1048576 auto
+
+test_checksum 1 1
+test_checksum 1048576 4
+
+test_output 1048576 1
+test_output 1048576 4
+test_output 1 1 --direct
+test_output 1048577 1 --direct
+test_output 1048577 4 --direct
+
+test_resume 1048576 0 "$TMP_DIR/input"
+test_resume 1048576 524288 "$TMP_DIR/input"
+test_resume 1048576 1048576 "$TMP_DIR/input"
+test_resume 1048576 524288 /dev/urandom
+
+test_tune 1048576 10G
+test_tune 1048576 1000G
+
+test_low_latency 1 0
+test_low_latency 1048576 0
+test_low_latency 1048576 1000
+
+test_stats 1048576
+test_live_stats 1048576
+
+test_duplex 1
+test_duplex 1048576
+
+test_fanout 1 2
+test_fanout 1048576 3
+test_fanout 1048576 2 --slow-receiver=block
+
+test_relay 1 2
+test_relay 1048576 3
+test_relay 1048576 2 --low-latency
+
+test_multicast 1 0
+test_multicast 1048576 5
+test_multicast 1048576 20 --fec 0
+
+test_udp 1 0
+test_udp 1048576 5
+test_udp 1048576 5 --simulate-delay=20
+
+test_random_io_uring 1
+test_random_io_uring 1048576
+
+test_random_zerocopy 1
+test_random_zerocopy 1048576
+
+test_random_pipeline 1 4
+test_random_pipeline 1048576 4
+
+test_bench 1M
+test_bench 0.5s
+
+test_server 65536 8
+test_server 65536 32 --workers 4
+
+test_shm 0
+test_shm 1
+test_shm 20971520
+
+test_fanout_drop 16777216